@@ -16,8 +16,25 @@ typedef void (*laplace_release_fn)(void *state);
 typedef kit_status_t (*laplace_clone_fn)(
     void *state, laplace_read_write_t *cloned);
 
+/*  Copy contents of another state of the same kind.
+ */
+typedef kit_status_t (*laplace_assign_fn)(void *state, void *source);
+
 typedef kit_status_t (*laplace_reset_fn)(void *state);
 
+/*  Take a snapshot, allocating it if it is NULL. Parts that did not
+ *  change since the previous snapshot are shared with it. Previous
+ *  snapshot can be NULL, or the same as the snapshot.
+ */
+typedef kit_status_t (*laplace_snapshot_fn)(void *state,
+                                            void      **snapshot,
+                                            void const *previous);
+
+typedef kit_status_t (*laplace_restore_fn)(void       *state,
+                                           void const *snapshot);
+
+typedef void (*laplace_snapshot_destroy_fn)(void *snapshot);
+
 typedef ptrdiff_t (*laplace_integers_size_fn)(
     void *state, laplace_handle_t handle);
 
@@ -44,17 +61,69 @@ typedef laplace_byte_t (*laplace_get_byte_fn)(void            *state,
 typedef kit_status_t (*laplace_apply_fn)(
     void *state, laplace_impact_t const *impact);
 
-typedef void (*laplace_adjust_loop_fn)(void *state);
+/*  Clear blocks allocated by deferred sync impacts. Called by all
+ *  threads at once.
+ */
+typedef void (*laplace_clear_loop_fn)(void     *state,
+                                      ptrdiff_t thread_count);
+
+typedef void (*laplace_clear_done_fn)(void *state);
+
+typedef void (*laplace_adjust_loop_fn)(void     *state,
+                                       ptrdiff_t thread_count);
 
 typedef void (*laplace_adjust_done_fn)(void *state);
 
+typedef uint64_t (*laplace_hash_fn)(void *state);
+
+/*  Hash trees of the state. Globals tree has a single leaf with the
+ *  random generator state and buffer sizes. The top node has the
+ *  roots of all trees as children.
+ */
+enum {
+  LAPLACE_HASH_TOP = -1,
+  LAPLACE_HASH_INTEGERS,
+  LAPLACE_HASH_INTEGER_BLOCKS,
+  LAPLACE_HASH_BYTES,
+  LAPLACE_HASH_BYTE_BLOCKS,
+  LAPLACE_HASH_GLOBALS,
+  LAPLACE_HASH_TREE_COUNT,
+  LAPLACE_HASH_FANOUT = 64
+};
+
+/*  Hash tree node. Level 0 are the leaves, cells or block table
+ *  entries. A node covers leaves from index * 64^level up to the
+ *  next node, so the same node covers the same leaves on all peers.
+ */
+typedef struct {
+  ptrdiff_t tree;
+  ptrdiff_t level;
+  ptrdiff_t index;
+} laplace_hash_node_t;
+
+/*  Write child nodes and their hashes, up to LAPLACE_HASH_FANOUT.
+ *  Either array can be NULL. Returns the child count, zero for
+ *  leaves.
+ */
+typedef ptrdiff_t (*laplace_hash_children_fn)(
+    void *state, laplace_hash_node_t node,
+    laplace_hash_node_t *children, uint64_t *hashes);
+
 struct laplace_read_write {
   void              *state;
   laplace_acquire_fn acquire;
   laplace_release_fn release;
   laplace_clone_fn   clone;
+  laplace_assign_fn  assign;
   laplace_reset_fn   reset;
 
+  /*  Snapshots for rollback. A snapshot costs only the parts of the
+   *  state changed since the previous one.
+   */
+  laplace_snapshot_fn         snapshot;
+  laplace_restore_fn          restore;
+  laplace_snapshot_destroy_fn snapshot_destroy;
+
   laplace_integers_size_fn integers_size;
   laplace_bytes_size_fn    bytes_size;
   laplace_read_integers_fn read_integers;
@@ -65,6 +134,23 @@ struct laplace_read_write {
   laplace_apply_fn       apply;
   laplace_adjust_loop_fn adjust_loop;
   laplace_adjust_done_fn adjust_done;
+
+  /*  Sync impacts applied in order, with clearing of new blocks left
+   *  to the clear loop, so only the block table bookkeeping is
+   *  serial. An impact that touches a block not cleared yet clears
+   *  it first, so the result is the same as of apply. Optional.
+   */
+  laplace_apply_fn      apply_deferred;
+  laplace_clear_loop_fn clear_loop;
+  laplace_clear_done_fn clear_done;
+
+  /*  Checksum of the whole state for desync detection, and the
+   *  hash trees to localize a desync. Valid between ticks. Hashes
+   *  are maintained during adjust, so the cost does not depend on
+   *  the state size.
+   */
+  laplace_hash_fn          hash;
+  laplace_hash_children_fn hash_children;
 };
 
 typedef struct {
@@ -84,6 +170,16 @@ typedef struct {
 #  define impact_t laplace_impact_t
 #  define read_write_t laplace_read_write_t
 #  define read_only_t laplace_read_only_t
+#  define hash_node_t laplace_hash_node_t
+
+#  define HASH_TOP LAPLACE_HASH_TOP
+#  define HASH_INTEGERS LAPLACE_HASH_INTEGERS
+#  define HASH_INTEGER_BLOCKS LAPLACE_HASH_INTEGER_BLOCKS
+#  define HASH_BYTES LAPLACE_HASH_BYTES
+#  define HASH_BYTE_BLOCKS LAPLACE_HASH_BYTE_BLOCKS
+#  define HASH_GLOBALS LAPLACE_HASH_GLOBALS
+#  define HASH_TREE_COUNT LAPLACE_HASH_TREE_COUNT
+#  define HASH_FANOUT LAPLACE_HASH_FANOUT
 #endif
 
 #ifdef __cplusplus
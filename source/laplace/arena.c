@@ -0,0 +1,186 @@
+#include "arena.h"
+
+#include <string.h>
+
+#define ALIGNMENT_ ((ptrdiff_t) _Alignof(max_align_t))
+#define ALIGN_(size_) \
+  (((size_) + ALIGNMENT_ - 1) & ~(ALIGNMENT_ - 1))
+
+struct laplace_arena_block {
+  laplace_arena_block_t *next;
+  ptrdiff_t              capacity;
+  max_align_t            data[];
+};
+
+static char *data_(laplace_arena_t const *const arena) {
+  return (char *) arena->blocks->data;
+}
+
+static int push_block_(laplace_arena_t *const arena,
+                       ptrdiff_t const        capacity) {
+  laplace_arena_block_t *const block = (laplace_arena_block_t *)
+      kit_alloc_dispatch(arena->alloc, KIT_ALLOCATE,
+                         (ptrdiff_t) sizeof *block + capacity, 0,
+                         NULL);
+  if (block == NULL)
+    return 0;
+
+  block->next     = arena->blocks;
+  block->capacity = capacity;
+  arena->blocks   = block;
+  arena->offset   = 0;
+  arena->last     = -1;
+  return 1;
+}
+
+static void free_blocks_(laplace_arena_t *const arena) {
+  while (arena->blocks != NULL) {
+    laplace_arena_block_t *const next = arena->blocks->next;
+    kit_alloc_dispatch(arena->alloc, KIT_DEALLOCATE, 0, 0,
+                       arena->blocks);
+    arena->blocks = next;
+  }
+}
+
+void laplace_arena_init(laplace_arena_t *const arena,
+                        kit_allocator_t const  alloc) {
+  assert(arena != NULL);
+
+  memset(arena, 0, sizeof *arena);
+  arena->alloc = alloc;
+  arena->last  = -1;
+}
+
+void laplace_arena_destroy(laplace_arena_t *const arena) {
+  assert(arena != NULL);
+
+  free_blocks_(arena);
+  arena->offset = 0;
+  arena->last   = -1;
+}
+
+void laplace_arena_reset(laplace_arena_t *const arena) {
+  assert(arena != NULL);
+
+  if (arena->blocks != NULL && arena->blocks->next != NULL) {
+    ptrdiff_t capacity = 0;
+    for (laplace_arena_block_t *block = arena->blocks; block != NULL;
+         block = block->next)
+      capacity += block->capacity;
+
+    free_blocks_(arena);
+    (void) push_block_(arena, capacity);
+  }
+
+  arena->offset = 0;
+  arena->last   = -1;
+}
+
+void laplace_arena_merge(laplace_arena_t *const dst,
+                         laplace_arena_t *const src) {
+  assert(dst != NULL && src != NULL);
+
+  if (src->blocks == NULL)
+    return;
+
+  if (dst->blocks == NULL) {
+    dst->blocks = src->blocks;
+    dst->offset = src->offset;
+    dst->last   = src->last;
+  } else {
+    laplace_arena_block_t *tail = dst->blocks;
+    while (tail->next != NULL)
+      tail = tail->next;
+    tail->next = src->blocks;
+  }
+
+  src->blocks = NULL;
+  src->offset = 0;
+  src->last   = -1;
+}
+
+void *laplace_arena_allocate(laplace_arena_t *const arena,
+                             ptrdiff_t const        size) {
+  assert(arena != NULL);
+  assert(size >= 0);
+
+  ptrdiff_t const n = ALIGN_(size);
+
+  if (arena->blocks == NULL ||
+      arena->offset + n > arena->blocks->capacity) {
+    ptrdiff_t const capacity = n > LAPLACE_ARENA_BLOCK_SIZE
+                                   ? n
+                                   : LAPLACE_ARENA_BLOCK_SIZE;
+    if (!push_block_(arena, capacity))
+      return NULL;
+  }
+
+  arena->last = arena->offset;
+  arena->offset += n;
+  return data_(arena) + arena->last;
+}
+
+static void *reallocate_(laplace_arena_t *const arena,
+                         ptrdiff_t const size,
+                         ptrdiff_t const previous_size,
+                         void *const     pointer) {
+  if (pointer == NULL)
+    return laplace_arena_allocate(arena, size);
+
+  /*  Grow or shrink the last allocation in place.
+   */
+  if (arena->last >= 0 && pointer == data_(arena) + arena->last &&
+      arena->last + ALIGN_(size) <= arena->blocks->capacity) {
+    arena->offset = arena->last + ALIGN_(size);
+    return pointer;
+  }
+
+  void *const p = laplace_arena_allocate(arena, size);
+  if (p != NULL && previous_size > 0)
+    memcpy(p, pointer,
+           previous_size < size ? previous_size : size);
+  return p;
+}
+
+static void *allocate_(int const request, void *const state,
+                       ptrdiff_t const size,
+                       ptrdiff_t const previous_size,
+                       void *const     pointer) {
+  laplace_arena_t *const arena = (laplace_arena_t *) state;
+
+  switch (request) {
+    case KIT_ALLOCATE: return laplace_arena_allocate(arena, size);
+
+    case KIT_ALLOCATE_ZERO: {
+      void *const p = laplace_arena_allocate(arena, size);
+      if (p != NULL)
+        memset(p, 0, size);
+      return p;
+    }
+
+    case KIT_REALLOCATE:
+      return reallocate_(arena, size, previous_size, pointer);
+
+    case KIT_DEALLOCATE:
+      /*  Only the last allocation can be given back.
+       */
+      if (arena->last >= 0 && pointer == data_(arena) + arena->last) {
+        arena->offset = arena->last;
+        arena->last   = -1;
+      }
+      break;
+
+    case KIT_DEALLOCATE_ALL: laplace_arena_reset(arena); break;
+
+    default:;
+  }
+
+  return NULL;
+}
+
+kit_allocator_t laplace_arena_allocator(
+    laplace_arena_t *const arena) {
+  kit_allocator_t const alloc = { .state    = arena,
+                                  .allocate = allocate_ };
+  return alloc;
+}
@@ -0,0 +1,66 @@
+#ifndef LAPLACE_ARENA_H
+#define LAPLACE_ARENA_H
+
+#include "options.h"
+
+#include <kit/allocator.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { LAPLACE_ARENA_BLOCK_SIZE = 16384 };
+
+typedef struct laplace_arena_block laplace_arena_block_t;
+
+/*  Bump allocator for memory that lives until the end of a tick.
+ *
+ *  Deallocation does nothing, and all memory is released at once by
+ *  reset. If a tick needed more than one block, reset replaces the
+ *  blocks with one block large enough for all of them, so a steady
+ *  workload stops touching the backing allocator.
+ */
+typedef struct {
+  kit_allocator_t        alloc;
+  laplace_arena_block_t *blocks;
+  ptrdiff_t              offset;
+  ptrdiff_t              last;
+} laplace_arena_t;
+
+void laplace_arena_init(laplace_arena_t *arena,
+                        kit_allocator_t  alloc);
+
+void laplace_arena_destroy(laplace_arena_t *arena);
+
+void laplace_arena_reset(laplace_arena_t *arena);
+
+/*  Move all blocks of src into dst and leave src empty. Both arenas
+ *  should use the same backing allocator.
+ */
+void laplace_arena_merge(laplace_arena_t *dst, laplace_arena_t *src);
+
+void *laplace_arena_allocate(laplace_arena_t *arena, ptrdiff_t size);
+
+/*  Allocator interface to the arena. Valid until the arena is
+ *  destroyed.
+ */
+kit_allocator_t laplace_arena_allocator(laplace_arena_t *arena);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define ARENA_BLOCK_SIZE LAPLACE_ARENA_BLOCK_SIZE
+#  define arena_t laplace_arena_t
+
+#  define arena_init laplace_arena_init
+#  define arena_destroy laplace_arena_destroy
+#  define arena_reset laplace_arena_reset
+#  define arena_merge laplace_arena_merge
+#  define arena_allocate laplace_arena_allocate
+#  define arena_allocator laplace_arena_allocator
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
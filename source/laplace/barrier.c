@@ -0,0 +1,125 @@
+#include "barrier.h"
+
+#include <kit/thread.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define SPIN_PAUSE_ __builtin_ia32_pause()
+#else
+#  define SPIN_PAUSE_ (void) 0
+#endif
+
+kit_status_t laplace_barrier_init(laplace_barrier_t *const barrier) {
+  if (mtx_init(&barrier->lock, mtx_plain) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_INIT;
+
+  if (cnd_init(&barrier->on_release) != thrd_success) {
+    mtx_destroy(&barrier->lock);
+    return LAPLACE_ERROR_BAD_CNDVAR_INIT;
+  }
+
+  atomic_store_explicit(&barrier->sense, 0, memory_order_relaxed);
+  laplace_barrier_reset(barrier);
+  return KIT_OK;
+}
+
+void laplace_barrier_destroy(laplace_barrier_t *const barrier) {
+  mtx_destroy(&barrier->lock);
+  cnd_destroy(&barrier->on_release);
+}
+
+void laplace_barrier_reset(laplace_barrier_t *const barrier) {
+  atomic_store_explicit(&barrier->arrived, 0, memory_order_relaxed);
+  atomic_store_explicit(&barrier->sleeping, 0, memory_order_relaxed);
+  atomic_store_explicit(&barrier->cancelled, 0,
+                        memory_order_release);
+}
+
+int laplace_barrier_sense(laplace_barrier_t *const barrier) {
+  return atomic_load_explicit(&barrier->sense, memory_order_acquire);
+}
+
+static int released(laplace_barrier_t *const barrier,
+                    int const                sense) {
+  return atomic_load_explicit(&barrier->sense,
+                              memory_order_seq_cst) == sense ||
+         atomic_load_explicit(&barrier->cancelled,
+                              memory_order_acquire);
+}
+
+kit_status_t laplace_barrier_wait(laplace_barrier_t *const barrier,
+                                  ptrdiff_t const          count,
+                                  int *const               sense,
+                                  int *const               serial) {
+  int const next = !*sense;
+  *sense         = next;
+  *serial        = 0;
+
+  if (atomic_load_explicit(&barrier->cancelled,
+                           memory_order_acquire))
+    return KIT_OK;
+
+  if (atomic_fetch_add_explicit(&barrier->arrived, 1,
+                                memory_order_acq_rel) ==
+      count - 1) {
+    atomic_store_explicit(&barrier->arrived, 0,
+                          memory_order_relaxed);
+    atomic_store_explicit(&barrier->sense, next,
+                          memory_order_seq_cst);
+    *serial = 1;
+
+    if (atomic_load_explicit(&barrier->sleeping,
+                             memory_order_seq_cst) == 0)
+      return KIT_OK;
+
+    if (mtx_lock(&barrier->lock) != thrd_success)
+      return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+    int const ok = cnd_broadcast(&barrier->on_release) ==
+                   thrd_success;
+    (void) mtx_unlock(&barrier->lock);
+
+    return ok ? KIT_OK : LAPLACE_ERROR_BAD_CNDVAR_BROADCAST;
+  }
+
+  for (ptrdiff_t i = 0; i < LAPLACE_BARRIER_SPIN_COUNT; i++) {
+    if (released(barrier, next))
+      return KIT_OK;
+    SPIN_PAUSE_;
+  }
+
+  for (ptrdiff_t i = 0; i < LAPLACE_BARRIER_YIELD_COUNT; i++) {
+    if (released(barrier, next))
+      return KIT_OK;
+    thrd_yield();
+  }
+
+  if (mtx_lock(&barrier->lock) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+
+  atomic_fetch_add_explicit(&barrier->sleeping, 1,
+                            memory_order_seq_cst);
+
+  int ok = 1;
+  while (ok && !released(barrier, next))
+    ok = cnd_wait(&barrier->on_release, &barrier->lock) ==
+         thrd_success;
+
+  atomic_fetch_add_explicit(&barrier->sleeping, -1,
+                            memory_order_relaxed);
+  (void) mtx_unlock(&barrier->lock);
+
+  return ok ? KIT_OK : LAPLACE_ERROR_BAD_CNDVAR_WAIT;
+}
+
+kit_status_t laplace_barrier_cancel(
+    laplace_barrier_t *const barrier) {
+  atomic_store_explicit(&barrier->cancelled, 1, memory_order_seq_cst);
+
+  if (mtx_lock(&barrier->lock) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+  int const ok = cnd_broadcast(&barrier->on_release) ==
+                 thrd_success;
+  (void) mtx_unlock(&barrier->lock);
+
+  return ok ? KIT_OK : LAPLACE_ERROR_BAD_CNDVAR_BROADCAST;
+}
@@ -0,0 +1,79 @@
+#ifndef LAPLACE_BARRIER_H
+#define LAPLACE_BARRIER_H
+
+#include "options.h"
+
+#include <kit/atomic.h>
+#include <kit/condition_variable.h>
+#include <kit/mutex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  LAPLACE_BARRIER_SPIN_COUNT  = 100,
+  LAPLACE_BARRIER_YIELD_COUNT = 20
+};
+
+/*  Sense-reversing barrier.
+ *
+ *  Waiting threads spin on the sense for a bounded number of
+ *  iterations, then yield a few times, then sleep on the condition
+ *  variable. The last arriving thread flips the sense and wakes
+ *  sleepers, if any.
+ */
+typedef struct {
+  KIT_ATOMIC(ptrdiff_t) arrived;
+  KIT_ATOMIC(ptrdiff_t) sleeping;
+  KIT_ATOMIC(int) sense;
+  KIT_ATOMIC(int) cancelled;
+
+  mtx_t lock;
+  cnd_t on_release;
+} laplace_barrier_t;
+
+kit_status_t laplace_barrier_init(laplace_barrier_t *barrier);
+
+void laplace_barrier_destroy(laplace_barrier_t *barrier);
+
+/*  Reset the barrier after cancellation. Should be called when no
+ *  threads are waiting.
+ */
+void laplace_barrier_reset(laplace_barrier_t *barrier);
+
+/*  Sense to start with for a thread joining the barrier.
+ */
+int laplace_barrier_sense(laplace_barrier_t *barrier);
+
+/*  Wait until count threads arrive. Serial is set for the last
+ *  arriving thread. If the barrier is cancelled, returns with serial
+ *  not set.
+ */
+kit_status_t laplace_barrier_wait(laplace_barrier_t *barrier,
+                                  ptrdiff_t count, int *sense,
+                                  int *serial);
+
+/*  Wake all waiting threads and make further waits return
+ *  immediately.
+ */
+kit_status_t laplace_barrier_cancel(laplace_barrier_t *barrier);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define BARRIER_SPIN_COUNT LAPLACE_BARRIER_SPIN_COUNT
+#  define BARRIER_YIELD_COUNT LAPLACE_BARRIER_YIELD_COUNT
+#  define barrier_t laplace_barrier_t
+
+#  define barrier_init laplace_barrier_init
+#  define barrier_destroy laplace_barrier_destroy
+#  define barrier_reset laplace_barrier_reset
+#  define barrier_sense laplace_barrier_sense
+#  define barrier_wait laplace_barrier_wait
+#  define barrier_cancel laplace_barrier_cancel
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
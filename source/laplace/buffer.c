@@ -7,97 +7,465 @@
 #define LOAD_ atomic_load_explicit
 #define STORE_ atomic_store_explicit
 #define ADD_ atomic_fetch_add_explicit
+#define SUB_ atomic_fetch_sub_explicit
 
 #define RLX_ memory_order_relaxed
 #define ACQ_ memory_order_acquire
 #define RLS_ memory_order_release
+#define SEQ_ memory_order_seq_cst
+
+static ptrdiff_t size_class(ptrdiff_t size) {
+  assert(size > 0);
+  ptrdiff_t k = 0;
+  while ((size >> 1) != 0) {
+    size >>= 1;
+    k++;
+  }
+  assert(k < LAPLACE_BUFFER_SIZE_CLASS_COUNT);
+  return k;
+}
 
-static ptrdiff_t buffer_alloc(laplace_buffer_void_t *const buffer,
-                              ptrdiff_t const              size) {
-  ptrdiff_t offset = 0;
+static void set_run(laplace_buffer_void_t *const buffer,
+                    ptrdiff_t const offset, ptrdiff_t const size,
+                    int const empty) {
+  assert(offset >= 0 && size > 0 &&
+         offset + size <= buffer->info.size);
 
-  while (offset < buffer->data.size) {
-    laplace_buf_info_t_ *info = buffer->info.values + offset;
-    if (info->empty && info->offset >= size)
-      break;
-    offset += info->offset;
+  laplace_buf_info_t_ *head = buffer->info.values + offset;
+  laplace_buf_info_t_ *tail = buffer->info.values + offset + size -
+                              1;
+
+  LAPLACE_BUF_WRITE_(*buffer, offset / LAPLACE_BUFFER_PAGE_SIZE);
+  LAPLACE_BUF_WRITE_(*buffer,
+                     (offset + size - 1) / LAPLACE_BUFFER_PAGE_SIZE);
+
+  tail->empty  = empty;
+  tail->offset = -size;
+  head->empty  = empty;
+  head->offset = size;
+}
+
+static void clear_tag(laplace_buffer_void_t *const buffer,
+                      ptrdiff_t const              offset) {
+  assert(offset >= 0 && offset < buffer->info.size);
+
+  LAPLACE_BUF_WRITE_(*buffer, offset / LAPLACE_BUFFER_PAGE_SIZE);
+
+  buffer->info.values[offset].empty  = 0;
+  buffer->info.values[offset].offset = 0;
+}
+
+static int is_free_run(laplace_buffer_void_t const *const buffer,
+                       laplace_buf_free_t_ const          run) {
+  return run.offset < buffer->info.size &&
+         buffer->info.values[run.offset].empty &&
+         buffer->info.values[run.offset].offset == run.size;
+}
+
+/*  Drop invalid records from the class list.
+ *
+ *  Compaction is triggered by the list size only, so the same
+ *  operations produce the same lists on every peer and in every
+ *  clone.
+ */
+static void compact_free_list(laplace_buffer_void_t *const buffer,
+                              ptrdiff_t const              k) {
+  ptrdiff_t n = 0;
+
+  for (ptrdiff_t i = 0; i < buffer->free_lists[k].size; i++) {
+    laplace_buf_free_t_ const run = buffer->free_lists[k].values[i];
+    if (is_free_run(buffer, run))
+      buffer->free_lists[k].values[n++] = run;
+  }
+
+  DA_RESIZE(buffer->free_lists[k], n);
+
+  buffer->free_marks[k] = n < LAPLACE_BUFFER_FREE_MARK_MIN
+                              ? LAPLACE_BUFFER_FREE_MARK_MIN
+                              : n;
+}
+
+static int push_free_run(laplace_buffer_void_t *const buffer,
+                         ptrdiff_t const              offset,
+                         ptrdiff_t const              size) {
+  laplace_buf_free_t_ const run = { .offset = offset, .size = size };
+
+  ptrdiff_t const k = size_class(size);
+
+  if (buffer->free_lists[k].size >= buffer->free_marks[k] * 2)
+    compact_free_list(buffer, k);
+
+  ptrdiff_t const n = buffer->free_lists[k].size;
+
+  DA_RESIZE(buffer->free_lists[k], n + 1);
+  if (buffer->free_lists[k].size != n + 1)
+    return 0;
+
+  buffer->free_lists[k].values[n] = run;
+  return 1;
+}
+
+/*  Take a free run from the size class lists.
+ *
+ *  Invalid records are dropped on the way. The class of the size
+ *  itself is checked only at the top, higher classes always fit.
+ */
+static ptrdiff_t take_free_run(laplace_buffer_void_t *const buffer,
+                               ptrdiff_t const              size,
+                               ptrdiff_t *const run_size) {
+  for (ptrdiff_t k = size_class(size);
+       k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++) {
+    while (buffer->free_lists[k].size > 0) {
+      ptrdiff_t const           n = buffer->free_lists[k].size - 1;
+      laplace_buf_free_t_ const run = buffer->free_lists[k].values[n];
+
+      if (!is_free_run(buffer, run)) {
+        DA_RESIZE(buffer->free_lists[k], n);
+        continue;
+      }
+
+      if (run.size < size)
+        break;
+
+      DA_RESIZE(buffer->free_lists[k], n);
+      *run_size = run.size;
+      return run.offset;
+    }
+  }
+
+  return LAPLACE_ID_UNDEFINED;
+}
+
+/*  An array retired in the epoch T can be in use only by readers
+ *  that entered in the epoch T or earlier. Arrays are published
+ *  before the epoch is advanced, so readers of later epochs see the
+ *  new arrays. The epoch and reader slots are sequentially
+ *  consistent, so a reader that is not seen by the scan sees the new
+ *  arrays too.
+ */
+static void reclaim(laplace_buffer_void_t *const buffer) {
+  if (buffer->retired.size == 0)
+    return;
+
+  ptrdiff_t const epoch = LOAD_(&buffer->read_epoch, RLX_) + 1;
+  ptrdiff_t       oldest = epoch;
+
+  STORE_(&buffer->read_epoch, epoch, SEQ_);
+
+  for (ptrdiff_t i = 0; i < LAPLACE_BUFFER_READER_COUNT; i++) {
+    ptrdiff_t const slot = LOAD_(&buffer->readers[i].epoch, SEQ_);
+    if (slot != 0 && slot - 1 < oldest)
+      oldest = slot - 1;
+  }
+
+  ptrdiff_t n = 0;
+
+  for (ptrdiff_t i = 0; i < buffer->retired.size; i++) {
+    laplace_buf_retired_t_ const r = buffer->retired.values[i];
+
+    if (r.epoch < oldest)
+      kit_alloc_dispatch(buffer->retired.alloc, KIT_DEALLOCATE, 0, 0,
+                         r.values);
+    else
+      buffer->retired.values[n++] = r;
+  }
+
+  DA_RESIZE(buffer->retired, n);
+}
+
+/*  Move the array to a bigger memory block. The previous block is
+ *  retired, because readers may still use it, and the new one is
+ *  published with the same size.
+ */
+static int relocate(laplace_buffer_void_t *const buffer,
+                    da_void_t *const             array,
+                    ptrdiff_t const              element_size,
+                    ptrdiff_t const              size) {
+  assert(size > array->capacity);
+
+  ptrdiff_t const n = buffer->retired.size;
+
+  DA_RESIZE(buffer->retired, n + 1);
+  if (buffer->retired.size != n + 1)
+    return 0;
+
+  ptrdiff_t const capacity = array->capacity * 2 < size
+                                 ? size
+                                 : array->capacity * 2;
+
+  void *const values = kit_alloc_dispatch(
+      array->alloc, KIT_ALLOCATE, capacity * element_size, 0, NULL);
+
+  if (values == NULL) {
+    DA_RESIZE(buffer->retired, n);
+    return 0;
   }
 
-  if (size >= PTRDIFF_MAX - offset)
+  if (array->size > 0)
+    memcpy(values, array->values, array->size * element_size);
+
+  if (array->values != NULL) {
+    buffer->retired.values[n].epoch  = LOAD_(&buffer->read_epoch,
+                                             RLX_);
+    buffer->retired.values[n].values = array->values;
+  } else
+    DA_RESIZE(buffer->retired, n);
+
+  array->values   = values;
+  array->capacity = capacity;
+
+  laplace_buffer_publish(buffer);
+  return 1;
+}
+
+/*  The data array is moved to new memory only when the capacity is
+ *  exceeded. New cells are not reachable until a block index is
+ *  published, so the readers can go on.
+ */
+static int grow(laplace_buffer_void_t *const buffer,
+                ptrdiff_t const              size) {
+  int             success        = 1;
+  ptrdiff_t const previous_size  = buffer->info.size;
+  ptrdiff_t const previous_flags = buffer->changed.size;
+  ptrdiff_t const flags          = LAPLACE_BUF_CHANGED_SIZE_(size);
+  ptrdiff_t const previous_words = buffer->summary.size;
+  ptrdiff_t const words          = LAPLACE_BUF_CHANGED_SIZE_(flags);
+  ptrdiff_t const previous_pages = buffer->written.size;
+  ptrdiff_t const pages          = LAPLACE_BUF_CHANGED_SIZE_(words);
+
+  reclaim(buffer);
+
+  DA_RESIZE(buffer->changed, flags);
+  assert(buffer->changed.size == flags);
+  if (buffer->changed.size != flags)
+    success = 0;
+  else if (flags > previous_flags)
+    memset(buffer->changed.values + previous_flags, 0,
+           (flags - previous_flags) * sizeof *buffer->changed.values);
+
+  DA_RESIZE(buffer->summary, words);
+  assert(buffer->summary.size == words);
+  if (buffer->summary.size != words)
+    success = 0;
+  else if (words > previous_words)
+    memset(buffer->summary.values + previous_words, 0,
+           (words - previous_words) * sizeof *buffer->summary.values);
+
+  DA_RESIZE(buffer->written, pages);
+  assert(buffer->written.size == pages);
+  if (buffer->written.size != pages)
+    success = 0;
+  else if (pages > previous_pages)
+    memset(buffer->written.values + previous_pages, 0,
+           (pages - previous_pages) * sizeof *buffer->written.values);
+
+  if (laplace_buffer_tree_resize(&buffer->cell_tree, size) != KIT_OK)
+    success = 0;
+
+  DA_RESIZE(buffer->info, size);
+  assert(buffer->info.size == size);
+  if (buffer->info.size != size)
+    success = 0;
+
+  if (size > buffer->data.capacity &&
+      !relocate(buffer, (da_void_t *) &buffer->data,
+                buffer->cell_size, size))
+    success = 0;
+  else
+    da_resize((da_void_t *) &buffer->data, buffer->cell_size, size);
+
+#ifdef LAPLACE_BUFFER_SOA
+  da_resize((da_void_t *) &buffer->deltas, buffer->cell_size, size);
+  if (buffer->deltas.size != size)
+    success = 0;
+#endif
+
+  /*  New cells are zero, so they add nothing to the hash.
+   */
+  if (success && size > previous_size) {
+    memset(buffer->info.values + previous_size, 0,
+           (size - previous_size) * sizeof *buffer->info.values);
+    memset((char *) buffer->data.values +
+               previous_size * buffer->cell_size,
+           0, (size - previous_size) * buffer->cell_size);
+#ifdef LAPLACE_BUFFER_SOA
+    memset((char *) buffer->deltas.values +
+               previous_size * buffer->cell_size,
+           0, (size - previous_size) * buffer->cell_size);
+#endif
+  }
+
+  laplace_buffer_publish(buffer);
+  reclaim(buffer);
+  return success;
+}
+
+static void clear_blocks(laplace_buffer_void_t *const buffer,
+                         ptrdiff_t const begin, ptrdiff_t const end) {
+  assert(begin >= 0 && end <= buffer->blocks.capacity);
+
+  for (ptrdiff_t i = begin; i < end; i++) {
+    STORE_(&buffer->blocks.values[i].index, LAPLACE_ID_UNDEFINED,
+           RLS_);
+    STORE_(&buffer->blocks.values[i].generation, -1, RLS_);
+    STORE_(&buffer->blocks.values[i].size, 0, RLS_);
+  }
+}
+
+/*  Hash of a block table entry. Cleared entries hash to zero, so
+ *  new blocks add nothing to the hash.
+ */
+static uint64_t block_hash(laplace_buffer_void_t const *const buffer,
+                           ptrdiff_t const                    id) {
+  laplace_buf_block_t_ const *const b = buffer->blocks.values + id;
+
+  ptrdiff_t const index      = LOAD_(&b->index, RLX_);
+  ptrdiff_t const generation = LOAD_(&b->generation, RLX_);
+  ptrdiff_t const size       = LOAD_(&b->size, RLX_);
+
+  if (index == LAPLACE_ID_UNDEFINED && generation == -1 && size == 0)
+    return 0;
+
+  uint64_t h = (uint64_t) id;
+  LAPLACE_BUF_MIX_(h);
+  h ^= (uint64_t) index;
+  LAPLACE_BUF_MIX_(h);
+  h ^= (uint64_t) generation;
+  LAPLACE_BUF_MIX_(h);
+  h ^= (uint64_t) size;
+  LAPLACE_BUF_MIX_(h);
+  return h;
+}
+
+static void rehash_block(laplace_buffer_void_t *const buffer,
+                         ptrdiff_t const              id,
+                         uint64_t const               previous) {
+  uint64_t const diff = block_hash(buffer, id) - previous;
+  if (diff == 0)
+    return;
+  laplace_buffer_tree_add(&buffer->block_tree, 1,
+                          id / LAPLACE_BUFFER_TREE_FANOUT, diff);
+  buffer->block_hash += diff;
+}
+
+/*  New blocks are cleared before the size is changed.
+ */
+static kit_status_t grow_blocks(laplace_buffer_void_t *const buffer,
+                                ptrdiff_t const              size) {
+  ptrdiff_t const previous_size = buffer->blocks.size;
+
+  assert(size > previous_size);
+
+  if (size > buffer->blocks.capacity &&
+      !relocate(buffer, (da_void_t *) &buffer->blocks,
+                sizeof *buffer->blocks.values, size))
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  if (laplace_buffer_tree_resize(&buffer->block_tree, size) != KIT_OK)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  clear_blocks(buffer, previous_size, size);
+  DA_RESIZE(buffer->blocks, size);
+  laplace_buffer_publish(buffer);
+  reclaim(buffer);
+  return KIT_OK;
+}
+
+static ptrdiff_t buffer_alloc(laplace_buffer_void_t *const buffer,
+                              ptrdiff_t const              size) {
+  assert(size > 0);
+
+  if (size >= PTRDIFF_MAX - buffer->data.size)
     /*  No assertion.
      *  Tested in test suite.
      */
     return LAPLACE_ID_UNDEFINED;
 
-  if (offset >= buffer->data.size) {
-    int success = 1;
+  ptrdiff_t run_size = 0;
+  ptrdiff_t offset   = take_free_run(buffer, size, &run_size);
 
-    if (mtx_lock(&buffer->read_lock) == thrd_success) {
-      while (success && buffer->read_count != 0)
-        if (cnd_wait(&buffer->read_sync, &buffer->read_lock) !=
-            thrd_success) {
-          (void) mtx_unlock(&buffer->read_lock);
-          success = 0;
-        }
-    } else {
-      assert(0);
-      success = 0;
-    }
+  if (offset == LAPLACE_ID_UNDEFINED) {
+    /*  Use or extend the free run at the end of the buffer, if any.
+     */
+    ptrdiff_t const end = buffer->data.size;
 
-    if (success) {
-      DA_RESIZE(buffer->changed, offset + size);
-      assert(buffer->changed.size == offset + size);
-      if (buffer->changed.size != offset + size)
-        success = 0;
+    offset = end;
+
+    if (end > 0 && buffer->info.values[end - 1].empty) {
+      ptrdiff_t const tail = buffer->info.values[end - 1].offset;
+      run_size             = tail < 0 ? -tail : tail;
+      offset               = end - run_size;
+    }
 
-      DA_RESIZE(buffer->info, offset + size);
-      assert(buffer->info.size == offset + size);
-      if (buffer->info.size != offset + size)
-        success = 0;
+    if (run_size < size) {
+      if (run_size > 0)
+        clear_tag(buffer, end - 1);
 
-      da_resize((da_void_t *) &buffer->data, buffer->cell_size,
-                offset + size);
-      assert(buffer->data.size == offset + size);
-      if (buffer->data.size != offset + size)
-        success = 0;
+      if (!grow(buffer, offset + size)) {
+        if (run_size > 0)
+          set_run(buffer, offset, run_size, 1);
+        return LAPLACE_ID_UNDEFINED;
+      }
 
-      (void) mtx_unlock(&buffer->read_lock);
+      run_size = size;
     }
+  }
+
+  if (run_size > size) {
+    /*  Split the run and put the rest back.
+     */
+    set_run(buffer, offset + size, run_size - size, 1);
 
-    if (!success)
+    if (!push_free_run(buffer, offset + size, run_size - size)) {
+      set_run(buffer, offset, run_size, 1);
+      (void) push_free_run(buffer, offset, run_size);
       return LAPLACE_ID_UNDEFINED;
+    }
   }
 
-  for (ptrdiff_t i = 0; i < size; i++) {
-    STORE_(&buffer->changed.values[offset + i].flag, 0, RLX_);
-  }
+  set_run(buffer, offset, size, 0);
 
-  for (ptrdiff_t i = 0; i < size; i++) {
-    laplace_buf_info_t_ *info = buffer->info.values + offset + i;
-    info->empty               = 0;
-    info->offset              = size - i;
-  }
+  for (ptrdiff_t i = 0; i < size; i++)
+    LAPLACE_BUF_UNMARK_(*buffer, offset + i);
 
   return offset;
 }
 
+/*  Free the run and merge it with neighbouring free runs.
+ */
 static void buffer_free(laplace_buffer_void_t *const buffer,
                         ptrdiff_t const              offset) {
+  assert(offset >= 0 && offset < buffer->info.size);
+  assert(!buffer->info.values[offset].empty);
+  assert(buffer->info.values[offset].offset > 0);
+
   ptrdiff_t begin = offset;
-  ptrdiff_t end   = begin;
+  ptrdiff_t end   = begin + buffer->info.values[offset].offset;
 
-  while (end < buffer->data.size) {
-    assert(end >= 0 && end < buffer->info.size);
-    end += buffer->info.values[end].offset;
-    if (end < buffer->data.size && !buffer->info.values[end].empty)
-      break;
+  assert(end <= buffer->info.size);
+
+  if (end < buffer->info.size && buffer->info.values[end].empty) {
+    ptrdiff_t const next_end = end + buffer->info.values[end].offset;
+    clear_tag(buffer, end - 1);
+    clear_tag(buffer, end);
+    end = next_end;
   }
 
-  for (ptrdiff_t i = begin; i < end; i++) {
-    laplace_buf_info_t_ *info = buffer->info.values + i;
-    info->empty               = 1;
-    info->offset              = end - i;
+  if (begin > 0 && buffer->info.values[begin - 1].empty) {
+    ptrdiff_t const tail = buffer->info.values[begin - 1].offset;
+    ptrdiff_t const previous_begin = begin -
+                                     (tail < 0 ? -tail : tail);
+    clear_tag(buffer, begin - 1);
+    clear_tag(buffer, begin);
+    begin = previous_begin;
   }
+
+  set_run(buffer, begin, end - begin, 1);
+
+  /*  If out of memory, the run will be reused only when it is at the
+   *  end of the buffer.
+   */
+  (void) push_free_run(buffer, begin, end - begin);
 }
 
 kit_status_t laplace_buffer_set_chunk_size(
@@ -111,6 +479,26 @@ kit_status_t laplace_buffer_set_chunk_size(
   return KIT_OK;
 }
 
+/*  Chunk size for the adjust pass. Each thread gets a few chunks, so
+ *  large buffers don't contend on the chunk counter and small buffers
+ *  are still split between threads. The buffer chunk size is the
+ *  lower bound.
+ */
+ptrdiff_t laplace_buffer_adjust_chunk_size(
+    laplace_buffer_void_t const *const buffer,
+    ptrdiff_t const                    thread_count) {
+  assert(buffer != NULL);
+
+  ptrdiff_t const count = (thread_count > 1 ? thread_count : 1) *
+                          LAPLACE_BUFFER_CHUNKS_PER_THREAD;
+  ptrdiff_t chunk_size = (buffer->data.size + count - 1) / count;
+  chunk_size           = (chunk_size + 63) / 64 * 64;
+
+  if (chunk_size < buffer->chunk_size)
+    return buffer->chunk_size;
+  return chunk_size;
+}
+
 laplace_handle_t laplace_buffer_allocate(
     laplace_buffer_void_t *const buffer, ptrdiff_t const size) {
   laplace_handle_t h;
@@ -128,54 +516,30 @@ laplace_handle_t laplace_buffer_allocate(
     return h;
   }
 
-  if (mtx_lock(&buffer->read_lock) == thrd_success) {
-    while (buffer->read_count != 0)
-      if (cnd_wait(&buffer->read_sync, &buffer->read_lock) !=
-          thrd_success) {
-        (void) mtx_unlock(&buffer->read_lock);
-        h.id    = LAPLACE_ID_UNDEFINED;
-        h.error = LAPLACE_ERROR_BAD_CNDVAR_WAIT;
-        return h;
-      }
-  } else {
-    assert(0);
-    h.id    = LAPLACE_ID_UNDEFINED;
-    h.error = LAPLACE_ERROR_BAD_MUTEX_LOCK;
-    return h;
-  }
-
   ptrdiff_t const block = buffer->next_block;
-  if (block >= buffer->blocks.size) {
-    ptrdiff_t i = buffer->blocks.size;
 
-    DA_RESIZE(buffer->blocks, block + 1);
+  if (block >= buffer->blocks.size) {
+    kit_status_t const s = grow_blocks(buffer, block + 1);
 
-    if (buffer->blocks.size != block + 1) {
+    if (s != KIT_OK) {
       buffer_free(buffer, offset);
-      (void) mtx_unlock(&buffer->read_lock);
       h.id    = LAPLACE_ID_UNDEFINED;
-      h.error = LAPLACE_ERROR_BAD_ALLOC;
+      h.error = s;
       return h;
     }
-
-    for (; i < buffer->blocks.size; i++) {
-      assert(i >= 0 && i < buffer->blocks.size);
-      STORE_(&buffer->blocks.values[i].index, LAPLACE_ID_UNDEFINED,
-             RLS_);
-      STORE_(&buffer->blocks.values[i].generation, -1, RLS_);
-      STORE_(&buffer->blocks.values[i].size, 0, RLS_);
-    }
   }
 
   assert(block >= 0 && block < buffer->blocks.size);
-  STORE_(&buffer->blocks.values[block].index, offset, RLS_);
+  uint64_t const previous = block_hash(buffer, block);
 
-  (void) mtx_unlock(&buffer->read_lock);
+  STORE_(&buffer->blocks.values[block].index, offset, RLS_);
 
   ptrdiff_t const generation = ADD_(
       &buffer->blocks.values[block].generation, 1, RLS_);
   STORE_(&buffer->blocks.values[block].size, size, RLS_);
 
+  rehash_block(buffer, block, previous);
+
   assert(buffer->next_block >= 0 &&
          buffer->next_block <= buffer->blocks.size);
   while (buffer->next_block < buffer->blocks.size &&
@@ -240,52 +604,27 @@ laplace_handle_t laplace_buffer_allocate_into(
     return h;
   }
 
-  if (mtx_lock(&buffer->read_lock) == thrd_success) {
-    while (buffer->read_count != 0)
-      if (cnd_wait(&buffer->read_sync, &buffer->read_lock) !=
-          thrd_success) {
-        (void) mtx_unlock(&buffer->read_lock);
-        h.id    = LAPLACE_ID_UNDEFINED;
-        h.error = LAPLACE_ERROR_BAD_CNDVAR_WAIT;
-        return h;
-      }
-  } else {
-    assert(0);
-    h.id    = LAPLACE_ID_UNDEFINED;
-    h.error = LAPLACE_ERROR_BAD_MUTEX_LOCK;
-    return h;
-  }
-
   if (handle.id >= buffer->blocks.size) {
-    ptrdiff_t i = buffer->blocks.size;
-
-    DA_RESIZE(buffer->blocks, handle.id + 1);
+    kit_status_t const s = grow_blocks(buffer, handle.id + 1);
 
-    if (buffer->blocks.size != handle.id + 1) {
+    if (s != KIT_OK) {
       buffer_free(buffer, offset);
-      (void) mtx_unlock(&buffer->read_lock);
       h.id    = LAPLACE_ID_UNDEFINED;
-      h.error = LAPLACE_ERROR_BAD_ALLOC;
+      h.error = s;
       return h;
     }
-
-    for (; i < buffer->blocks.size; i++) {
-      assert(i >= 0 && i < buffer->blocks.size);
-      STORE_(&buffer->blocks.values[i].index, LAPLACE_ID_UNDEFINED,
-             RLS_);
-      STORE_(&buffer->blocks.values[i].generation, -1, RLS_);
-      STORE_(&buffer->blocks.values[i].size, 0, RLS_);
-    }
   }
 
-  STORE_(&buffer->blocks.values[handle.id].index, offset, RLS_);
+  uint64_t const previous = block_hash(buffer, handle.id);
 
-  (void) mtx_unlock(&buffer->read_lock);
+  STORE_(&buffer->blocks.values[handle.id].index, offset, RLS_);
 
   STORE_(&buffer->blocks.values[handle.id].generation, generation + 1,
          RLS_);
   STORE_(&buffer->blocks.values[handle.id].size, size, RLS_);
 
+  rehash_block(buffer, handle.id, previous);
+
   assert(buffer->next_block >= 0 &&
          buffer->next_block <= buffer->blocks.size);
   while (buffer->next_block < buffer->blocks.size &&
@@ -335,26 +674,13 @@ laplace_buffer_realloc_result_t laplace_buffer_reallocate(
 
   buffer_free(buffer, result.previous_offset);
 
-  if (mtx_lock(&buffer->read_lock) == thrd_success) {
-    while (buffer->read_count != 0)
-      if (cnd_wait(&buffer->read_sync, &buffer->read_lock) !=
-          thrd_success) {
-        (void) mtx_unlock(&buffer->read_lock);
-        result.status = LAPLACE_ERROR_BAD_CNDVAR_WAIT;
-        return result;
-      }
-  } else {
-    assert(0);
-    result.status = LAPLACE_ERROR_BAD_MUTEX_LOCK;
-    return result;
-  }
+  uint64_t const previous = block_hash(buffer, handle.id);
 
   STORE_(&buffer->blocks.values[handle.id].index, offset, RLS_);
-
-  (void) mtx_unlock(&buffer->read_lock);
-
   STORE_(&buffer->blocks.values[handle.id].size, size, RLS_);
 
+  rehash_block(buffer, handle.id, previous);
+
   result.status = KIT_OK;
   return result;
 }
@@ -365,35 +691,9 @@ kit_status_t laplace_buffer_reserve(
     return LAPLACE_ERROR_INVALID_SIZE;
 
   if (buffer->blocks.size < size) {
-    ptrdiff_t i = buffer->blocks.size;
-
-    if (mtx_lock(&buffer->read_lock) == thrd_success) {
-      while (buffer->read_count != 0)
-        if (cnd_wait(&buffer->read_sync, &buffer->read_lock) !=
-            thrd_success) {
-          (void) mtx_unlock(&buffer->read_lock);
-          return LAPLACE_ERROR_BAD_CNDVAR_WAIT;
-        }
-    } else {
-      assert(0);
-      return LAPLACE_ERROR_BAD_MUTEX_LOCK;
-    }
-
-    DA_RESIZE(buffer->blocks, size);
-
-    if (buffer->blocks.size != size) {
-      (void) mtx_unlock(&buffer->read_lock);
-      return LAPLACE_ERROR_BAD_ALLOC;
-    }
-
-    for (; i < buffer->blocks.size; i++) {
-      assert(i >= 0 && i < buffer->blocks.size);
-      STORE_(&buffer->blocks.values[i].index, LAPLACE_ID_UNDEFINED,
-             RLS_);
-      STORE_(&buffer->blocks.values[i].generation, -1, RLS_);
-    }
-
-    (void) mtx_unlock(&buffer->read_lock);
+    kit_status_t const s = grow_blocks(buffer, size);
+    if (s != KIT_OK)
+      return s;
   }
 
   buffer->reserved = size;
@@ -428,9 +728,13 @@ kit_status_t laplace_buffer_deallocate(laplace_buffer_void_t *buffer,
 
   buffer_free(buffer, block);
 
+  uint64_t const previous = block_hash(buffer, handle.id);
+
   STORE_(&buffer->blocks.values[handle.id].index,
          LAPLACE_ID_UNDEFINED, RLS_);
 
+  rehash_block(buffer, handle.id, previous);
+
   if (buffer->next_block > handle.id)
     buffer->next_block = handle.id;
   if (buffer->next_block < buffer->reserved)
@@ -466,29 +770,1619 @@ kit_status_t laplace_buffer_check(laplace_buffer_void_t const *buffer,
   return KIT_OK;
 }
 
+/*  Find the block in the published arrays.
+ */
+static kit_status_t view_block(
+    laplace_buffer_void_t const *const  buffer,
+    laplace_handle_t const              handle,
+    laplace_buf_block_t_ const **const  block) {
+  ptrdiff_t const size = LOAD_(&buffer->view.blocks_size, SEQ_);
+  laplace_buf_block_t_ const *const blocks =
+      (laplace_buf_block_t_ const *) LOAD_(&buffer->view.blocks,
+                                           SEQ_);
+
+  if (handle.id < 0 || handle.id >= size)
+    return LAPLACE_ERROR_INVALID_HANDLE_ID;
+
+  laplace_buf_block_t_ const *const b = blocks + handle.id;
+
+  if (LOAD_(&b->index, ACQ_) == LAPLACE_ID_UNDEFINED)
+    return LAPLACE_ERROR_INVALID_HANDLE_ID;
+  if (LOAD_(&b->generation, ACQ_) != handle.generation)
+    return LAPLACE_ERROR_INVALID_HANDLE_GENERATION;
+
+  *block = b;
+  return KIT_OK;
+}
+
 ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
                               laplace_handle_t       handle) {
-  if (mtx_lock(&buffer->read_lock) != thrd_success) {
-    assert(0);
+  ptrdiff_t const slot = laplace_buffer_read_begin(buffer);
+
+  laplace_buf_block_t_ const *b    = NULL;
+  ptrdiff_t                   size = 0;
+
+  if (view_block(buffer, handle, &b) == KIT_OK)
+    size = LOAD_(&b->size, ACQ_);
+
+  laplace_buffer_read_end(buffer, slot);
+  return size;
+}
+
+kit_status_t laplace_buffer_read(laplace_buffer_void_t *const buffer,
+                                 laplace_handle_t const       handle,
+                                 ptrdiff_t const              index,
+                                 ptrdiff_t const              size,
+                                 void *const destination) {
+  if (size < 0)
+    return LAPLACE_ERROR_INVALID_SIZE;
+
+#ifdef LAPLACE_BUFFER_SOA
+  ptrdiff_t const value_size = buffer->cell_size;
+  ptrdiff_t const value      = 0;
+#else
+  ptrdiff_t const value_size = buffer->cell_size / 2;
+  ptrdiff_t const value      = value_size;
+#endif
+
+  ptrdiff_t const slot = laplace_buffer_read_begin(buffer);
+
+  laplace_buf_block_t_ const *b = NULL;
+
+  kit_status_t s = view_block(buffer, handle, &b);
+
+  ptrdiff_t const block = s == KIT_OK ? LOAD_(&b->index, ACQ_) : 0;
+  ptrdiff_t const data_size = LOAD_(&buffer->view.data_size, SEQ_);
+  char const *const data = (char const *) LOAD_(&buffer->view.data,
+                                                 SEQ_);
+
+  if (s == KIT_OK && size != 0 &&
+      (index < 0 || block + index < 0 ||
+       block + index + size > data_size ||
+       index + size > LOAD_(&b->size, ACQ_)))
+    s = LAPLACE_ERROR_INVALID_INDEX;
+
+  if (s != KIT_OK)
+    memset(destination, 0, size * value_size);
+  else
+    for (ptrdiff_t i = 0; i < size; i++) {
+      char const *const p = data +
+                            (block + index + i) * buffer->cell_size +
+                            value;
+      char *const       q = (char *) destination + i * value_size;
+
+      switch (value_size) {
+#define READ_(type_)                                            \
+  case sizeof(type_): {                                         \
+    type_ const x = LOAD_((KIT_ATOMIC(type_) const *) p, RLX_); \
+    memcpy(q, &x, sizeof x);                                    \
+  } break;
+        READ_(int8_t)
+        READ_(int16_t)
+        READ_(int32_t)
+        READ_(int64_t)
+#undef READ_
+        default: assert(0);
+      }
+    }
+
+  laplace_buffer_read_end(buffer, slot);
+  return s;
+}
+
+/*  Preferred reader slot of the thread. Slots are assigned round
+ *  robin, so threads rarely share one.
+ */
+static _Thread_local ptrdiff_t reader_slot_ = -1;
+static KIT_ATOMIC(ptrdiff_t) next_reader_slot_;
+
+/*  The reader claims a free slot and publishes its epoch there. The
+ *  slot is on its own cache line, so readers don't write to shared
+ *  memory. If the slot is taken by another thread, try the next one.
+ *  When all slots are taken, yield after each pass so the readers
+ *  that hold them can finish.
+ */
+ptrdiff_t laplace_buffer_read_begin(laplace_buffer_void_t *buffer) {
+  if (reader_slot_ < 0)
+    reader_slot_ = ADD_(&next_reader_slot_, 1, RLX_) %
+                   LAPLACE_BUFFER_READER_COUNT;
+
+  for (ptrdiff_t slot = reader_slot_;;) {
+    ptrdiff_t const epoch = LOAD_(&buffer->read_epoch, SEQ_);
+    ptrdiff_t       free  = 0;
+
+    if (atomic_compare_exchange_strong_explicit(
+            &buffer->readers[slot].epoch, &free, epoch + 1, SEQ_,
+            RLX_))
+      return slot;
+
+    slot = (slot + 1) % LAPLACE_BUFFER_READER_COUNT;
+    if (slot == reader_slot_)
+      thrd_yield();
+  }
+}
+
+void laplace_buffer_read_end(laplace_buffer_void_t *buffer,
+                             ptrdiff_t              slot) {
+  STORE_(&buffer->readers[slot].epoch, 0, RLS_);
+}
+
+void laplace_buffer_publish(laplace_buffer_void_t *const buffer) {
+  STORE_(&buffer->view.data, (intptr_t) buffer->data.values, SEQ_);
+  STORE_(&buffer->view.blocks, (intptr_t) buffer->blocks.values,
+         SEQ_);
+  STORE_(&buffer->view.data_size, buffer->data.size, SEQ_);
+  STORE_(&buffer->view.blocks_size, buffer->blocks.size, SEQ_);
+}
+
+int laplace_buffer_ctz(uint64_t x) {
+  assert(x != 0);
+  int n = 0;
+  for (; (x & 1) == 0; x >>= 1) n++;
+  return n;
+}
+
+#define LANE_(x_) x_,
+
+uint64_t const laplace_buf_lanes_[64] = {
+  LAPLACE_BUF_LANES_(LANE_)
+};
+
+#undef LANE_
+
+/*  Word weights are even and lane weights are odd, so cell weights
+ *  are odd.
+ */
+uint64_t laplace_buffer_word_weight(ptrdiff_t const word) {
+  uint64_t w = (uint64_t) word + (uint64_t) 0x9e3779b97f4a7c15ull;
+  LAPLACE_BUF_MIX_(w);
+  return w << 1;
+}
+
+/*  First level has a node per 64 leaves, and levels are added until
+ *  the top one has at most 64 nodes.
+ */
+static void tree_layout(laplace_buf_tree_t_ *const tree,
+                        ptrdiff_t const            size) {
+  ptrdiff_t const fanout = LAPLACE_BUFFER_TREE_FANOUT;
+
+  ptrdiff_t n = (size + fanout - 1) / fanout;
+  ptrdiff_t k = 1;
+
+  tree->size       = size;
+  tree->offsets[0] = 0;
+  tree->offsets[1] = 0;
+
+  for (;;) {
+    assert(k < LAPLACE_BUFFER_TREE_MAX_HEIGHT);
+    tree->offsets[k + 1] = tree->offsets[k] + n;
+    if (n <= fanout)
+      break;
+    n = (n + fanout - 1) / fanout;
+    k++;
+  }
+
+  tree->height = k + 1;
+}
+
+void laplace_buffer_tree_init(laplace_buf_tree_t_ *const tree,
+                              kit_allocator_t const      alloc) {
+  assert(tree != NULL);
+
+  memset(tree, 0, sizeof *tree);
+  DA_INIT(tree->nodes, 0, alloc);
+  tree_layout(tree, 0);
+}
+
+/*  Sum the stored level from the level below.
+ */
+static void tree_sum_level(laplace_buf_tree_t_ *const tree,
+                           ptrdiff_t const            k) {
+  ptrdiff_t const            fanout = LAPLACE_BUFFER_TREE_FANOUT;
+  laplace_buf_hash_t_ *const nodes  = tree->nodes.values;
+
+  for (ptrdiff_t i = tree->offsets[k]; i < tree->offsets[k + 1];
+       i++) {
+    ptrdiff_t const begin = tree->offsets[k - 1] +
+                            (i - tree->offsets[k]) * fanout;
+    ptrdiff_t       end   = begin + fanout;
+    if (end > tree->offsets[k])
+      end = tree->offsets[k];
+
+    uint64_t sum = 0;
+    for (ptrdiff_t j = begin; j < end; j++)
+      sum += LOAD_(&nodes[j].hash, RLX_);
+    STORE_(&nodes[i].hash, sum, RLX_);
+  }
+}
+
+/*  New leaves are zero, so on growth stored nodes keep their sums.
+ *  Levels are moved to the new offsets from the top down, as the
+ *  offsets only increase, and only levels added at the top are
+ *  summed. So a resize costs the size of the upper levels, not of
+ *  the first one.
+ */
+kit_status_t laplace_buffer_tree_resize(
+    laplace_buf_tree_t_ *const tree, ptrdiff_t const size) {
+  assert(tree != NULL);
+  assert(size >= 0);
+
+  laplace_buf_tree_t_ layout;
+  tree_layout(&layout, size);
+
+  ptrdiff_t const total = layout.offsets[layout.height];
+
+  DA_RESIZE(tree->nodes, total);
+  if (tree->nodes.size != total)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  laplace_buf_hash_t_ *const nodes  = tree->nodes.values;
+  ptrdiff_t const            height = size >= tree->size
+                                          ? tree->height
+                                          : 2;
+
+  for (ptrdiff_t k = height; k >= 1; k--) {
+    ptrdiff_t const n = k < height ? tree->offsets[k + 1] -
+                                         tree->offsets[k]
+                                   : 0;
+    if (k < height && n > 0 &&
+        layout.offsets[k] != tree->offsets[k])
+      memmove(nodes + layout.offsets[k], nodes + tree->offsets[k],
+              n * sizeof *nodes);
+    if (k < layout.height)
+      for (ptrdiff_t i = layout.offsets[k] + n;
+           i < layout.offsets[k + 1]; i++)
+        STORE_(&nodes[i].hash, 0, RLX_);
+  }
+
+  tree->size   = layout.size;
+  tree->height = layout.height;
+  memcpy(tree->offsets, layout.offsets, sizeof tree->offsets);
+
+  for (ptrdiff_t k = height; k < tree->height; k++)
+    tree_sum_level(tree, k);
+
+  return KIT_OK;
+}
+
+kit_status_t laplace_buffer_tree_copy(
+    laplace_buf_tree_t_ *const dst, laplace_buf_tree_t_ const *src) {
+  assert(dst != NULL && src != NULL);
+
+  DA_RESIZE(dst->nodes, src->nodes.size);
+  if (dst->nodes.size != src->nodes.size)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  if (src->nodes.size > 0)
+    memcpy(dst->nodes.values, src->nodes.values,
+           src->nodes.size * sizeof *src->nodes.values);
+
+  dst->size   = src->size;
+  dst->height = src->height;
+  memcpy(dst->offsets, src->offsets, sizeof dst->offsets);
+  return KIT_OK;
+}
+
+void laplace_buffer_tree_add(laplace_buf_tree_t_ *const tree,
+                             ptrdiff_t const level, ptrdiff_t index,
+                             uint64_t const diff) {
+  assert(tree != NULL);
+  assert(level >= 1);
+
+  for (ptrdiff_t k = level; k < tree->height;
+       k++, index /= LAPLACE_BUFFER_TREE_FANOUT) {
+    assert(tree->offsets[k] + index < tree->offsets[k + 1]);
+    ADD_(&tree->nodes.values[tree->offsets[k] + index].hash, diff,
+         RLX_);
+  }
+}
+
+ptrdiff_t laplace_buffer_tree_level_size(
+    laplace_buf_tree_t_ const *const tree, ptrdiff_t const level) {
+  assert(tree != NULL);
+
+  if (level <= 0)
+    return level == 0 ? tree->size : 0;
+  if (level >= tree->height)
+    return 1;
+  return tree->offsets[level + 1] - tree->offsets[level];
+}
+
+/*  Stored node, root or zero. Level 0 is handled by the caller.
+ */
+static uint64_t tree_node(laplace_buf_tree_t_ const *const tree,
+                          uint64_t const root, ptrdiff_t const level,
+                          ptrdiff_t const index) {
+  if (level >= tree->height)
+    return index == 0 ? root : 0;
+  return LOAD_(&tree->nodes.values[tree->offsets[level] + index].hash,
+               RLX_);
+}
+
+/*  Values are sign-extended, as in LAPLACE_BUF_HASH_DIFF_.
+ */
+static uint64_t read_value(char const *const p,
+                           ptrdiff_t const   size) {
+  switch (size) {
+    case 1: {
+      int8_t x;
+      memcpy(&x, p, sizeof x);
+      return (uint64_t) (int64_t) x;
+    }
+    case 2: {
+      int16_t x;
+      memcpy(&x, p, sizeof x);
+      return (uint64_t) (int64_t) x;
+    }
+    case 4: {
+      int32_t x;
+      memcpy(&x, p, sizeof x);
+      return (uint64_t) (int64_t) x;
+    }
+    default: {
+      int64_t x;
+      assert(size == 8);
+      memcpy(&x, p, sizeof x);
+      return (uint64_t) x;
+    }
+  }
+}
+
+static uint64_t cell_value(laplace_buffer_void_t const *const buffer,
+                           ptrdiff_t const                    index) {
+#ifdef LAPLACE_BUFFER_SOA
+  ptrdiff_t const   size = buffer->cell_size;
+  char const *const p    = (char const *) buffer->data.values +
+                        index * size;
+#else
+  ptrdiff_t const   size = buffer->cell_size / 2;
+  char const *const p    = (char const *) buffer->data.values +
+                        index * buffer->cell_size + size;
+#endif
+
+  return read_value(p, size);
+}
+
+uint64_t laplace_buffer_cell_hash(
+    laplace_buffer_void_t const *const buffer, ptrdiff_t const level,
+    ptrdiff_t const index) {
+  assert(buffer != NULL);
+
+  laplace_buf_tree_t_ const *const tree = &buffer->cell_tree;
+
+  if (index < 0 ||
+      index >= laplace_buffer_tree_level_size(tree, level))
     return 0;
-  } else {
-    buffer->read_count++;
-    (void) mtx_unlock(&buffer->read_lock);
+
+  if (level == 0)
+    return (laplace_buffer_word_weight(index / 64) +
+            laplace_buf_lanes_[index % 64]) *
+           cell_value(buffer, index);
+
+  return tree_node(tree, LOAD_(&buffer->hash, RLX_), level, index);
+}
+
+uint64_t laplace_buffer_block_hash(
+    laplace_buffer_void_t const *const buffer, ptrdiff_t const level,
+    ptrdiff_t const index) {
+  assert(buffer != NULL);
+
+  laplace_buf_tree_t_ const *const tree = &buffer->block_tree;
+
+  if (index < 0 ||
+      index >= laplace_buffer_tree_level_size(tree, level))
+    return 0;
+
+  if (level == 0)
+    return block_hash(buffer, index);
+
+  return tree_node(tree, buffer->block_hash, level, index);
+}
+
+static KIT_ATOMIC(ptrdiff_t) snapshot_next_id = 1;
+
+static ptrdiff_t value_size(
+    laplace_buffer_void_t const *const buffer) {
+#ifdef LAPLACE_BUFFER_SOA
+  return buffer->cell_size;
+#else
+  return buffer->cell_size / 2;
+#endif
+}
+
+static char *page_values(laplace_buf_page_t_ *const page) {
+  return (char *) (page + 1);
+}
+
+static int is_written(laplace_buffer_void_t const *const buffer,
+                      ptrdiff_t const                    page) {
+  return (LOAD_(&buffer->written.values[page / 64].flags, RLX_) >>
+          (page % 64)) &
+         1;
+}
+
+#ifndef LAPLACE_BUFFER_SOA
+/*  Copy values with strides. Sizes are constant in each case, so
+ *  the copies are inlined.
+ */
+static void copy_strided(char *const       dst,
+                         ptrdiff_t const   dst_stride,
+                         char const *const src,
+                         ptrdiff_t const   src_stride,
+                         ptrdiff_t const   size,
+                         ptrdiff_t const   count) {
+  switch (size) {
+    case 1:
+      for (ptrdiff_t i = 0; i < count; i++)
+        dst[i * dst_stride] = src[i * src_stride];
+      break;
+    case 2:
+      for (ptrdiff_t i = 0; i < count; i++)
+        memcpy(dst + i * dst_stride, src + i * src_stride, 2);
+      break;
+    case 4:
+      for (ptrdiff_t i = 0; i < count; i++)
+        memcpy(dst + i * dst_stride, src + i * src_stride, 4);
+      break;
+    default:
+      assert(size == 8);
+      for (ptrdiff_t i = 0; i < count; i++)
+        memcpy(dst + i * dst_stride, src + i * src_stride, 8);
+  }
+}
+#endif
+
+static laplace_buf_page_t_ *page_copy(
+    laplace_buffer_void_t const *const buffer, ptrdiff_t const page,
+    kit_allocator_t const alloc) {
+  ptrdiff_t const size  = value_size(buffer);
+  ptrdiff_t const begin = page * LAPLACE_BUFFER_PAGE_SIZE;
+  ptrdiff_t       count = buffer->data.size - begin;
+  if (count > LAPLACE_BUFFER_PAGE_SIZE)
+    count = LAPLACE_BUFFER_PAGE_SIZE;
+
+  assert(count > 0);
+
+  laplace_buf_page_t_ *const p = (laplace_buf_page_t_ *)
+      kit_alloc_dispatch(alloc, KIT_ALLOCATE,
+                         sizeof *p + LAPLACE_BUFFER_PAGE_SIZE * size,
+                         0, NULL);
+  if (p == NULL)
+    return NULL;
+
+  STORE_(&p->ref_count, 1, RLX_);
+  p->alloc = alloc;
+
+  memcpy(p->info, buffer->info.values + begin,
+         count * sizeof *p->info);
+  memset(p->info + count, 0,
+         (LAPLACE_BUFFER_PAGE_SIZE - count) * sizeof *p->info);
+
+  char *const       values = page_values(p);
+  char const *const cells  = (char const *) buffer->data.values +
+                            begin * buffer->cell_size;
+
+#ifdef LAPLACE_BUFFER_SOA
+  memcpy(values, cells, count * size);
+#else
+  copy_strided(values, size, cells + size, buffer->cell_size, size,
+               count);
+#endif
+  memset(values + count * size, 0,
+         (LAPLACE_BUFFER_PAGE_SIZE - count) * size);
+
+  return p;
+}
+
+/*  Write the page back to the cells. Deltas are zeroed.
+ */
+static void page_restore(laplace_buffer_void_t *const buffer,
+                         ptrdiff_t const              page,
+                         laplace_buf_page_t_ *const   p) {
+  ptrdiff_t const size  = value_size(buffer);
+  ptrdiff_t const begin = page * LAPLACE_BUFFER_PAGE_SIZE;
+  ptrdiff_t       count = buffer->data.size - begin;
+  if (count > LAPLACE_BUFFER_PAGE_SIZE)
+    count = LAPLACE_BUFFER_PAGE_SIZE;
+
+  assert(count > 0);
+
+  memcpy(buffer->info.values + begin, p->info,
+         count * sizeof *p->info);
+
+  char *const cells = (char *) buffer->data.values +
+                      begin * buffer->cell_size;
+
+#ifdef LAPLACE_BUFFER_SOA
+  memcpy(cells, page_values(p), count * size);
+  memset((char *) buffer->deltas.values + begin * size, 0,
+         count * size);
+#else
+  memset(cells, 0, count * buffer->cell_size);
+  copy_strided(cells + size, buffer->cell_size, page_values(p), size,
+               size, count);
+#endif
+}
+
+static void page_release(laplace_buf_page_t_ *const p) {
+  if (p != NULL && ADD_(&p->ref_count, -1, SEQ_) == 1)
+    kit_alloc_dispatch(p->alloc, KIT_DEALLOCATE, 0, 0, p);
+}
+
+static void snapshot_clear(
+    laplace_buffer_snapshot_t *const snapshot) {
+  for (ptrdiff_t i = 0; i < snapshot->pages.size; i++)
+    page_release(snapshot->pages.values[i]);
+
+  DA_RESIZE(snapshot->pages, 0);
+  DA_RESIZE(snapshot->blocks, 0);
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++)
+    DA_RESIZE(snapshot->free_lists[k], 0);
+
+  snapshot->id   = 0;
+  snapshot->size = 0;
+}
+
+/*  Copy everything except pages.
+ */
+static kit_status_t snapshot_copy_tables(
+    laplace_buffer_snapshot_t *const   snapshot,
+    laplace_buffer_void_t const *const buffer) {
+  snapshot->cell_size  = buffer->cell_size;
+  snapshot->size       = buffer->data.size;
+  snapshot->reserved   = buffer->reserved;
+  snapshot->next_block = buffer->next_block;
+  snapshot->hash       = LOAD_(&buffer->hash, RLX_);
+  snapshot->block_hash = buffer->block_hash;
+
+  if (laplace_buffer_tree_copy(&snapshot->cell_tree,
+                               &buffer->cell_tree) != KIT_OK ||
+      laplace_buffer_tree_copy(&snapshot->block_tree,
+                               &buffer->block_tree) != KIT_OK)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  DA_RESIZE(snapshot->blocks, buffer->blocks.size);
+  if (snapshot->blocks.size != buffer->blocks.size)
+    return LAPLACE_ERROR_BAD_ALLOC;
+  if (buffer->blocks.size > 0)
+    memcpy(snapshot->blocks.values, buffer->blocks.values,
+           buffer->blocks.size * sizeof *buffer->blocks.values);
+
+  memcpy(snapshot->free_marks, buffer->free_marks,
+         sizeof snapshot->free_marks);
+
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++) {
+    ptrdiff_t const n = buffer->free_lists[k].size;
+    DA_RESIZE(snapshot->free_lists[k], n);
+    if (snapshot->free_lists[k].size != n)
+      return LAPLACE_ERROR_BAD_ALLOC;
+    if (n > 0)
+      memcpy(snapshot->free_lists[k].values,
+             buffer->free_lists[k].values,
+             n * sizeof *buffer->free_lists[k].values);
+  }
+
+  return KIT_OK;
+}
+
+void laplace_buffer_snapshot_init(
+    laplace_buffer_snapshot_t *const snapshot,
+    kit_allocator_t const            alloc) {
+  assert(snapshot != NULL);
+
+  memset(snapshot, 0, sizeof *snapshot);
+
+  laplace_buffer_tree_init(&snapshot->cell_tree, alloc);
+  laplace_buffer_tree_init(&snapshot->block_tree, alloc);
+  DA_INIT(snapshot->pages, 0, alloc);
+  DA_INIT(snapshot->blocks, 0, alloc);
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++)
+    DA_INIT(snapshot->free_lists[k], 0, alloc);
+}
+
+void laplace_buffer_snapshot_destroy(
+    laplace_buffer_snapshot_t *const snapshot) {
+  assert(snapshot != NULL);
+
+  snapshot_clear(snapshot);
+
+  DA_DESTROY(snapshot->cell_tree.nodes);
+  DA_DESTROY(snapshot->block_tree.nodes);
+  DA_DESTROY(snapshot->pages);
+  DA_DESTROY(snapshot->blocks);
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++)
+    DA_DESTROY(snapshot->free_lists[k]);
+}
+
+kit_status_t laplace_buffer_snapshot_take(
+    laplace_buffer_snapshot_t *const       snapshot,
+    laplace_buffer_void_t *const           buffer,
+    laplace_buffer_snapshot_t const *const previous) {
+  assert(snapshot != NULL && buffer != NULL);
+  assert(buffer->written.size ==
+         LAPLACE_BUF_CHANGED_SIZE_(buffer->summary.size));
+
+  ptrdiff_t const count = (buffer->data.size +
+                           LAPLACE_BUFFER_PAGE_SIZE - 1) /
+                          LAPLACE_BUFFER_PAGE_SIZE;
+  ptrdiff_t const shared = previous != NULL && previous->id != 0 &&
+                                   previous->id == buffer->snapshot_id
+                               ? previous->pages.size
+                               : 0;
+  ptrdiff_t const old_count = snapshot->pages.size;
+
+  /*  Pages are replaced in place, so the previous snapshot can be
+   *  the same one.
+   */
+  if (count > old_count) {
+    DA_RESIZE(snapshot->pages, count);
+    if (snapshot->pages.size != count) {
+      snapshot_clear(snapshot);
+      return LAPLACE_ERROR_BAD_ALLOC;
+    }
+    memset(snapshot->pages.values + old_count, 0,
+           (count - old_count) * sizeof *snapshot->pages.values);
+  }
+
+  for (ptrdiff_t i = 0; i < count; i++) {
+    laplace_buf_page_t_ *const old = snapshot->pages.values[i];
+    laplace_buf_page_t_       *p;
+
+    if (i < shared && !is_written(buffer, i)) {
+      p = previous->pages.values[i];
+      ADD_(&p->ref_count, 1, RLX_);
+    } else {
+      p = page_copy(buffer, i, snapshot->pages.alloc);
+      if (p == NULL) {
+        snapshot_clear(snapshot);
+        return LAPLACE_ERROR_BAD_ALLOC;
+      }
+    }
+
+    snapshot->pages.values[i] = p;
+    page_release(old);
+  }
+
+  for (ptrdiff_t i = count; i < snapshot->pages.size; i++)
+    page_release(snapshot->pages.values[i]);
+  DA_RESIZE(snapshot->pages, count);
+
+  if (snapshot_copy_tables(snapshot, buffer) != KIT_OK) {
+    snapshot_clear(snapshot);
+    return LAPLACE_ERROR_BAD_ALLOC;
+  }
+
+  if (buffer->written.size > 0)
+    memset(buffer->written.values, 0,
+           buffer->written.size * sizeof *buffer->written.values);
+
+  snapshot->id        = ADD_(&snapshot_next_id, 1, RLX_);
+  buffer->snapshot_id = snapshot->id;
+
+  return KIT_OK;
+}
+
+kit_status_t laplace_buffer_snapshot_restore(
+    laplace_buffer_void_t *const           buffer,
+    laplace_buffer_snapshot_t const *const snapshot) {
+  assert(buffer != NULL && snapshot != NULL);
+
+  if (snapshot->id == 0)
+    return LAPLACE_ERROR_INVALID_BUFFER;
+
+  assert(snapshot->cell_size == buffer->cell_size);
+
+  /*  The buffer can only grow after it was in sync with the snapshot,
+   *  so shrinking it back does not lose written pages.
+   */
+  int const shared = buffer->snapshot_id == snapshot->id;
+
+  /*  If the restore fails, the buffer is not in sync with any
+   *  snapshot.
+   */
+  buffer->snapshot_id = 0;
+
+  if (!grow(buffer, snapshot->size))
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  for (ptrdiff_t i = 0; i < snapshot->pages.size; i++)
+    if (!shared || is_written(buffer, i))
+      page_restore(buffer, i, snapshot->pages.values[i]);
+
+  if (buffer->changed.size > 0)
+    memset(buffer->changed.values, 0,
+           buffer->changed.size * sizeof *buffer->changed.values);
+  if (buffer->summary.size > 0)
+    memset(buffer->summary.values, 0,
+           buffer->summary.size * sizeof *buffer->summary.values);
+
+  if (laplace_buffer_tree_copy(&buffer->cell_tree,
+                               &snapshot->cell_tree) != KIT_OK ||
+      laplace_buffer_tree_copy(&buffer->block_tree,
+                               &snapshot->block_tree) != KIT_OK)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  STORE_(&buffer->hash, snapshot->hash, RLX_);
+  buffer->block_hash = snapshot->block_hash;
+  buffer->reserved   = snapshot->reserved;
+  buffer->next_block = snapshot->next_block;
+
+  DA_RESIZE(buffer->blocks, snapshot->blocks.size);
+  laplace_buffer_publish(buffer);
+  if (buffer->blocks.size != snapshot->blocks.size)
+    return LAPLACE_ERROR_BAD_ALLOC;
+  if (snapshot->blocks.size > 0)
+    memcpy(buffer->blocks.values, snapshot->blocks.values,
+           snapshot->blocks.size * sizeof *snapshot->blocks.values);
+
+  memcpy(buffer->free_marks, snapshot->free_marks,
+         sizeof buffer->free_marks);
+
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++) {
+    ptrdiff_t const n = snapshot->free_lists[k].size;
+    DA_RESIZE(buffer->free_lists[k], n);
+    if (buffer->free_lists[k].size != n)
+      return LAPLACE_ERROR_BAD_ALLOC;
+    if (n > 0)
+      memcpy(buffer->free_lists[k].values,
+             snapshot->free_lists[k].values,
+             n * sizeof *snapshot->free_lists[k].values);
+  }
+
+  if (buffer->written.size > 0)
+    memset(buffer->written.values, 0,
+           buffer->written.size * sizeof *buffer->written.values);
+
+  buffer->snapshot_id = snapshot->id;
+
+  return KIT_OK;
+}
+
+enum { SAVE_ARRAY_COUNT = 6 + LAPLACE_BUFFER_SIZE_CLASS_COUNT };
+
+/*  Array of the buffer by its place in the saved layout. Deltas are
+ *  a separate array only in the structure of arrays layout.
+ */
+static da_void_t *saved_array(laplace_buffer_void_t *const buffer,
+                              ptrdiff_t const              k,
+                              ptrdiff_t *const element_size) {
+  switch (k) {
+    case 0:
+      *element_size = buffer->cell_size;
+      return (da_void_t *) &buffer->data;
+    case 1:
+#ifdef LAPLACE_BUFFER_SOA
+      *element_size = buffer->cell_size;
+      return (da_void_t *) &buffer->deltas;
+#else
+      *element_size = 0;
+      return NULL;
+#endif
+    case 2:
+      *element_size = sizeof *buffer->info.values;
+      return (da_void_t *) &buffer->info;
+    case 3:
+      *element_size = sizeof *buffer->blocks.values;
+      return (da_void_t *) &buffer->blocks;
+    case 4:
+      *element_size = sizeof *buffer->cell_tree.nodes.values;
+      return (da_void_t *) &buffer->cell_tree.nodes;
+    case 5:
+      *element_size = sizeof *buffer->block_tree.nodes.values;
+      return (da_void_t *) &buffer->block_tree.nodes;
+    default:
+      *element_size = sizeof *buffer->free_lists[0].values;
+      return (da_void_t *) &buffer->free_lists[k - 6];
+  }
+}
+
+static int64_t *saved_offset(laplace_buffer_save_t *const save,
+                             ptrdiff_t const              k) {
+  switch (k) {
+    case 0: return &save->data;
+    case 1: return &save->deltas;
+    case 2: return &save->info;
+    case 3: return &save->blocks;
+    case 4: return &save->cell_tree;
+    case 5: return &save->block_tree;
+    default: return save->free_lists + (k - 6);
+  }
+}
+
+static int64_t save_align(int64_t const offset) {
+  int64_t const align = LAPLACE_BUFFER_SAVE_ALIGN;
+  return (offset + align - 1) / align * align;
+}
+
+int64_t laplace_buffer_save_layout(
+    laplace_buffer_save_t *const       save,
+    laplace_buffer_void_t const *const buffer, int64_t offset) {
+  assert(save != NULL && buffer != NULL);
+  assert(buffer->cell_tree.size == buffer->data.size);
+  assert(buffer->block_tree.size == buffer->blocks.size);
+
+  laplace_buffer_void_t *const b = (laplace_buffer_void_t *) buffer;
+
+  memset(save, 0, sizeof *save);
+
+  save->cell_size   = buffer->cell_size;
+  save->size        = buffer->data.size;
+  save->block_count = buffer->blocks.size;
+  save->reserved    = buffer->reserved;
+  save->next_block  = buffer->next_block;
+  save->hash        = LOAD_(&buffer->hash, RLX_);
+  save->block_hash  = buffer->block_hash;
+
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++) {
+    save->free_sizes[k] = buffer->free_lists[k].size;
+    save->free_marks[k] = buffer->free_marks[k];
   }
 
-  ptrdiff_t size = 0;
-  if (laplace_buffer_check(buffer, handle, 0, 0) == KIT_OK)
-    size = LOAD_(&buffer->blocks.values[handle.id].size, ACQ_);
+  for (ptrdiff_t k = 0; k < SAVE_ARRAY_COUNT; k++) {
+    ptrdiff_t        element_size;
+    da_void_t *const array = saved_array(b, k, &element_size);
+
+    offset                = save_align(offset);
+    *saved_offset(save, k) = offset;
 
-  if (mtx_lock(&buffer->read_lock) != thrd_success) {
-    assert(0);
+    if (array != NULL)
+      offset += (int64_t) array->size * element_size;
+  }
+
+  return offset;
+}
+
+kit_status_t laplace_buffer_save_write(
+    laplace_buffer_save_t const *const save,
+    laplace_buffer_void_t const *const buffer,
+    int64_t *const position, laplace_write_fn const write,
+    void *const user_data) {
+  assert(save != NULL && buffer != NULL && position != NULL &&
+         write != NULL);
+
+  static char const zeros[LAPLACE_BUFFER_SAVE_ALIGN] = { 0 };
+
+  laplace_buffer_void_t *const b = (laplace_buffer_void_t *) buffer;
+  laplace_buffer_save_t *const s = (laplace_buffer_save_t *) save;
+
+  for (ptrdiff_t k = 0; k < SAVE_ARRAY_COUNT; k++) {
+    ptrdiff_t        element_size;
+    da_void_t *const array  = saved_array(b, k, &element_size);
+    int64_t const    offset = *saved_offset(s, k);
+
+    assert(offset >= *position &&
+           offset - *position < LAPLACE_BUFFER_SAVE_ALIGN);
+
+    if (offset > *position) {
+      kit_status_t const status = write(user_data, zeros,
+                                        offset - *position);
+      if (status != KIT_OK)
+        return status;
+      *position = offset;
+    }
+
+    if (array == NULL || array->size == 0)
+      continue;
+
+    int64_t const      size   = (int64_t) array->size * element_size;
+    kit_status_t const status = write(user_data, array->values,
+                                      size);
+    if (status != KIT_OK)
+      return status;
+    *position += size;
+  }
+
+  return KIT_OK;
+}
+
+static int in_region(laplace_buffer_region_t const *const region,
+                     void const *const                    p) {
+  return (uintptr_t) p >= (uintptr_t) region->begin &&
+         (uintptr_t) p < (uintptr_t) region->end;
+}
+
+/*  Arrays in the region are never freed. When they grow, they are
+ *  copied to memory of the base allocator.
+ */
+static void *region_allocate(int const request, void *const state,
+                             ptrdiff_t const size,
+                             ptrdiff_t const previous_size,
+                             void *const     pointer) {
+  laplace_buffer_region_t *const region = (laplace_buffer_region_t *)
+      state;
+
+  if (!in_region(region, pointer))
+    return kit_alloc_dispatch(region->base, request, size,
+                              previous_size, pointer);
+
+  switch (request) {
+    case KIT_DEALLOCATE: return NULL;
+
+    case KIT_REALLOCATE: {
+      void *const p = kit_alloc_dispatch(region->base, KIT_ALLOCATE,
+                                         size, 0, NULL);
+      if (p != NULL && previous_size > 0)
+        memcpy(p, pointer,
+               previous_size < size ? previous_size : size);
+      return p;
+    }
+
+    default:
+      return kit_alloc_dispatch(region->base, request, size,
+                                previous_size, pointer);
+  }
+}
+
+static int64_t saved_count(
+    laplace_buffer_save_t const *const save,
+    laplace_buf_tree_t_ const *const   cell_tree,
+    laplace_buf_tree_t_ const *const block_tree, ptrdiff_t const k) {
+  switch (k) {
+    case 0:
+    case 1:
+    case 2: return save->size;
+    case 3: return save->block_count;
+    case 4: return cell_tree->offsets[cell_tree->height];
+    case 5: return block_tree->offsets[block_tree->height];
+    default: return save->free_sizes[k - 6];
+  }
+}
+
+static int resize_flags(da_void_t *const array,
+                        ptrdiff_t const  element_size,
+                        ptrdiff_t const  size) {
+  da_resize(array, element_size, size);
+  if (array->size != size)
     return 0;
-  } else {
-    ptrdiff_t const count = --buffer->read_count;
-    (void) mtx_unlock(&buffer->read_lock);
-    if (count == 0)
-      (void) cnd_broadcast(&buffer->read_sync);
+  if (size > 0)
+    memset(array->values, 0, size * element_size);
+  return 1;
+}
+
+kit_status_t laplace_buffer_load(
+    laplace_buffer_void_t *const       buffer,
+    laplace_buffer_save_t const *const save,
+    laplace_buffer_region_t *const     region) {
+  assert(buffer != NULL && save != NULL && region != NULL);
+  assert(buffer->data.size == 0 && buffer->blocks.size == 0);
+
+  int64_t const region_size = region->end - region->begin;
+  int64_t const max_size    = PTRDIFF_MAX / 64;
+
+  if (save->cell_size != buffer->cell_size || save->size < 0 ||
+      save->size > max_size || save->block_count < 0 ||
+      save->block_count > max_size || save->reserved < 0 ||
+      save->next_block < 0 || save->next_block > save->block_count)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  laplace_buf_tree_t_ cell_tree, block_tree;
+  tree_layout(&cell_tree, save->size);
+  tree_layout(&block_tree, save->block_count);
+
+  laplace_buffer_save_t *const s = (laplace_buffer_save_t *) save;
+
+  for (ptrdiff_t k = 0; k < SAVE_ARRAY_COUNT; k++) {
+    ptrdiff_t        element_size;
+    da_void_t *const array  = saved_array(buffer, k, &element_size);
+    int64_t const    offset = *saved_offset(s, k);
+    int64_t const    count  = saved_count(save, &cell_tree,
+                                          &block_tree, k);
+
+    if (array == NULL)
+      continue;
+    if (count < 0 || count > max_size || offset < 0 ||
+        offset % LAPLACE_BUFFER_SAVE_ALIGN != 0 ||
+        offset > region_size ||
+        count > (region_size - offset) / element_size)
+      return LAPLACE_ERROR_INVALID_FORMAT;
   }
 
-  return size;
+  kit_allocator_t const alloc = { .state    = region,
+                                  .allocate = region_allocate };
+
+  for (ptrdiff_t k = 0; k < SAVE_ARRAY_COUNT; k++) {
+    ptrdiff_t        element_size;
+    da_void_t *const array = saved_array(buffer, k, &element_size);
+    int64_t const    count = saved_count(save, &cell_tree,
+                                         &block_tree, k);
+
+    if (array == NULL)
+      continue;
+
+    DA_DESTROY(*array);
+    array->alloc    = alloc;
+    array->values   = count > 0 ? region->begin + *saved_offset(s, k)
+                                : NULL;
+    array->size     = count;
+    array->capacity = count;
+  }
+
+  /*  Arrays retired by growth may be in the region.
+   */
+  buffer->retired.alloc = alloc;
+
+  laplace_buffer_publish(buffer);
+
+  buffer->cell_tree.size   = cell_tree.size;
+  buffer->cell_tree.height = cell_tree.height;
+  memcpy(buffer->cell_tree.offsets, cell_tree.offsets,
+         sizeof cell_tree.offsets);
+  buffer->block_tree.size   = block_tree.size;
+  buffer->block_tree.height = block_tree.height;
+  memcpy(buffer->block_tree.offsets, block_tree.offsets,
+         sizeof block_tree.offsets);
+
+  ptrdiff_t const flags = LAPLACE_BUF_CHANGED_SIZE_(save->size);
+  ptrdiff_t const words = LAPLACE_BUF_CHANGED_SIZE_(flags);
+  ptrdiff_t const pages = LAPLACE_BUF_CHANGED_SIZE_(words);
+
+  if (!resize_flags((da_void_t *) &buffer->changed,
+                    sizeof *buffer->changed.values, flags) ||
+      !resize_flags((da_void_t *) &buffer->summary,
+                    sizeof *buffer->summary.values, words) ||
+      !resize_flags((da_void_t *) &buffer->written,
+                    sizeof *buffer->written.values, pages))
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  STORE_(&buffer->hash, save->hash, RLX_);
+  STORE_(&buffer->next_chunk, 0, RLX_);
+  buffer->block_hash  = save->block_hash;
+  buffer->reserved    = save->reserved;
+  buffer->next_block  = save->next_block;
+  buffer->snapshot_id = 0;
+
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++)
+    buffer->free_marks[k] = save->free_marks[k];
+
+  return KIT_OK;
+}
+
+enum { DIFF_CHUNK_SIZE = 4096, DIFF_MERGE_GAP = 2 };
+
+/*  Output of a diff is collected in chunks, so the write function is
+ *  not called per value.
+ */
+typedef struct {
+  laplace_write_fn write;
+  void            *user_data;
+  kit_status_t     status;
+  ptrdiff_t        size;
+  unsigned char    data[DIFF_CHUNK_SIZE];
+} diff_writer_t;
+
+typedef struct {
+  unsigned char const *data;
+  ptrdiff_t            size;
+  ptrdiff_t            position;
+  int                  ok;
+} diff_reader_t;
+
+static void diff_flush(diff_writer_t *const w) {
+  if (w->status == KIT_OK && w->size > 0)
+    w->status = w->write(w->user_data, w->data, w->size);
+  w->size = 0;
+}
+
+static void write_varint(diff_writer_t *const w, uint64_t x) {
+  if (w->size + 10 > DIFF_CHUNK_SIZE)
+    diff_flush(w);
+  while (x >= 0x80) {
+    w->data[w->size++] = (unsigned char) (x | 0x80);
+    x >>= 7;
+  }
+  w->data[w->size++] = (unsigned char) x;
+}
+
+static void write_zigzag(diff_writer_t *const w, int64_t const x) {
+  write_varint(w, ((uint64_t) x << 1) ^ (uint64_t) (x >> 63));
+}
+
+static uint64_t read_varint(diff_reader_t *const r) {
+  uint64_t x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (r->position >= r->size)
+      break;
+    unsigned char const b = r->data[r->position++];
+    x |= (uint64_t) (b & 0x7f) << shift;
+    if ((b & 0x80) == 0)
+      return x;
+  }
+  r->ok = 0;
+  return 0;
+}
+
+static int64_t read_zigzag(diff_reader_t *const r) {
+  uint64_t const x = read_varint(r);
+  return (int64_t) (x >> 1) ^ -(int64_t) (x & 1);
+}
+
+/*  Read a count that should not exceed the limit.
+ */
+static ptrdiff_t read_count(diff_reader_t *const r,
+                            ptrdiff_t const      limit) {
+  uint64_t const x = read_varint(r);
+  if (x > (uint64_t) limit) {
+    r->ok = 0;
+    return 0;
+  }
+  return (ptrdiff_t) x;
+}
+
+/*  Truncate to the value size with sign extension, so deltas wrap
+ *  the same way as values.
+ */
+static int64_t wrap_value(uint64_t const x, ptrdiff_t const size) {
+  if (size >= 8)
+    return (int64_t) x;
+  int const shift = 64 - (int) size * 8;
+  return (int64_t) (x << shift) >> shift;
+}
+
+typedef struct {
+  laplace_buffer_snapshot_t const *previous;
+  laplace_buffer_snapshot_t const *snapshot;
+  ptrdiff_t                        value_size;
+} diff_t;
+
+static laplace_buf_page_t_ const *previous_page(
+    diff_t const *const d, ptrdiff_t const page) {
+  if (d->previous == NULL || page >= d->previous->pages.size)
+    return NULL;
+  return d->previous->pages.values[page];
+}
+
+static int page_shared(diff_t const *const d, ptrdiff_t const page) {
+  return previous_page(d, page) == d->snapshot->pages.values[page];
+}
+
+/*  Cells past the previous snapshot are zero.
+ */
+static int64_t diff_value(diff_t const *const              d,
+                          laplace_buf_page_t_ const *const p,
+                          ptrdiff_t const                  index) {
+  if (p == NULL)
+    return 0;
+  return (int64_t) read_value(
+      page_values((laplace_buf_page_t_ *) p) +
+          (index % LAPLACE_BUFFER_PAGE_SIZE) * d->value_size,
+      d->value_size);
+}
+
+static laplace_buf_info_t_ diff_info(
+    laplace_buf_page_t_ const *const p, ptrdiff_t const index) {
+  laplace_buf_info_t_ info = { .empty = 0, .offset = 0 };
+  if (p != NULL)
+    info = p->info[index % LAPLACE_BUFFER_PAGE_SIZE];
+  return info;
+}
+
+static int cell_differs(diff_t const *const d, int const tags,
+                        ptrdiff_t const index) {
+  ptrdiff_t const page = index / LAPLACE_BUFFER_PAGE_SIZE;
+
+  if (page_shared(d, page))
+    return 0;
+
+  laplace_buf_page_t_ const *const a = previous_page(d, page);
+  laplace_buf_page_t_ const *const b =
+      d->snapshot->pages.values[page];
+
+  if (!tags)
+    return diff_value(d, a, index) != diff_value(d, b, index);
+
+  laplace_buf_info_t_ const x = diff_info(a, index);
+  laplace_buf_info_t_ const y = diff_info(b, index);
+  return x.empty != y.empty || x.offset != y.offset;
+}
+
+static laplace_buf_block_t_ const *diff_block(
+    laplace_buffer_snapshot_t const *const snapshot,
+    ptrdiff_t const                        id) {
+  if (snapshot == NULL || id >= snapshot->blocks.size)
+    return NULL;
+  return snapshot->blocks.values + id;
+}
+
+static int block_differs(diff_t const *const d, ptrdiff_t const id) {
+  laplace_buf_block_t_ const *const a = diff_block(d->previous, id);
+  laplace_buf_block_t_ const *const b = diff_block(d->snapshot, id);
+
+  assert(b != NULL);
+
+  /*  Entries past the previous block table are cleared.
+   */
+  ptrdiff_t const index = a != NULL ? LOAD_(&a->index, RLX_)
+                                    : LAPLACE_ID_UNDEFINED;
+  ptrdiff_t const generation = a != NULL
+                                   ? LOAD_(&a->generation, RLX_)
+                                   : -1;
+  ptrdiff_t const size = a != NULL ? LOAD_(&a->size, RLX_) : 0;
+
+  return index != LOAD_(&b->index, RLX_) ||
+         generation != LOAD_(&b->generation, RLX_) ||
+         size != LOAD_(&b->size, RLX_);
+}
+
+/*  Find the next run of changed entries from the index. Runs are
+ *  merged over short gaps, since a zero delta is cheaper than a run
+ *  header. Kind is 0 for values, 1 for boundary tags and 2 for
+ *  blocks. Returns 0 if there are no more runs.
+ */
+static int next_run(diff_t const *const d, int const kind,
+                    ptrdiff_t i, ptrdiff_t *const begin,
+                    ptrdiff_t *const end) {
+  ptrdiff_t const size = kind == 2 ? d->snapshot->blocks.size
+                                   : d->snapshot->size;
+  ptrdiff_t const gap  = kind == 0 ? DIFF_MERGE_GAP : 0;
+
+  for (;;) {
+    if (i >= size)
+      return 0;
+    if (kind != 2 && page_shared(d, i / LAPLACE_BUFFER_PAGE_SIZE)) {
+      i = (i / LAPLACE_BUFFER_PAGE_SIZE + 1) *
+          LAPLACE_BUFFER_PAGE_SIZE;
+      continue;
+    }
+    if (kind == 2 ? block_differs(d, i) : cell_differs(d, kind, i))
+      break;
+    i++;
+  }
+
+  ptrdiff_t last = i;
+  *begin         = i;
+
+  for (i++; i < size && i - last <= gap + 1; i++)
+    if (kind == 2 ? block_differs(d, i) : cell_differs(d, kind, i))
+      last = i;
+
+  *end = last + 1;
+  return 1;
+}
+
+static void write_entry(diff_writer_t *const w, diff_t const *const d,
+                        int const kind, ptrdiff_t const index) {
+  if (kind == 2) {
+    laplace_buf_block_t_ const *const b =
+        d->snapshot->blocks.values + index;
+    write_zigzag(w, LOAD_(&b->index, RLX_));
+    write_zigzag(w, LOAD_(&b->generation, RLX_));
+    write_zigzag(w, LOAD_(&b->size, RLX_));
+    return;
+  }
+
+  ptrdiff_t const page = index / LAPLACE_BUFFER_PAGE_SIZE;
+  laplace_buf_page_t_ const *const b =
+      d->snapshot->pages.values[page];
+
+  if (kind == 1) {
+    laplace_buf_info_t_ const info = diff_info(b, index);
+    write_zigzag(w, info.empty);
+    write_zigzag(w, info.offset);
+    return;
+  }
+
+  uint64_t const x = (uint64_t) diff_value(d, previous_page(d, page),
+                                           index);
+  uint64_t const y = (uint64_t) diff_value(d, b, index);
+  write_zigzag(w, wrap_value(y - x, d->value_size));
+}
+
+static int free_list_differs(
+    laplace_buffer_snapshot_t const *const previous,
+    laplace_buffer_snapshot_t const *const snapshot,
+    ptrdiff_t const                        k) {
+  if (previous == NULL)
+    return snapshot->free_lists[k].size != 0 ||
+           snapshot->free_marks[k] != 0;
+
+  if (previous->free_lists[k].size != snapshot->free_lists[k].size ||
+      previous->free_marks[k] != snapshot->free_marks[k])
+    return 1;
+
+  for (ptrdiff_t i = 0; i < snapshot->free_lists[k].size; i++) {
+    laplace_buf_free_t_ const a = previous->free_lists[k].values[i];
+    laplace_buf_free_t_ const b = snapshot->free_lists[k].values[i];
+    if (a.offset != b.offset || a.size != b.size)
+      return 1;
+  }
+
+  return 0;
+}
+
+kit_status_t laplace_buffer_diff(
+    laplace_buffer_snapshot_t const *const previous,
+    laplace_buffer_snapshot_t const *const snapshot,
+    laplace_write_fn const write, void *const user_data) {
+  assert(snapshot != NULL && write != NULL);
+
+  if (snapshot->id == 0 ||
+      (previous != NULL &&
+       (previous->id == 0 ||
+        previous->cell_size != snapshot->cell_size ||
+        previous->size > snapshot->size ||
+        previous->blocks.size > snapshot->blocks.size)))
+    return LAPLACE_ERROR_INVALID_BUFFER;
+
+#ifdef LAPLACE_BUFFER_SOA
+  diff_t const d = { .previous   = previous,
+                     .snapshot   = snapshot,
+                     .value_size = snapshot->cell_size };
+#else
+  diff_t const d = { .previous   = previous,
+                     .snapshot   = snapshot,
+                     .value_size = snapshot->cell_size / 2 };
+#endif
+
+  diff_writer_t w;
+  w.write     = write;
+  w.user_data = user_data;
+  w.status    = KIT_OK;
+  w.size      = 0;
+
+  write_varint(&w, previous != NULL ? previous->hash : 0);
+  write_varint(&w, previous != NULL ? previous->block_hash : 0);
+  write_varint(&w, snapshot->hash);
+  write_varint(&w, snapshot->block_hash);
+  write_varint(&w, snapshot->size);
+  write_varint(&w, snapshot->blocks.size);
+  write_varint(&w, snapshot->reserved);
+  write_varint(&w, snapshot->next_block);
+
+  /*  Runs of values, boundary tags and blocks, each ends with an
+   *  empty run.
+   */
+  for (int kind = 0; kind < 3 && w.status == KIT_OK; kind++) {
+    ptrdiff_t i = 0, begin, end;
+
+    while (next_run(&d, kind, i, &begin, &end)) {
+      write_varint(&w, begin - i);
+      write_varint(&w, end - begin);
+      for (ptrdiff_t j = begin; j < end; j++)
+        write_entry(&w, &d, kind, j);
+      i = end;
+    }
+
+    write_varint(&w, 0);
+    write_varint(&w, 0);
+  }
+
+  /*  Changed free lists, by size class plus one, end with zero.
+   */
+  for (ptrdiff_t k = 0; k < LAPLACE_BUFFER_SIZE_CLASS_COUNT; k++) {
+    if (!free_list_differs(previous, snapshot, k))
+      continue;
+
+    write_varint(&w, k + 1);
+    write_zigzag(&w, snapshot->free_marks[k]);
+    write_varint(&w, snapshot->free_lists[k].size);
+
+    for (ptrdiff_t i = 0; i < snapshot->free_lists[k].size; i++) {
+      write_varint(&w, snapshot->free_lists[k].values[i].offset);
+      write_varint(&w, snapshot->free_lists[k].values[i].size);
+    }
+  }
+
+  write_varint(&w, 0);
+
+  diff_flush(&w);
+  return w.status;
+}
+
+static void write_value(char *const p, ptrdiff_t const size,
+                        uint64_t const x) {
+  switch (size) {
+    case 1: {
+      int8_t const y = (int8_t) x;
+      memcpy(p, &y, sizeof y);
+    } break;
+    case 2: {
+      int16_t const y = (int16_t) x;
+      memcpy(p, &y, sizeof y);
+    } break;
+    case 4: {
+      int32_t const y = (int32_t) x;
+      memcpy(p, &y, sizeof y);
+    } break;
+    default: {
+      int64_t const y = (int64_t) x;
+      assert(size == 8);
+      memcpy(p, &y, sizeof y);
+    }
+  }
+}
+
+static void apply_values(laplace_buffer_void_t *const buffer,
+                         diff_reader_t *const         r,
+                         ptrdiff_t const              begin,
+                         ptrdiff_t const              end) {
+  ptrdiff_t const size   = value_size(buffer);
+  uint64_t        sum    = 0;
+  uint64_t        weight = 0;
+  ptrdiff_t       word   = -1;
+
+  for (ptrdiff_t i = begin; i < end && r->ok; i++) {
+    if (i / 64 != word) {
+      if (word >= 0)
+        LAPLACE_BUF_HASH_ADD_(*buffer, word, sum);
+      word   = i / 64;
+      sum    = 0;
+      weight = laplace_buffer_word_weight(word);
+      LAPLACE_BUF_WRITE_(*buffer, i / LAPLACE_BUFFER_PAGE_SIZE);
+    }
+
+#ifdef LAPLACE_BUFFER_SOA
+    char *const p = (char *) buffer->data.values + i * size;
+#else
+    char *const p = (char *) buffer->data.values +
+                    i * buffer->cell_size + size;
+#endif
+
+    uint64_t const previous = read_value(p, size);
+    uint64_t const value    = (uint64_t) wrap_value(
+        previous + (uint64_t) read_zigzag(r), size);
+
+    write_value(p, size, value);
+    LAPLACE_BUF_HASH_DIFF_(sum, weight, i, previous, value);
+  }
+
+  if (word >= 0)
+    LAPLACE_BUF_HASH_ADD_(*buffer, word, sum);
+}
+
+/*  Boundary tags and blocks are checked to be within the buffer, so
+ *  a broken diff can not make later calls access memory out of it.
+ */
+static void apply_entry(laplace_buffer_void_t *const buffer,
+                        diff_reader_t *const r, int const kind,
+                        ptrdiff_t const index) {
+  ptrdiff_t const cells = buffer->data.size;
+
+  if (kind == 1) {
+    int64_t const empty  = read_zigzag(r);
+    int64_t const offset = read_zigzag(r);
+
+    if ((empty != 0 && empty != 1) || offset > cells - index ||
+        offset < -(index + 1)) {
+      r->ok = 0;
+      return;
+    }
+
+    laplace_buf_info_t_ *const info = buffer->info.values + index;
+    info->empty  = (int) empty;
+    info->offset = (ptrdiff_t) offset;
+    LAPLACE_BUF_WRITE_(*buffer, index / LAPLACE_BUFFER_PAGE_SIZE);
+    return;
+  }
+
+  int64_t const offset     = read_zigzag(r);
+  int64_t const generation = read_zigzag(r);
+  int64_t const size       = read_zigzag(r);
+
+  if (offset < LAPLACE_ID_UNDEFINED || offset > cells || size < 0 ||
+      size > cells - (offset > 0 ? offset : 0)) {
+    r->ok = 0;
+    return;
+  }
+
+  laplace_buf_block_t_ *const b = buffer->blocks.values + index;
+  uint64_t const previous       = block_hash(buffer, index);
+
+  STORE_(&b->index, (ptrdiff_t) offset, RLS_);
+  STORE_(&b->generation, (ptrdiff_t) generation, RLS_);
+  STORE_(&b->size, (ptrdiff_t) size, RLS_);
+  rehash_block(buffer, index, previous);
+}
+
+static kit_status_t apply_free_lists(
+    laplace_buffer_void_t *const buffer, diff_reader_t *const r) {
+  for (;;) {
+    ptrdiff_t const k = read_count(r,
+                                   LAPLACE_BUFFER_SIZE_CLASS_COUNT);
+    if (!r->ok)
+      return LAPLACE_ERROR_INVALID_FORMAT;
+    if (k == 0)
+      return KIT_OK;
+
+    ptrdiff_t const mark = (ptrdiff_t) read_zigzag(r);
+
+    /*  Each record takes two bytes at least.
+     */
+    ptrdiff_t const n = read_count(r, (r->size - r->position) / 2);
+    if (!r->ok)
+      return LAPLACE_ERROR_INVALID_FORMAT;
+
+    DA_RESIZE(buffer->free_lists[k - 1], n);
+    if (buffer->free_lists[k - 1].size != n)
+      return LAPLACE_ERROR_BAD_ALLOC;
+
+    laplace_buf_free_t_ *const list =
+        buffer->free_lists[k - 1].values;
+
+    for (ptrdiff_t i = 0; i < n; i++) {
+      laplace_buf_free_t_ *const f = list + i;
+      f->offset = read_count(r, buffer->data.size - 1);
+      f->size   = read_count(r, buffer->data.size - f->offset);
+    }
+
+    /*  Free runs are within the buffer, so the head of a run is
+     *  below the cell count.
+     */
+    if (!r->ok || (n > 0 && buffer->data.size == 0))
+      return LAPLACE_ERROR_INVALID_FORMAT;
+
+    buffer->free_marks[k - 1] = mark;
+  }
+}
+
+kit_status_t laplace_buffer_diff_apply(
+    laplace_buffer_void_t *const buffer, void const *const data,
+    ptrdiff_t const size, ptrdiff_t *const position) {
+  assert(buffer != NULL && position != NULL);
+  assert(data != NULL || size == 0);
+
+  ptrdiff_t const max_size = PTRDIFF_MAX / 64;
+
+  diff_reader_t r = { .data     = (unsigned char const *) data,
+                      .size     = size,
+                      .position = *position,
+                      .ok       = 1 };
+
+  uint64_t const  previous_hash       = read_varint(&r);
+  uint64_t const  previous_block_hash = read_varint(&r);
+  uint64_t const  hash                = read_varint(&r);
+  uint64_t const  block_hash          = read_varint(&r);
+  ptrdiff_t const cells               = read_count(&r, max_size);
+  ptrdiff_t const blocks              = read_count(&r, max_size);
+  ptrdiff_t const reserved            = read_count(&r, max_size);
+  ptrdiff_t const next_block          = read_count(&r, blocks);
+
+  if (!r.ok || previous_hash != LOAD_(&buffer->hash, RLX_) ||
+      previous_block_hash != buffer->block_hash ||
+      cells < buffer->data.size || blocks < buffer->blocks.size)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  if (cells > buffer->data.size && !grow(buffer, cells))
+    return LAPLACE_ERROR_BAD_ALLOC;
+  if (blocks > buffer->blocks.size &&
+      grow_blocks(buffer, blocks) != KIT_OK)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  for (int kind = 0; kind < 3; kind++) {
+    ptrdiff_t const limit = kind == 2 ? blocks : cells;
+    ptrdiff_t       i     = 0;
+
+    for (;;) {
+      ptrdiff_t const skip   = read_count(&r, limit - i);
+      ptrdiff_t const length = read_count(&r, limit - i - skip);
+
+      if (!r.ok)
+        return LAPLACE_ERROR_INVALID_FORMAT;
+      if (length == 0)
+        break;
+
+      i += skip;
+
+      if (kind == 0)
+        apply_values(buffer, &r, i, i + length);
+      else
+        for (ptrdiff_t j = i; j < i + length && r.ok; j++)
+          apply_entry(buffer, &r, kind, j);
+
+      i += length;
+    }
+  }
+
+  kit_status_t const s = apply_free_lists(buffer, &r);
+  if (s != KIT_OK)
+    return s;
+
+  buffer->reserved   = reserved;
+  buffer->next_block = next_block;
+
+  if (!r.ok || LOAD_(&buffer->hash, RLX_) != hash ||
+      buffer->block_hash != block_hash)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  *position = r.position;
+  return KIT_OK;
 }
@@ -4,9 +4,8 @@
 #include "handle.h"
 
 #include <kit/atomic.h>
-#include <kit/condition_variable.h>
 #include <kit/dynamic_array.h>
-#include <kit/mutex.h>
+#include <kit/thread.h>
 
 #include <assert.h>
 #include <string.h>
@@ -15,11 +14,28 @@
 extern "C" {
 #endif
 
-/*  TODO
- *  - Implement lock-free data allocation.
- */
+enum {
+  LAPLACE_BUFFER_DEFAULT_CHUNK_SIZE = 64,
+  LAPLACE_BUFFER_CHUNKS_PER_THREAD  = 8,
+  LAPLACE_BUFFER_SIZE_CLASS_COUNT   = 64,
+  LAPLACE_BUFFER_FREE_MARK_MIN      = 16,
+  LAPLACE_BUFFER_TREE_FANOUT        = 64,
+  LAPLACE_BUFFER_TREE_MAX_HEIGHT    = 12,
+  LAPLACE_BUFFER_PAGE_SIZE          = 4096,
+  LAPLACE_BUFFER_SAVE_ALIGN         = 64,
+  LAPLACE_BUFFER_READER_COUNT       = 32,
+  LAPLACE_BUFFER_CACHE_LINE         = 64
+};
 
-enum { LAPLACE_BUFFER_DEFAULT_CHUNK_SIZE = 400 };
+/*  Delta application kernels. Auto selects the best kernel
+ *  supported by the CPU.
+ */
+enum {
+  LAPLACE_BUFFER_KERNEL_AUTO = 0,
+  LAPLACE_BUFFER_KERNEL_SCALAR,
+  LAPLACE_BUFFER_KERNEL_SSE2,
+  LAPLACE_BUFFER_KERNEL_AVX2
+};
 
 /*  FIXME
  *  Are atomics essential here?
@@ -30,81 +46,292 @@ typedef struct {
   KIT_ATOMIC(ptrdiff_t) size;
 } laplace_buf_block_t_;
 
+/*  Boundary tags.
+ *
+ *  Only the first and the last cell of each run, free or allocated,
+ *  hold valid info. The first cell stores the size of the run, the
+ *  last cell stores the negative size of the run. Single-cell runs
+ *  store the positive size. Interior cells are zero.
+ */
 typedef struct {
   int       empty;
   ptrdiff_t offset;
 } laplace_buf_info_t_;
 
+/*  Free run record in a size class list.
+ *
+ *  Records are not removed when the run is merged or split, so a
+ *  record is valid only if the boundary tags still match it.
+ */
 typedef struct {
-  KIT_ATOMIC(int8_t) flag;
+  ptrdiff_t offset;
+  ptrdiff_t size;
+} laplace_buf_free_t_;
+
+/*  Changed flags, one bit per cell. The summary has one bit per
+ *  flag word, so the adjust pass can skip clean regions.
+ */
+typedef struct {
+  KIT_ATOMIC(uint64_t) flags;
 } laplace_buf_changed_t_;
 
-#define LAPLACE_BUFFER_DATA                 \
-  struct {                                  \
-    ptrdiff_t cell_size;                    \
-    ptrdiff_t chunk_size;                   \
-    ptrdiff_t reserved;                     \
-    ptrdiff_t next_block;                   \
-    mtx_t     read_lock;                    \
-    cnd_t     read_sync;                    \
-    ptrdiff_t read_count;                   \
-    KIT_ATOMIC(ptrdiff_t) next_chunk;       \
-    KIT_DA(laplace_buf_changed_t_) changed; \
-    KIT_DA(laplace_buf_info_t_) info;       \
-    KIT_DA(laplace_buf_block_t_) blocks;    \
-  }
+typedef struct {
+  KIT_ATOMIC(uint64_t) hash;
+} laplace_buf_hash_t_;
+
+/*  Hash tree over a row of leaves.
+ *
+ *  Each node is the sum of its 64 children. Level 0 are the leaves,
+ *  they are computed on demand. The root is at the top level and is
+ *  kept by the owner of the tree. Levels in between are stored in
+ *  one array, and the offsets array holds the start of each level
+ *  and the end of the last one.
+ */
+typedef struct {
+  ptrdiff_t size;
+  ptrdiff_t height;
+  ptrdiff_t offsets[LAPLACE_BUFFER_TREE_MAX_HEIGHT + 1];
+  KIT_DA(laplace_buf_hash_t_) nodes;
+} laplace_buf_tree_t_;
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define LAPLACE_BUF_CTZ_(x_) __builtin_ctzll(x_)
+#else
+#  define LAPLACE_BUF_CTZ_(x_) laplace_buffer_ctz(x_)
+#endif
+
+#define LAPLACE_BUF_CHANGED_SIZE_(size_) (((size_) + 63) / 64)
+
+#define LAPLACE_BUF_MARK_(buf_, i_)                                  \
+  do {                                                               \
+    ptrdiff_t const word_ = (i_) / 64;                               \
+    if (atomic_fetch_or_explicit(                                    \
+            &(buf_).changed.values[word_].flags,                     \
+            (uint64_t) 1 << ((i_) % 64), memory_order_relaxed) == 0) \
+      atomic_fetch_or_explicit(                                      \
+          &(buf_).summary.values[word_ / 64].flags,                  \
+          (uint64_t) 1 << (word_ % 64), memory_order_relaxed);       \
+  } while (0)
+
+#define LAPLACE_BUF_UNMARK_(buf_, i_)                                \
+  atomic_fetch_and_explicit(&(buf_).changed.values[(i_) / 64].flags, \
+                            ~((uint64_t) 1 << ((i_) % 64)),          \
+                            memory_order_relaxed)
+
+#define LAPLACE_BUF_MARKED_(buf_, i_)                             \
+  ((atomic_load_explicit(&(buf_).changed.values[(i_) / 64].flags, \
+                         memory_order_relaxed) >>                 \
+    ((i_) % 64)) &                                                \
+   1)
+
+/*  Written flags, one bit per page. A page is as big as a summary
+ *  word covers, so the adjust pass marks pages per summary word.
+ */
+#define LAPLACE_BUF_WRITE_(buf_, page_)           \
+  atomic_fetch_or_explicit(                       \
+      &(buf_).written.values[(page_) / 64].flags, \
+      (uint64_t) 1 << ((page_) % 64), memory_order_relaxed)
 
-#define LAPLACE_BUFFER_CELL(element_type_) \
-  struct {                                 \
-    KIT_ATOMIC(element_type_) delta;       \
-    KIT_ATOMIC(element_type_) value;       \
+#define LAPLACE_BUF_MIX_(z_)                 \
+  do {                                       \
+    (z_) = ((z_) ^ ((z_) >> 30)) *           \
+           (uint64_t) 0xbf58476d1ce4e5b9ull; \
+    (z_) = ((z_) ^ ((z_) >> 27)) *           \
+           (uint64_t) 0x94d049bb133111ebull; \
+    (z_) ^= (z_) >> 31;                      \
+  } while (0)
+
+/*  Cell hash is the value times the odd weight of the cell offset,
+ *  and the hash of a range is the sum of its cell hashes. So a
+ *  change of a value adds the weighted difference, and the hash
+ *  does not depend on the order of changes.
+ *
+ *  Cell weight is the weight of its flag word plus the weight of its
+ *  lane, so it is computed once per flag word.
+ */
+#define LAPLACE_BUF_HASH_DIFF_(sum_, weight_, i_, previous_, value_) \
+  do {                                                               \
+    (sum_) += ((weight_) + laplace_buf_lanes_[(i_) % 64]) *          \
+              ((uint64_t) (int64_t) (value_) -                       \
+               (uint64_t) (int64_t) (previous_));                    \
+  } while (0)
+
+#define LAPLACE_BUF_HASH_ADD_(buf_, word_, sum_)             \
+  do {                                                       \
+    if ((sum_) != 0) {                                       \
+      laplace_buffer_tree_add(&(buf_).cell_tree, 1, (word_), \
+                              (sum_));                       \
+      atomic_fetch_add_explicit(&(buf_).hash, (sum_),        \
+                                memory_order_relaxed);       \
+    }                                                        \
+  } while (0)
+
+/*  Store the cell value and update the hashes. The value should be
+ *  of the element type.
+ */
+#define LAPLACE_BUF_STORE_(buf_, i_, value_)                        \
+  do {                                                              \
+    uint64_t sum_ = 0;                                              \
+    LAPLACE_BUF_HASH_DIFF_(                                         \
+        sum_, laplace_buffer_word_weight((i_) / 64), (i_),          \
+        atomic_exchange_explicit(&LAPLACE_BUF_VALUE_((buf_), (i_)), \
+                                 (value_), memory_order_relaxed),   \
+        (value_));                                                  \
+    LAPLACE_BUF_HASH_ADD_((buf_), (i_) / 64, sum_);                 \
+    LAPLACE_BUF_WRITE_((buf_), (i_) / LAPLACE_BUFFER_PAGE_SIZE);    \
+  } while (0)
+
+/*  Array replaced by growth. It may still be in use by readers that
+ *  entered in the epoch of retirement.
+ */
+typedef struct {
+  ptrdiff_t epoch;
+  void     *values;
+} laplace_buf_retired_t_;
+
+/*  Reader slot holds the epoch the reader entered in plus one, or
+ *  zero if it is free. Each slot has its own cache line.
+ */
+typedef struct {
+  KIT_ATOMIC(ptrdiff_t) epoch;
+  char padding[LAPLACE_BUFFER_CACHE_LINE - sizeof(ptrdiff_t)];
+} laplace_buf_reader_t_;
+
+/*  Arrays published for thread safe reads. Pointers are published
+ *  before sizes and read after them, so a size is never larger than
+ *  the array read with it.
+ */
+typedef struct {
+  KIT_ATOMIC(intptr_t) data;
+  KIT_ATOMIC(intptr_t) blocks;
+  KIT_ATOMIC(ptrdiff_t) data_size;
+  KIT_ATOMIC(ptrdiff_t) blocks_size;
+} laplace_buf_view_t_;
+
+#define LAPLACE_BUFFER_DATA                                \
+  struct {                                                 \
+    ptrdiff_t cell_size;                                   \
+    ptrdiff_t chunk_size;                                  \
+    ptrdiff_t reserved;                                    \
+    ptrdiff_t next_block;                                  \
+    KIT_ATOMIC(ptrdiff_t) read_epoch;                      \
+    laplace_buf_reader_t_                                  \
+    readers[LAPLACE_BUFFER_READER_COUNT];                  \
+    laplace_buf_view_t_ view;                              \
+    KIT_DA(laplace_buf_retired_t_) retired;                \
+    KIT_ATOMIC(ptrdiff_t) next_chunk;                      \
+    KIT_DA(laplace_buf_changed_t_) changed;                \
+    KIT_DA(laplace_buf_changed_t_) summary;                \
+    KIT_DA(laplace_buf_changed_t_) written;                \
+    ptrdiff_t snapshot_id;                                 \
+    KIT_ATOMIC(uint64_t) hash;                             \
+    uint64_t            block_hash;                        \
+    laplace_buf_tree_t_ cell_tree;                         \
+    laplace_buf_tree_t_ block_tree;                        \
+    KIT_DA(laplace_buf_info_t_) info;                      \
+    KIT_DA(laplace_buf_block_t_) blocks;                   \
+    KIT_DA(laplace_buf_free_t_)                            \
+    free_lists[LAPLACE_BUFFER_SIZE_CLASS_COUNT];           \
+    ptrdiff_t free_marks[LAPLACE_BUFFER_SIZE_CLASS_COUNT]; \
   }
 
+#ifdef LAPLACE_BUFFER_SOA
+/*  Structure of arrays layout. Values and deltas are stored in
+ *  separate arrays, so reads don't pull deltas into the cache.
+ */
 typedef struct {
   LAPLACE_BUFFER_DATA;
   KIT_DA(void) data;
+  KIT_DA(void) deltas;
 } laplace_buffer_void_t;
 
-#define LAPLACE_BUFFER_TYPE(element_type_)           \
-  struct {                                           \
-    LAPLACE_BUFFER_DATA;                             \
-    KIT_DA(LAPLACE_BUFFER_CELL(element_type_)) data; \
-  }
+#  define LAPLACE_BUFFER_TYPE(element_type_)    \
+    struct {                                    \
+      LAPLACE_BUFFER_DATA;                      \
+      KIT_DA(KIT_ATOMIC(element_type_)) data;   \
+      KIT_DA(KIT_ATOMIC(element_type_)) deltas; \
+    }
 
-#define LAPLACE_BUFFER_INIT(status_, buf_, alloc_)                \
-  do {                                                            \
-    (status_) = KIT_OK;                                           \
-    memset(&(buf_), 0, sizeof(buf_));                             \
-    (buf_).cell_size  = sizeof *(buf_).data.values;               \
-    (buf_).chunk_size = LAPLACE_BUFFER_DEFAULT_CHUNK_SIZE;        \
-    if (mtx_init(&(buf_).read_lock, mtx_plain) != thrd_success) { \
-      (status_) = LAPLACE_ERROR_BAD_MUTEX_INIT;                   \
-    } else if (cnd_init(&(buf_).read_sync) != thrd_success) {     \
-      (void) mtx_destroy(&(buf_).read_lock);                      \
-      (status_) = LAPLACE_ERROR_BAD_CNDVAR_INIT;                  \
-    } else {                                                      \
-      (buf_).read_count = 0;                                      \
-      KIT_DA_INIT((buf_).changed, 0, (alloc_));                   \
-      KIT_DA_INIT((buf_).info, 0, (alloc_));                      \
-      KIT_DA_INIT((buf_).blocks, 0, (alloc_));                    \
-      KIT_DA_INIT((buf_).data, 0, (alloc_));                      \
-    }                                                             \
+#  define LAPLACE_BUF_VALUE_(buf_, i_) (buf_).data.values[i_]
+#  define LAPLACE_BUF_DELTA_(buf_, i_) (buf_).deltas.values[i_]
+
+#  define LAPLACE_BUF_DELTAS_INIT_(buf_, alloc_) \
+    KIT_DA_INIT((buf_).deltas, 0, (alloc_))
+#  define LAPLACE_BUF_DELTAS_DESTROY_(buf_) \
+    KIT_DA_DESTROY((buf_).deltas)
+#  define LAPLACE_BUF_DELTAS_RESIZE_(buf_, size_) \
+    KIT_DA_RESIZE((buf_).deltas, (size_))
+#  define LAPLACE_BUF_DELTAS_SIZE_(buf_) (buf_).deltas.size
+#else
+#  define LAPLACE_BUFFER_CELL(element_type_) \
+    struct {                                 \
+      KIT_ATOMIC(element_type_) delta;       \
+      KIT_ATOMIC(element_type_) value;       \
+    }
+
+typedef struct {
+  LAPLACE_BUFFER_DATA;
+  KIT_DA(void) data;
+} laplace_buffer_void_t;
+
+#  define LAPLACE_BUFFER_TYPE(element_type_)           \
+    struct {                                           \
+      LAPLACE_BUFFER_DATA;                             \
+      KIT_DA(LAPLACE_BUFFER_CELL(element_type_)) data; \
+    }
+
+#  define LAPLACE_BUF_VALUE_(buf_, i_) (buf_).data.values[i_].value
+#  define LAPLACE_BUF_DELTA_(buf_, i_) (buf_).data.values[i_].delta
+
+#  define LAPLACE_BUF_DELTAS_INIT_(buf_, alloc_)
+#  define LAPLACE_BUF_DELTAS_DESTROY_(buf_)
+#  define LAPLACE_BUF_DELTAS_RESIZE_(buf_, size_)
+#  define LAPLACE_BUF_DELTAS_SIZE_(buf_) (buf_).data.size
+#endif
+
+#define LAPLACE_BUFFER_INIT(status_, buf_, alloc_)               \
+  do {                                                           \
+    (status_) = KIT_OK;                                          \
+    memset(&(buf_), 0, sizeof(buf_));                            \
+    (buf_).cell_size  = sizeof *(buf_).data.values;              \
+    (buf_).chunk_size = LAPLACE_BUFFER_DEFAULT_CHUNK_SIZE;       \
+    KIT_DA_INIT((buf_).retired, 0, (alloc_));                    \
+    KIT_DA_INIT((buf_).changed, 0, (alloc_));                    \
+    KIT_DA_INIT((buf_).summary, 0, (alloc_));                    \
+    KIT_DA_INIT((buf_).written, 0, (alloc_));                    \
+    laplace_buffer_tree_init(&(buf_).cell_tree, (alloc_));       \
+    laplace_buffer_tree_init(&(buf_).block_tree, (alloc_));      \
+    KIT_DA_INIT((buf_).info, 0, (alloc_));                       \
+    KIT_DA_INIT((buf_).blocks, 0, (alloc_));                     \
+    KIT_DA_INIT((buf_).data, 0, (alloc_));                       \
+    LAPLACE_BUF_DELTAS_INIT_((buf_), (alloc_));                  \
+    for (ptrdiff_t k_ = 0; k_ < LAPLACE_BUFFER_SIZE_CLASS_COUNT; \
+         k_++)                                                   \
+      KIT_DA_INIT((buf_).free_lists[k_], 0, (alloc_));           \
   } while (0)
 
 #define LAPLACE_BUFFER_DESTROY(buffer_)                              \
   do {                                                               \
-    if (mtx_lock(&(buffer_).read_lock) == thrd_success) {            \
-      while ((buffer_).read_count != 0 &&                            \
-             cnd_wait(&(buffer_).read_sync, &(buffer_).read_lock) == \
-                 thrd_success) { }                                   \
-      (void) mtx_unlock(&(buffer_).read_lock);                       \
-    }                                                                \
-    mtx_destroy(&(buffer_).read_lock);                               \
-    cnd_destroy(&(buffer_).read_sync);                               \
+    for (ptrdiff_t k_ = 0; k_ < LAPLACE_BUFFER_READER_COUNT; k_++)   \
+      while (atomic_load_explicit(&(buffer_).readers[k_].epoch,      \
+                                  memory_order_acquire) != 0)        \
+        thrd_yield();                                                \
+    for (ptrdiff_t i_ = 0; i_ < (buffer_).retired.size; i_++)        \
+      kit_alloc_dispatch((buffer_).retired.alloc, KIT_DEALLOCATE, 0, \
+                         0, (buffer_).retired.values[i_].values);    \
+    KIT_DA_DESTROY((buffer_).retired);                               \
     KIT_DA_DESTROY((buffer_).changed);                               \
+    KIT_DA_DESTROY((buffer_).summary);                               \
+    KIT_DA_DESTROY((buffer_).written);                               \
+    KIT_DA_DESTROY((buffer_).cell_tree.nodes);                       \
+    KIT_DA_DESTROY((buffer_).block_tree.nodes);                      \
     KIT_DA_DESTROY((buffer_).info);                                  \
     KIT_DA_DESTROY((buffer_).blocks);                                \
     KIT_DA_DESTROY((buffer_).data);                                  \
+    LAPLACE_BUF_DELTAS_DESTROY_(buffer_);                            \
+    for (ptrdiff_t k_ = 0; k_ < LAPLACE_BUFFER_SIZE_CLASS_COUNT;     \
+         k_++)                                                       \
+      KIT_DA_DESTROY((buffer_).free_lists[k_]);                      \
   } while (0)
 
 kit_status_t laplace_buffer_set_chunk_size(
@@ -141,6 +368,275 @@ kit_status_t laplace_buffer_check(laplace_buffer_void_t const *buffer,
 ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
                               laplace_handle_t       handle);
 
+/*  Enter and leave a read section. Arrays published when the section
+ *  begins are not freed until it ends. Returns the reader slot.
+ *
+ *  At most LAPLACE_BUFFER_READER_COUNT sections can be open at once.
+ *  Other readers yield until a slot is free.
+ */
+ptrdiff_t laplace_buffer_read_begin(laplace_buffer_void_t *buffer);
+
+void laplace_buffer_read_end(laplace_buffer_void_t *buffer,
+                             ptrdiff_t              slot);
+
+/*  Publish the arrays for thread safe reads. Called after the arrays
+ *  are moved or resized.
+ */
+void laplace_buffer_publish(laplace_buffer_void_t *buffer);
+
+/*  Read values into an array of the value type. Bounds are checked
+ *  against the published arrays, so it can run concurrently with
+ *  allocation.
+ */
+kit_status_t laplace_buffer_read(laplace_buffer_void_t *buffer,
+                                 laplace_handle_t       handle,
+                                 ptrdiff_t index, ptrdiff_t size,
+                                 void *destination);
+
+int laplace_buffer_ctz(uint64_t x);
+
+ptrdiff_t laplace_buffer_adjust_chunk_size(
+    laplace_buffer_void_t const *buffer, ptrdiff_t thread_count);
+
+kit_status_t laplace_buffer_set_kernel(int kernel);
+
+int laplace_buffer_kernel(void);
+
+/*  Apply deltas to a run of whole flag words. Returns the hash
+ *  difference of the run.
+ */
+uint64_t laplace_buffer_apply_deltas(laplace_buffer_void_t *buffer,
+                                     ptrdiff_t element_size,
+                                     ptrdiff_t offset,
+                                     ptrdiff_t size);
+
+/*  Odd lane weights of the cell hash, listed once for the weight
+ *  table and the vector kernels.
+ */
+#define LAPLACE_BUF_LANES_(X_)                        \
+  X_(0x6db6ca64564daeabull) X_(0x6f8aaeac2856bddbull) \
+  X_(0x95aa7361b00ce2d5ull) X_(0x6527fdf3ebeec2d3ull) \
+  X_(0x4dd4ec063092a71bull) X_(0x05c3b502db824e19ull) \
+  X_(0x22c4ca229d65ea67ull) X_(0xd6ff3b141669712dull) \
+  X_(0x8f36c6edc8561999ull) X_(0x9be2184be3cd50dfull) \
+  X_(0xba1963d27a3e7a0full) X_(0x495dfcb20f9b4f89ull) \
+  X_(0x7fb619217c28120dull) X_(0x697d2e05af9cc0c5ull) \
+  X_(0x388c70692aab1ef9ull) X_(0xb9ce6d1d8451a877ull) \
+  X_(0xa6504bd486e8fcb7ull) X_(0xb2b6339941b413f1ull) \
+  X_(0x97e98eabf44f0fdfull) X_(0x32f92204fed5045dull) \
+  X_(0x0ed4162680b659e7ull) X_(0xdf1f0939cf800563ull) \
+  X_(0x8cb41804d6f293afull) X_(0x7b5b05389061b179ull) \
+  X_(0x964d94b2b84fcff5ull) X_(0xb11c3ce01e5ddcc3ull) \
+  X_(0x3ec9a28b86aae299ull) X_(0x120b05ef1b819ee5ull) \
+  X_(0x90f1f218a42235f3ull) X_(0xa72d409a19b9898bull) \
+  X_(0xc30dfec6ea2f60c7ull) X_(0xf3b6fbd0de1f6623ull) \
+  X_(0xe5411ccafbde3389ull) X_(0x2cf9dd8444be876full) \
+  X_(0x1ce4c3c0bfa1a3c1ull) X_(0xb3d5b87651437697ull) \
+  X_(0x9ea301ae4bc173bbull) X_(0x542ca3677c2beacfull) \
+  X_(0x9217e35900480d23ull) X_(0x70e2f695d6dc8379ull) \
+  X_(0xde8b0774fafe05adull) X_(0x7902863cee8462afull) \
+  X_(0x1411cf34ef42e1d1ull) X_(0x674956cdf8d7a1abull) \
+  X_(0x6ab74e8f71f129ddull) X_(0x8bc08e953ec5c0e1ull) \
+  X_(0x7bf4cc349f974a17ull) X_(0x20c7c9fa4e21ebebull) \
+  X_(0x5e82a4585b206699ull) X_(0x89cd74153da4c475ull) \
+  X_(0x246a07de8ecef4bdull) X_(0x9e65d188de50d46bull) \
+  X_(0x9f09d2eb5ab6bb5bull) X_(0xd546a17471e79b7dull) \
+  X_(0xe85474e6e23a6fc7ull) X_(0xb67d9a4bcf271cd1ull) \
+  X_(0xf9a57d2013f0a3bbull) X_(0x3e915407a0e21f93ull) \
+  X_(0x44891153af56a40dull) X_(0xa1d8b6ef8f34fbefull) \
+  X_(0x0b4377ac19811a4dull) X_(0xfde958186f8f55e5ull) \
+  X_(0x39f56fcb3fc1582bull) X_(0x0dab4eefafe246c3ull)
+
+extern uint64_t const laplace_buf_lanes_[64];
+
+uint64_t laplace_buffer_word_weight(ptrdiff_t word);
+
+void laplace_buffer_tree_init(laplace_buf_tree_t_ *tree,
+                              kit_allocator_t      alloc);
+
+/*  Resize the tree to the leaf count. Stored nodes of the first
+ *  level are kept, new ones are zero, upper levels are recomputed.
+ */
+kit_status_t laplace_buffer_tree_resize(laplace_buf_tree_t_ *tree,
+                                        ptrdiff_t            size);
+
+kit_status_t laplace_buffer_tree_copy(
+    laplace_buf_tree_t_ *dst, laplace_buf_tree_t_ const *src);
+
+/*  Add to a stored node and its stored ancestors. Thread-safe.
+ */
+void laplace_buffer_tree_add(laplace_buf_tree_t_ *tree,
+                             ptrdiff_t level, ptrdiff_t index,
+                             uint64_t diff);
+
+/*  Node count at the level. Levels from the top up have one node.
+ */
+ptrdiff_t laplace_buffer_tree_level_size(
+    laplace_buf_tree_t_ const *tree, ptrdiff_t level);
+
+/*  Hash of a cell tree node. Nodes at the top level and above with
+ *  zero index are the root, nodes out of range are zero.
+ */
+uint64_t laplace_buffer_cell_hash(laplace_buffer_void_t const *buffer,
+                                  ptrdiff_t level, ptrdiff_t index);
+
+/*  Hash of a block table tree node, same as for cells.
+ */
+uint64_t laplace_buffer_block_hash(
+    laplace_buffer_void_t const *buffer, ptrdiff_t level,
+    ptrdiff_t index);
+
+/*  Snapshot page. Holds the values and the boundary tags of a page
+ *  of cells, values follow the header. Cells past the buffer size
+ *  are zero.
+ */
+typedef struct {
+  KIT_ATOMIC(ptrdiff_t) ref_count;
+  kit_allocator_t       alloc;
+  laplace_buf_info_t_   info[LAPLACE_BUFFER_PAGE_SIZE];
+} laplace_buf_page_t_;
+
+/*  Buffer snapshot with pages shared between snapshots.
+ *
+ *  A snapshot taken after another one shares the pages that were not
+ *  written since, so it costs only the pages that changed. Block
+ *  table, free lists and hash trees are copied.
+ */
+typedef struct {
+  ptrdiff_t           id;
+  ptrdiff_t           cell_size;
+  ptrdiff_t           size;
+  ptrdiff_t           reserved;
+  ptrdiff_t           next_block;
+  uint64_t            hash;
+  uint64_t            block_hash;
+  laplace_buf_tree_t_ cell_tree;
+  laplace_buf_tree_t_ block_tree;
+  KIT_DA(laplace_buf_page_t_ *) pages;
+  KIT_DA(laplace_buf_block_t_) blocks;
+  KIT_DA(laplace_buf_free_t_)
+  free_lists[LAPLACE_BUFFER_SIZE_CLASS_COUNT];
+  ptrdiff_t free_marks[LAPLACE_BUFFER_SIZE_CLASS_COUNT];
+} laplace_buffer_snapshot_t;
+
+void laplace_buffer_snapshot_init(laplace_buffer_snapshot_t *snapshot,
+                                  kit_allocator_t            alloc);
+
+void laplace_buffer_snapshot_destroy(
+    laplace_buffer_snapshot_t *snapshot);
+
+/*  Take a snapshot of the buffer. Previous content of the snapshot is
+ *  released. Pages are shared with the previous snapshot if it is the
+ *  latest one taken or restored for the buffer, otherwise all pages
+ *  are copied. Previous snapshot can be the same as the snapshot, or
+ *  NULL.
+ *
+ *  On failure the snapshot is empty. Can take only after join and
+ *  before schedule.
+ */
+kit_status_t laplace_buffer_snapshot_take(
+    laplace_buffer_snapshot_t       *snapshot,
+    laplace_buffer_void_t           *buffer,
+    laplace_buffer_snapshot_t const *previous);
+
+/*  Restore the buffer from a snapshot. If the snapshot is the latest
+ *  one taken or restored for the buffer, only the pages written since
+ *  are copied.
+ */
+kit_status_t laplace_buffer_snapshot_restore(
+    laplace_buffer_void_t           *buffer,
+    laplace_buffer_snapshot_t const *snapshot);
+
+/*  Saved buffer header.
+ *
+ *  Arrays are stored as they are in memory, so a loaded buffer can
+ *  use them in place. Offsets are from the beginning of the saved
+ *  data and aligned to LAPLACE_BUFFER_SAVE_ALIGN bytes. Changed
+ *  flags are not stored, since a buffer is saved after join.
+ */
+typedef struct {
+  int64_t  cell_size;
+  int64_t  size;
+  int64_t  block_count;
+  int64_t  reserved;
+  int64_t  next_block;
+  uint64_t hash;
+  uint64_t block_hash;
+  int64_t  data;
+  int64_t  deltas;
+  int64_t  info;
+  int64_t  blocks;
+  int64_t  cell_tree;
+  int64_t  block_tree;
+  int64_t  free_lists[LAPLACE_BUFFER_SIZE_CLASS_COUNT];
+  int64_t  free_sizes[LAPLACE_BUFFER_SIZE_CLASS_COUNT];
+  int64_t  free_marks[LAPLACE_BUFFER_SIZE_CLASS_COUNT];
+} laplace_buffer_save_t;
+
+/*  Memory that arrays of a loaded buffer point into. The region
+ *  allocator does not free memory in the region, and moves arrays
+ *  out of it when they grow. Other requests go to the base
+ *  allocator.
+ */
+typedef struct {
+  kit_allocator_t base;
+  char           *begin;
+  char           *end;
+} laplace_buffer_region_t;
+
+/*  Place arrays of the buffer from the offset and fill the header.
+ *  Returns the end of the last array.
+ */
+int64_t laplace_buffer_save_layout(
+    laplace_buffer_save_t *save, laplace_buffer_void_t const *buffer,
+    int64_t offset);
+
+/*  Write arrays of the buffer with padding between them. Position is
+ *  the count of bytes written before, it is updated. Can save only
+ *  after join and before schedule.
+ */
+kit_status_t laplace_buffer_save_write(
+    laplace_buffer_save_t const *save,
+    laplace_buffer_void_t const *buffer, int64_t *position,
+    laplace_write_fn write, void *user_data);
+
+/*  Load an empty buffer from saved data in the region. Arrays point
+ *  into the region, so it should be writable and stay valid while
+ *  the buffer is in use. The region should be aligned to 8 bytes.
+ *
+ *  Offsets and sizes are checked, contents of the arrays are not.
+ */
+kit_status_t laplace_buffer_load(laplace_buffer_void_t       *buffer,
+                                 laplace_buffer_save_t const *save,
+                                 laplace_buffer_region_t     *region);
+
+/*  Write the difference between two snapshots of a buffer. Previous
+ *  snapshot can be NULL, then the difference is from an empty
+ *  buffer.
+ *
+ *  Pages shared between the snapshots are skipped, other cells are
+ *  compared. Changed cells are encoded as runs of zigzag varint
+ *  value deltas, followed by runs of changed boundary tags, runs of
+ *  changed block table entries and changed free lists.
+ */
+kit_status_t laplace_buffer_diff(
+    laplace_buffer_snapshot_t const *previous,
+    laplace_buffer_snapshot_t const *snapshot, laplace_write_fn write,
+    void *user_data);
+
+/*  Apply a difference to a buffer that matches the previous
+ *  snapshot. Reads the data from the position, position is updated.
+ *  Hashes of the buffer are checked before and after. Boundary tags,
+ *  blocks and free runs out of the buffer are rejected. Can apply
+ *  only after join and before schedule.
+ *
+ *  On failure the buffer may be changed in part.
+ */
+kit_status_t laplace_buffer_diff_apply(laplace_buffer_void_t *buffer,
+                                       void const *data,
+                                       ptrdiff_t   size,
+                                       ptrdiff_t  *position);
+
 #define LAPLACE_BUFFER_SET_CHUNK_SIZE(buf_, chunk_size_)           \
   laplace_buffer_set_chunk_size((laplace_buffer_void_t *) &(buf_), \
                                 (chunk_size_))
@@ -157,14 +653,12 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
       ptrdiff_t const end_ = begin_ + (size_);                    \
       for (ptrdiff_t i_ = begin_; i_ < end_; i_++) {              \
         assert(i_ >= 0 && i_ < (buf_).data.size);                 \
-        atomic_store_explicit(&(buf_).changed.values[i_].flag, 0, \
-                              memory_order_relaxed);              \
+        LAPLACE_BUF_UNMARK_((buf_), i_);                          \
       }                                                           \
       for (ptrdiff_t i_ = begin_; i_ < end_; i_++) {              \
         assert(i_ >= 0 && i_ < (buf_).data.size);                 \
-        atomic_store_explicit(&(buf_).data.values[i_].value, 0,   \
-                              memory_order_relaxed);              \
-        atomic_store_explicit(&(buf_).data.values[i_].delta, 0,   \
+        LAPLACE_BUF_STORE_((buf_), i_, 0);                        \
+        atomic_store_explicit(&LAPLACE_BUF_DELTA_((buf_), i_), 0, \
                               memory_order_relaxed);              \
       }                                                           \
     }                                                             \
@@ -197,14 +691,11 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
                  res_.offset + i_ < (buf_).data.size);               \
           assert(res_.previous_offset + i_ >= 0 &&                   \
                  res_.previous_offset + i_ < (buf_).data.size);      \
-          atomic_store_explicit(                                     \
-              &(buf_).changed.values[res_.offset + i_].flag,         \
-              atomic_load_explicit(                                  \
-                  &(buf_)                                            \
-                       .changed.values[res_.previous_offset + i_]    \
-                       .flag,                                        \
-                  memory_order_relaxed),                             \
-              memory_order_relaxed);                                 \
+          if (LAPLACE_BUF_MARKED_((buf_),                            \
+                                  res_.previous_offset + i_))        \
+            LAPLACE_BUF_MARK_((buf_), res_.offset + i_);             \
+          else                                                       \
+            LAPLACE_BUF_UNMARK_((buf_), res_.offset + i_);           \
         }                                                            \
         for (ptrdiff_t i_ = 0;                                       \
              i_ < res_.previous_size && i_ < (size_); i_++) {        \
@@ -212,20 +703,17 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
                  res_.offset + i_ < (buf_).data.size);               \
           assert(res_.previous_offset + i_ >= 0 &&                   \
                  res_.previous_offset + i_ < (buf_).data.size);      \
-          atomic_store_explicit(                                     \
-              &(buf_).data.values[res_.offset + i_].value,           \
+          LAPLACE_BUF_STORE_(                                        \
+              (buf_), res_.offset + i_,                              \
               atomic_load_explicit(                                  \
-                  &(buf_)                                            \
-                       .data.values[res_.previous_offset + i_]       \
-                       .value,                                       \
-                  memory_order_relaxed),                             \
-              memory_order_relaxed);                                 \
+                  &LAPLACE_BUF_VALUE_((buf_),                        \
+                                      res_.previous_offset + i_),    \
+                  memory_order_relaxed));                            \
           atomic_store_explicit(                                     \
-              &(buf_).data.values[res_.offset + i_].delta,           \
+              &LAPLACE_BUF_DELTA_((buf_), res_.offset + i_),         \
               atomic_load_explicit(                                  \
-                  &(buf_)                                            \
-                       .data.values[res_.previous_offset + i_]       \
-                       .delta,                                       \
+                  &LAPLACE_BUF_DELTA_((buf_),                        \
+                                      res_.previous_offset + i_),    \
                   memory_order_relaxed),                             \
               memory_order_relaxed);                                 \
         }                                                            \
@@ -246,79 +734,54 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
 #define LAPLACE_BUFFER_SIZE_THREAD_SAFE(buf_, handle_) \
   laplace_buffer_size((laplace_buffer_void_t *) &(buf_), (handle_))
 
-#define LAPLACE_BUFFER_READ_THREAD_SAFE(status_, buf_, handle_,   \
-                                        index_, size_, dst_)      \
-  do {                                                            \
-    if (mtx_lock(&(buf_).read_lock) != thrd_success) {            \
-      memset((dst_), 0, (size_) * sizeof *(dst_));                \
-      (status_) = LAPLACE_ERROR_BAD_MUTEX_LOCK;                   \
-    } else {                                                      \
-      (buf_).read_count++;                                        \
-      (void) mtx_unlock(&(buf_).read_lock);                       \
-      (status_) = laplace_buffer_check(                           \
-          (laplace_buffer_void_t *) &(buf_), (handle_), (index_), \
-          (size_));                                               \
-      if ((status_) == KIT_OK) {                                  \
-        ptrdiff_t const begin_ =                                  \
-            atomic_load_explicit(                                 \
-                &(buf_).blocks.values[(handle_).id].index,        \
-                memory_order_acquire) +                           \
-            (index_);                                             \
-        for (ptrdiff_t i_ = 0; i_ < (size_); i_++) {              \
-          assert(begin_ >= 0 && begin_ + i_ < (buf_).data.size);  \
-          (dst_)[i_] = atomic_load_explicit(                      \
-              &(buf_).data.values[begin_ + i_].value,             \
-              memory_order_relaxed);                              \
-        }                                                         \
-      } else {                                                    \
-        memset((dst_), 0, (size_) * sizeof *(dst_));              \
-      }                                                           \
-      if (mtx_lock(&(buf_).read_lock) != thrd_success) {          \
-        (status_) = LAPLACE_ERROR_BAD_MUTEX_LOCK;                 \
-      } else {                                                    \
-        ptrdiff_t const count_ = --(buf_).read_count;             \
-        (void) mtx_unlock(&(buf_).read_lock);                     \
-        if (count_ == 0 &&                                        \
-            cnd_broadcast(&(buf_).read_sync) != thrd_success)     \
-          (status_) = LAPLACE_ERROR_BAD_CNDVAR_BROADCAST;         \
-      }                                                           \
-    }                                                             \
+/*  Allocation doesn't wait for readers, so the block index may
+ *  change after the check. Arrays replaced by growth are kept until
+ *  all readers of their epoch are gone.
+ */
+#define LAPLACE_BUFFER_READ_THREAD_SAFE(status_, buf_, handle_, \
+                                        index_, size_, dst_)    \
+  do {                                                          \
+    assert(sizeof *(dst_) ==                                    \
+           sizeof LAPLACE_BUF_VALUE_((buf_), 0));               \
+    (status_) = laplace_buffer_read(                            \
+        (laplace_buffer_void_t *) &(buf_), (handle_), (index_), \
+        (size_), (dst_));                                       \
+    (void) (status_);                                           \
   } while (0)
 
-#define LAPLACE_BUFFER_SET(status_, buf_, handle_, index_, value_)   \
-  do {                                                               \
-    (status_) = laplace_buffer_check(                                \
-        (laplace_buffer_void_t *) &(buf_), (handle_), (index_), 1);  \
-    if ((status_) == KIT_OK) {                                       \
-      ptrdiff_t const offset_ = LAPLACE_BUF_INDEX_UNSAFE_(           \
-                                    (buf_), (handle_).id) +          \
-                                (index_);                            \
-      assert(offset_ >= 0 && offset_ < (buf_).data.size);            \
-      atomic_store_explicit(&(buf_).changed.values[offset_].flag, 1, \
-                            memory_order_relaxed);                   \
-      atomic_fetch_add_explicit(                                     \
-          &(buf_).data.values[offset_].delta,                        \
-          (value_) -atomic_load_explicit(                            \
-              &(buf_).data.values[offset_].value,                    \
-              memory_order_relaxed),                                 \
-          memory_order_relaxed);                                     \
-    }                                                                \
+#define LAPLACE_BUFFER_SET(status_, buf_, handle_, index_, value_)  \
+  do {                                                              \
+    (status_) = laplace_buffer_check(                               \
+        (laplace_buffer_void_t *) &(buf_), (handle_), (index_), 1); \
+    if ((status_) == KIT_OK) {                                      \
+      ptrdiff_t const offset_ = LAPLACE_BUF_INDEX_UNSAFE_(          \
+                                    (buf_), (handle_).id) +         \
+                                (index_);                           \
+      assert(offset_ >= 0 && offset_ < (buf_).data.size);           \
+      LAPLACE_BUF_MARK_((buf_), offset_);                           \
+      atomic_fetch_add_explicit(                                    \
+          &LAPLACE_BUF_DELTA_((buf_), offset_),                     \
+          (value_) -atomic_load_explicit(                           \
+              &LAPLACE_BUF_VALUE_((buf_), offset_),                 \
+              memory_order_relaxed),                                \
+          memory_order_relaxed);                                    \
+    }                                                               \
   } while (0)
 
-#define LAPLACE_BUFFER_ADD(status_, buf_, handle_, index_, delta_)   \
-  do {                                                               \
-    (status_) = laplace_buffer_check(                                \
-        (laplace_buffer_void_t *) &(buf_), (handle_), (index_), 1);  \
-    if ((status_) == KIT_OK) {                                       \
-      ptrdiff_t const offset_ = LAPLACE_BUF_INDEX_UNSAFE_(           \
-                                    (buf_), (handle_).id) +          \
-                                (index_);                            \
-      assert(offset_ >= 0 && offset_ < (buf_).data.size);            \
-      atomic_store_explicit(&(buf_).changed.values[offset_].flag, 1, \
-                            memory_order_relaxed);                   \
-      atomic_fetch_add_explicit(&(buf_).data.values[offset_].delta,  \
-                                (delta_), memory_order_relaxed);     \
-    }                                                                \
+#define LAPLACE_BUFFER_ADD(status_, buf_, handle_, index_, delta_)  \
+  do {                                                              \
+    (status_) = laplace_buffer_check(                               \
+        (laplace_buffer_void_t *) &(buf_), (handle_), (index_), 1); \
+    if ((status_) == KIT_OK) {                                      \
+      ptrdiff_t const offset_ = LAPLACE_BUF_INDEX_UNSAFE_(          \
+                                    (buf_), (handle_).id) +         \
+                                (index_);                           \
+      assert(offset_ >= 0 && offset_ < (buf_).data.size);           \
+      LAPLACE_BUF_MARK_((buf_), offset_);                           \
+      atomic_fetch_add_explicit(                                    \
+          &LAPLACE_BUF_DELTA_((buf_), offset_), (delta_),           \
+          memory_order_relaxed);                                    \
+    }                                                               \
   } while (0)
 
 #define LAPLACE_BUFFER_SET_N(status_, buf_, handle_, index_, size_, \
@@ -332,15 +795,13 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
                                     (buf_), (handle_).id) +         \
                                 (index_);                           \
       for (ptrdiff_t i_ = 0; i_ < (size_); i_++)                    \
-        atomic_store_explicit(                                      \
-            &(buf_).changed.values[offset_ + i_].flag, 1,           \
-            memory_order_relaxed);                                  \
+        LAPLACE_BUF_MARK_((buf_), offset_ + i_);                    \
       for (ptrdiff_t i_ = 0; i_ < (size_); i_++)                    \
         atomic_fetch_add_explicit(                                  \
-            &(buf_).data.values[offset_ + i_].delta,                \
+            &LAPLACE_BUF_DELTA_((buf_), offset_ + i_),              \
             (values_)[i_] -                                         \
                 atomic_load_explicit(                               \
-                    &(buf_).data.values[offset_ + i_].value,        \
+                    &LAPLACE_BUF_VALUE_((buf_), offset_ + i_),      \
                     memory_order_relaxed),                          \
             memory_order_relaxed);                                  \
     }                                                               \
@@ -357,101 +818,259 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
                                     (buf_), (handle_).id) +         \
                                 (index_);                           \
       for (ptrdiff_t i_ = 0; i_ < (size_); i_++)                    \
-        atomic_store_explicit(                                      \
-            &(buf_).changed.values[offset_ + i_].flag, 1,           \
-            memory_order_relaxed);                                  \
+        LAPLACE_BUF_MARK_((buf_), offset_ + i_);                    \
       for (ptrdiff_t i_ = 0; i_ < (size_); i_++)                    \
         atomic_fetch_add_explicit(                                  \
-            &(buf_).data.values[offset_ + i_].delta, (deltas_)[i_], \
+            &LAPLACE_BUF_DELTA_((buf_), offset_ + i_),              \
+            (deltas_)[i_],                                          \
             memory_order_relaxed);                                  \
     }                                                               \
   } while (0)
 
-/*  FIXME
- *  Measure performance.
+#define LAPLACE_BUF_NEXT_(element_type_, value_, delta_) \
+  ((element_type_) ((uint64_t) (value_) + (uint64_t) (delta_)))
+
+#define LAPLACE_BUF_APPLY_(buffer_, element_type_, i_, weight_, \
+                           sum_)                                \
+  do {                                                          \
+    assert((i_) >= 0 && (i_) < (buffer_).data.size);            \
+    element_type_ const delta_ = atomic_exchange_explicit(      \
+        &LAPLACE_BUF_DELTA_((buffer_), (i_)), 0,                \
+        memory_order_relaxed);                                  \
+    if (delta_ != 0) {                                          \
+      element_type_ const value_ = atomic_fetch_add_explicit(   \
+          &LAPLACE_BUF_VALUE_((buffer_), (i_)), delta_,         \
+          memory_order_relaxed);                                \
+      LAPLACE_BUF_HASH_DIFF_(                                   \
+          (sum_), (weight_), (i_), value_,                      \
+          LAPLACE_BUF_NEXT_(element_type_, value_, delta_));    \
+    }                                                           \
+  } while (0)
+
+/*  Element size for the vector kernels, or zero if the element
+ *  type has no kernel.
+ */
+#ifdef __cplusplus
+#  define LAPLACE_BUF_KERNEL_SIZE_(element_type_) 0
+#else
+#  define LAPLACE_BUF_KERNEL_SIZE_(element_type_) \
+    _Generic((element_type_) 0, int64_t: 8, int8_t: 1, default: 0)
+#endif
+
+/*  Apply deltas in the range of cells.
+ *
+ *  Range bounds are aligned to flag words, so each flag word is taken
+ *  by one thread. Clean flag words are skipped using the summary.
+ *  Hashes are updated for changed cells only, the hash tree once
+ *  per summary word.
  */
-#define LAPLACE_BUFFER_ADJUST(return_, buffer_, element_type_)       \
+#define LAPLACE_BUFFER_ADJUST_RANGE(buffer_, element_type_, offset_, \
+                                    size_)                           \
   do {                                                               \
-    ptrdiff_t const begin_ = atomic_fetch_add_explicit(              \
-        &(buffer_).next_chunk, (buffer_).chunk_size,                 \
-        memory_order_relaxed);                                       \
-    ptrdiff_t end_ = begin_ + (buffer_).chunk_size;                  \
-    if (end_ > (buffer_).data.size)                                  \
-      end_ = (buffer_).data.size;                                    \
-    assert(begin_ >= 0 && end_ <= (buffer_).data.size);              \
-    assert((buffer_).changed.size == (buffer_).data.size);           \
-    for (ptrdiff_t i_ = begin_; i_ < end_;) {                        \
-      while (i_ < end_ && atomic_exchange_explicit(                  \
-                              &(buffer_).changed.values[i_].flag, 0, \
-                              memory_order_relaxed) == 0)            \
-        i_++;                                                        \
-      while (i_ < end_) {                                            \
-        element_type_ const delta_ = atomic_exchange_explicit(       \
-            &(buffer_).data.values[i_].delta, 0,                     \
+    ptrdiff_t begin_ = ((offset_) + 63) / 64;                        \
+    ptrdiff_t end_   = ((offset_) + (size_) + 63) / 64;              \
+    if (end_ > (buffer_).changed.size)                               \
+      end_ = (buffer_).changed.size;                                 \
+    if (begin_ > end_)                                               \
+      begin_ = end_;                                                 \
+    uint64_t total_ = 0;                                             \
+    assert((buffer_).changed.size ==                                 \
+           LAPLACE_BUF_CHANGED_SIZE_((buffer_).data.size));          \
+    assert((buffer_).summary.size ==                                 \
+           LAPLACE_BUF_CHANGED_SIZE_((buffer_).changed.size));       \
+    for (ptrdiff_t s_ = begin_ / 64; s_ * 64 < end_; s_++) {         \
+      uint64_t words_ = atomic_load_explicit(                        \
+          &(buffer_).summary.values[s_].flags,                       \
+          memory_order_relaxed);                                     \
+      if (s_ * 64 < begin_)                                          \
+        words_ &= ~(uint64_t) 0 << (begin_ - s_ * 64);               \
+      if (end_ - s_ * 64 < 64)                                       \
+        words_ &= ((uint64_t) 1 << (end_ - s_ * 64)) - 1;            \
+      if (words_ == 0)                                               \
+        continue;                                                    \
+      LAPLACE_BUF_WRITE_((buffer_), s_);                             \
+      atomic_fetch_and_explicit(&(buffer_).summary.values[s_].flags, \
+                                ~words_, memory_order_relaxed);      \
+      uint64_t group_ = 0;                                           \
+      for (; words_ != 0; words_ &= words_ - 1) {                    \
+        ptrdiff_t const w_ = s_ * 64 + LAPLACE_BUF_CTZ_(words_);     \
+        uint64_t        flags_ = atomic_exchange_explicit(           \
+            &(buffer_).changed.values[w_].flags, 0,                  \
             memory_order_relaxed);                                   \
-        if (delta_ == 0) {                                           \
-          i_++;                                                      \
-          break;                                                     \
+        uint64_t sum_ = 0;                                           \
+        if (flags_ == ~(uint64_t) 0 &&                               \
+            LAPLACE_BUF_KERNEL_SIZE_(element_type_) != 0)            \
+          sum_ = laplace_buffer_apply_deltas(                        \
+              (laplace_buffer_void_t *) &(buffer_),                  \
+              LAPLACE_BUF_KERNEL_SIZE_(element_type_), w_ * 64, 64); \
+        else {                                                       \
+          uint64_t const weight_ = laplace_buffer_word_weight(w_);   \
+          if (flags_ == ~(uint64_t) 0)                               \
+            for (ptrdiff_t i_ = w_ * 64; i_ < w_ * 64 + 64; i_++)    \
+              LAPLACE_BUF_APPLY_((buffer_), element_type_, i_,       \
+                                 weight_, sum_);                     \
+          else                                                       \
+            for (; flags_ != 0; flags_ &= flags_ - 1)                \
+              LAPLACE_BUF_APPLY_((buffer_), element_type_,           \
+                                 w_ * 64 + LAPLACE_BUF_CTZ_(flags_), \
+                                 weight_, sum_);                     \
         }                                                            \
-        atomic_fetch_add_explicit(&(buffer_).data.values[i_].value,  \
-                                  delta_, memory_order_relaxed);     \
-        i_++;                                                        \
+        if (sum_ != 0)                                               \
+          atomic_fetch_add_explicit(                                 \
+              &(buffer_).cell_tree.nodes.values[w_].hash, sum_,      \
+              memory_order_relaxed);                                 \
+        group_ += sum_;                                              \
       }                                                              \
+      if (group_ != 0)                                               \
+        laplace_buffer_tree_add(&(buffer_).cell_tree, 2, s_,         \
+                                group_);                             \
+      total_ += group_;                                              \
     }                                                                \
-    (return_) = (end_ != (buffer_).data.size);                       \
+    if (total_ != 0)                                                 \
+      atomic_fetch_add_explicit(&(buffer_).hash, total_,             \
+                                memory_order_relaxed);               \
+  } while (0)
+
+#define LAPLACE_BUFFER_ADJUST(return_, buffer_, element_type_)    \
+  do {                                                            \
+    ptrdiff_t const chunk_ = atomic_fetch_add_explicit(           \
+        &(buffer_).next_chunk, (buffer_).chunk_size,              \
+        memory_order_relaxed);                                    \
+    LAPLACE_BUFFER_ADJUST_RANGE((buffer_), element_type_, chunk_, \
+                                (buffer_).chunk_size);            \
+    (return_) = (chunk_ + (buffer_).chunk_size <                  \
+                 (buffer_).data.size);                            \
   } while (0)
 
 #define LAPLACE_BUFFER_ADJUST_DONE(buffer_)       \
   atomic_store_explicit(&(buffer_).next_chunk, 0, \
                         memory_order_relaxed)
 
-/*  FIXME
- *  Add tests for this.
- *
- *  Can clone only after join and before schedule.
+/*  Can clone only after join and before schedule.
  */
-#define LAPLACE_BUFFER_CLONE(s, dst, src)                         \
-  do {                                                            \
-    kit_status_t status_ = KIT_OK;                                \
-    (dst).cell_size      = (src).cell_size;                       \
-    (dst).chunk_size     = (src).chunk_size;                      \
-    (dst).reserved       = (src).reserved;                        \
-    (dst).next_block     = (src).next_block;                      \
-    atomic_store_explicit(&(dst).next_chunk, 0,                   \
-                          memory_order_relaxed);                  \
-    KIT_DA_RESIZE((dst).changed, (src).changed.size);             \
-    if ((dst).changed.size != (src).changed.size)                 \
-      status_ = LAPLACE_ERROR_BAD_ALLOC;                          \
-    else                                                          \
-      for (ptrdiff_t i_ = 0; i_ < (src).changed.size; i_++)       \
-        atomic_store_explicit(&(dst).changed.values[i_].flag, 0,  \
-                              memory_order_relaxed);              \
-    KIT_DA_RESIZE((dst).info, (src).info.size);                   \
-    if ((dst).info.size != (src).info.size)                       \
-      status_ = LAPLACE_ERROR_BAD_ALLOC;                          \
-    else if ((dst).info.size > 0)                                 \
-      memcpy((dst).info.values, (src).info.values,                \
-             sizeof((src).info.values[0]) * (src).info.size);     \
-    KIT_DA_RESIZE((dst).blocks, (src).blocks.size);               \
-    if ((dst).blocks.size != (src).blocks.size)                   \
-      status_ = LAPLACE_ERROR_BAD_ALLOC;                          \
-    else if ((dst).blocks.size > 0)                               \
-      memcpy((dst).blocks.values, (src).blocks.values,            \
-             sizeof((src).blocks.values[0]) * (src).blocks.size); \
-    KIT_DA_RESIZE((dst).data, (src).data.size);                   \
-    if ((dst).data.size != (src).data.size)                       \
-      status_ = LAPLACE_ERROR_BAD_ALLOC;                          \
-    else                                                          \
-      for (ptrdiff_t i_ = 0; i_ < (src).data.size; i_++) {        \
-        atomic_store_explicit(                                    \
-            &(dst).data.values[i_].value,                         \
-            atomic_load_explicit(&(src).data.values[i_].value,    \
-                                 memory_order_relaxed),           \
-            memory_order_relaxed);                                \
-        atomic_store_explicit(&(dst).data.values[i_].delta, 0,    \
-                              memory_order_relaxed);              \
-      }                                                           \
-    (s) = status_;                                                \
+#define LAPLACE_BUFFER_CLONE(s, dst, src)                           \
+  do {                                                              \
+    kit_status_t status_ = KIT_OK;                                  \
+    (dst).cell_size      = (src).cell_size;                         \
+    (dst).chunk_size     = (src).chunk_size;                        \
+    (dst).reserved       = (src).reserved;                          \
+    (dst).next_block     = (src).next_block;                        \
+    atomic_store_explicit(&(dst).next_chunk, 0,                     \
+                          memory_order_relaxed);                    \
+    KIT_DA_RESIZE((dst).changed, (src).changed.size);               \
+    if ((dst).changed.size != (src).changed.size)                   \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    else if ((dst).changed.size > 0)                                \
+      memset((dst).changed.values, 0,                               \
+             sizeof((dst).changed.values[0]) * (dst).changed.size); \
+    KIT_DA_RESIZE((dst).summary, (src).summary.size);               \
+    if ((dst).summary.size != (src).summary.size)                   \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    else if ((dst).summary.size > 0)                                \
+      memset((dst).summary.values, 0,                               \
+             sizeof((dst).summary.values[0]) * (dst).summary.size); \
+    KIT_DA_RESIZE((dst).written, (src).written.size);               \
+    if ((dst).written.size != (src).written.size)                   \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    else if ((dst).written.size > 0)                                \
+      memset((dst).written.values, 0,                               \
+             sizeof((dst).written.values[0]) * (dst).written.size); \
+    (dst).snapshot_id = 0;                                          \
+    if (laplace_buffer_tree_copy(&(dst).cell_tree,                  \
+                                 &(src).cell_tree) != KIT_OK ||     \
+        laplace_buffer_tree_copy(&(dst).block_tree,                 \
+                                 &(src).block_tree) != KIT_OK)      \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    atomic_store_explicit(                                          \
+        &(dst).hash,                                                \
+        atomic_load_explicit(&(src).hash, memory_order_relaxed),    \
+        memory_order_relaxed);                                      \
+    (dst).block_hash = (src).block_hash;                            \
+    KIT_DA_RESIZE((dst).info, (src).info.size);                     \
+    if ((dst).info.size != (src).info.size)                         \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    else if ((dst).info.size > 0)                                   \
+      memcpy((dst).info.values, (src).info.values,                  \
+             sizeof((src).info.values[0]) * (src).info.size);       \
+    KIT_DA_RESIZE((dst).blocks, (src).blocks.size);                 \
+    if ((dst).blocks.size != (src).blocks.size)                     \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    else if ((dst).blocks.size > 0)                                 \
+      memcpy((dst).blocks.values, (src).blocks.values,              \
+             sizeof((src).blocks.values[0]) * (src).blocks.size);   \
+    memcpy((dst).free_marks, (src).free_marks,                      \
+           sizeof((src).free_marks));                               \
+    for (ptrdiff_t k_ = 0; k_ < LAPLACE_BUFFER_SIZE_CLASS_COUNT;    \
+         k_++) {                                                    \
+      KIT_DA_RESIZE((dst).free_lists[k_],                           \
+                    (src).free_lists[k_].size);                     \
+      if ((dst).free_lists[k_].size != (src).free_lists[k_].size)   \
+        status_ = LAPLACE_ERROR_BAD_ALLOC;                          \
+      else if ((dst).free_lists[k_].size > 0)                       \
+        memcpy((dst).free_lists[k_].values,                         \
+               (src).free_lists[k_].values,                         \
+               sizeof((src).free_lists[k_].values[0]) *             \
+                   (src).free_lists[k_].size);                      \
+    }                                                               \
+    KIT_DA_RESIZE((dst).data, (src).data.size);                     \
+    LAPLACE_BUF_DELTAS_RESIZE_((dst), (src).data.size);             \
+    if ((dst).data.size != (src).data.size ||                       \
+        LAPLACE_BUF_DELTAS_SIZE_(dst) != (src).data.size)           \
+      status_ = LAPLACE_ERROR_BAD_ALLOC;                            \
+    else                                                            \
+      for (ptrdiff_t i_ = 0; i_ < (src).data.size; i_++) {          \
+        atomic_store_explicit(                                      \
+            &LAPLACE_BUF_VALUE_((dst), i_),                         \
+            atomic_load_explicit(&LAPLACE_BUF_VALUE_((src), i_),    \
+                                 memory_order_relaxed),             \
+            memory_order_relaxed);                                  \
+        atomic_store_explicit(&LAPLACE_BUF_DELTA_((dst), i_), 0,    \
+                              memory_order_relaxed);                \
+      }                                                             \
+    laplace_buffer_publish((laplace_buffer_void_t *) &(dst));       \
+    (s) = status_;                                                  \
+  } while (0)
+
+#define LAPLACE_BUFFER_SNAPSHOT(status_, snapshot_, buf_, previous_) \
+  do {                                                               \
+    (status_) = laplace_buffer_snapshot_take(                        \
+        &(snapshot_), (laplace_buffer_void_t *) &(buf_),             \
+        (previous_));                                                \
+  } while (0)
+
+#define LAPLACE_BUFFER_RESTORE(status_, buf_, snapshot_)  \
+  do {                                                    \
+    (status_) = laplace_buffer_snapshot_restore(          \
+        (laplace_buffer_void_t *) &(buf_), &(snapshot_)); \
+  } while (0)
+
+#define LAPLACE_BUFFER_SAVE_LAYOUT(end_, save_, buf_, offset_) \
+  do {                                                         \
+    (end_) = laplace_buffer_save_layout(                       \
+        &(save_), (laplace_buffer_void_t const *) &(buf_),     \
+        (offset_));                                            \
+  } while (0)
+
+#define LAPLACE_BUFFER_SAVE(status_, save_, buf_, position_, write_, \
+                            user_data_)                              \
+  do {                                                               \
+    (status_) = laplace_buffer_save_write(                           \
+        &(save_), (laplace_buffer_void_t const *) &(buf_),           \
+        (position_), (write_), (user_data_));                        \
+  } while (0)
+
+#define LAPLACE_BUFFER_LOAD(status_, buf_, save_, region_)       \
+  do {                                                           \
+    (status_) = laplace_buffer_load(                             \
+        (laplace_buffer_void_t *) &(buf_), &(save_), (region_)); \
+  } while (0)
+
+#define LAPLACE_BUFFER_DIFF_APPLY(status_, buf_, data_, size_, \
+                                  position_)                   \
+  do {                                                         \
+    (status_) = laplace_buffer_diff_apply(                     \
+        (laplace_buffer_void_t *) &(buf_), (data_), (size_),   \
+        (position_));                                          \
   } while (0)
 
 #ifndef LAPLACE_DISABLE_SHORT_NAMES
@@ -469,12 +1088,26 @@ ptrdiff_t laplace_buffer_size(laplace_buffer_void_t *buffer,
 #  define BUFFER_READ_THREAD_SAFE LAPLACE_BUFFER_READ_THREAD_SAFE
 #  define BUFFER_SET LAPLACE_BUFFER_SET
 #  define BUFFER_ADD LAPLACE_BUFFER_ADD
+#  define BUFFER_ADJUST_RANGE LAPLACE_BUFFER_ADJUST_RANGE
 #  define BUFFER_ADJUST LAPLACE_BUFFER_ADJUST
 #  define BUFFER_ADJUST_LOOP LAPLACE_BUFFER_ADJUST_LOOP
 #  define BUFFER_ADJUST_DONE LAPLACE_BUFFER_ADJUST_DONE
 #  define BUFFER_CLONE LAPLACE_BUFFER_CLONE
+#  define BUFFER_SNAPSHOT LAPLACE_BUFFER_SNAPSHOT
+#  define BUFFER_RESTORE LAPLACE_BUFFER_RESTORE
+#  define BUFFER_SAVE_LAYOUT LAPLACE_BUFFER_SAVE_LAYOUT
+#  define BUFFER_SAVE LAPLACE_BUFFER_SAVE
+#  define BUFFER_LOAD LAPLACE_BUFFER_LOAD
+#  define BUFFER_DIFF_APPLY LAPLACE_BUFFER_DIFF_APPLY
 
 #  define BUFFER_DEFAULT_CHUNK_SIZE LAPLACE_BUFFER_DEFAULT_CHUNK_SIZE
+#  define BUFFER_CHUNKS_PER_THREAD LAPLACE_BUFFER_CHUNKS_PER_THREAD
+#  define BUFFER_PAGE_SIZE LAPLACE_BUFFER_PAGE_SIZE
+#  define BUFFER_SAVE_ALIGN LAPLACE_BUFFER_SAVE_ALIGN
+#  define BUFFER_KERNEL_AUTO LAPLACE_BUFFER_KERNEL_AUTO
+#  define BUFFER_KERNEL_SCALAR LAPLACE_BUFFER_KERNEL_SCALAR
+#  define BUFFER_KERNEL_SSE2 LAPLACE_BUFFER_KERNEL_SSE2
+#  define BUFFER_KERNEL_AVX2 LAPLACE_BUFFER_KERNEL_AVX2
 #endif
 
 #ifdef __cplusplus
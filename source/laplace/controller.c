@@ -14,19 +14,188 @@ kit_status_t controller_init(controller_t *const controller,
     return ERROR_BAD_ALLOC;
 
   DA_RESIZE(controller->history, 0);
+  DA_INIT(controller->snapshots, 0, alloc);
+  DA_INIT(controller->inputs, 0, alloc);
+
+  controller->rollback_time = -1;
 
   return KIT_OK;
 }
 
+static void release_snapshots(controller_t *const controller) {
+  for (ptrdiff_t i = 0; i < controller->snapshots.size; i++) {
+    snapshot_t *const slot = controller->snapshots.values + i;
+    if (slot->data != NULL && slot->destroy != NULL)
+      slot->destroy(slot->data);
+    if (slot->state.state != NULL && slot->state.release != NULL)
+      slot->state.release(slot->state.state);
+    actions_snapshot_destroy(&slot->actions);
+  }
+
+  DA_RESIZE(controller->snapshots, 0);
+  controller->snapshot_first = 0;
+  controller->snapshot_count = 0;
+}
+
+static void release_inputs(controller_t *const controller) {
+  for (ptrdiff_t i = 0; i < controller->inputs.size; i++)
+    DA_DESTROY(controller->inputs.values[i].events);
+
+  DA_RESIZE(controller->inputs, 0);
+}
+
 kit_status_t controller_destroy(controller_t *const controller) {
+  release_snapshots(controller);
+  release_inputs(controller);
+
   DA_DESTROY(controller->history);
+  DA_DESTROY(controller->snapshots);
+  DA_DESTROY(controller->inputs);
+
+  return KIT_OK;
+}
+
+kit_status_t controller_set_speculative(
+    controller_t *const controller, int const speculative,
+    ptrdiff_t const input_count) {
+  if (input_count < 0)
+    return ERROR_INVALID_SIZE;
+
+  ptrdiff_t const count = speculative ? input_count : 0;
+
+  release_inputs(controller);
+  DA_RESIZE(controller->inputs, count);
+
+  if (controller->inputs.size != count)
+    return ERROR_BAD_ALLOC;
+
+  for (ptrdiff_t i = 0; i < count; i++)
+    DA_INIT(controller->inputs.values[i].events, 0,
+            controller->inputs.alloc);
+
+  controller->speculative = speculative;
+
+  return KIT_OK;
+}
+
+kit_status_t controller_set_snapshots(controller_t *const  controller,
+                                      laplace_time_t const interval,
+                                      ptrdiff_t const      count) {
+  if (interval < 0 || count < 0)
+    return ERROR_INVALID_SIZE;
+
+  release_snapshots(controller);
+
+  controller->snapshot_interval = interval;
+
+  if (interval == 0 || count == 0)
+    return KIT_OK;
+
+  DA_RESIZE(controller->snapshots, count);
+
+  if (controller->snapshots.size != count) {
+    controller->snapshot_interval = 0;
+    return ERROR_BAD_ALLOC;
+  }
+
+  memset(controller->snapshots.values, 0,
+         count * sizeof *controller->snapshots.values);
+
+  for (ptrdiff_t i = 0; i < count; i++)
+    actions_snapshot_init(&controller->snapshots.values[i].actions,
+                          controller->snapshots.alloc);
+
+  return KIT_OK;
+}
+
+static snapshot_t *snapshot_at(controller_t *const controller,
+                               ptrdiff_t const     n) {
+  ptrdiff_t const size = controller->snapshots.size;
+  return controller->snapshots.values +
+         (controller->snapshot_first + n) % size;
+}
+
+static kit_status_t fill_slot(snapshot_t *const       slot,
+                              read_write_t const       access,
+                              snapshot_t const *const previous) {
+  if (access.snapshot != NULL) {
+    slot->destroy = access.snapshot_destroy;
+    return access.snapshot(access.state, &slot->data,
+                           previous != NULL ? previous->data : NULL);
+  }
+
+  if (slot->state.state != NULL && slot->state.assign != NULL)
+    return slot->state.assign(slot->state.state, access.state);
+
+  if (slot->state.state != NULL && slot->state.release != NULL)
+    slot->state.release(slot->state.state);
+  memset(&slot->state, 0, sizeof slot->state);
+
+  kit_status_t const s = access.clone(access.state, &slot->state);
+
+  if (s != KIT_OK)
+    memset(&slot->state, 0, sizeof slot->state);
+  else if (slot->state.acquire != NULL)
+    slot->state.acquire(slot->state.state);
+
+  return s;
+}
+
+static kit_status_t take_snapshot(controller_t *const controller,
+                                  execution_t *const  execution) {
+  read_write_t const access = execution->_access;
+
+  if (controller->snapshot_interval <= 0 ||
+      controller->snapshots.size == 0 ||
+      (access.snapshot == NULL && access.clone == NULL))
+    return KIT_OK;
+
+  if (controller->snapshot_count > 0 &&
+      controller->time <
+          snapshot_at(controller, controller->snapshot_count - 1)
+                  ->time +
+              controller->snapshot_interval)
+    return KIT_OK;
+
+  snapshot_t const *const previous =
+      controller->snapshot_count > 0
+          ? snapshot_at(controller, controller->snapshot_count - 1)
+          : NULL;
+
+  snapshot_t *slot;
+
+  if (controller->snapshot_count == controller->snapshots.size) {
+    /*  Overwrite the oldest snapshot.
+     */
+    slot = snapshot_at(controller, 0);
+    controller->snapshot_first = (controller->snapshot_first + 1) %
+                                 controller->snapshots.size;
+    controller->snapshot_count--;
+  } else
+    slot = snapshot_at(controller, controller->snapshot_count);
+
+  /*  On failure the slot may be partially copied, so it is not
+   *  counted as a snapshot.
+   */
+  kit_status_t s = fill_slot(slot, access, previous);
+
+  if (s == KIT_OK)
+    s = execution_snapshot_actions(execution, &slot->actions);
+
+  if (s != KIT_OK)
+    return s;
+
+  slot->time  = controller->time;
+  slot->index = controller->index;
+  controller->snapshot_count++;
 
   return KIT_OK;
 }
 
 kit_status_t controller_queue(controller_t *const controller,
                               event_t const       event) {
-  if (event.time < controller->time)
+  if (event.time < 0 ||
+      (event.time < controller->time && !controller->speculative))
     return ERROR_INVALID_EVENT_TIME;
 
   ptrdiff_t const size     = controller->history.size;
@@ -48,6 +217,55 @@ kit_status_t controller_queue(controller_t *const controller,
 
   memcpy(controller->history.values + position, &event, sizeof event);
 
+  /*  A late event is inserted before the index, and the state is
+   *  rolled back on the next schedule and join.
+   */
+  if (event.time < controller->time) {
+    controller->index++;
+
+    if (controller->rollback_time < 0 ||
+        event.time < controller->rollback_time)
+      controller->rollback_time = event.time;
+  }
+
+  return KIT_OK;
+}
+
+kit_status_t controller_queue_input(controller_t *const controller,
+                                    ptrdiff_t const     input,
+                                    event_t const       event) {
+  if (input < 0 || input >= controller->inputs.size)
+    return ERROR_INVALID_INDEX;
+
+  input_t *const  in       = controller->inputs.values + input;
+  ptrdiff_t const size     = in->events.size;
+  ptrdiff_t       position = size;
+
+  while (position > 0 &&
+         in->events.values[position - 1].time > event.time)
+    position--;
+
+  /*  Inputs are resized first, so the history is not changed if
+   *  there is no memory for the input.
+   */
+  DA_RESIZE(in->events, size + 1);
+
+  if (in->events.size != size + 1)
+    return ERROR_BAD_ALLOC;
+
+  kit_status_t const s = controller_queue(controller, event);
+
+  if (s != KIT_OK) {
+    DA_RESIZE(in->events, size);
+    return s;
+  }
+
+  for (ptrdiff_t i = size; i > position; i--)
+    memcpy(in->events.values + i, in->events.values + (i - 1),
+           sizeof *in->events.values);
+
+  memcpy(in->events.values + position, &event, sizeof event);
+
   return KIT_OK;
 }
 
@@ -57,24 +275,153 @@ kit_status_t controller_rewind(controller_t *const  controller,
   if (time < 0)
     return ERROR_INVALID_REWIND_TIME;
 
-  if (time < controller->time && execution->_access.reset != NULL) {
-    kit_status_t const s = execution->_access.reset(
-        execution->_access.state);
+  /*  Pending rollback restores the state from an earlier time.
+   */
+  laplace_time_t restore_time = time;
+
+  if (controller->rollback_time >= 0 &&
+      controller->rollback_time < restore_time)
+    restore_time = controller->rollback_time;
+
+  if (restore_time < controller->time) {
+    /*  Snapshots later than the target time are dropped, their states
+     *  are kept for reuse.
+     */
+    while (controller->snapshot_count > 0 &&
+           snapshot_at(controller, controller->snapshot_count - 1)
+                   ->time > restore_time)
+      controller->snapshot_count--;
+
+    read_write_t *const access = &execution->_access;
+
+    snapshot_t const *const snapshot =
+        controller->snapshot_count > 0
+            ? snapshot_at(controller, controller->snapshot_count - 1)
+            : NULL;
+
+    if (snapshot != NULL &&
+        (snapshot->data != NULL ? access->restore != NULL
+                                : access->assign != NULL)) {
+      kit_status_t s =
+          snapshot->data != NULL
+              ? access->restore(access->state, snapshot->data)
+              : access->assign(access->state, snapshot->state.state);
+
+      if (s == KIT_OK)
+        s = execution_restore_actions(execution, &snapshot->actions);
 
-    if (s != KIT_OK)
-      return s;
+      if (s != KIT_OK)
+        return s;
+
+      controller->time  = snapshot->time;
+      controller->index = snapshot->index;
+    } else if (access->reset != NULL) {
+      kit_status_t s = access->reset(access->state);
+
+      if (s == KIT_OK)
+        s = execution_restore_actions(execution, NULL);
+
+      if (s != KIT_OK)
+        return s;
 
-    controller->time  = 0;
-    controller->index = 0;
+      controller->time  = 0;
+      controller->index = 0;
+    } else
+      return ERROR_INVALID_REWIND_TIME;
   }
 
+  /*  The rollback is done only when the state is restored, so on
+   *  failure it is retried on the next schedule and join.
+   */
+  controller->rollback_time = -1;
+
   return schedule_and_join(controller, execution,
                            time - controller->time);
 }
 
+/*  Queue the latest input of the channel before the tick, unless
+ *  the channel has an input for the tick.
+ */
+static kit_status_t predict(controller_t *const  controller,
+                            execution_t *const   execution,
+                            ptrdiff_t const      input,
+                            laplace_time_t const time) {
+  input_t const *const in = controller->inputs.values + input;
+
+  ptrdiff_t begin = 0, end = in->events.size;
+
+  while (begin < end) {
+    ptrdiff_t const middle = begin + (end - begin) / 2;
+
+    if (in->events.values[middle].time < time)
+      begin = middle + 1;
+    else
+      end = middle;
+  }
+
+  if (begin == 0 || (begin < in->events.size &&
+                     in->events.values[begin].time == time))
+    return KIT_OK;
+
+  return execution_queue(execution,
+                         in->events.values[begin - 1].action);
+}
+
+/*  Run ticks one by one, queue the events of each tick and the
+ *  predicted inputs, and take snapshots between ticks.
+ */
+static kit_status_t speculate(controller_t *const  controller,
+                              execution_t *const   execution,
+                              laplace_time_t const time_elapsed) {
+  if (time_elapsed < 0)
+    return ERROR_INVALID_EVENT_TIME;
+
+  laplace_time_t const time_end = controller->time + time_elapsed;
+
+  while (controller->time < time_end) {
+    laplace_time_t const time = controller->time;
+
+    for (; controller->index < controller->history.size &&
+           controller->history.values[controller->index].time <= time;
+         controller->index++) {
+      kit_status_t const s = execution_queue(
+          execution,
+          controller->history.values[controller->index].action);
+
+      if (s != KIT_OK)
+        return s;
+    }
+
+    for (ptrdiff_t i = 0; i < controller->inputs.size; i++) {
+      kit_status_t const s = predict(controller, execution, i, time);
+
+      if (s != KIT_OK)
+        return s;
+    }
+
+    kit_status_t s = execution_schedule(execution, 1);
+
+    if (s != KIT_OK)
+      return s;
+
+    controller->time = time + 1;
+    execution_join(execution);
+
+    s = take_snapshot(controller, execution);
+
+    if (s != KIT_OK)
+      return s;
+  }
+
+  return KIT_OK;
+}
+
 kit_status_t schedule(controller_t *const  controller,
                       execution_t *const   execution,
                       laplace_time_t const time_elapsed) {
+  if (controller->speculative)
+    return schedule_and_join(controller, execution, time_elapsed);
+
   if (time_elapsed < 0)
     return ERROR_INVALID_EVENT_TIME;
   if (time_elapsed == 0)
@@ -142,11 +489,25 @@ kit_status_t schedule(controller_t *const  controller,
 kit_status_t schedule_and_join(controller_t *const  controller,
                                execution_t *const   execution,
                                laplace_time_t const time_elapsed) {
+  if (controller->speculative) {
+    if (controller->rollback_time >= 0) {
+      kit_status_t const s = controller_rewind(controller, execution,
+                                               controller->time);
+
+      if (s != KIT_OK)
+        return s;
+    }
+
+    return speculate(controller, execution, time_elapsed);
+  }
+
   kit_status_t const s = schedule(controller, execution,
                                   time_elapsed);
 
-  if (s == KIT_OK)
-    execution_join(execution);
+  if (s != KIT_OK)
+    return s;
 
-  return s;
+  execution_join(execution);
+
+  return take_snapshot(controller, execution);
 }
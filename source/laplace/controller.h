@@ -15,10 +15,45 @@ typedef struct {
   laplace_action_t action;
 } laplace_event_t;
 
+/*  Snapshot data is taken by the snapshot entry of the state. If the
+ *  state has no such entry, the snapshot is a clone of the state.
+ *  Queued actions are copied with the state, so actions that run for
+ *  many ticks are rolled back too.
+ */
+typedef struct {
+  laplace_time_t              time;
+  ptrdiff_t                   index;
+  void                       *data;
+  laplace_snapshot_destroy_fn destroy;
+  laplace_read_write_t        state;
+  laplace_actions_snapshot_t  actions;
+} laplace_snapshot_t;
+
+/*  Inputs of an input channel in time order. The latest input before
+ *  a tick is repeated as the prediction if the channel has no input
+ *  for that tick.
+ */
+typedef struct {
+  KIT_DA(laplace_event_t) events;
+} laplace_input_t;
+
+/*  Snapshots are kept in a ring. Slots past the count keep their
+ *  states allocated, so they can be reused without cloning.
+ *
+ *  Rollback time is the earliest time of late events, or negative if
+ *  there are none.
+ */
 typedef struct {
   laplace_time_t time;
   ptrdiff_t      index;
+  laplace_time_t snapshot_interval;
+  ptrdiff_t      snapshot_first;
+  ptrdiff_t      snapshot_count;
+  int            speculative;
+  laplace_time_t rollback_time;
   KIT_DA(laplace_event_t) history;
+  KIT_DA(laplace_snapshot_t) snapshots;
+  KIT_DA(laplace_input_t) inputs;
 } laplace_controller_t;
 
 kit_status_t laplace_controller_init(laplace_controller_t *controller,
@@ -31,6 +66,44 @@ kit_status_t laplace_controller_destroy(
 kit_status_t laplace_controller_queue(
     laplace_controller_t *controller, laplace_event_t event);
 
+/*  Take a snapshot of the state and the queued actions each time
+ *  interval, and keep up to the specified number of the latest
+ *  snapshots. Rewind restores the nearest snapshot at or before the
+ *  target time and replays events only from there. Without a
+ *  snapshot, rewind resets the state and drops the queued actions.
+ *
+ *  Snapshots are taken in schedule and join, so the actual interval
+ *  may be longer. Zero interval or count disables snapshots.
+ */
+kit_status_t laplace_controller_set_snapshots(
+    laplace_controller_t *controller, laplace_time_t interval,
+    ptrdiff_t count);
+
+/*  Enable or disable speculative mode with the specified number of
+ *  input channels.
+ *
+ *  In speculative mode the controller does not wait for inputs. Each
+ *  tick, a channel that has no input for it repeats its latest input
+ *  before that tick. Events and inputs with earlier time than the
+ *  controller are accepted, and the next schedule and join rolls back
+ *  to the nearest snapshot and resimulates to the present before
+ *  going on. Predicted inputs are not added to the history, so
+ *  resimulation uses the actual ones, and the result depends only on
+ *  the inputs and not on the order they arrive in.
+ *
+ *  Schedule joins after each tick, so snapshots can be taken every
+ *  tick. A channel should have at most one input per tick.
+ */
+kit_status_t laplace_controller_set_speculative(
+    laplace_controller_t *controller, int speculative,
+    ptrdiff_t input_count);
+
+/*  Queue an event as the input of the channel.
+ */
+kit_status_t laplace_controller_queue_input(
+    laplace_controller_t *controller, ptrdiff_t input,
+    laplace_event_t event);
+
 kit_status_t laplace_controller_rewind(
     laplace_controller_t *controller, laplace_execution_t *execution,
     laplace_time_t time);
@@ -45,11 +118,18 @@ kit_status_t laplace_schedule_and_join(
 
 #ifndef LAPLACE_DISABLE_SHORT_NAMES
 #  define event_t laplace_event_t
+#  define snapshot_t laplace_snapshot_t
+#  define input_t laplace_input_t
 #  define controller_t laplace_controller_t
 
 #  define controller_init laplace_controller_init
 #  define controller_destroy laplace_controller_destroy
 #  define controller_queue laplace_controller_queue
+#  define controller_set_snapshots laplace_controller_set_snapshots
+#  define controller_set_speculative \
+    laplace_controller_set_speculative
+#  define controller_queue_input laplace_controller_queue_input
+#  define controller_rewind laplace_controller_rewind
 #  define schedule laplace_schedule
 #  define schedule_and_join laplace_schedule_and_join
 
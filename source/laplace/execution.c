@@ -1,6 +1,5 @@
 #include "execution.h"
 
-#include <kit/lower_bound.h>
 #include <kit/move_back.h>
 
 #define LOCK_                                           \
@@ -40,62 +39,236 @@
     return execution->status;                          \
   }
 
-#define ONCE_BEGIN_                                          \
-  LOCK_                                                      \
-  if (!execution->_done) {                                   \
-    if (++execution->_fence_in == execution->thread_count) { \
-      UNLOCK_                                                \
-    BROADCAST_(_on_fence)
-
-#define ONCE_END_                                               \
-  LOCK_                                                         \
-  }                                                             \
-  else {                                                        \
-    while (!execution->_done && execution->_fence_in != 0 &&    \
-           execution->_fence_in != execution->thread_count)     \
-      WAIT_(_on_fence)                                          \
-  }                                                             \
-  }                                                             \
-  else {                                                        \
-    UNLOCK_                                                     \
-    BROADCAST_(_on_fence)                                       \
-    LOCK_                                                       \
-  }                                                             \
-  if (!execution->_done) {                                      \
-    if (++execution->_fence_out == execution->thread_count) {   \
-      execution->_fence_in  = 0;                                \
-      execution->_fence_out = 0;                                \
-      UNLOCK_                                                   \
-      BROADCAST_(_on_fence)                                     \
-    } else {                                                    \
-      while (!execution->_done && execution->_fence_out != 0 && \
-             execution->_fence_out != execution->thread_count)  \
-        WAIT_(_on_fence)                                        \
-      UNLOCK_                                                   \
-    }                                                           \
-  } else {                                                      \
-    UNLOCK_                                                     \
-    BROADCAST_(_on_fence)                                       \
+#define FENCE_(serial_)                                      \
+  {                                                          \
+    kit_status_t const s_ = laplace_barrier_wait(            \
+        &execution->_fence, execution->thread_count, &sense, \
+        &(serial_));                                         \
+    if (s_ != KIT_OK)                                        \
+      return s_;                                             \
   }
 
+#define ONCE_BEGIN_ \
+  {                 \
+    int serial_;    \
+    FENCE_(serial_) \
+    if (serial_) {
+
+#define ONCE_END_ \
+  }               \
+  FENCE_(serial_) \
+  }
+
+static laplace_promise_t *promise_of_(
+    laplace_execution_t const *const    execution,
+    laplace_action_state_t const *const action) {
+  return (laplace_promise_t *) laplace_slab_frame(&execution->_frames,
+                                                  action->frame);
+}
+
+/*  Allocate a frame for the action and start its coroutine. Frames
+ *  are sized to the coroutine, and are not limited by
+ *  LAPLACE_COROUTINE_SIZE.
+ */
+static kit_status_t start_action_(
+    laplace_execution_t *const    execution,
+    laplace_action_state_t *const state,
+    laplace_action_t const        action) {
+  if (action.size < 0)
+    return LAPLACE_ERROR_INVALID_SIZE;
+
+  ptrdiff_t const size = action.size >
+                                 (ptrdiff_t) sizeof(laplace_promise_t)
+                             ? action.size
+                             : (ptrdiff_t) sizeof(laplace_promise_t);
+  ptrdiff_t const frame = laplace_slab_allocate(&execution->_frames,
+                                                size);
+  if (frame < 0)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  kit_status_t const s = laplace_promise_init(
+      (laplace_promise_t *) laplace_slab_frame(&execution->_frames,
+                                               frame),
+      laplace_slab_frame_size(&execution->_frames, frame), action,
+      laplace_execution_read_only(execution), execution->_alloc);
+
+  if (s != KIT_OK) {
+    laplace_slab_deallocate(&execution->_frames, frame);
+    return s;
+  }
+
+  state->tick_duration = action.tick_duration;
+  state->finished      = 0;
+  state->frame         = frame;
+  return KIT_OK;
+}
+
+/*  Append forks to the queue. Should be called under the lock in
+ *  multithreaded mode.
+ */
+static kit_status_t append_forks_(
+    laplace_execution_t *const execution) {
+  ptrdiff_t const n = execution->_queue.size;
+  ptrdiff_t const s = execution->_forks.size;
+  DA_RESIZE(execution->_queue, n + s);
+  if (execution->_queue.size != n + s)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  for (ptrdiff_t i = 0; i < s; i++) {
+    laplace_action_state_t *const state = execution->_queue.values +
+                                          n + i;
+    state->order = n + i;
+    state->wake  = execution->_time;
+
+    kit_status_t const status = start_action_(
+        execution, state, execution->_forks.values[i].action);
+
+    if (status != KIT_OK) {
+      DA_RESIZE(execution->_queue, n + i);
+      return status;
+    }
+  }
+
+  DA_RESIZE(execution->_forks, 0);
+  return KIT_OK;
+}
+
+/*  Release frames of finished actions and remove them from the
+ *  queue. Should be called under the lock in multithreaded mode.
+ */
+static void compact_queue_(laplace_execution_t *const execution) {
+  for (ptrdiff_t i = 0; i < execution->_queue.size; i++)
+    if (execution->_queue.values[i].finished)
+      laplace_slab_deallocate(&execution->_frames,
+                              execution->_queue.values[i].frame);
+
+  MOVE_BACK_INL(execution->_queue.size, execution->_queue,
+                execution->_queue.values[index_].finished);
+}
+
+/*  Collect actions that are due at the current tick. Should be called
+ *  under the lock in multithreaded mode.
+ */
+static kit_status_t begin_tick_(
+    laplace_execution_t *const execution) {
+  kit_status_t const s = laplace_wheel_advance(&execution->_wheel,
+                                               execution->_time);
+  if (s != KIT_OK)
+    return s;
+
+  ptrdiff_t const n = execution->_wheel.due.size;
+  DA_RESIZE(execution->_ready, n);
+  if (execution->_ready.size != n)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  if (n != 0)
+    memcpy(execution->_ready.values, execution->_wheel.due.values,
+           n * sizeof *execution->_ready.values);
+
+  return KIT_OK;
+}
+
+/*  Keep ready actions that run again during this tick, put others
+ *  to sleep, and append forks to the queue and the ready actions.
+ *  Later steps of the tick run only the ready actions, so the cost
+ *  of a tick is proportional to the work done and not to the queue
+ *  size. Should be called under the lock in multithreaded mode.
+ */
+static kit_status_t next_step_(
+    laplace_execution_t *const execution) {
+  ptrdiff_t kept = 0;
+
+  for (ptrdiff_t i = 0; i < execution->_ready.size; i++) {
+    ptrdiff_t const                     index  = execution->_ready
+                                                    .values[i];
+    laplace_action_state_t const *const action = execution->_queue
+                                                     .values +
+                                                 index;
+
+    if (action->finished)
+      execution->_finished++;
+    else if (action->wake == execution->_time)
+      execution->_ready.values[kept++] = index;
+    else {
+      kit_status_t const s = laplace_wheel_insert(
+          &execution->_wheel, execution->_time, action->wake, index);
+      if (s != KIT_OK)
+        return s;
+    }
+  }
+
+  ptrdiff_t const n = execution->_queue.size;
+
+  kit_status_t const s = append_forks_(execution);
+  if (s != KIT_OK)
+    return s;
+
+  ptrdiff_t const forks = execution->_queue.size - n;
+  DA_RESIZE(execution->_ready, kept + forks);
+  if (execution->_ready.size != kept + forks)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  for (ptrdiff_t i = 0; i < forks; i++)
+    execution->_ready.values[kept + i] = n + i;
+
+  return KIT_OK;
+}
+
+/*  Advance the time. If some actions finished, compact the queue and
+ *  rebuild the wheel, since compaction moves actions. Should be
+ *  called under the lock in multithreaded mode.
+ */
+static kit_status_t end_tick_(
+    laplace_execution_t *const execution) {
+  execution->_time++;
+  DA_RESIZE(execution->_ready, 0);
+
+  if (execution->_finished == 0)
+    return KIT_OK;
+
+  execution->_finished = 0;
+  compact_queue_(execution);
+  laplace_wheel_clear(&execution->_wheel);
+
+  for (ptrdiff_t i = 0; i < execution->_queue.size; i++) {
+    execution->_queue.values[i].order = i;
+
+    kit_status_t const s = laplace_wheel_insert(
+        &execution->_wheel, execution->_time,
+        execution->_queue.values[i].wake, i);
+    if (s != KIT_OK)
+      return s;
+  }
+
+  return KIT_OK;
+}
+
 static kit_status_t sync_routine_(
     laplace_execution_t *const execution, laplace_time_t time) {
   for (; time != 0; time--) {
+    kit_status_t const status = begin_tick_(execution);
+    if (status != KIT_OK)
+      return status;
+
     for (int done = 0; !done;) {
       done = 1;
 
-      for (ptrdiff_t i = 0; i < execution->_queue.size; i++) {
-        laplace_action_state_t *action = execution->_queue.values + i;
+      for (ptrdiff_t i = 0; i < execution->_ready.size; i++) {
+        laplace_action_state_t *action = execution->_queue.values +
+                                         execution->_ready.values[i];
 
-        if (action->clock != 0 ||
-            laplace_generator_status(&action->generator) ==
-                LAPLACE_GENERATOR_FINISHED)
+        if (action->wake != execution->_time || action->finished)
           continue;
 
         int is_continue = 0;
 
-        laplace_impact_list_t list = laplace_generator_run(
-            &action->generator);
+        laplace_promise_t *const promise = promise_of_(execution,
+                                                       action);
+        promise->alloc = laplace_arena_allocator(&execution->_arena);
+
+        laplace_impact_list_t list = laplace_promise_run(promise);
+        action->finished           = laplace_promise_finished(
+            promise);
 
         for (ptrdiff_t j = 0; j < list.size; j++) {
           laplace_impact_t *impact = list.values + j;
@@ -107,51 +280,35 @@ static kit_status_t sync_routine_(
               break;
 
             case LAPLACE_IMPACT_QUEUE_ACTION: {
-              laplace_action_state_t fork = {
-                .order = 0,
-                .clock = 0,
-                .tick_duration =
-                    impact->queue_action.action.tick_duration
+              laplace_fork_t fork = {
+                .order  = action->order,
+                .action = impact->queue_action.action
               };
 
-              laplace_generator_init(
-                  &fork.generator, impact->queue_action.action,
-                  laplace_execution_read_only(execution),
-                  execution->_alloc);
-
-              ptrdiff_t n;
-              LOWER_BOUND_INL(n, execution->_forks.size,
-                              execution->_forks.values[index_].order <
-                                  action->order);
-
-              ptrdiff_t s = execution->_forks.size;
-              DA_INSERT(execution->_forks, n, fork);
-              if (execution->_forks.size != s + 1) {
+              ptrdiff_t const n = execution->_forks.size;
+              DA_RESIZE(execution->_forks, n + 1);
+              if (execution->_forks.size != n + 1) {
                 DA_DESTROY(list);
                 return LAPLACE_ERROR_BAD_ALLOC;
               }
 
+              execution->_forks.values[n] = fork;
+
               done = 0;
             } break;
 
             default:
               if (laplace_impact_mode_of(impact) ==
                   LAPLACE_IMPACT_SYNC) {
-                laplace_impact_t x = *impact;
-                x.order            = action->order;
-
-                ptrdiff_t n;
-                LOWER_BOUND_INL(
-                    n, execution->_sync.size,
-                    execution->_sync.values[index_].order <
-                        action->order);
-
-                ptrdiff_t s = execution->_sync.size;
-                DA_INSERT(execution->_sync, n, x);
-                if (execution->_sync.size != s + 1) {
+                ptrdiff_t const n = execution->_sync.size;
+                DA_RESIZE(execution->_sync, n + 1);
+                if (execution->_sync.size != n + 1) {
                   DA_DESTROY(list);
                   return LAPLACE_ERROR_BAD_ALLOC;
                 }
+
+                execution->_sync.values[n]       = *impact;
+                execution->_sync.values[n].order = action->order;
               } else {
                 ptrdiff_t const n = execution->_async.size;
                 DA_RESIZE(execution->_async, n + 1);
@@ -168,7 +325,7 @@ static kit_status_t sync_routine_(
         DA_DESTROY(list);
 
         if (!is_continue)
-          action->clock = action->tick_duration;
+          action->wake = execution->_time + action->tick_duration;
       }
 
       if (execution->_access.apply != NULL) {
@@ -187,22 +344,12 @@ static kit_status_t sync_routine_(
         }
       }
 
-      for (ptrdiff_t i = 0; i < execution->_forks.size; i++)
-        execution->_forks.values[i].order = execution->_queue.size +
-                                            i;
-
-      ptrdiff_t const n = execution->_queue.size;
-      ptrdiff_t const s = execution->_forks.size;
-      DA_RESIZE(execution->_queue, n + s);
-      if (execution->_queue.size != n + s)
-        return LAPLACE_ERROR_BAD_ALLOC;
-
-      if (s != 0)
-        memcpy(execution->_queue.values + n, execution->_forks.values,
-               s * sizeof *execution->_queue.values);
+      kit_status_t const s = next_step_(execution);
+      if (s != KIT_OK)
+        return s;
 
       if (execution->_access.adjust_loop != NULL)
-        execution->_access.adjust_loop(execution->_access.state);
+        execution->_access.adjust_loop(execution->_access.state, 1);
 
       if (execution->_access.adjust_done != NULL)
         execution->_access.adjust_done(execution->_access.state);
@@ -212,22 +359,326 @@ static kit_status_t sync_routine_(
       DA_RESIZE(execution->_forks, 0);
     }
 
-    MOVE_BACK_INL(execution->_queue.size, execution->_queue,
-                  laplace_generator_status(
-                      &execution->_queue.values[index_].generator) ==
-                      LAPLACE_GENERATOR_FINISHED);
+    kit_status_t const s = end_tick_(execution);
+    if (s != KIT_OK)
+      return s;
+
+    laplace_arena_reset(&execution->_arena);
+  }
+
+  return KIT_OK;
+}
+
+/*  Merge impacts staged by all threads. Each thread processes actions
+ *  in increasing order, so the staged sync impacts and forks are
+ *  sorted by action order, and a k-way merge keeps the result
+ *  deterministic. Non-empty lists are kept in a binary min-heap
+ *  keyed on the order of their head element, so the merge costs
+ *  O(total log threads). Should be called under the lock.
+ */
+#define HEAD_ORDER_(list_, k_)                            \
+  (execution->_merge.values[k_]                           \
+       ->list_.values[execution->_merge.values[k_]->head] \
+       .order)
+
+#define SIFT_DOWN_(list_, k_)                                      \
+  do {                                                             \
+    ptrdiff_t const    n_ = execution->_merge.size;                \
+    ptrdiff_t          i_ = (k_);                                  \
+    laplace_staging_t *s_ = execution->_merge.values[i_];          \
+    for (;;) {                                                     \
+      ptrdiff_t c_ = 2 * i_ + 1;                                   \
+      if (c_ >= n_)                                                \
+        break;                                                     \
+      if (c_ + 1 < n_ &&                                           \
+          HEAD_ORDER_(list_, c_ + 1) < HEAD_ORDER_(list_, c_))     \
+        c_++;                                                      \
+      if (s_->list_.values[s_->head].order <=                      \
+          HEAD_ORDER_(list_, c_))                                  \
+        break;                                                     \
+      execution->_merge.values[i_] = execution->_merge.values[c_]; \
+      i_                           = c_;                           \
+    }                                                              \
+    execution->_merge.values[i_] = s_;                             \
+  } while (0)
+
+#define MERGE_BY_ORDER_(dst_, list_)                              \
+  do {                                                            \
+    ptrdiff_t n_ = 0;                                             \
+    for (ptrdiff_t k_ = 0; k_ < execution->_staging.size; k_++) { \
+      laplace_staging_t *s_ = execution->_staging.values[k_];     \
+      s_->head              = 0;                                  \
+      if (s_->list_.size != 0)                                    \
+        execution->_merge.values[n_++] = s_;                      \
+    }                                                             \
+    execution->_merge.size = n_;                                  \
+    for (ptrdiff_t k_ = n_ / 2 - 1; k_ >= 0; k_--)                \
+      SIFT_DOWN_(list_, k_);                                      \
+    for (ptrdiff_t i_ = 0; i_ < (dst_).size; i_++) {              \
+      laplace_staging_t *min_ = execution->_merge.values[0];      \
+      (dst_).values[i_]       = min_->list_.values[min_->head++]; \
+      if (min_->head == min_->list_.size)                         \
+        execution->_merge.values[0] =                             \
+            execution->_merge.values[--execution->_merge.size];   \
+      if (execution->_merge.size != 0)                            \
+        SIFT_DOWN_(list_, 0);                                     \
+    }                                                             \
+  } while (0)
+
+static int merge_staging_(laplace_execution_t *const execution) {
+  ptrdiff_t sync_size  = 0;
+  ptrdiff_t async_size = 0;
+  ptrdiff_t forks_size = 0;
+
+  for (ptrdiff_t k = 0; k < execution->_staging.size; k++) {
+    laplace_staging_t *staging = execution->_staging.values[k];
+    sync_size += staging->sync.size;
+    async_size += staging->async.size;
+    forks_size += staging->forks.size;
+    if (staging->tick_continue)
+      execution->_tick_done = 0;
+  }
+
+  DA_RESIZE(execution->_sync, sync_size);
+  DA_RESIZE(execution->_async, async_size);
+  DA_RESIZE(execution->_forks, forks_size);
+  DA_RESIZE(execution->_merge, execution->_staging.size);
+
+  if (execution->_merge.size != execution->_staging.size ||
+      execution->_sync.size != sync_size ||
+      execution->_async.size != async_size ||
+      execution->_forks.size != forks_size)
+    return 0;
+
+  MERGE_BY_ORDER_(execution->_sync, sync);
+  MERGE_BY_ORDER_(execution->_forks, forks);
+
+  for (ptrdiff_t k = 0, n = 0; k < execution->_staging.size; k++) {
+    laplace_staging_t *staging = execution->_staging.values[k];
+    if (staging->async.size != 0)
+      memcpy(execution->_async.values + n, staging->async.values,
+             staging->async.size * sizeof *staging->async.values);
+    n += staging->async.size;
+
+    staging->tick_continue = 0;
+    DA_RESIZE(staging->sync, 0);
+    DA_RESIZE(staging->async, 0);
+    DA_RESIZE(staging->forks, 0);
+  }
+
+  return 1;
+}
+
+/*  Number of indices a thread claims at once. Each thread gets a few
+ *  batches, so short queues are still split between threads.
+ */
+static ptrdiff_t claim_batch_(ptrdiff_t const size,
+                              ptrdiff_t const thread_count) {
+  ptrdiff_t const count = (thread_count > 1 ? thread_count : 1) *
+                          LAPLACE_EXECUTION_BATCHES_PER_THREAD;
+  ptrdiff_t const batch = size / count;
+
+  if (batch < 1)
+    return 1;
+  if (batch > LAPLACE_EXECUTION_MAX_BATCH)
+    return LAPLACE_EXECUTION_MAX_BATCH;
+  return batch;
+}
 
-    for (ptrdiff_t i = 0; i < execution->_queue.size; i++) {
-      execution->_queue.values[i].order = i;
-      execution->_queue.values[i].clock--;
+static kit_status_t run_action_(
+    laplace_execution_t *const    execution,
+    laplace_staging_t *const      staging,
+    laplace_action_state_t *const action) {
+  if (action->wake != execution->_time || action->finished)
+    return KIT_OK;
+
+  int is_continue = 0;
+
+  laplace_promise_t *const promise = promise_of_(execution, action);
+  promise->alloc = laplace_arena_allocator(&staging->arena);
+
+  laplace_impact_list_t list = laplace_promise_run(promise);
+  action->finished           = laplace_promise_finished(promise);
+
+  for (ptrdiff_t j = 0; j < list.size; j++) {
+    laplace_impact_t *impact = list.values + j;
+
+    switch (impact->type) {
+      case LAPLACE_IMPACT_TICK_CONTINUE:
+        is_continue            = 1;
+        staging->tick_continue = 1;
+        break;
+
+      case LAPLACE_IMPACT_QUEUE_ACTION: {
+        laplace_fork_t fork = { .order  = action->order,
+                                .action = impact->queue_action
+                                              .action };
+
+        ptrdiff_t const n = staging->forks.size;
+        DA_RESIZE(staging->forks, n + 1);
+        if (staging->forks.size != n + 1) {
+          DA_DESTROY(list);
+          return LAPLACE_ERROR_BAD_ALLOC;
+        }
+
+        staging->forks.values[n] = fork;
+        staging->tick_continue   = 1;
+      } break;
+
+      default:
+        if (laplace_impact_mode_of(impact) == LAPLACE_IMPACT_SYNC) {
+          ptrdiff_t const n = staging->sync.size;
+          DA_RESIZE(staging->sync, n + 1);
+          if (staging->sync.size != n + 1) {
+            DA_DESTROY(list);
+            return LAPLACE_ERROR_BAD_ALLOC;
+          }
+
+          staging->sync.values[n]       = *impact;
+          staging->sync.values[n].order = action->order;
+        } else {
+          ptrdiff_t const n = staging->async.size;
+          DA_RESIZE(staging->async, n + 1);
+          if (staging->async.size != n + 1) {
+            DA_DESTROY(list);
+            return LAPLACE_ERROR_BAD_ALLOC;
+          }
+
+          staging->async.values[n] = *impact;
+        }
     }
   }
 
+  DA_DESTROY(list);
+
+  if (!is_continue)
+    action->wake = execution->_time + action->tick_duration;
+
   return KIT_OK;
 }
 
-static kit_status_t routine_internal_(
+/*  Run ready actions, claimed in batches. Called by all threads at
+ *  once.
+ */
+static kit_status_t run_actions_(laplace_execution_t *const execution,
+                                 laplace_staging_t *const   staging) {
+  for (;;) {
+    ptrdiff_t const begin = atomic_fetch_add_explicit(
+        &execution->_queue_index, execution->_queue_batch,
+        memory_order_relaxed);
+    if (begin >= execution->_ready_end)
+      break;
+    ptrdiff_t const end = begin + execution->_queue_batch <
+                                  execution->_ready_end
+                              ? begin + execution->_queue_batch
+                              : execution->_ready_end;
+
+    for (ptrdiff_t i = begin; i < end; i++) {
+      kit_status_t const s = run_action_(
+          execution, staging,
+          execution->_queue.values + execution->_ready.values[i]);
+      if (s != KIT_OK)
+        return s;
+    }
+  }
+
+  return KIT_OK;
+}
+
+/*  Apply async impacts, claimed in batches. Called by all threads at
+ *  once.
+ */
+static kit_status_t apply_async_(
+    laplace_execution_t *const execution) {
+  if (execution->_access.apply == NULL)
+    return KIT_OK;
+
+  ptrdiff_t const size  = execution->_async.size;
+  ptrdiff_t const batch = claim_batch_(size, execution->thread_count);
+
+  for (;;) {
+    ptrdiff_t const begin = atomic_fetch_add_explicit(
+        &execution->_async_index, batch, memory_order_relaxed);
+    if (begin >= size)
+      break;
+    ptrdiff_t const end = begin + batch < size ? begin + batch
+                                               : size;
+
+    for (ptrdiff_t i = begin; i < end; i++) {
+      kit_status_t const s = execution->_access.apply(
+          execution->_access.state, execution->_async.values + i);
+      if (s != KIT_OK)
+        return s;
+    }
+  }
+
+  return KIT_OK;
+}
+
+static void step_begin_(laplace_execution_t *const execution) {
+  execution->_tick_done   = 1;
+  execution->_ready_end   = execution->_ready.size;
+  execution->_queue_batch = claim_batch_(execution->_ready_end,
+                                         execution->thread_count);
+}
+
+/*  Merge staged impacts and apply sync impacts. Block ids and offsets
+ *  are assigned here in action order, new blocks are cleared by all
+ *  threads.
+ */
+static kit_status_t apply_sync_(
     laplace_execution_t *const execution) {
+  atomic_store_explicit(&execution->_queue_index, 0,
+                        memory_order_relaxed);
+
+  LOCK_
+  int const ok_ = merge_staging_(execution);
+  UNLOCK_
+
+  if (!ok_)
+    return LAPLACE_ERROR_BAD_ALLOC;
+
+  execution->_clear = execution->_sync.size != 0 &&
+                      execution->_access.apply_deferred != NULL &&
+                      execution->_access.clear_loop != NULL &&
+                      execution->_access.clear_done != NULL;
+
+  laplace_apply_fn const apply = execution->_clear
+                                     ? execution->_access
+                                           .apply_deferred
+                                     : execution->_access.apply;
+
+  kit_status_t res = KIT_OK;
+
+  if (apply != NULL)
+    for (ptrdiff_t i = 0; i < execution->_sync.size; i++)
+      res = apply(execution->_access.state,
+                  execution->_sync.values + i);
+  DA_RESIZE(execution->_sync, 0);
+
+  return res;
+}
+
+static kit_status_t step_end_(laplace_execution_t *const execution) {
+  atomic_store_explicit(&execution->_async_index, 0,
+                        memory_order_relaxed);
+  DA_RESIZE(execution->_async, 0);
+
+  if (execution->_clear)
+    execution->_access.clear_done(execution->_access.state);
+
+  LOCK_
+  kit_status_t const s = next_step_(execution);
+  UNLOCK_
+
+  return s;
+}
+
+static kit_status_t routine_internal_(
+    laplace_execution_t *const execution,
+    laplace_staging_t *const   staging) {
+  int sense = laplace_barrier_sense(&execution->_fence);
+
   LOCK_
   while (!execution->_done) {
     while (!execution->_done && execution->_ticks == 0)
@@ -236,8 +687,16 @@ static kit_status_t routine_internal_(
     while (!execution->_done && execution->_ticks != 0) {
       UNLOCK_
 
-      ONCE_BEGIN_
-      execution->_tick_done = 0;
+      ONCE_BEGIN_ {
+        execution->_tick_done = 0;
+
+        LOCK_
+        kit_status_t const s = begin_tick_(execution);
+        UNLOCK_
+
+        if (s != KIT_OK)
+          return s;
+      }
       ONCE_END_
 
       LOCK_
@@ -245,178 +704,42 @@ static kit_status_t routine_internal_(
         UNLOCK_
 
         ONCE_BEGIN_
-        execution->_tick_done = 1;
+        step_begin_(execution);
         ONCE_END_
 
-        LOCK_
-        while (execution->_queue_index < execution->_queue.size) {
-          ptrdiff_t i = execution->_queue_index++;
-          UNLOCK_
-
-          laplace_action_state_t *action = execution->_queue.values +
-                                           i;
-
-          if (action->clock != 0 ||
-              laplace_generator_status(&action->generator) ==
-                  LAPLACE_GENERATOR_FINISHED) {
-            LOCK_
-            continue;
-          }
-
-          int is_continue = 0;
-
-          laplace_impact_list_t list = laplace_generator_run(
-              &action->generator);
-
-          for (ptrdiff_t j = 0; j < list.size; j++) {
-            laplace_impact_t *impact = list.values + j;
-
-            switch (impact->type) {
-              case LAPLACE_IMPACT_TICK_CONTINUE:
-                is_continue = 1;
-                LOCK_
-                execution->_tick_done = 0;
-                UNLOCK_
-                break;
-
-              case LAPLACE_IMPACT_QUEUE_ACTION: {
-                laplace_action_state_t fork = {
-                  .order = 0,
-                  .clock = 0,
-                  .tick_duration =
-                      impact->queue_action.action.tick_duration
-                };
-
-                laplace_generator_init(
-                    &fork.generator, impact->queue_action.action,
-                    laplace_execution_read_only(execution),
-                    execution->_alloc);
-
-                LOCK_
-                ptrdiff_t n;
-                ptrdiff_t s = execution->_forks.size;
-                LOWER_BOUND_INL(
-                    n, execution->_forks.size,
-                    execution->_forks.values[index_].order <
-                        action->order);
-                DA_INSERT(execution->_forks, n, fork);
-                int ok_ = execution->_forks.size == s + 1;
-                UNLOCK_
-
-                if (!ok_) {
-                  DA_DESTROY(list);
-                  return LAPLACE_ERROR_BAD_ALLOC;
-                }
-
-                LOCK_
-                execution->_tick_done = 0;
-                UNLOCK_
-              } break;
-
-              default:
-                if (laplace_impact_mode_of(impact) ==
-                    LAPLACE_IMPACT_SYNC) {
-                  laplace_impact_t x = *impact;
-                  x.order            = action->order;
-
-                  LOCK_
-                  ptrdiff_t n;
-                  ptrdiff_t s = execution->_sync.size;
-                  LOWER_BOUND_INL(
-                      n, execution->_sync.size,
-                      execution->_sync.values[index_].order <
-                          action->order);
-                  DA_INSERT(execution->_sync, n, x);
-                  int ok_ = execution->_sync.size == s + 1;
-                  UNLOCK_
-
-                  if (!ok_) {
-                    DA_DESTROY(list);
-                    return LAPLACE_ERROR_BAD_ALLOC;
-                  }
-
-                } else {
-                  LOCK_
-                  ptrdiff_t const n = execution->_async.size;
-                  DA_RESIZE(execution->_async, n + 1);
-                  int ok_ = execution->_async.size == n + 1;
-                  UNLOCK_
-
-                  if (!ok_) {
-                    DA_DESTROY(list);
-                    return LAPLACE_ERROR_BAD_ALLOC;
-                  }
-
-                  execution->_async.values[n] = *impact;
-                }
-            }
-          }
-
-          DA_DESTROY(list);
-
-          if (!is_continue)
-            action->clock = action->tick_duration;
-
-          LOCK_
-        }
-        UNLOCK_
-
-        kit_status_t res = KIT_OK;
+        kit_status_t res = run_actions_(execution, staging);
+        if (res != KIT_OK)
+          return res;
 
-        ONCE_BEGIN_ {
-          execution->_queue_index = 0;
-
-          if (execution->_access.apply != NULL)
-            for (ptrdiff_t i = 0; i < execution->_sync.size; i++)
-              res = execution->_access.apply(execution->_access.state,
-                                             execution->_sync.values +
-                                                 i);
-          DA_RESIZE(execution->_sync, 0);
-        }
+        ONCE_BEGIN_
+        res = apply_sync_(execution);
         ONCE_END_
 
         if (res != KIT_OK)
           return res;
 
-        LOCK_
-        if (execution->_access.apply != NULL)
-          while (execution->_async_index != execution->_async.size) {
-            ptrdiff_t i = execution->_async_index++;
-            UNLOCK_
-
-            res = execution->_access.apply(execution->_access.state,
-                                           execution->_async.values +
-                                               i);
-
-            if (res != KIT_OK)
-              return res;
+        if (execution->_clear) {
+          int serial;
+          execution->_access.clear_loop(execution->_access.state,
+                                        execution->thread_count);
+          FENCE_(serial)
+          (void) serial;
+        }
 
-            LOCK_
-          }
-        UNLOCK_
+        res = apply_async_(execution);
+        if (res != KIT_OK)
+          return res;
 
         ONCE_BEGIN_ {
-          execution->_async_index = 0;
-          DA_RESIZE(execution->_async, 0);
-
-          for (ptrdiff_t i = 0; i < execution->_forks.size; i++)
-            execution->_forks.values[i].order =
-                execution->_queue.size + i;
-          ptrdiff_t const n = execution->_queue.size;
-          ptrdiff_t const s = execution->_forks.size;
-          DA_RESIZE(execution->_queue, n + s);
-          if (execution->_queue.size != n + s)
-            return LAPLACE_ERROR_BAD_ALLOC;
-          if (s != 0)
-            memcpy(execution->_queue.values + n,
-                   execution->_forks.values,
-                   s * sizeof *execution->_queue.values);
-          DA_RESIZE(execution->_forks, 0);
+          kit_status_t const s = step_end_(execution);
+          if (s != KIT_OK)
+            return s;
         }
         ONCE_END_
 
         if (execution->_access.adjust_loop != NULL)
-          execution->_access.adjust_loop(execution->_access.state);
+          execution->_access.adjust_loop(execution->_access.state,
+                                         execution->thread_count);
 
         ONCE_BEGIN_
         if (execution->_access.adjust_done != NULL)
@@ -428,25 +751,23 @@ static kit_status_t routine_internal_(
       UNLOCK_
 
       ONCE_BEGIN_ {
-        MOVE_BACK_INL(
-            execution->_queue.size, execution->_queue,
-            laplace_generator_status(
-                &execution->_queue.values[index_].generator) ==
-                LAPLACE_GENERATOR_FINISHED);
-
         LOCK_
-        for (ptrdiff_t i = 0; i < execution->_queue.size; i++) {
-          execution->_queue.values[i].order = i;
-          execution->_queue.values[i].clock--;
-        }
-        int joined = (--execution->_ticks == 0);
+        kit_status_t const s      = end_tick_(execution);
+        int const          joined = (--execution->_ticks == 0);
         UNLOCK_
 
+        if (s != KIT_OK)
+          return s;
         if (joined)
           BROADCAST_(_on_join)
       }
       ONCE_END_
 
+      /*  All impacts of the tick are applied, so memory generators
+       *  allocated during the tick can be released.
+       */
+      laplace_arena_reset(&staging->arena);
+
       LOCK_
     }
   }
@@ -455,8 +776,60 @@ static kit_status_t routine_internal_(
   return KIT_OK;
 }
 
+static void staging_init_(laplace_execution_t const *const execution,
+                          laplace_staging_t *const         staging) {
+  memset(staging, 0, sizeof *staging);
+  laplace_arena_init(&staging->arena, execution->_alloc);
+  DA_INIT(staging->sync, 0, execution->_alloc);
+  DA_INIT(staging->async, 0, execution->_alloc);
+  DA_INIT(staging->forks, 0, execution->_alloc);
+}
+
+static void staging_destroy_(laplace_staging_t *const staging) {
+  DA_DESTROY(staging->sync);
+  DA_DESTROY(staging->async);
+  DA_DESTROY(staging->forks);
+  laplace_arena_destroy(&staging->arena);
+}
+
+static kit_status_t stage_begin_(laplace_execution_t *const execution,
+                                 laplace_staging_t *const   staging) {
+  staging_init_(execution, staging);
+
+  LOCK_
+  ptrdiff_t const n = execution->_staging.size;
+  DA_RESIZE(execution->_staging, n + 1);
+  int const ok_ = execution->_staging.size == n + 1;
+  if (ok_)
+    execution->_staging.values[n] = staging;
+  UNLOCK_
+
+  return ok_ ? KIT_OK : LAPLACE_ERROR_BAD_ALLOC;
+}
+
+static void stage_end_(laplace_execution_t *const execution,
+                       laplace_staging_t *const   staging) {
+  /*  Other threads may still read impacts allocated from the arena,
+   *  so its memory is kept until the threads are joined.
+   */
+  if (mtx_lock(&execution->_lock) == thrd_success) {
+    MOVE_BACK_INL(execution->_staging.size, execution->_staging,
+                  execution->_staging.values[index_] == staging);
+    laplace_arena_merge(&execution->_retired, &staging->arena);
+    (void) mtx_unlock(&execution->_lock);
+  }
+
+  staging_destroy_(staging);
+}
+
 static int routine_(laplace_execution_t *const execution) {
-  kit_status_t s = routine_internal_(execution);
+  laplace_staging_t staging;
+  kit_status_t      s = stage_begin_(execution, &staging);
+
+  if (s == KIT_OK)
+    s = routine_internal_(execution, &staging);
+
+  stage_end_(execution, &staging);
 
   if (s != KIT_OK) {
     LOCK_
@@ -464,7 +837,8 @@ static int routine_(laplace_execution_t *const execution) {
     execution->_done  = 1;
     UNLOCK_
 
-    BROADCAST_(_on_fence);
+    if (laplace_barrier_cancel(&execution->_fence) != KIT_OK)
+      return 0;
     BROADCAST_(_on_tick);
     BROADCAST_(_on_join);
   }
@@ -472,6 +846,259 @@ static int routine_(laplace_execution_t *const execution) {
   return 0;
 }
 
+/*  Stages of a tick that run as pool tasks. Tick stands for the
+ *  beginning of a tick and has no tasks.
+ */
+enum {
+  STAGE_TICK_,
+  STAGE_ACTIONS_,
+  STAGE_CLEAR_,
+  STAGE_ASYNC_,
+  STAGE_ADJUST_
+};
+
+static void stage_fail_(laplace_execution_t *const execution,
+                        kit_status_t const         status) {
+  if (mtx_lock(&execution->_lock) != thrd_success)
+    return;
+  execution->status = status;
+  execution->_done  = 1;
+  (void) mtx_unlock(&execution->_lock);
+}
+
+static int stage_has_work_(laplace_execution_t const *const execution,
+                           int const                        stage) {
+  switch (stage) {
+    case STAGE_ACTIONS_: return execution->_ready_end != 0;
+    case STAGE_CLEAR_: return execution->_clear;
+    case STAGE_ASYNC_:
+      return execution->_access.apply != NULL &&
+             execution->_async.size != 0;
+    case STAGE_ADJUST_:
+      return execution->_access.adjust_loop != NULL;
+    default: return 0;
+  }
+}
+
+static void stage_submit_(laplace_execution_t *execution, int stage);
+
+/*  Run serial parts of the tick, starting after the stage, until the
+ *  next stage with work is submitted. When the ticks are done or the
+ *  execution is stopped, mark it idle. Called by the last task of a
+ *  stage, or by schedule to begin a tick.
+ */
+static void stage_advance_(laplace_execution_t *const execution,
+                           int                        stage) {
+  kit_status_t s = KIT_OK;
+
+  for (;;) {
+    if (mtx_lock(&execution->_lock) != thrd_success) {
+      s = LAPLACE_ERROR_BAD_MUTEX_LOCK;
+      break;
+    }
+    int const done = execution->_done;
+    (void) mtx_unlock(&execution->_lock);
+
+    if (done)
+      break;
+
+    int next = stage + 1;
+
+    switch (stage) {
+      case STAGE_TICK_:
+        if (mtx_lock(&execution->_lock) != thrd_success) {
+          s = LAPLACE_ERROR_BAD_MUTEX_LOCK;
+          break;
+        }
+        s = begin_tick_(execution);
+        (void) mtx_unlock(&execution->_lock);
+
+        if (s == KIT_OK)
+          step_begin_(execution);
+        break;
+
+      case STAGE_ACTIONS_: s = apply_sync_(execution); break;
+      case STAGE_ASYNC_: s = step_end_(execution); break;
+
+      case STAGE_ADJUST_:
+        if (execution->_access.adjust_done != NULL)
+          execution->_access.adjust_done(execution->_access.state);
+
+        next = STAGE_ACTIONS_;
+
+        if (!execution->_tick_done) {
+          step_begin_(execution);
+          break;
+        }
+
+        /*  All impacts of the tick are applied, so memory generators
+         *  allocated during the tick can be released.
+         */
+        for (ptrdiff_t i = 0; i < execution->_tasks.size; i++)
+          laplace_arena_reset(&execution->_tasks.values[i]
+                                   .staging.arena);
+
+        if (mtx_lock(&execution->_lock) != thrd_success) {
+          s = LAPLACE_ERROR_BAD_MUTEX_LOCK;
+          break;
+        }
+        s = end_tick_(execution);
+        int const joined = s == KIT_OK && --execution->_ticks == 0;
+        if (joined) {
+          execution->_busy = 0;
+          (void) cnd_broadcast(&execution->_on_join);
+        }
+        (void) mtx_unlock(&execution->_lock);
+
+        if (joined)
+          return;
+
+        next = STAGE_TICK_;
+        break;
+
+      default:;
+    }
+
+    if (s != KIT_OK)
+      break;
+
+    if (stage_has_work_(execution, next)) {
+      stage_submit_(execution, next);
+      return;
+    }
+
+    stage = next;
+  }
+
+  if (s != KIT_OK)
+    stage_fail_(execution, s);
+
+  if (mtx_lock(&execution->_lock) != thrd_success)
+    return;
+  execution->_busy = 0;
+  (void) cnd_broadcast(&execution->_on_join);
+  (void) mtx_unlock(&execution->_lock);
+}
+
+static void stage_done_(laplace_execution_t *const execution,
+                        ptrdiff_t const            count) {
+  if (atomic_fetch_add_explicit(&execution->_stage_pending, -count,
+                                memory_order_acq_rel) == count)
+    stage_advance_(execution, execution->_stage);
+}
+
+static void stage_task_(void *const data) {
+  laplace_stage_task_t *const task      = (laplace_stage_task_t *)
+      data;
+  laplace_execution_t *const  execution = task->execution;
+  kit_status_t                s         = KIT_OK;
+
+  switch (execution->_stage) {
+    case STAGE_ACTIONS_:
+      s = run_actions_(execution, &task->staging);
+      break;
+
+    case STAGE_CLEAR_:
+      execution->_access.clear_loop(execution->_access.state,
+                                    execution->thread_count);
+      break;
+
+    case STAGE_ASYNC_: s = apply_async_(execution); break;
+
+    case STAGE_ADJUST_:
+      execution->_access.adjust_loop(execution->_access.state,
+                                     execution->thread_count);
+      break;
+
+    default:;
+  }
+
+  if (s != KIT_OK)
+    stage_fail_(execution, s);
+
+  stage_done_(execution, 1);
+}
+
+/*  Submit a task per thread. The stage can finish and the execution
+ *  can be destroyed as soon as the last task is submitted, so the
+ *  execution is not touched after that.
+ */
+static void stage_submit_(laplace_execution_t *const execution,
+                          int const                  stage) {
+  ptrdiff_t const n = execution->_tasks.size;
+
+  execution->_stage = stage;
+  atomic_store_explicit(&execution->_stage_pending, n,
+                        memory_order_relaxed);
+
+  for (ptrdiff_t i = 0; i < n; i++) {
+    kit_status_t const s = execution->_thread_pool.submit(
+        execution->_thread_pool.state, stage_task_,
+        execution->_tasks.values + i);
+
+    if (s != KIT_OK) {
+      stage_fail_(execution, s);
+      stage_done_(execution, n - i);
+      return;
+    }
+  }
+}
+
+static kit_status_t set_task_count_(
+    laplace_execution_t *const execution, ptrdiff_t const count) {
+  if (count < 0)
+    return LAPLACE_ERROR_INVALID_SIZE;
+
+  LOCK_
+  while (execution->_busy)
+    WAIT_(_on_join)
+
+  ptrdiff_t const n = execution->_tasks.size;
+
+  for (ptrdiff_t i = count; i < n; i++)
+    staging_destroy_(&execution->_tasks.values[i].staging);
+
+  DA_RESIZE(execution->_staging, count);
+  if (execution->_staging.size == count)
+    DA_RESIZE(execution->_tasks, count);
+
+  if (execution->_tasks.size != count) {
+    DA_RESIZE(execution->_staging, n);
+    UNLOCK_
+    return LAPLACE_ERROR_BAD_ALLOC;
+  }
+
+  for (ptrdiff_t i = 0; i < count; i++) {
+    laplace_stage_task_t *const task = execution->_tasks.values + i;
+    if (i >= n) {
+      task->execution = execution;
+      staging_init_(execution, &task->staging);
+    }
+    execution->_staging.values[i] = &task->staging;
+  }
+
+  execution->thread_count = count;
+  UNLOCK_
+
+  return KIT_OK;
+}
+
+static kit_status_t schedule_tasks_(
+    laplace_execution_t *const execution, laplace_time_t const time) {
+  LOCK_
+  execution->_ticks += time;
+  int const start = !execution->_busy && !execution->_done &&
+                    execution->_ticks != 0;
+  if (start)
+    execution->_busy = 1;
+  UNLOCK_
+
+  if (start)
+    stage_advance_(execution, STAGE_TICK_);
+
+  return KIT_OK;
+}
+
 static kit_status_t append_tick_(laplace_execution_t *const execution,
                                  laplace_time_t const       time) {
   if (mtx_lock(&execution->_lock) != thrd_success)
@@ -505,11 +1132,13 @@ kit_status_t laplace_execution_init(
     return LAPLACE_ERROR_BAD_CNDVAR_INIT;
   }
 
-  if (cnd_init(&execution->_on_fence) != thrd_success) {
+  kit_status_t const s = laplace_barrier_init(&execution->_fence);
+
+  if (s != KIT_OK) {
     mtx_destroy(&execution->_lock);
     cnd_destroy(&execution->_on_tick);
     cnd_destroy(&execution->_on_join);
-    return LAPLACE_ERROR_BAD_CNDVAR_INIT;
+    return s;
   }
 
   if (access.acquire != NULL)
@@ -526,6 +1155,14 @@ kit_status_t laplace_execution_init(
   DA_INIT(execution->_forks, 0, alloc);
   DA_INIT(execution->_sync, 0, alloc);
   DA_INIT(execution->_async, 0, alloc);
+  DA_INIT(execution->_staging, 0, alloc);
+  DA_INIT(execution->_merge, 0, alloc);
+  DA_INIT(execution->_ready, 0, alloc);
+  DA_INIT(execution->_tasks, 0, alloc);
+  laplace_slab_init(&execution->_frames, alloc);
+  laplace_wheel_init(&execution->_wheel, alloc);
+  laplace_arena_init(&execution->_arena, alloc);
+  laplace_arena_init(&execution->_retired, alloc);
 
   return KIT_OK;
 }
@@ -537,15 +1174,25 @@ void laplace_execution_destroy(laplace_execution_t *const execution) {
   }
 
   (void) cnd_broadcast(&execution->_on_tick);
-  (void) cnd_broadcast(&execution->_on_fence);
+  (void) laplace_barrier_cancel(&execution->_fence);
 
   if (execution->_thread_pool.join != NULL)
     execution->_thread_pool.join(execution->_thread_pool.state);
 
+  if (mtx_lock(&execution->_lock) == thrd_success) {
+    while (execution->_busy &&
+           cnd_wait(&execution->_on_join, &execution->_lock) ==
+               thrd_success) { }
+    (void) mtx_unlock(&execution->_lock);
+  }
+
+  for (ptrdiff_t i = 0; i < execution->_tasks.size; i++)
+    staging_destroy_(&execution->_tasks.values[i].staging);
+
   mtx_destroy(&execution->_lock);
   cnd_destroy(&execution->_on_tick);
   cnd_destroy(&execution->_on_join);
-  cnd_destroy(&execution->_on_fence);
+  laplace_barrier_destroy(&execution->_fence);
 
   if (execution->_access.release != NULL)
     execution->_access.release(execution->_access.state);
@@ -557,6 +1204,14 @@ void laplace_execution_destroy(laplace_execution_t *const execution) {
   DA_DESTROY(execution->_forks);
   DA_DESTROY(execution->_sync);
   DA_DESTROY(execution->_async);
+  DA_DESTROY(execution->_staging);
+  DA_DESTROY(execution->_merge);
+  DA_DESTROY(execution->_ready);
+  DA_DESTROY(execution->_tasks);
+  laplace_slab_destroy(&execution->_frames);
+  laplace_wheel_destroy(&execution->_wheel);
+  laplace_arena_destroy(&execution->_arena);
+  laplace_arena_destroy(&execution->_retired);
 }
 
 kit_status_t laplace_execution_set_thread_count(
@@ -564,9 +1219,13 @@ kit_status_t laplace_execution_set_thread_count(
     ptrdiff_t const            thread_count) {
   if (execution->_thread_pool.run == NULL &&
       execution->_thread_pool.join == NULL &&
+      execution->_thread_pool.submit == NULL &&
       execution->thread_count == 0 && thread_count == 0)
     return KIT_OK;
 
+  if (execution->_thread_pool.submit != NULL)
+    return set_task_count_(execution, thread_count);
+
   if (execution->_thread_pool.run == NULL ||
       execution->_thread_pool.join == NULL)
     return LAPLACE_ERROR_NO_THREAD_POOL;
@@ -577,14 +1236,20 @@ kit_status_t laplace_execution_set_thread_count(
     UNLOCK_
 
     BROADCAST_(_on_tick)
-    BROADCAST_(_on_fence)
+
+    kit_status_t const s = laplace_barrier_cancel(&execution->_fence);
+    if (s != KIT_OK)
+      return s;
 
     execution->_thread_pool.join(execution->_thread_pool.state);
 
     LOCK_
     execution->_done = 0;
+    laplace_arena_destroy(&execution->_retired);
     UNLOCK_
 
+    laplace_barrier_reset(&execution->_fence);
+
     if (thread_count != 0) {
       kit_status_t const s = execution->_thread_pool.run(
           execution->_thread_pool.state, thread_count,
@@ -640,13 +1305,22 @@ kit_status_t laplace_execution_queue(
     return LAPLACE_ERROR_BAD_ALLOC;
   }
 
-  execution->_queue.values[n].order         = n;
-  execution->_queue.values[n].clock         = execution->_ticks;
-  execution->_queue.values[n].tick_duration = action.tick_duration;
+  laplace_action_state_t *const state = execution->_queue.values + n;
 
-  kit_status_t s = laplace_generator_init(
-      &execution->_queue.values[n].generator, action,
-      laplace_execution_read_only(execution), execution->_alloc);
+  state->order = n;
+  state->wake  = execution->_time + execution->_ticks;
+
+  kit_status_t s = start_action_(execution, state, action);
+
+  if (s == KIT_OK) {
+    s = laplace_wheel_insert(&execution->_wheel, execution->_time,
+                             state->wake, n);
+    if (s != KIT_OK)
+      laplace_slab_deallocate(&execution->_frames, state->frame);
+  }
+
+  if (s != KIT_OK)
+    DA_RESIZE(execution->_queue, n);
 
   UNLOCK_
 
@@ -658,18 +1332,152 @@ kit_status_t laplace_execution_schedule(
   if (execution->thread_count == 0)
     return sync_routine_(execution, time_elapsed);
 
+  if (execution->_thread_pool.submit != NULL)
+    return schedule_tasks_(execution, time_elapsed);
+
   return append_tick_(execution, time_elapsed);
 }
 
+void laplace_actions_snapshot_init(
+    laplace_actions_snapshot_t *const snapshot,
+    kit_allocator_t const             alloc) {
+  DA_INIT(snapshot->actions, 0, alloc);
+  DA_INIT(snapshot->frames, 0, alloc);
+}
+
+void laplace_actions_snapshot_destroy(
+    laplace_actions_snapshot_t *const snapshot) {
+  DA_DESTROY(snapshot->actions);
+  DA_DESTROY(snapshot->frames);
+}
+
+kit_status_t laplace_execution_snapshot_actions(
+    laplace_execution_t *const        execution,
+    laplace_actions_snapshot_t *const snapshot) {
+  LOCK_
+
+  ptrdiff_t const n    = execution->_queue.size;
+  ptrdiff_t       size = 0;
+
+  for (ptrdiff_t i = 0; i < n; i++)
+    size += laplace_slab_frame_size(
+        &execution->_frames, execution->_queue.values[i].frame);
+
+  DA_RESIZE(snapshot->actions, n);
+  DA_RESIZE(snapshot->frames, size);
+
+  if (snapshot->actions.size != n || snapshot->frames.size != size) {
+    UNLOCK_
+    return LAPLACE_ERROR_BAD_ALLOC;
+  }
+
+  for (ptrdiff_t i = 0, offset = 0; i < n; i++) {
+    laplace_action_state_t const *const action = execution->_queue
+                                                     .values +
+                                                 i;
+    ptrdiff_t const frame_size = laplace_slab_frame_size(
+        &execution->_frames, action->frame);
+
+    memcpy(snapshot->frames.values + offset,
+           laplace_slab_frame(&execution->_frames, action->frame),
+           frame_size);
+
+    snapshot->actions.values[i]       = *action;
+    snapshot->actions.values[i].wake  = action->wake -
+                                       execution->_time;
+    snapshot->actions.values[i].frame = offset;
+
+    offset += frame_size;
+  }
+
+  UNLOCK_
+
+  return KIT_OK;
+}
+
+kit_status_t laplace_execution_restore_actions(
+    laplace_execution_t *const              execution,
+    laplace_actions_snapshot_t const *const snapshot) {
+  LOCK_
+
+  for (ptrdiff_t i = 0; i < execution->_queue.size; i++)
+    laplace_slab_deallocate(&execution->_frames,
+                            execution->_queue.values[i].frame);
+
+  laplace_wheel_clear(&execution->_wheel);
+
+  ptrdiff_t const n = snapshot != NULL ? snapshot->actions.size : 0;
+
+  DA_RESIZE(execution->_queue, n);
+
+  kit_status_t s = execution->_queue.size == n
+                       ? KIT_OK
+                       : LAPLACE_ERROR_BAD_ALLOC;
+
+  ptrdiff_t count = 0;
+
+  while (s == KIT_OK && count < n) {
+    laplace_action_state_t const *const action = snapshot->actions
+                                                     .values +
+                                                 count;
+    ptrdiff_t const offset     = action->frame;
+    ptrdiff_t const frame_size = (count + 1 < n
+                                      ? action[1].frame
+                                      : snapshot->frames.size) -
+                                 offset;
+    ptrdiff_t const frame = laplace_slab_allocate(&execution->_frames,
+                                                  frame_size);
+
+    if (frame < 0) {
+      s = LAPLACE_ERROR_BAD_ALLOC;
+      break;
+    }
+
+    memcpy(laplace_slab_frame(&execution->_frames, frame),
+           snapshot->frames.values + offset, frame_size);
+
+    laplace_action_state_t *const state = execution->_queue.values +
+                                          count;
+
+    *state       = *action;
+    state->order = count;
+    state->wake  = execution->_time + action->wake;
+    state->frame = frame;
+
+    s = laplace_wheel_insert(&execution->_wheel, execution->_time,
+                             state->wake, count);
+
+    if (s != KIT_OK)
+      laplace_slab_deallocate(&execution->_frames, frame);
+    else
+      count++;
+  }
+
+  /*  On failure the restored part is kept, so the queue stays
+   *  consistent with the wheel.
+   */
+  if (s != KIT_OK)
+    DA_RESIZE(execution->_queue, count);
+
+  UNLOCK_
+
+  return s;
+}
+
 void laplace_execution_join(laplace_execution_t *execution) {
   if (execution->thread_count == 0)
     return;
 
   if (mtx_lock(&execution->_lock) != thrd_success)
     return;
-  while (!execution->_done && execution->_ticks != 0 &&
-         cnd_wait(&execution->_on_join, &execution->_lock) ==
-             thrd_success) { }
+  if (execution->_thread_pool.submit != NULL)
+    while (execution->_busy &&
+           cnd_wait(&execution->_on_join, &execution->_lock) ==
+               thrd_success) { }
+  else
+    while (!execution->_done && execution->_ticks != 0 &&
+           cnd_wait(&execution->_on_join, &execution->_lock) ==
+               thrd_success) { }
   (void) mtx_unlock(&execution->_lock);
 }
 
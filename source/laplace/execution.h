@@ -2,8 +2,12 @@
 #define LAPLACE_EXECUTION_H
 
 #include "access.h"
+#include "arena.h"
+#include "barrier.h"
 #include "generator.h"
 #include "impact.h"
+#include "slab.h"
+#include "wheel.h"
 
 #include <kit/allocator.h>
 #include <kit/atomic.h>
@@ -15,6 +19,11 @@
 extern "C" {
 #endif
 
+enum {
+  LAPLACE_EXECUTION_BATCHES_PER_THREAD = 8,
+  LAPLACE_EXECUTION_MAX_BATCH          = 64
+};
+
 typedef struct laplace_execution laplace_execution_t;
 
 typedef int (*laplace_pool_routine_fn)(void *execution);
@@ -25,21 +34,81 @@ typedef kit_status_t (*laplace_pool_run_fn)(
 
 typedef void (*laplace_pool_join_fn)(void *state);
 
+typedef void (*laplace_pool_task_fn)(void *data);
+
+typedef kit_status_t (*laplace_pool_submit_fn)(
+    void *state, laplace_pool_task_fn fn, void *data);
+
+/*  Thread pool of the execution.
+ *
+ *  If submit is set, ticks run as tasks. Each stage of a tick is
+ *  split into as many tasks as the thread count, and the last task
+ *  of a stage runs the serial part and submits the next stage. The
+ *  execution holds no threads between tasks, so the thread count is
+ *  not limited by the pool size.
+ *
+ *  Otherwise run starts routines that stay in the execution until it
+ *  is stopped, and join waits for them.
+ */
 typedef struct {
-  void                *state;
-  laplace_acquire_fn   acquire;
-  laplace_release_fn   release;
-  laplace_pool_run_fn  run;
-  laplace_pool_join_fn join;
+  void                  *state;
+  laplace_acquire_fn     acquire;
+  laplace_release_fn     release;
+  laplace_pool_run_fn    run;
+  laplace_pool_join_fn   join;
+  laplace_pool_submit_fn submit;
 } laplace_thread_pool_t;
 
+/*  Scheduling record of a queued action. The coroutine frame lives
+ *  in the execution's slab and is referenced by index, so scans and
+ *  compaction of the queue move only these records. Wake is the tick
+ *  when the action runs next.
+ */
 typedef struct {
-  ptrdiff_t           order;
-  laplace_time_t      clock;
-  laplace_time_t      tick_duration;
-  laplace_generator_t generator;
+  ptrdiff_t      order;
+  laplace_time_t wake;
+  laplace_time_t tick_duration;
+  int            finished;
+  ptrdiff_t      frame;
 } laplace_action_state_t;
 
+/*  Copy of the queued actions and their frames, taken between ticks.
+ *  Frame of an action is its offset in the frame data. Wake times are
+ *  relative to the execution time, so the copy can be restored later.
+ */
+typedef struct {
+  KIT_DA(laplace_action_state_t) actions;
+  KIT_DA(char) frames;
+} laplace_actions_snapshot_t;
+
+/*  Action queued by another action. Its frame is allocated when
+ *  forks are appended to the queue.
+ */
+typedef struct {
+  ptrdiff_t        order;
+  laplace_action_t action;
+} laplace_fork_t;
+
+/*  Impacts and forks emitted by one thread, merged at the fence.
+ *  Generators run by the thread allocate from its arena.
+ */
+typedef struct {
+  int             tick_continue;
+  ptrdiff_t       head;
+  laplace_arena_t arena;
+  KIT_DA(laplace_impact_t) sync;
+  KIT_DA(laplace_impact_t) async;
+  KIT_DA(laplace_fork_t) forks;
+} laplace_staging_t;
+
+/*  Task of a tick stage. Tasks of one stage run in parallel, each
+ *  with its own staging.
+ */
+typedef struct {
+  laplace_execution_t *execution;
+  laplace_staging_t    staging;
+} laplace_stage_task_t;
+
 struct laplace_execution {
   kit_status_t status;
   ptrdiff_t    thread_count;
@@ -49,22 +118,37 @@ struct laplace_execution {
   kit_allocator_t       _alloc;
 
   KIT_DA(laplace_action_state_t) _queue;
-  KIT_DA(laplace_action_state_t) _forks;
+  KIT_DA(laplace_fork_t) _forks;
   KIT_DA(laplace_impact_t) _sync;
   KIT_DA(laplace_impact_t) _async;
+  KIT_DA(laplace_staging_t *) _staging;
+  KIT_DA(laplace_staging_t *) _merge;
+  KIT_DA(ptrdiff_t) _ready;
+  KIT_DA(laplace_stage_task_t) _tasks;
+  laplace_slab_t  _frames;
+  laplace_wheel_t _wheel;
+  laplace_arena_t _arena;
+  laplace_arena_t _retired;
 
   int            _done;
   int            _tick_done;
+  int            _clear;
+  int            _busy;
+  int            _stage;
   laplace_time_t _ticks;
-  ptrdiff_t      _fence_in;
-  ptrdiff_t      _fence_out;
-  ptrdiff_t      _queue_index;
-  ptrdiff_t      _async_index;
+  laplace_time_t _time;
+  ptrdiff_t      _finished;
+  ptrdiff_t      _ready_end;
+  ptrdiff_t      _queue_batch;
+  KIT_ATOMIC(ptrdiff_t) _queue_index;
+  KIT_ATOMIC(ptrdiff_t) _async_index;
+  KIT_ATOMIC(ptrdiff_t) _stage_pending;
 
   mtx_t _lock;
   cnd_t _on_tick;
   cnd_t _on_join;
-  cnd_t _on_fence;
+
+  laplace_barrier_t _fence;
 };
 
 kit_status_t laplace_execution_init(laplace_execution_t  *execution,
@@ -86,17 +170,48 @@ kit_status_t laplace_execution_queue(laplace_execution_t *execution,
 kit_status_t laplace_execution_schedule(
     laplace_execution_t *execution, laplace_time_t time_elapsed);
 
+void laplace_actions_snapshot_init(
+    laplace_actions_snapshot_t *snapshot, kit_allocator_t alloc);
+
+void laplace_actions_snapshot_destroy(
+    laplace_actions_snapshot_t *snapshot);
+
+/*  Copy the queued actions, so they can be restored together with a
+ *  snapshot of the state. Can copy only after join and before
+ *  schedule.
+ */
+kit_status_t laplace_execution_snapshot_actions(
+    laplace_execution_t        *execution,
+    laplace_actions_snapshot_t *snapshot);
+
+/*  Replace the queued actions with a copy. Null copy drops all
+ *  actions. Can restore only after join and before schedule.
+ */
+kit_status_t laplace_execution_restore_actions(
+    laplace_execution_t              *execution,
+    laplace_actions_snapshot_t const *snapshot);
+
 void laplace_execution_join(laplace_execution_t *execution);
 
 kit_status_t laplace_execution_schedule_and_join(
     laplace_execution_t *execution, laplace_time_t time_elapsed);
 
 #ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define EXECUTION_BATCHES_PER_THREAD \
+    LAPLACE_EXECUTION_BATCHES_PER_THREAD
+#  define EXECUTION_MAX_BATCH LAPLACE_EXECUTION_MAX_BATCH
 #  define execution_t laplace_execution_t
 #  define pool_routine_fn laplace_pool_routine_fn
 #  define pool_resize_fn laplace_pool_resize_fn
 #  define pool_join_fn laplace_pool_join_fn
+#  define pool_task_fn laplace_pool_task_fn
+#  define pool_submit_fn laplace_pool_submit_fn
 #  define thread_pool_t laplace_thread_pool_t
+#  define staging_t laplace_staging_t
+#  define stage_task_t laplace_stage_task_t
+#  define action_state_t laplace_action_state_t
+#  define fork_t laplace_fork_t
+#  define actions_snapshot_t laplace_actions_snapshot_t
 
 #  define execution_init laplace_execution_init
 #  define execution_destroy laplace_execution_destroy
@@ -105,6 +220,11 @@ kit_status_t laplace_execution_schedule_and_join(
 #  define execution_read_only laplace_execution_read_only
 #  define execution_queue laplace_execution_queue
 #  define execution_schedule laplace_execution_schedule
+#  define actions_snapshot_init laplace_actions_snapshot_init
+#  define actions_snapshot_destroy laplace_actions_snapshot_destroy
+#  define execution_snapshot_actions \
+    laplace_execution_snapshot_actions
+#  define execution_restore_actions laplace_execution_restore_actions
 #  define execution_join laplace_execution_join
 #  define execution_schedule_and_join \
     laplace_execution_schedule_and_join
@@ -9,27 +9,51 @@ kit_status_t laplace_generator_init(laplace_generator_t *generator,
   if (action.size > LAPLACE_COROUTINE_SIZE)
     return LAPLACE_ERROR_INVALID_SIZE;
   memset(generator, 0, sizeof *generator);
-  generator->promise._index         = 0;
-  generator->promise._id            = action.id;
-  generator->promise._state_machine = action.coro;
-  generator->promise.alloc          = alloc;
-  generator->promise.access         = access;
-  generator->promise.self           = action.self;
-  generator->tick_duration          = action.tick_duration;
-  return KIT_OK;
+  generator->tick_duration = action.tick_duration;
+  return laplace_promise_init(&generator->promise,
+                              LAPLACE_COROUTINE_SIZE, action, access,
+                              alloc);
 }
 
 laplace_impact_list_t laplace_generator_run(
     laplace_generator_t *const generator) {
-  AF_EXECUTE(generator->promise);
-  laplace_impact_list_t list = generator->promise.return_value;
-  memset(&generator->promise.return_value, 0,
-         sizeof generator->promise.return_value);
-  return list;
+  return laplace_promise_run(&generator->promise);
 }
 
 laplace_generator_status_t laplace_generator_status(
     laplace_generator_t const *const generator) {
-  return AF_FINISHED(generator->promise) ? LAPLACE_GENERATOR_FINISHED
-                                         : LAPLACE_GENERATOR_RUNNING;
+  return laplace_promise_finished(&generator->promise)
+             ? LAPLACE_GENERATOR_FINISHED
+             : LAPLACE_GENERATOR_RUNNING;
+}
+
+kit_status_t laplace_promise_init(laplace_promise_t *const promise,
+                                  ptrdiff_t const    frame_size,
+                                  laplace_action_t const    action,
+                                  laplace_read_only_t const access,
+                                  kit_allocator_t const     alloc) {
+  if (action.size > frame_size ||
+      frame_size < (ptrdiff_t) sizeof *promise)
+    return LAPLACE_ERROR_INVALID_SIZE;
+  memset(promise, 0, frame_size);
+  promise->_index         = 0;
+  promise->_id            = action.id;
+  promise->_state_machine = action.coro;
+  promise->alloc          = alloc;
+  promise->access         = access;
+  promise->self           = action.self;
+  return KIT_OK;
+}
+
+laplace_impact_list_t laplace_promise_run(
+    laplace_promise_t *const promise) {
+  AF_EXECUTE(*promise);
+  laplace_impact_list_t list = promise->return_value;
+  memset(&promise->return_value, 0, sizeof promise->return_value);
+  return list;
+}
+
+int laplace_promise_finished(
+    laplace_promise_t const *const promise) {
+  return AF_FINISHED(*promise);
 }
@@ -15,6 +15,10 @@ typedef enum {
   LAPLACE_GENERATOR_FINISHED = 1
 } laplace_generator_status_t;
 
+/*  Generator with an inline coroutine frame of
+ *  LAPLACE_COROUTINE_SIZE bytes. The execution allocates frames of
+ *  any size from its slab instead.
+ */
 typedef struct {
   union {
     laplace_promise_t promise;
@@ -37,6 +41,19 @@ laplace_impact_list_t laplace_generator_run(
 laplace_generator_status_t laplace_generator_status(
     laplace_generator_t const *generator);
 
+/*  Initialize a coroutine in a frame of frame_size bytes that starts
+ *  with the promise.
+ */
+kit_status_t laplace_promise_init(laplace_promise_t  *promise,
+                                  ptrdiff_t           frame_size,
+                                  laplace_action_t    action,
+                                  laplace_read_only_t access,
+                                  kit_allocator_t     alloc);
+
+laplace_impact_list_t laplace_promise_run(laplace_promise_t *promise);
+
+int laplace_promise_finished(laplace_promise_t const *promise);
+
 #define LAPLACE_ACTION_UNSAFE(coro_, tick_duration_, ...)     \
   {                                                           \
     .size = sizeof(AF_TYPE(coro_)), .id = 0, .coro = (coro_), \
@@ -93,6 +110,9 @@ laplace_generator_status_t laplace_generator_status(
 #  define generator_init laplace_generator_init
 #  define generator_run laplace_generator_run
 #  define generator_status laplace_generator_status
+#  define promise_init laplace_promise_init
+#  define promise_run laplace_promise_run
+#  define promise_finished laplace_promise_finished
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,504 @@
+#include "buffer.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define LAPLACE_KERNEL_X86
+#  include <immintrin.h>
+#endif
+
+/*  Delta application kernels.
+ *
+ *  Each kernel adds deltas to values and zeroes deltas for one flag
+ *  word of 64 cells. In the same pass it sums the value differences
+ *  of the word, plain and weighted by lane, for the hash. See
+ *  LAPLACE_BUF_HASH_DIFF_. All kernels use wrapping integer
+ *  arithmetic, so results are bit-identical for every kernel.
+ *
+ *  In the array of structures layout the delta and the value of a
+ *  cell are adjacent, so the vector kernels add the swapped lanes
+ *  and mask out the delta lanes.
+ *
+ *  For 64-bit cells the value difference is the delta itself. For
+ *  8-bit cells the difference fits 16 bits, so lane weights are
+ *  split into 15-bit limbs for the 16-bit multiply-add.
+ */
+
+typedef struct {
+  uint64_t total;
+  uint64_t lanes;
+} word_sum_t;
+
+typedef word_sum_t (*apply_fn)(void *values, void *deltas);
+
+static KIT_ATOMIC(int) kernel_current = LAPLACE_BUFFER_KERNEL_AUTO;
+
+#ifdef LAPLACE_BUFFER_SOA
+static word_sum_t apply_64_scalar(void *values, void *deltas) {
+  int64_t   *v   = (int64_t *) values;
+  int64_t   *d   = (int64_t *) deltas;
+  word_sum_t sum = { 0, 0 };
+  for (ptrdiff_t j = 0; j < 64; j++) {
+    uint64_t const x = (uint64_t) d[j];
+    v[j]             = (int64_t) ((uint64_t) v[j] + x);
+    d[j]             = 0;
+    sum.total += x;
+    sum.lanes += laplace_buf_lanes_[j] * x;
+  }
+  return sum;
+}
+
+static word_sum_t apply_8_scalar(void *values, void *deltas) {
+  int8_t    *v   = (int8_t *) values;
+  int8_t    *d   = (int8_t *) deltas;
+  word_sum_t sum = { 0, 0 };
+  for (ptrdiff_t j = 0; j < 64; j++) {
+    int8_t const   next = (int8_t) (uint8_t) ((uint8_t) v[j] +
+                                            (uint8_t) d[j]);
+    uint64_t const x    = (uint64_t) ((int64_t) next -
+                                   (int64_t) v[j]);
+    v[j]                = next;
+    d[j]                = 0;
+    sum.total += x;
+    sum.lanes += laplace_buf_lanes_[j] * x;
+  }
+  return sum;
+}
+#else
+static word_sum_t apply_64_scalar(void *values, void *deltas) {
+  int64_t   *c   = (int64_t *) values;
+  word_sum_t sum = { 0, 0 };
+  (void) deltas;
+  for (ptrdiff_t j = 0; j < 64; j++) {
+    uint64_t const x = (uint64_t) c[j * 2];
+    c[j * 2 + 1]     = (int64_t) ((uint64_t) c[j * 2 + 1] + x);
+    c[j * 2]         = 0;
+    sum.total += x;
+    sum.lanes += laplace_buf_lanes_[j] * x;
+  }
+  return sum;
+}
+
+static word_sum_t apply_8_scalar(void *values, void *deltas) {
+  int8_t    *c   = (int8_t *) values;
+  word_sum_t sum = { 0, 0 };
+  (void) deltas;
+  for (ptrdiff_t j = 0; j < 64; j++) {
+    int8_t const   value = c[j * 2 + 1];
+    int8_t const   next  = (int8_t) (uint8_t) ((uint8_t) value +
+                                             (uint8_t) c[j * 2]);
+    uint64_t const x     = (uint64_t) ((int64_t) next -
+                                   (int64_t) value);
+    c[j * 2 + 1]         = next;
+    c[j * 2]             = 0;
+    sum.total += x;
+    sum.lanes += laplace_buf_lanes_[j] * x;
+  }
+  return sum;
+}
+#endif
+
+#ifdef LAPLACE_KERNEL_X86
+#  define LIMB_0_(x_) (int16_t) ((x_) & 0x7fff),
+#  define LIMB_1_(x_) (int16_t) (((x_) >> 15) & 0x7fff),
+#  define LIMB_2_(x_) (int16_t) (((x_) >> 30) & 0x7fff),
+#  define LIMB_3_(x_) (int16_t) (((x_) >> 45) & 0x7fff),
+#  define LIMB_4_(x_) (int16_t) ((x_) >> 60),
+
+enum { LIMB_COUNT = 5, LIMB_BITS = 15 };
+
+static int16_t const lane_limbs[LIMB_COUNT][64] = {
+  { LAPLACE_BUF_LANES_(LIMB_0_) }, { LAPLACE_BUF_LANES_(LIMB_1_) },
+  { LAPLACE_BUF_LANES_(LIMB_2_) }, { LAPLACE_BUF_LANES_(LIMB_3_) },
+  { LAPLACE_BUF_LANES_(LIMB_4_) }
+};
+
+#  undef LIMB_0_
+#  undef LIMB_1_
+#  undef LIMB_2_
+#  undef LIMB_3_
+#  undef LIMB_4_
+
+/*  Low halves of 64-bit products, from 32-bit multiplications.
+ */
+__attribute__((target("sse2"))) static __m128i mul_64_sse2(
+    __m128i a, __m128i b) {
+  __m128i const lo = _mm_mul_epu32(a, b);
+  __m128i const hi = _mm_add_epi64(
+      _mm_mul_epu32(_mm_srli_epi64(a, 32), b),
+      _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+  return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+}
+
+__attribute__((target("avx2"))) static __m256i mul_64_avx2(
+    __m256i a, __m256i b) {
+  __m256i const lo = _mm256_mul_epu32(a, b);
+  __m256i const hi = _mm256_add_epi64(
+      _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+      _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+__attribute__((target("sse2"))) static uint64_t sum_64_sse2(
+    __m128i x) {
+  uint64_t s[2];
+  _mm_storeu_si128((__m128i *) s, x);
+  return s[0] + s[1];
+}
+
+__attribute__((target("avx2"))) static uint64_t sum_64_avx2(
+    __m256i x) {
+  uint64_t s[4];
+  _mm256_storeu_si256((__m256i *) s, x);
+  return s[0] + s[1] + s[2] + s[3];
+}
+
+__attribute__((target("sse2"))) static int64_t sum_32_sse2(
+    __m128i x) {
+  int32_t s[4];
+  _mm_storeu_si128((__m128i *) s, x);
+  return (int64_t) s[0] + s[1] + s[2] + s[3];
+}
+
+/*  Accumulate 16-bit value differences of the cells from j. Sums
+ *  of a word fit 32 bits, as limbs and differences are 15 and 9
+ *  bits wide.
+ */
+__attribute__((target("sse2"))) static void madd_8_sse2(
+    __m128i *acc, __m128i x, ptrdiff_t j) {
+  acc[0] = _mm_add_epi32(acc[0],
+                         _mm_madd_epi16(x, _mm_set1_epi16(1)));
+  for (int k = 0; k < LIMB_COUNT; k++)
+    acc[k + 1] = _mm_add_epi32(
+        acc[k + 1],
+        _mm_madd_epi16(x, _mm_loadu_si128((__m128i const *) (
+                              lane_limbs[k] + j))));
+}
+
+__attribute__((target("avx2"))) static void madd_8_avx2(
+    __m256i *acc, __m256i x, ptrdiff_t j) {
+  acc[0] = _mm256_add_epi32(
+      acc[0], _mm256_madd_epi16(x, _mm256_set1_epi16(1)));
+  for (int k = 0; k < LIMB_COUNT; k++)
+    acc[k + 1] = _mm256_add_epi32(
+        acc[k + 1],
+        _mm256_madd_epi16(x, _mm256_loadu_si256((__m256i const *) (
+                                 lane_limbs[k] + j))));
+}
+
+__attribute__((target("sse2"))) static word_sum_t limbs_sum_sse2(
+    __m128i const *acc) {
+  word_sum_t sum = { (uint64_t) sum_32_sse2(acc[0]), 0 };
+  for (int k = 0; k < LIMB_COUNT; k++)
+    sum.lanes += (uint64_t) sum_32_sse2(acc[k + 1])
+                 << (k * LIMB_BITS);
+  return sum;
+}
+
+__attribute__((target("avx2"))) static word_sum_t limbs_sum_avx2(
+    __m256i const *acc) {
+  __m128i half[LIMB_COUNT + 1];
+  for (int k = 0; k <= LIMB_COUNT; k++)
+    half[k] = _mm_add_epi32(_mm256_castsi256_si128(acc[k]),
+                            _mm256_extracti128_si256(acc[k], 1));
+  return limbs_sum_sse2(half);
+}
+
+#  ifdef LAPLACE_BUFFER_SOA
+__attribute__((target("sse2"))) static word_sum_t apply_64_sse2(
+    void *values, void *deltas) {
+  char   *v     = (char *) values;
+  char   *d     = (char *) deltas;
+  __m128i zero  = _mm_setzero_si128();
+  __m128i total = zero;
+  __m128i lanes = zero;
+  for (ptrdiff_t j = 0; j < 64; j += 2) {
+    __m128i      *pv = (__m128i *) (v + j * 8);
+    __m128i      *pd = (__m128i *) (d + j * 8);
+    __m128i const x  = _mm_loadu_si128(pd);
+    _mm_storeu_si128(pv, _mm_add_epi64(_mm_loadu_si128(pv), x));
+    _mm_storeu_si128(pd, zero);
+    total = _mm_add_epi64(total, x);
+    lanes = _mm_add_epi64(
+        lanes, mul_64_sse2(_mm_loadu_si128((__m128i const *) (
+                               laplace_buf_lanes_ + j)),
+                           x));
+  }
+  word_sum_t const sum = { sum_64_sse2(total), sum_64_sse2(lanes) };
+  return sum;
+}
+
+__attribute__((target("sse2"))) static word_sum_t apply_8_sse2(
+    void *values, void *deltas) {
+  char   *v    = (char *) values;
+  char   *d    = (char *) deltas;
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc[LIMB_COUNT + 1];
+  for (int k = 0; k <= LIMB_COUNT; k++) acc[k] = zero;
+  for (ptrdiff_t j = 0; j < 64; j += 16) {
+    __m128i      *pv    = (__m128i *) (v + j);
+    __m128i      *pd    = (__m128i *) (d + j);
+    __m128i const value = _mm_loadu_si128(pv);
+    __m128i const next  = _mm_add_epi8(value, _mm_loadu_si128(pd));
+    _mm_storeu_si128(pv, next);
+    _mm_storeu_si128(pd, zero);
+    madd_8_sse2(
+        acc,
+        _mm_sub_epi16(
+            _mm_srai_epi16(_mm_unpacklo_epi8(next, next), 8),
+            _mm_srai_epi16(_mm_unpacklo_epi8(value, value), 8)),
+        j);
+    madd_8_sse2(
+        acc,
+        _mm_sub_epi16(
+            _mm_srai_epi16(_mm_unpackhi_epi8(next, next), 8),
+            _mm_srai_epi16(_mm_unpackhi_epi8(value, value), 8)),
+        j + 8);
+  }
+  return limbs_sum_sse2(acc);
+}
+
+__attribute__((target("avx2"))) static word_sum_t apply_64_avx2(
+    void *values, void *deltas) {
+  char   *v     = (char *) values;
+  char   *d     = (char *) deltas;
+  __m256i zero  = _mm256_setzero_si256();
+  __m256i total = zero;
+  __m256i lanes = zero;
+  for (ptrdiff_t j = 0; j < 64; j += 4) {
+    __m256i      *pv = (__m256i *) (v + j * 8);
+    __m256i      *pd = (__m256i *) (d + j * 8);
+    __m256i const x  = _mm256_loadu_si256(pd);
+    _mm256_storeu_si256(pv,
+                        _mm256_add_epi64(_mm256_loadu_si256(pv), x));
+    _mm256_storeu_si256(pd, zero);
+    total = _mm256_add_epi64(total, x);
+    lanes = _mm256_add_epi64(
+        lanes, mul_64_avx2(_mm256_loadu_si256((__m256i const *) (
+                               laplace_buf_lanes_ + j)),
+                           x));
+  }
+  word_sum_t const sum = { sum_64_avx2(total), sum_64_avx2(lanes) };
+  return sum;
+}
+
+__attribute__((target("avx2"))) static word_sum_t apply_8_avx2(
+    void *values, void *deltas) {
+  char   *v    = (char *) values;
+  char   *d    = (char *) deltas;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc[LIMB_COUNT + 1];
+  for (int k = 0; k <= LIMB_COUNT; k++) acc[k] = zero;
+  for (ptrdiff_t j = 0; j < 64; j += 32) {
+    __m256i      *pv    = (__m256i *) (v + j);
+    __m256i      *pd    = (__m256i *) (d + j);
+    __m256i const value = _mm256_loadu_si256(pv);
+    __m256i const next  = _mm256_add_epi8(value,
+                                          _mm256_loadu_si256(pd));
+    _mm256_storeu_si256(pv, next);
+    _mm256_storeu_si256(pd, zero);
+    madd_8_avx2(
+        acc,
+        _mm256_sub_epi16(
+            _mm256_cvtepi8_epi16(_mm256_castsi256_si128(next)),
+            _mm256_cvtepi8_epi16(_mm256_castsi256_si128(value))),
+        j);
+    madd_8_avx2(
+        acc,
+        _mm256_sub_epi16(
+            _mm256_cvtepi8_epi16(_mm256_extracti128_si256(next, 1)),
+            _mm256_cvtepi8_epi16(_mm256_extracti128_si256(value, 1))),
+        j + 16);
+  }
+  return limbs_sum_avx2(acc);
+}
+#  else
+__attribute__((target("sse2"))) static word_sum_t apply_64_sse2(
+    void *values, void *deltas) {
+  char   *c     = (char *) values;
+  __m128i mask  = _mm_set_epi32(-1, -1, 0, 0);
+  __m128i total = _mm_setzero_si128();
+  __m128i lanes = _mm_setzero_si128();
+  (void) deltas;
+  for (ptrdiff_t j = 0; j < 64; j++) {
+    __m128i      *p = (__m128i *) (c + j * 16);
+    __m128i const x = _mm_loadu_si128(p);
+    __m128i const y = _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i const d = _mm_andnot_si128(mask, x);
+    _mm_storeu_si128(p, _mm_and_si128(_mm_add_epi64(x, y), mask));
+    total = _mm_add_epi64(total, d);
+    lanes = _mm_add_epi64(
+        lanes, mul_64_sse2(_mm_loadl_epi64((__m128i const *) (
+                               laplace_buf_lanes_ + j)),
+                           d));
+  }
+  word_sum_t const sum = { sum_64_sse2(total), sum_64_sse2(lanes) };
+  return sum;
+}
+
+__attribute__((target("sse2"))) static word_sum_t apply_8_sse2(
+    void *values, void *deltas) {
+  char   *c    = (char *) values;
+  __m128i mask = _mm_set1_epi16(-256);
+  __m128i acc[LIMB_COUNT + 1];
+  for (int k = 0; k <= LIMB_COUNT; k++) acc[k] = _mm_setzero_si128();
+  (void) deltas;
+  for (ptrdiff_t j = 0; j < 64; j += 8) {
+    __m128i      *p = (__m128i *) (c + j * 2);
+    __m128i const x = _mm_loadu_si128(p);
+    __m128i const y = _mm_and_si128(
+        _mm_add_epi8(x, _mm_slli_epi16(x, 8)), mask);
+    _mm_storeu_si128(p, y);
+    madd_8_sse2(acc,
+                _mm_sub_epi16(_mm_srai_epi16(y, 8),
+                              _mm_srai_epi16(x, 8)),
+                j);
+  }
+  return limbs_sum_sse2(acc);
+}
+
+__attribute__((target("avx2"))) static word_sum_t apply_64_avx2(
+    void *values, void *deltas) {
+  char   *c     = (char *) values;
+  __m256i mask  = _mm256_set_epi32(-1, -1, 0, 0, -1, -1, 0, 0);
+  __m256i total = _mm256_setzero_si256();
+  __m256i lanes = _mm256_setzero_si256();
+  (void) deltas;
+  for (ptrdiff_t j = 0; j < 64; j += 2) {
+    __m256i      *p = (__m256i *) (c + j * 16);
+    __m256i const x = _mm256_loadu_si256(p);
+    __m256i const y = _mm256_shuffle_epi32(x,
+                                           _MM_SHUFFLE(1, 0, 3, 2));
+    __m256i const d = _mm256_andnot_si256(mask, x);
+    __m256i const w = _mm256_permute4x64_epi64(
+        _mm256_castsi128_si256(_mm_loadu_si128(
+            (__m128i const *) (laplace_buf_lanes_ + j))),
+        _MM_SHUFFLE(1, 1, 0, 0));
+    _mm256_storeu_si256(
+        p, _mm256_and_si256(_mm256_add_epi64(x, y), mask));
+    total = _mm256_add_epi64(total, d);
+    lanes = _mm256_add_epi64(lanes, mul_64_avx2(w, d));
+  }
+  word_sum_t const sum = { sum_64_avx2(total), sum_64_avx2(lanes) };
+  return sum;
+}
+
+__attribute__((target("avx2"))) static word_sum_t apply_8_avx2(
+    void *values, void *deltas) {
+  char   *c    = (char *) values;
+  __m256i mask = _mm256_set1_epi16(-256);
+  __m256i acc[LIMB_COUNT + 1];
+  for (int k = 0; k <= LIMB_COUNT; k++)
+    acc[k] = _mm256_setzero_si256();
+  (void) deltas;
+  for (ptrdiff_t j = 0; j < 64; j += 16) {
+    __m256i      *p = (__m256i *) (c + j * 2);
+    __m256i const x = _mm256_loadu_si256(p);
+    __m256i const y = _mm256_and_si256(
+        _mm256_add_epi8(x, _mm256_slli_epi16(x, 8)), mask);
+    _mm256_storeu_si256(p, y);
+    madd_8_avx2(acc,
+                _mm256_sub_epi16(_mm256_srai_epi16(y, 8),
+                                 _mm256_srai_epi16(x, 8)),
+                j);
+  }
+  return limbs_sum_avx2(acc);
+}
+#  endif
+#else
+#  define apply_64_sse2 apply_64_scalar
+#  define apply_8_sse2 apply_8_scalar
+#  define apply_64_avx2 apply_64_scalar
+#  define apply_8_avx2 apply_8_scalar
+#endif
+
+static apply_fn const apply_64[] = { apply_64_scalar,
+                                     apply_64_scalar, apply_64_sse2,
+                                     apply_64_avx2 };
+
+static apply_fn const apply_8[] = { apply_8_scalar, apply_8_scalar,
+                                    apply_8_sse2, apply_8_avx2 };
+
+static int kernel_supported(int kernel) {
+  switch (kernel) {
+    case LAPLACE_BUFFER_KERNEL_SCALAR: return 1;
+#ifdef LAPLACE_KERNEL_X86
+    case LAPLACE_BUFFER_KERNEL_SSE2:
+      return __builtin_cpu_supports("sse2");
+    case LAPLACE_BUFFER_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:;
+  }
+  return 0;
+}
+
+static int kernel_detect(void) {
+  if (kernel_supported(LAPLACE_BUFFER_KERNEL_AVX2))
+    return LAPLACE_BUFFER_KERNEL_AVX2;
+  if (kernel_supported(LAPLACE_BUFFER_KERNEL_SSE2))
+    return LAPLACE_BUFFER_KERNEL_SSE2;
+  return LAPLACE_BUFFER_KERNEL_SCALAR;
+}
+
+kit_status_t laplace_buffer_set_kernel(int kernel) {
+  if (kernel != LAPLACE_BUFFER_KERNEL_AUTO &&
+      !kernel_supported(kernel))
+    return LAPLACE_ERROR_UNSUPPORTED_KERNEL;
+  atomic_store_explicit(&kernel_current, kernel,
+                        memory_order_relaxed);
+  return KIT_OK;
+}
+
+int laplace_buffer_kernel(void) {
+  int kernel = atomic_load_explicit(&kernel_current,
+                                    memory_order_relaxed);
+  if (kernel != LAPLACE_BUFFER_KERNEL_AUTO)
+    return kernel;
+  kernel = kernel_detect();
+  int expected = LAPLACE_BUFFER_KERNEL_AUTO;
+  if (!atomic_compare_exchange_strong_explicit(
+          &kernel_current, &expected, kernel, memory_order_relaxed,
+          memory_order_relaxed))
+    return expected;
+  return kernel;
+}
+
+uint64_t laplace_buffer_apply_deltas(laplace_buffer_void_t *buffer,
+                                     ptrdiff_t element_size,
+                                     ptrdiff_t offset,
+                                     ptrdiff_t size) {
+  assert(buffer != NULL);
+  assert(element_size == 8 || element_size == 1);
+  assert(offset >= 0 && size >= 0);
+  assert(offset % 64 == 0 && size % 64 == 0);
+  assert(offset + size <= buffer->data.size);
+
+  int const      kernel = laplace_buffer_kernel();
+  apply_fn const apply  = element_size == 8 ? apply_64[kernel]
+                                            : apply_8[kernel];
+  char *const    values = (char *) buffer->data.values;
+  uint64_t       sum    = 0;
+
+#ifdef LAPLACE_BUFFER_SOA
+  assert(buffer->cell_size == element_size);
+  char *const v = values + offset * element_size;
+  char *const d = (char *) buffer->deltas.values +
+                  offset * element_size;
+#else
+  assert(buffer->cell_size == element_size * 2);
+  char *const c = values + offset * element_size * 2;
+#endif
+
+  for (ptrdiff_t w = 0; w < size; w += 64) {
+#ifdef LAPLACE_BUFFER_SOA
+    word_sum_t const s = apply(v + w * element_size,
+                               d + w * element_size);
+#else
+    word_sum_t const s = apply(c + w * element_size * 2, NULL);
+#endif
+    sum += laplace_buffer_word_weight((offset + w) / 64) * s.total +
+           s.lanes;
+  }
+
+  return sum;
+}
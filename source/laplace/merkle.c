@@ -0,0 +1,81 @@
+#include "merkle.h"
+
+#include <assert.h>
+
+ptrdiff_t laplace_merkle_compare(
+    laplace_read_write_t const *const access,
+    laplace_hash_node_t const node, ptrdiff_t const remote_count,
+    uint64_t const *const remote, laplace_hash_node_t *const differ) {
+  assert(access != NULL);
+  assert(remote_count >= 0 && remote_count <= LAPLACE_HASH_FANOUT);
+  assert(remote != NULL || remote_count == 0);
+  assert(differ != NULL);
+
+  laplace_hash_node_t children[LAPLACE_HASH_FANOUT];
+  uint64_t            hashes[LAPLACE_HASH_FANOUT];
+
+  ptrdiff_t const count = access->hash_children(access->state, node,
+                                                children, hashes);
+
+  ptrdiff_t const n = count > remote_count ? count : remote_count;
+  ptrdiff_t       k = 0;
+
+  for (ptrdiff_t i = 0; i < n; i++) {
+    uint64_t const x = i < count ? hashes[i] : 0;
+    uint64_t const y = i < remote_count ? remote[i] : 0;
+    if (x == y)
+      continue;
+
+    if (i < count)
+      differ[k++] = children[i];
+    else {
+      /*  Child that the local state does not have.
+       */
+      laplace_hash_node_t const child = {
+        .tree  = node.tree,
+        .level = node.level - 1,
+        .index = node.index * LAPLACE_HASH_FANOUT + i
+      };
+      differ[k++] = child;
+    }
+  }
+
+  return k;
+}
+
+static ptrdiff_t localize(laplace_read_write_t const *const a,
+                          laplace_read_write_t const *const b,
+                          laplace_hash_node_t const         node,
+                          ptrdiff_t const                   capacity,
+                          laplace_hash_node_t *const        leaves,
+                          ptrdiff_t                         count) {
+  uint64_t            remote[LAPLACE_HASH_FANOUT];
+  laplace_hash_node_t differ[LAPLACE_HASH_FANOUT];
+
+  ptrdiff_t const n = b->hash_children(b->state, node, NULL, remote);
+  ptrdiff_t const m = laplace_merkle_compare(a, node, n, remote,
+                                             differ);
+
+  for (ptrdiff_t i = 0; i < m && count < capacity; i++)
+    if (differ[i].level <= 0)
+      leaves[count++] = differ[i];
+    else
+      count = localize(a, b, differ[i], capacity, leaves, count);
+
+  return count;
+}
+
+ptrdiff_t laplace_merkle_localize(laplace_read_write_t const *const a,
+                                  laplace_read_write_t const *const b,
+                                  ptrdiff_t const            capacity,
+                                  laplace_hash_node_t *const leaves) {
+  assert(a != NULL && b != NULL);
+  assert(capacity >= 0);
+  assert(leaves != NULL || capacity == 0);
+
+  laplace_hash_node_t const top = { .tree  = LAPLACE_HASH_TOP,
+                                    .level = 0,
+                                    .index = 0 };
+
+  return localize(a, b, top, capacity, leaves, 0);
+}
@@ -0,0 +1,48 @@
+#ifndef LAPLACE_MERKLE_H
+#define LAPLACE_MERKLE_H
+
+#include "access.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  Desync localization over the hash trees of a state.
+ *
+ *  A peer sends the child hashes of a node, the other peer compares
+ *  them with its own and asks for the children of the nodes that
+ *  differ. Starting from the top node, a single differing leaf is
+ *  found in one round per tree level, with up to 64 hashes per
+ *  round.
+ */
+
+/*  Compare child hashes of a node with the ones a peer got for the
+ *  same node. Missing hashes are zero. Writes the differing child
+ *  nodes, up to LAPLACE_HASH_FANOUT, and returns their count.
+ */
+ptrdiff_t laplace_merkle_compare(laplace_read_write_t const *access,
+                                 laplace_hash_node_t         node,
+                                 ptrdiff_t       remote_count,
+                                 uint64_t const *remote,
+                                 laplace_hash_node_t *differ);
+
+/*  Find leaves that differ between two states, e.g. a state and its
+ *  replay. Writes up to capacity leaves in order and returns their
+ *  count. Leaves of the globals tree stand for the random generator
+ *  state and buffer sizes.
+ */
+ptrdiff_t laplace_merkle_localize(laplace_read_write_t const *a,
+                                  laplace_read_write_t const *b,
+                                  ptrdiff_t            capacity,
+                                  laplace_hash_node_t *leaves);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define merkle_compare laplace_merkle_compare
+#  define merkle_localize laplace_merkle_localize
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,6 +14,12 @@ typedef int64_t laplace_time_t;
 typedef int64_t laplace_integer_t;
 typedef int8_t  laplace_byte_t;
 
+/*  Output stream, returns the status of the write.
+ */
+typedef kit_status_t (*laplace_write_fn)(void       *user_data,
+                                         void const *data,
+                                         ptrdiff_t   size);
+
 enum { LAPLACE_ID_UNDEFINED = -1, LAPLACE_COROUTINE_SIZE = 400 };
 
 enum {
@@ -35,6 +41,9 @@ enum {
   LAPLACE_ERROR_INVALID_REWIND_TIME,
   LAPLACE_ERROR_WRONG_IMPACT,
   LAPLACE_ERROR_NO_THREAD_POOL,
+  LAPLACE_ERROR_UNSUPPORTED_KERNEL,
+  LAPLACE_ERROR_BAD_AFFINITY,
+  LAPLACE_ERROR_INVALID_FORMAT,
   LAPLACE_ERROR_NOT_IMPLEMENTED = -1
 };
 
@@ -61,6 +70,9 @@ enum {
 #  define ERROR_INVALID_REWIND_TIME LAPLACE_ERROR_INVALID_REWIND_TIME
 #  define ERROR_WRONG_IMPACT LAPLACE_ERROR_WRONG_IMPACT
 #  define ERROR_NO_THREAD_POOL LAPLACE_ERROR_NO_THREAD_POOL
+#  define ERROR_UNSUPPORTED_KERNEL LAPLACE_ERROR_UNSUPPORTED_KERNEL
+#  define ERROR_BAD_AFFINITY LAPLACE_ERROR_BAD_AFFINITY
+#  define ERROR_INVALID_FORMAT LAPLACE_ERROR_INVALID_FORMAT
 #  define ERROR_NOT_IMPLEMENTED LAPLACE_ERROR_NOT_IMPLEMENTED
 #endif
 
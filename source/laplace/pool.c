@@ -0,0 +1,429 @@
+#ifdef __linux__
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#  endif
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+#include "pool.h"
+
+#include <string.h>
+
+static _Thread_local laplace_pool_worker_t *current_worker_ = NULL;
+
+static void notify_done_(laplace_pool_t *const pool) {
+  if (mtx_lock(&pool->lock) != thrd_success)
+    return;
+  (void) cnd_broadcast(&pool->on_done);
+  (void) mtx_unlock(&pool->lock);
+}
+
+static int take_back_(laplace_pool_deque_t *const deque,
+                      laplace_pool_task_t *const  task) {
+  if (deque->tasks.size == deque->head)
+    return 0;
+
+  *task = deque->tasks.values[deque->tasks.size - 1];
+  DA_RESIZE(deque->tasks, deque->tasks.size - 1);
+  if (deque->tasks.size == deque->head) {
+    DA_RESIZE(deque->tasks, 0);
+    deque->head = 0;
+  }
+  return 1;
+}
+
+static int take_front_(laplace_pool_deque_t *const deque,
+                       laplace_pool_task_t *const  task) {
+  if (deque->tasks.size == deque->head)
+    return 0;
+
+  *task = deque->tasks.values[deque->head++];
+  if (deque->tasks.size == deque->head) {
+    DA_RESIZE(deque->tasks, 0);
+    deque->head = 0;
+  }
+  return 1;
+}
+
+static int push_(laplace_pool_deque_t *const      deque,
+                 laplace_pool_task_t const *const task) {
+  ptrdiff_t const n = deque->tasks.size;
+  DA_RESIZE(deque->tasks, n + 1);
+  if (deque->tasks.size != n + 1)
+    return 0;
+  deque->tasks.values[n] = *task;
+  return 1;
+}
+
+/*  Take a task of the worker. Local tasks go first, then own tasks
+ *  from the back.
+ */
+static int pop_(laplace_pool_worker_t *const worker,
+                laplace_pool_task_t *const   task) {
+  if (mtx_lock(&worker->lock) != thrd_success)
+    return 0;
+
+  int found = take_front_(&worker->local, task);
+
+  if (found)
+    atomic_fetch_add_explicit(&worker->local_queued, -1,
+                              memory_order_relaxed);
+  else {
+    found = take_back_(&worker->tasks, task);
+    if (found)
+      atomic_fetch_add_explicit(&worker->pool->queued, -1,
+                                memory_order_relaxed);
+  }
+
+  (void) mtx_unlock(&worker->lock);
+  return found;
+}
+
+static int steal_(laplace_pool_worker_t *const worker,
+                  laplace_pool_task_t *const   task) {
+  if (mtx_lock(&worker->lock) != thrd_success)
+    return 0;
+
+  int const found = take_front_(&worker->tasks, task);
+
+  if (found)
+    atomic_fetch_add_explicit(&worker->pool->queued, -1,
+                              memory_order_relaxed);
+
+  (void) mtx_unlock(&worker->lock);
+  return found;
+}
+
+static int find_(laplace_pool_worker_t *const worker,
+                 laplace_pool_task_t *const   task) {
+  laplace_pool_t *const pool = worker->pool;
+
+  if (pop_(worker, task))
+    return 1;
+
+  ptrdiff_t const n = pool->worker_count;
+
+  for (ptrdiff_t i = 1; i < n; i++)
+    if (steal_(pool->workers + (worker->index + i) % n, task))
+      return 1;
+
+  return 0;
+}
+
+static int pin_(int const cpu) {
+#ifdef __linux__
+  if (cpu >= CPU_SETSIZE)
+    return 0;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  return pthread_setaffinity_np(pthread_self(), sizeof set, &set) ==
+         0;
+#else
+  (void) cpu;
+  return 0;
+#endif
+}
+
+static void run_task_(laplace_pool_t *const           pool,
+                      laplace_pool_task_t const *const task) {
+  task->fn(task->data);
+
+  if (atomic_fetch_add_explicit(&pool->pending, -1,
+                                memory_order_acq_rel) == 1)
+    notify_done_(pool);
+}
+
+static int idle_(laplace_pool_worker_t *const worker) {
+  return atomic_load_explicit(&worker->pool->queued,
+                              memory_order_acquire) == 0 &&
+         atomic_load_explicit(&worker->local_queued,
+                              memory_order_acquire) == 0;
+}
+
+static int worker_run_(void *const p) {
+  laplace_pool_worker_t *const worker = (laplace_pool_worker_t *) p;
+  laplace_pool_t *const        pool   = worker->pool;
+
+  current_worker_ = worker;
+
+  int const pinned = worker->cpu < 0 || pin_(worker->cpu);
+
+  if (mtx_lock(&pool->lock) != thrd_success)
+    return 0;
+  pool->started++;
+  if (!pinned)
+    pool->pin_failed = 1;
+  (void) cnd_broadcast(&pool->on_done);
+  (void) mtx_unlock(&pool->lock);
+
+  for (;;) {
+    laplace_pool_task_t task;
+
+    if (find_(worker, &task)) {
+      run_task_(pool, &task);
+      continue;
+    }
+
+    if (mtx_lock(&pool->lock) != thrd_success)
+      return 0;
+
+    while (!pool->stop && idle_(worker))
+      if (cnd_wait(&pool->on_task, &pool->lock) != thrd_success)
+        break;
+
+    int const stop = pool->stop && idle_(worker);
+    (void) mtx_unlock(&pool->lock);
+
+    if (stop)
+      return 0;
+  }
+}
+
+static kit_status_t submit_(laplace_pool_t *const            pool,
+                            ptrdiff_t const                  index,
+                            laplace_pool_task_t const *const task) {
+  laplace_pool_worker_t *worker = current_worker_;
+  int const              local  = index >= 0;
+
+  if (local)
+    worker = pool->workers + index;
+  else if (worker == NULL || worker->pool != pool)
+    worker = pool->workers +
+             atomic_fetch_add_explicit(&pool->next, 1,
+                                       memory_order_relaxed) %
+                 pool->worker_count;
+
+  KIT_ATOMIC(ptrdiff_t) *const queued = local ? &worker->local_queued
+                                              : &pool->queued;
+
+  atomic_fetch_add_explicit(&pool->pending, 1, memory_order_acq_rel);
+  atomic_fetch_add_explicit(queued, 1, memory_order_release);
+
+  int ok = 0;
+
+  if (mtx_lock(&worker->lock) == thrd_success) {
+    ok = push_(local ? &worker->local : &worker->tasks, task);
+    (void) mtx_unlock(&worker->lock);
+  }
+
+  if (!ok) {
+    atomic_fetch_add_explicit(queued, -1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->pending, -1,
+                              memory_order_acq_rel);
+    return LAPLACE_ERROR_BAD_ALLOC;
+  }
+
+  /*  Any worker can take a shared task, but a local task needs its
+   *  own worker to wake up.
+   */
+  if (mtx_lock(&pool->lock) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+  int const signaled = (local ? cnd_broadcast(&pool->on_task)
+                              : cnd_signal(&pool->on_task)) ==
+                       thrd_success;
+  (void) mtx_unlock(&pool->lock);
+
+  return signaled ? KIT_OK : LAPLACE_ERROR_BAD_CNDVAR_BROADCAST;
+}
+
+kit_status_t laplace_pool_init(laplace_pool_t *const pool,
+                               ptrdiff_t const       worker_count,
+                               kit_allocator_t const alloc) {
+  return laplace_pool_init_pinned(pool, worker_count, NULL, alloc);
+}
+
+kit_status_t laplace_pool_init_pinned(laplace_pool_t *const pool,
+                                      ptrdiff_t const worker_count,
+                                      int const *const cpus,
+                                      kit_allocator_t const alloc) {
+  assert(pool != NULL);
+
+  memset(pool, 0, sizeof *pool);
+
+  if (worker_count <= 0)
+    return LAPLACE_ERROR_INVALID_SIZE;
+
+  pool->alloc = alloc;
+
+  if (mtx_init(&pool->lock, mtx_plain) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_INIT;
+
+  if (cnd_init(&pool->on_task) != thrd_success) {
+    mtx_destroy(&pool->lock);
+    return LAPLACE_ERROR_BAD_CNDVAR_INIT;
+  }
+
+  if (cnd_init(&pool->on_done) != thrd_success) {
+    mtx_destroy(&pool->lock);
+    cnd_destroy(&pool->on_task);
+    return LAPLACE_ERROR_BAD_CNDVAR_INIT;
+  }
+
+  pool->workers = (laplace_pool_worker_t *) kit_alloc_dispatch(
+      alloc, KIT_ALLOCATE, worker_count * sizeof *pool->workers, 0,
+      NULL);
+
+  if (pool->workers == NULL) {
+    laplace_pool_destroy(pool);
+    return LAPLACE_ERROR_BAD_ALLOC;
+  }
+
+  for (ptrdiff_t i = 0; i < worker_count; i++) {
+    laplace_pool_worker_t *const worker = pool->workers + i;
+
+    memset(worker, 0, sizeof *worker);
+    worker->pool  = pool;
+    worker->index = i;
+    worker->cpu   = cpus != NULL ? cpus[i] : -1;
+    DA_INIT(worker->tasks.tasks, 0, alloc);
+    DA_INIT(worker->local.tasks, 0, alloc);
+
+    if (mtx_init(&worker->lock, mtx_plain) != thrd_success) {
+      laplace_pool_destroy(pool);
+      return LAPLACE_ERROR_BAD_MUTEX_INIT;
+    }
+
+    /*  The worker count is the number of workers that can be
+     *  destroyed.
+     */
+    pool->worker_count = i + 1;
+
+    if (thrd_create(&worker->thread, worker_run_, worker) !=
+        thrd_success) {
+      mtx_destroy(&worker->lock);
+      DA_DESTROY(worker->tasks.tasks);
+      DA_DESTROY(worker->local.tasks);
+      pool->worker_count = i;
+      laplace_pool_destroy(pool);
+      return LAPLACE_ERROR_BAD_THREAD_CREATE;
+    }
+  }
+
+  if (cpus == NULL)
+    return KIT_OK;
+
+  if (mtx_lock(&pool->lock) != thrd_success) {
+    laplace_pool_destroy(pool);
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+  }
+
+  int ok = 1;
+  while (ok && pool->started < worker_count)
+    ok = cnd_wait(&pool->on_done, &pool->lock) == thrd_success;
+  int const pin_failed = pool->pin_failed;
+
+  (void) mtx_unlock(&pool->lock);
+
+  if (!ok || pin_failed) {
+    laplace_pool_destroy(pool);
+    return ok ? LAPLACE_ERROR_BAD_AFFINITY
+              : LAPLACE_ERROR_BAD_CNDVAR_WAIT;
+  }
+
+  return KIT_OK;
+}
+
+void laplace_pool_destroy(laplace_pool_t *const pool) {
+  assert(pool != NULL);
+
+  if (mtx_lock(&pool->lock) == thrd_success) {
+    pool->stop = 1;
+    (void) cnd_broadcast(&pool->on_task);
+    (void) mtx_unlock(&pool->lock);
+  }
+
+  /*  Workers that still run may steal from any deque, so all of them
+   *  are joined before the deques are destroyed.
+   */
+  for (ptrdiff_t i = 0; i < pool->worker_count; i++)
+    (void) thrd_join(pool->workers[i].thread, NULL);
+
+  for (ptrdiff_t i = 0; i < pool->worker_count; i++) {
+    laplace_pool_worker_t *const worker = pool->workers + i;
+    mtx_destroy(&worker->lock);
+    DA_DESTROY(worker->tasks.tasks);
+    DA_DESTROY(worker->local.tasks);
+  }
+
+  if (pool->workers != NULL)
+    kit_alloc_dispatch(pool->alloc, KIT_DEALLOCATE, 0, 0,
+                       pool->workers);
+
+  mtx_destroy(&pool->lock);
+  cnd_destroy(&pool->on_task);
+  cnd_destroy(&pool->on_done);
+
+  pool->workers      = NULL;
+  pool->worker_count = 0;
+}
+
+kit_status_t laplace_pool_submit(laplace_pool_t *const      pool,
+                                 laplace_pool_task_fn const fn,
+                                 void *const                data) {
+  assert(pool != NULL);
+  assert(fn != NULL);
+
+  laplace_pool_task_t const task = { .fn = fn, .data = data };
+  return submit_(pool, -1, &task);
+}
+
+kit_status_t laplace_pool_submit_to(laplace_pool_t *const      pool,
+                                    ptrdiff_t const            worker,
+                                    laplace_pool_task_fn const fn,
+                                    void *const                data) {
+  assert(pool != NULL);
+  assert(fn != NULL);
+
+  if (worker < 0 || worker >= pool->worker_count)
+    return LAPLACE_ERROR_INVALID_INDEX;
+
+  laplace_pool_task_t const task = { .fn = fn, .data = data };
+  return submit_(pool, worker, &task);
+}
+
+ptrdiff_t laplace_pool_current_worker(
+    laplace_pool_t const *const pool) {
+  assert(pool != NULL);
+
+  if (current_worker_ == NULL || current_worker_->pool != pool)
+    return -1;
+  return current_worker_->index;
+}
+
+kit_status_t laplace_pool_wait(laplace_pool_t *const pool) {
+  assert(pool != NULL);
+
+  if (mtx_lock(&pool->lock) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+
+  int ok = 1;
+  while (ok && atomic_load_explicit(&pool->pending,
+                                    memory_order_acquire) != 0)
+    ok = cnd_wait(&pool->on_done, &pool->lock) == thrd_success;
+
+  (void) mtx_unlock(&pool->lock);
+  return ok ? KIT_OK : LAPLACE_ERROR_BAD_CNDVAR_WAIT;
+}
+
+static kit_status_t pool_submit_(void *const                 state,
+                                 laplace_pool_task_fn const fn,
+                                 void *const                data) {
+  return laplace_pool_submit((laplace_pool_t *) state, fn, data);
+}
+
+laplace_thread_pool_t laplace_pool_thread_pool(
+    laplace_pool_t *const pool) {
+  laplace_thread_pool_t const thread_pool = {
+    .state   = pool,
+    .acquire = NULL,
+    .release = NULL,
+    .run     = NULL,
+    .join    = NULL,
+    .submit  = pool_submit_
+  };
+  return thread_pool;
+}
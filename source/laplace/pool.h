@@ -0,0 +1,136 @@
+#ifndef LAPLACE_POOL_H
+#define LAPLACE_POOL_H
+
+#include "execution.h"
+
+#include <kit/allocator.h>
+#include <kit/atomic.h>
+#include <kit/condition_variable.h>
+#include <kit/dynamic_array.h>
+#include <kit/mutex.h>
+#include <kit/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  laplace_pool_task_fn fn;
+  void                *data;
+} laplace_pool_task_t;
+
+typedef struct laplace_pool laplace_pool_t;
+
+typedef struct {
+  ptrdiff_t head;
+  KIT_DA(laplace_pool_task_t) tasks;
+} laplace_pool_deque_t;
+
+typedef struct {
+  laplace_pool_t      *pool;
+  ptrdiff_t            index;
+  int                  cpu;
+  thrd_t               thread;
+  mtx_t                lock;
+  laplace_pool_deque_t tasks;
+  laplace_pool_deque_t local;
+
+  KIT_ATOMIC(ptrdiff_t) local_queued;
+} laplace_pool_worker_t;
+
+/*  Thread pool with a fixed set of worker threads.
+ *
+ *  Each worker has a deque of tasks. A worker pops its own tasks
+ *  from the back, and steals tasks of other workers from the front
+ *  when its deque is empty. Tasks submitted from a worker go to its
+ *  own deque, other tasks are spread between workers.
+ *
+ *  Workers can be pinned to CPUs. Tasks submitted to a specific
+ *  worker are never stolen, so memory they touch first is placed on
+ *  the NUMA node of that worker's CPU.
+ *
+ *  Executions submit each stage of a tick as tasks and hold no
+ *  workers between them, so their thread count is not limited by the
+ *  worker count. A task should not wait for other tasks of the same
+ *  pool, so a scheduler can not run executions that use its pool.
+ */
+struct laplace_pool {
+  kit_allocator_t        alloc;
+  ptrdiff_t              worker_count;
+  laplace_pool_worker_t *workers;
+  ptrdiff_t              started;
+  int                    pin_failed;
+  int                    stop;
+
+  KIT_ATOMIC(ptrdiff_t) queued;
+  KIT_ATOMIC(ptrdiff_t) pending;
+  KIT_ATOMIC(ptrdiff_t) next;
+
+  mtx_t lock;
+  cnd_t on_task;
+  cnd_t on_done;
+};
+
+kit_status_t laplace_pool_init(laplace_pool_t *pool,
+                               ptrdiff_t       worker_count,
+                               kit_allocator_t alloc);
+
+/*  Init the pool and pin worker i to CPU cpus[i]. Negative CPU
+ *  leaves the worker unpinned. Pinning is supported on Linux only.
+ */
+kit_status_t laplace_pool_init_pinned(laplace_pool_t *pool,
+                                      ptrdiff_t       worker_count,
+                                      int const      *cpus,
+                                      kit_allocator_t alloc);
+
+/*  Finish queued tasks and join worker threads. Executions that use
+ *  the pool should be destroyed first.
+ */
+void laplace_pool_destroy(laplace_pool_t *pool);
+
+kit_status_t laplace_pool_submit(laplace_pool_t      *pool,
+                                 laplace_pool_task_fn fn,
+                                 void                *data);
+
+/*  Submit a task that only the specified worker will run.
+ */
+kit_status_t laplace_pool_submit_to(laplace_pool_t      *pool,
+                                    ptrdiff_t            worker,
+                                    laplace_pool_task_fn fn,
+                                    void                *data);
+
+/*  Index of the worker that runs the current task, or -1 if called
+ *  outside of the pool.
+ */
+ptrdiff_t laplace_pool_current_worker(laplace_pool_t const *pool);
+
+/*  Wait until all submitted tasks are done. Should not be called from
+ *  a task.
+ */
+kit_status_t laplace_pool_wait(laplace_pool_t *pool);
+
+/*  Thread pool interface for the execution.
+ */
+laplace_thread_pool_t laplace_pool_thread_pool(laplace_pool_t *pool);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define pool_task_t laplace_pool_task_t
+#  define pool_deque_t laplace_pool_deque_t
+#  define pool_worker_t laplace_pool_worker_t
+#  define pool_t laplace_pool_t
+
+#  define pool_init laplace_pool_init
+#  define pool_init_pinned laplace_pool_init_pinned
+#  define pool_destroy laplace_pool_destroy
+#  define pool_submit laplace_pool_submit
+#  define pool_submit_to laplace_pool_submit_to
+#  define pool_current_worker laplace_pool_current_worker
+#  define pool_wait laplace_pool_wait
+#  define pool_thread_pool laplace_pool_thread_pool
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,6 +11,10 @@
 extern "C" {
 #endif
 
+/*  The execution points alloc to a per-thread arena before each run.
+ *  Memory from it, including the returned impact list, is released
+ *  at the end of the tick, so it must not be kept across ticks.
+ */
 typedef struct {
   KIT_AF_STATE_DATA;
   laplace_impact_list_t return_value;
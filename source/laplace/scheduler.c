@@ -0,0 +1,308 @@
+#include "scheduler.h"
+
+#include <string.h>
+
+static int earlier_(laplace_scheduler_t const *const scheduler,
+                    ptrdiff_t const a, ptrdiff_t const b) {
+  laplace_time_t const x = scheduler->matches.values[a].deadline;
+  laplace_time_t const y = scheduler->matches.values[b].deadline;
+  return x < y || (x == y && a < b);
+}
+
+static void sift_up_(laplace_scheduler_t *const scheduler,
+                     ptrdiff_t                  i) {
+  ptrdiff_t *const heap = scheduler->heap.values;
+
+  while (i > 0) {
+    ptrdiff_t const parent = (i - 1) / 2;
+    if (!earlier_(scheduler, heap[i], heap[parent]))
+      break;
+    ptrdiff_t const t = heap[i];
+    heap[i]           = heap[parent];
+    heap[parent]      = t;
+    i                 = parent;
+  }
+}
+
+static void sift_down_(laplace_scheduler_t *const scheduler,
+                       ptrdiff_t                  i) {
+  ptrdiff_t *const heap = scheduler->heap.values;
+  ptrdiff_t const  size = scheduler->heap.size;
+
+  for (;;) {
+    ptrdiff_t const left  = i * 2 + 1;
+    ptrdiff_t const right = left + 1;
+    ptrdiff_t       first = i;
+
+    if (left < size && earlier_(scheduler, heap[left], heap[first]))
+      first = left;
+    if (right < size && earlier_(scheduler, heap[right], heap[first]))
+      first = right;
+    if (first == i)
+      break;
+
+    ptrdiff_t const t = heap[i];
+    heap[i]           = heap[first];
+    heap[first]       = t;
+    i                 = first;
+  }
+}
+
+static void heap_erase_(laplace_scheduler_t *const scheduler,
+                        ptrdiff_t const            i) {
+  ptrdiff_t const last = scheduler->heap.size - 1;
+
+  scheduler->heap.values[i] = scheduler->heap.values[last];
+  DA_RESIZE(scheduler->heap, last);
+
+  if (i < last) {
+    sift_down_(scheduler, i);
+    sift_up_(scheduler, i);
+  }
+}
+
+/*  Heap capacity is reserved when a match is added, so the push
+ *  does not allocate.
+ */
+static void heap_push_(laplace_scheduler_t *const scheduler,
+                       ptrdiff_t const            match) {
+  ptrdiff_t const n = scheduler->heap.size;
+  DA_RESIZE(scheduler->heap, n + 1);
+  assert(scheduler->heap.size == n + 1);
+  scheduler->heap.values[n] = match;
+  sift_up_(scheduler, n);
+}
+
+static void drain_(void *const p) {
+  laplace_scheduler_t *const scheduler = (laplace_scheduler_t *) p;
+
+  if (mtx_lock(&scheduler->lock) != thrd_success)
+    return;
+
+  while (scheduler->heap.size != 0) {
+    ptrdiff_t const                  k = scheduler->heap.values[0];
+    laplace_scheduler_match_t *const m = scheduler->matches.values +
+                                         k;
+
+    heap_erase_(scheduler, 0);
+    if (scheduler->time < m->deadline)
+      scheduler->time = m->deadline;
+
+    (void) mtx_unlock(&scheduler->lock);
+
+    kit_status_t const s = laplace_execution_schedule_and_join(
+        m->execution, 1);
+
+    if (mtx_lock(&scheduler->lock) != thrd_success)
+      return;
+
+    m->deadline += m->period;
+    m->pending--;
+
+    if (s != KIT_OK) {
+      m->status  = s;
+      m->pending = 0;
+      if (scheduler->status == KIT_OK)
+        scheduler->status = s;
+    }
+
+    if (m->pending > 0)
+      heap_push_(scheduler, k);
+  }
+
+  if (--scheduler->active == 0)
+    (void) cnd_broadcast(&scheduler->on_done);
+
+  (void) mtx_unlock(&scheduler->lock);
+}
+
+kit_status_t laplace_scheduler_init(
+    laplace_scheduler_t *const scheduler, laplace_pool_t *const pool,
+    kit_allocator_t const alloc) {
+  assert(scheduler != NULL);
+  assert(pool != NULL);
+
+  memset(scheduler, 0, sizeof *scheduler);
+
+  scheduler->alloc = alloc;
+  scheduler->pool  = pool;
+
+  if (mtx_init(&scheduler->lock, mtx_plain) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_INIT;
+
+  if (cnd_init(&scheduler->on_done) != thrd_success) {
+    mtx_destroy(&scheduler->lock);
+    return LAPLACE_ERROR_BAD_CNDVAR_INIT;
+  }
+
+  DA_INIT(scheduler->matches, 0, alloc);
+  DA_INIT(scheduler->free, 0, alloc);
+  DA_INIT(scheduler->heap, 0, alloc);
+
+  return KIT_OK;
+}
+
+void laplace_scheduler_destroy(laplace_scheduler_t *const scheduler) {
+  assert(scheduler != NULL);
+
+  DA_DESTROY(scheduler->matches);
+  DA_DESTROY(scheduler->free);
+  DA_DESTROY(scheduler->heap);
+
+  mtx_destroy(&scheduler->lock);
+  cnd_destroy(&scheduler->on_done);
+}
+
+ptrdiff_t laplace_scheduler_add(laplace_scheduler_t *const scheduler,
+                                laplace_execution_t *const execution,
+                                laplace_time_t const       period) {
+  assert(scheduler != NULL);
+  assert(execution != NULL);
+
+  if (period <= 0)
+    return -1;
+
+  /*  Ticks are run by a blocking join on a worker of the pool. Tasks
+   *  of an execution that uses threads would queue behind the join,
+   *  and could deadlock it.
+   */
+  if (execution->thread_count != 0 ||
+      execution->_thread_pool.state == scheduler->pool)
+    return -1;
+
+  ptrdiff_t match;
+
+  if (scheduler->free.size != 0) {
+    match = scheduler->free.values[scheduler->free.size - 1];
+    DA_RESIZE(scheduler->free, scheduler->free.size - 1);
+  } else {
+    match = scheduler->matches.size;
+
+    /*  Reserve a heap slot for the new match.
+     */
+    ptrdiff_t const n = scheduler->heap.size;
+    DA_RESIZE(scheduler->heap, match + 1);
+    if (scheduler->heap.size != match + 1)
+      return -1;
+    DA_RESIZE(scheduler->heap, n);
+
+    DA_RESIZE(scheduler->matches, match + 1);
+    if (scheduler->matches.size != match + 1)
+      return -1;
+  }
+
+  laplace_scheduler_match_t *const m = scheduler->matches.values +
+                                       match;
+
+  memset(m, 0, sizeof *m);
+  m->execution = execution;
+  m->period    = period;
+  m->deadline  = scheduler->time + period;
+  m->status    = KIT_OK;
+
+  return match;
+}
+
+void laplace_scheduler_remove(laplace_scheduler_t *const scheduler,
+                              ptrdiff_t const            match) {
+  assert(scheduler != NULL);
+
+  if (match < 0 || match >= scheduler->matches.size ||
+      scheduler->matches.values[match].execution == NULL)
+    return;
+
+  for (ptrdiff_t i = 0; i < scheduler->heap.size; i++)
+    if (scheduler->heap.values[i] == match) {
+      heap_erase_(scheduler, i);
+      break;
+    }
+
+  scheduler->matches.values[match].execution = NULL;
+  scheduler->matches.values[match].pending   = 0;
+
+  /*  If the free list cannot grow, the slot is not reused.
+   */
+  ptrdiff_t const n = scheduler->free.size;
+  DA_RESIZE(scheduler->free, n + 1);
+  if (scheduler->free.size == n + 1)
+    scheduler->free.values[n] = match;
+}
+
+kit_status_t laplace_scheduler_queue(
+    laplace_scheduler_t *const scheduler, ptrdiff_t const match,
+    laplace_time_t const ticks) {
+  assert(scheduler != NULL);
+
+  if (match < 0 || match >= scheduler->matches.size ||
+      scheduler->matches.values[match].execution == NULL)
+    return LAPLACE_ERROR_INVALID_INDEX;
+
+  if (ticks < 0)
+    return LAPLACE_ERROR_INVALID_SIZE;
+  if (ticks == 0)
+    return KIT_OK;
+
+  laplace_scheduler_match_t *const m = scheduler->matches.values +
+                                       match;
+
+  if (m->pending == 0) {
+    /*  An idle match does not keep credit from the time it was idle.
+     */
+    if (m->deadline < scheduler->time + m->period)
+      m->deadline = scheduler->time + m->period;
+    heap_push_(scheduler, match);
+  }
+
+  m->pending += ticks;
+
+  return KIT_OK;
+}
+
+kit_status_t laplace_scheduler_run(
+    laplace_scheduler_t *const scheduler) {
+  assert(scheduler != NULL);
+
+  if (mtx_lock(&scheduler->lock) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+
+  ptrdiff_t n = scheduler->heap.size;
+  if (n > scheduler->pool->worker_count)
+    n = scheduler->pool->worker_count;
+
+  scheduler->status = KIT_OK;
+  scheduler->active = n;
+
+  (void) mtx_unlock(&scheduler->lock);
+
+  kit_status_t submitted = KIT_OK;
+
+  for (ptrdiff_t i = 0; i < n; i++) {
+    submitted = laplace_pool_submit(scheduler->pool, drain_,
+                                    scheduler);
+    if (submitted == KIT_OK)
+      continue;
+
+    if (mtx_lock(&scheduler->lock) != thrd_success)
+      return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+    scheduler->active -= n - i;
+    (void) mtx_unlock(&scheduler->lock);
+    break;
+  }
+
+  if (mtx_lock(&scheduler->lock) != thrd_success)
+    return LAPLACE_ERROR_BAD_MUTEX_LOCK;
+
+  int ok = 1;
+  while (ok && scheduler->active != 0)
+    ok = cnd_wait(&scheduler->on_done, &scheduler->lock) ==
+         thrd_success;
+
+  kit_status_t const s = scheduler->status;
+  (void) mtx_unlock(&scheduler->lock);
+
+  if (!ok)
+    return LAPLACE_ERROR_BAD_CNDVAR_WAIT;
+  if (submitted != KIT_OK)
+    return submitted;
+  return s;
+}
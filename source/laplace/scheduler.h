@@ -0,0 +1,93 @@
+#ifndef LAPLACE_SCHEDULER_H
+#define LAPLACE_SCHEDULER_H
+
+#include "pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  laplace_execution_t *execution;
+  laplace_time_t       period;
+  laplace_time_t       deadline;
+  ptrdiff_t            pending;
+  kit_status_t         status;
+} laplace_scheduler_match_t;
+
+/*  Runs ticks of many executions on a shared pool.
+ *
+ *  Each match has a tick period. A match that runs a tick moves its
+ *  deadline forward by its period, and the next tick to run is always
+ *  the one with the earliest deadline, ties broken by match index.
+ *  So every match gets ticks in proportion to its rate, and a match
+ *  is never run by two workers at once.
+ *
+ *  Executions should have zero thread count and should not use the
+ *  scheduler's pool, so that a tick runs entirely on the worker that
+ *  took it. Other executions are rejected by add.
+ */
+typedef struct {
+  kit_status_t    status;
+  kit_allocator_t alloc;
+  laplace_pool_t *pool;
+  laplace_time_t  time;
+  ptrdiff_t       active;
+
+  KIT_DA(laplace_scheduler_match_t) matches;
+  KIT_DA(ptrdiff_t) free;
+  KIT_DA(ptrdiff_t) heap;
+
+  mtx_t lock;
+  cnd_t on_done;
+} laplace_scheduler_t;
+
+kit_status_t laplace_scheduler_init(laplace_scheduler_t *scheduler,
+                                    laplace_pool_t      *pool,
+                                    kit_allocator_t      alloc);
+
+void laplace_scheduler_destroy(laplace_scheduler_t *scheduler);
+
+/*  Add an execution with the specified tick period. Returns the match
+ *  index, or -1 on failure or if the execution uses threads or the
+ *  scheduler's pool.
+ */
+ptrdiff_t laplace_scheduler_add(laplace_scheduler_t *scheduler,
+                                laplace_execution_t *execution,
+                                laplace_time_t       period);
+
+/*  Remove a match. Its pending ticks are dropped. Should not be
+ *  called during run.
+ */
+void laplace_scheduler_remove(laplace_scheduler_t *scheduler,
+                              ptrdiff_t            match);
+
+/*  Add ticks to run for a match. Should not be called during run.
+ */
+kit_status_t laplace_scheduler_queue(laplace_scheduler_t *scheduler,
+                                     ptrdiff_t            match,
+                                     laplace_time_t       ticks);
+
+/*  Run all queued ticks. A match whose tick fails keeps the status,
+ *  and its remaining ticks are dropped. Returns the first failure.
+ *  Should not be called from a task of the pool.
+ */
+kit_status_t laplace_scheduler_run(laplace_scheduler_t *scheduler);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define scheduler_match_t laplace_scheduler_match_t
+#  define scheduler_t laplace_scheduler_t
+
+#  define scheduler_init laplace_scheduler_init
+#  define scheduler_destroy laplace_scheduler_destroy
+#  define scheduler_add laplace_scheduler_add
+#  define scheduler_remove laplace_scheduler_remove
+#  define scheduler_queue laplace_scheduler_queue
+#  define scheduler_run laplace_scheduler_run
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
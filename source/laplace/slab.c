@@ -0,0 +1,178 @@
+#include "slab.h"
+
+#include <string.h>
+
+/*  Frame index is slot * KINDS_ + kind, where kinds below the class
+ *  count are size classes and the last kind is large frames.
+ */
+#define KINDS_ (LAPLACE_SLAB_CLASS_COUNT + 1)
+#define LARGE_ LAPLACE_SLAB_CLASS_COUNT
+
+void laplace_slab_init(laplace_slab_t *const slab,
+                       kit_allocator_t const alloc) {
+  assert(slab != NULL);
+
+  memset(slab, 0, sizeof *slab);
+  slab->alloc = alloc;
+
+  for (ptrdiff_t i = 0; i < LAPLACE_SLAB_CLASS_COUNT; i++) {
+    laplace_slab_class_t *const c = slab->classes + i;
+    c->frame_size = (i + 1) * LAPLACE_SLAB_GRANULARITY;
+    DA_INIT(c->chunks, 0, alloc);
+    DA_INIT(c->free, 0, alloc);
+  }
+
+  DA_INIT(slab->large, 0, alloc);
+  DA_INIT(slab->large_free, 0, alloc);
+}
+
+void laplace_slab_destroy(laplace_slab_t *const slab) {
+  assert(slab != NULL);
+
+  for (ptrdiff_t i = 0; i < LAPLACE_SLAB_CLASS_COUNT; i++) {
+    laplace_slab_class_t *const c = slab->classes + i;
+    for (ptrdiff_t j = 0; j < c->chunks.size; j++)
+      kit_alloc_dispatch(slab->alloc, KIT_DEALLOCATE, 0, 0,
+                         c->chunks.values[j]);
+    DA_DESTROY(c->chunks);
+    DA_DESTROY(c->free);
+    c->size = 0;
+  }
+
+  for (ptrdiff_t i = 0; i < slab->large.size; i++)
+    if (slab->large.values[i].values != NULL)
+      kit_alloc_dispatch(slab->alloc, KIT_DEALLOCATE, 0, 0,
+                         slab->large.values[i].values);
+  DA_DESTROY(slab->large);
+  DA_DESTROY(slab->large_free);
+}
+
+static ptrdiff_t allocate_large_(laplace_slab_t *const slab,
+                                 ptrdiff_t const       size) {
+  char *const values = (char *) kit_alloc_dispatch(
+      slab->alloc, KIT_ALLOCATE, size, 0, NULL);
+  if (values == NULL)
+    return -1;
+
+  ptrdiff_t slot;
+
+  if (slab->large_free.size != 0) {
+    slot = slab->large_free.values[slab->large_free.size - 1];
+    DA_RESIZE(slab->large_free, slab->large_free.size - 1);
+  } else {
+    slot = slab->large.size;
+    DA_RESIZE(slab->large, slot + 1);
+    if (slab->large.size != slot + 1) {
+      kit_alloc_dispatch(slab->alloc, KIT_DEALLOCATE, 0, 0, values);
+      return -1;
+    }
+  }
+
+  slab->large.values[slot].values = values;
+  slab->large.values[slot].size   = size;
+  return slot * KINDS_ + LARGE_;
+}
+
+ptrdiff_t laplace_slab_allocate(laplace_slab_t *const slab,
+                                ptrdiff_t const       size) {
+  assert(slab != NULL);
+
+  if (size <= 0)
+    return -1;
+
+  if (size > LAPLACE_SLAB_CLASS_COUNT * LAPLACE_SLAB_GRANULARITY)
+    return allocate_large_(slab, size);
+
+  ptrdiff_t const             n = (size - 1) /
+                                  LAPLACE_SLAB_GRANULARITY;
+  laplace_slab_class_t *const c = slab->classes + n;
+
+  if (c->free.size != 0) {
+    ptrdiff_t const slot = c->free.values[c->free.size - 1];
+    DA_RESIZE(c->free, c->free.size - 1);
+    return slot * KINDS_ + n;
+  }
+
+  if (c->size == c->chunks.size * LAPLACE_SLAB_CHUNK_SIZE) {
+    char *const chunk = (char *) kit_alloc_dispatch(
+        slab->alloc, KIT_ALLOCATE,
+        c->frame_size * LAPLACE_SLAB_CHUNK_SIZE, 0, NULL);
+    if (chunk == NULL)
+      return -1;
+
+    ptrdiff_t const k = c->chunks.size;
+    DA_RESIZE(c->chunks, k + 1);
+    if (c->chunks.size != k + 1) {
+      kit_alloc_dispatch(slab->alloc, KIT_DEALLOCATE, 0, 0, chunk);
+      return -1;
+    }
+    c->chunks.values[k] = chunk;
+  }
+
+  return (c->size++) * KINDS_ + n;
+}
+
+void laplace_slab_deallocate(laplace_slab_t *const slab,
+                             ptrdiff_t const       frame) {
+  assert(slab != NULL);
+  assert(frame >= 0);
+
+  ptrdiff_t const slot = frame / KINDS_;
+
+  if (frame % KINDS_ == LARGE_) {
+    assert(slot < slab->large.size);
+
+    kit_alloc_dispatch(slab->alloc, KIT_DEALLOCATE, 0, 0,
+                       slab->large.values[slot].values);
+    slab->large.values[slot].values = NULL;
+    slab->large.values[slot].size   = 0;
+
+    ptrdiff_t const n = slab->large_free.size;
+    DA_RESIZE(slab->large_free, n + 1);
+    if (slab->large_free.size == n + 1)
+      slab->large_free.values[n] = slot;
+    return;
+  }
+
+  laplace_slab_class_t *const c = slab->classes + frame % KINDS_;
+  ptrdiff_t const             n = c->free.size;
+
+  /*  If the free list cannot grow, the frame is leaked until the
+   *  slab is destroyed.
+   */
+  DA_RESIZE(c->free, n + 1);
+  if (c->free.size == n + 1)
+    c->free.values[n] = slot;
+}
+
+void *laplace_slab_frame(laplace_slab_t const *const slab,
+                         ptrdiff_t const             frame) {
+  assert(slab != NULL);
+  assert(frame >= 0);
+
+  ptrdiff_t const slot = frame / KINDS_;
+
+  if (frame % KINDS_ == LARGE_) {
+    assert(slot < slab->large.size);
+    return slab->large.values[slot].values;
+  }
+
+  laplace_slab_class_t const *const c = slab->classes +
+                                        frame % KINDS_;
+
+  assert(slot < c->size);
+
+  return c->chunks.values[slot / LAPLACE_SLAB_CHUNK_SIZE] +
+         (slot % LAPLACE_SLAB_CHUNK_SIZE) * c->frame_size;
+}
+
+ptrdiff_t laplace_slab_frame_size(laplace_slab_t const *const slab,
+                                  ptrdiff_t const             frame) {
+  assert(slab != NULL);
+  assert(frame >= 0);
+
+  if (frame % KINDS_ == LARGE_)
+    return slab->large.values[frame / KINDS_].size;
+
+  return slab->classes[frame % KINDS_].frame_size;
+}
@@ -0,0 +1,83 @@
+#ifndef LAPLACE_SLAB_H
+#define LAPLACE_SLAB_H
+
+#include "options.h"
+
+#include <kit/allocator.h>
+#include <kit/dynamic_array.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  LAPLACE_SLAB_GRANULARITY = 64,
+  LAPLACE_SLAB_CLASS_COUNT = 16,
+  LAPLACE_SLAB_CHUNK_SIZE  = 64
+};
+
+typedef struct {
+  ptrdiff_t frame_size;
+  ptrdiff_t size;
+  KIT_DA(char *) chunks;
+  KIT_DA(ptrdiff_t) free;
+} laplace_slab_class_t;
+
+typedef struct {
+  char     *values;
+  ptrdiff_t size;
+} laplace_slab_large_t;
+
+/*  Pool of coroutine frames.
+ *
+ *  Frames up to the class count times the granularity are grouped
+ *  in size classes that are multiples of the granularity, and stored
+ *  in chunks. Larger frames are allocated one by one. Frames never
+ *  move. A frame is referenced by an index that encodes its class
+ *  and slot.
+ */
+typedef struct {
+  kit_allocator_t      alloc;
+  laplace_slab_class_t classes[LAPLACE_SLAB_CLASS_COUNT];
+  KIT_DA(laplace_slab_large_t) large;
+  KIT_DA(ptrdiff_t) large_free;
+} laplace_slab_t;
+
+void laplace_slab_init(laplace_slab_t *slab, kit_allocator_t alloc);
+
+void laplace_slab_destroy(laplace_slab_t *slab);
+
+/*  Allocate a frame of at least the given size. Returns the frame
+ *  index, or -1 on failure.
+ */
+ptrdiff_t laplace_slab_allocate(laplace_slab_t *slab, ptrdiff_t size);
+
+void laplace_slab_deallocate(laplace_slab_t *slab, ptrdiff_t frame);
+
+void *laplace_slab_frame(laplace_slab_t const *slab, ptrdiff_t frame);
+
+ptrdiff_t laplace_slab_frame_size(laplace_slab_t const *slab,
+                                  ptrdiff_t             frame);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define SLAB_GRANULARITY LAPLACE_SLAB_GRANULARITY
+#  define SLAB_CLASS_COUNT LAPLACE_SLAB_CLASS_COUNT
+#  define SLAB_CHUNK_SIZE LAPLACE_SLAB_CHUNK_SIZE
+#  define slab_class_t laplace_slab_class_t
+#  define slab_large_t laplace_slab_large_t
+#  define slab_t laplace_slab_t
+
+#  define slab_init laplace_slab_init
+#  define slab_destroy laplace_slab_destroy
+#  define slab_allocate laplace_slab_allocate
+#  define slab_deallocate laplace_slab_deallocate
+#  define slab_frame laplace_slab_frame
+#  define slab_frame_size laplace_slab_frame_size
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,15 +6,84 @@
 #include <kit/atomic.h>
 #include <kit/mersenne_twister_64.h>
 
+/*  Blocks allocated by deferred sync impacts, in allocation order.
+ *  Flags are indexed by block id and are set until the block is
+ *  cleared.
+ */
+typedef struct {
+  KIT_DA(ptrdiff_t) ids;
+  KIT_DA(char) flags;
+} deferred_t;
+
 typedef struct {
   ATOMIC(ptrdiff_t) ref_count;
-  kit_allocator_t  alloc;
-  uint64_t         seed;
-  kit_mt64_state_t mt64;
+  ATOMIC(ptrdiff_t) next_chunk;
+  ATOMIC(ptrdiff_t) next_clear;
+  kit_allocator_t         alloc;
+  uint64_t                seed;
+  kit_mt64_state_t        mt64;
+  int                     deferring;
+  deferred_t              deferred_integers;
+  deferred_t              deferred_bytes;
+  laplace_buffer_region_t region;
   LAPLACE_BUFFER_TYPE(laplace_integer_t) integers;
   LAPLACE_BUFFER_TYPE(laplace_byte_t) bytes;
 } state_internal_t;
 
+typedef struct {
+  kit_allocator_t           alloc;
+  uint64_t                  seed;
+  kit_mt64_state_t          mt64;
+  laplace_buffer_snapshot_t integers;
+  laplace_buffer_snapshot_t bytes;
+} state_snapshot_t;
+
+#ifdef LAPLACE_BUFFER_SOA
+enum { SAVE_LAYOUT = 1 };
+#else
+enum { SAVE_LAYOUT = 0 };
+#endif
+
+enum { SAVE_VERSION = 1, SAVE_BYTE_ORDER = 0x01020304 };
+
+static char const save_magic[8] = "LAPLACE";
+
+enum { DIFF_VERSION = 1 };
+
+static char const diff_magic[8] = "LAPLDIF";
+
+/*  State diff header. Random generator words follow it if they
+ *  changed, then buffer diffs. Previous hashes are repeated here, so
+ *  all of them are checked before the state is changed.
+ */
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t layout;
+  uint64_t seed;
+  uint64_t mt64_index;
+  uint64_t mt64_changed;
+  uint64_t has_previous;
+  uint64_t random_previous_hash;
+  uint64_t random_hash;
+  uint64_t previous_hashes[4];
+} state_diff_t;
+
+/*  Saved state header. Buffers follow it.
+ */
+typedef struct {
+  char                  magic[8];
+  uint32_t              version;
+  uint32_t              layout;
+  uint32_t              word_size;
+  uint32_t              byte_order;
+  int64_t               size;
+  uint64_t              seed;
+  kit_mt64_state_t      mt64;
+  laplace_buffer_save_t integers;
+  laplace_buffer_save_t bytes;
+} state_save_t;
+
 static void acquire(void *p) {
   state_internal_t *internal = (state_internal_t *) p;
 
@@ -26,6 +95,11 @@ static void destroy(state_internal_t *internal) {
   LAPLACE_BUFFER_DESTROY(internal->integers);
   LAPLACE_BUFFER_DESTROY(internal->bytes);
 
+  DA_DESTROY(internal->deferred_integers.ids);
+  DA_DESTROY(internal->deferred_integers.flags);
+  DA_DESTROY(internal->deferred_bytes.ids);
+  DA_DESTROY(internal->deferred_bytes.flags);
+
   kit_alloc_dispatch(internal->alloc, KIT_DEALLOCATE, 0, 0, internal);
 }
 
@@ -47,6 +121,8 @@ static kit_status_t clone_(void *p, laplace_read_write_t *cloned) {
 
   state_internal_t *clone_self = (state_internal_t *) cloned->state;
 
+  clone_self->mt64 = self->mt64;
+
   LAPLACE_BUFFER_CLONE(s, clone_self->integers, self->integers);
 
   if (s != KIT_OK) {
@@ -64,6 +140,97 @@ static kit_status_t clone_(void *p, laplace_read_write_t *cloned) {
   return KIT_OK;
 }
 
+static kit_status_t assign(void *p, void *source) {
+  state_internal_t *self = (state_internal_t *) p;
+  state_internal_t *src  = (state_internal_t *) source;
+
+  if (self == src)
+    return KIT_OK;
+
+  self->seed = src->seed;
+  self->mt64 = src->mt64;
+
+  kit_status_t s;
+
+  LAPLACE_BUFFER_CLONE(s, self->integers, src->integers);
+
+  if (s != KIT_OK)
+    return s;
+
+  LAPLACE_BUFFER_CLONE(s, self->bytes, src->bytes);
+
+  return s;
+}
+
+static void snapshot_destroy(void *p) {
+  state_snapshot_t *snapshot = (state_snapshot_t *) p;
+
+  if (snapshot == NULL)
+    return;
+
+  laplace_buffer_snapshot_destroy(&snapshot->integers);
+  laplace_buffer_snapshot_destroy(&snapshot->bytes);
+  kit_alloc_dispatch(snapshot->alloc, KIT_DEALLOCATE, 0, 0, snapshot);
+}
+
+static kit_status_t snapshot(void *p, void **snapshot_p,
+                             void const *previous_p) {
+  state_internal_t       *self     = (state_internal_t *) p;
+  state_snapshot_t       *snapshot = (state_snapshot_t *) *snapshot_p;
+  state_snapshot_t const *previous = (state_snapshot_t const *)
+      previous_p;
+
+  if (snapshot == NULL) {
+    snapshot = (state_snapshot_t *) kit_alloc_dispatch(
+        self->alloc, KIT_ALLOCATE, sizeof *snapshot, 0, NULL);
+
+    if (snapshot == NULL)
+      return LAPLACE_ERROR_BAD_ALLOC;
+
+    snapshot->alloc = self->alloc;
+    laplace_buffer_snapshot_init(&snapshot->integers, self->alloc);
+    laplace_buffer_snapshot_init(&snapshot->bytes, self->alloc);
+    *snapshot_p = snapshot;
+  }
+
+  snapshot->seed = self->seed;
+  snapshot->mt64 = self->mt64;
+
+  kit_status_t s;
+
+  LAPLACE_BUFFER_SNAPSHOT(s, snapshot->integers, self->integers,
+                          previous != NULL ? &previous->integers
+                                           : NULL);
+
+  if (s != KIT_OK)
+    return s;
+
+  LAPLACE_BUFFER_SNAPSHOT(s, snapshot->bytes, self->bytes,
+                          previous != NULL ? &previous->bytes : NULL);
+
+  return s;
+}
+
+static kit_status_t restore(void *p, void const *snapshot_p) {
+  state_internal_t       *self     = (state_internal_t *) p;
+  state_snapshot_t const *snapshot = (state_snapshot_t const *)
+      snapshot_p;
+
+  self->seed = snapshot->seed;
+  self->mt64 = snapshot->mt64;
+
+  kit_status_t s;
+
+  LAPLACE_BUFFER_RESTORE(s, self->integers, snapshot->integers);
+
+  if (s != KIT_OK)
+    return s;
+
+  LAPLACE_BUFFER_RESTORE(s, self->bytes, snapshot->bytes);
+
+  return s;
+}
+
 static kit_status_t reset(void *p) {
   state_internal_t *self = (state_internal_t *) p;
 
@@ -93,22 +260,13 @@ static kit_status_t reset(void *p) {
 static ptrdiff_t integers_size(void *p, laplace_handle_t handle) {
   state_internal_t *internal = (state_internal_t *) p;
 
-  if (laplace_buffer_check(
-          (laplace_buffer_void_t *) &internal->integers, handle, 0,
-          0) != KIT_OK)
-    return 0;
-
-  return internal->integers.blocks.values[handle.id].size;
+  return LAPLACE_BUFFER_SIZE_THREAD_SAFE(internal->integers, handle);
 }
 
 static ptrdiff_t bytes_size(void *p, laplace_handle_t handle) {
   state_internal_t *internal = (state_internal_t *) p;
 
-  if (laplace_buffer_check((laplace_buffer_void_t *) &internal->bytes,
-                           handle, 0, 0) != KIT_OK)
-    return 0;
-
-  return internal->bytes.blocks.values[handle.id].size;
+  return LAPLACE_BUFFER_SIZE_THREAD_SAFE(internal->bytes, handle);
 }
 
 static kit_status_t read_integers(
@@ -178,6 +336,63 @@ static int64_t rng(mt64_state_t *const mt64, int64_t const min,
   return min + (int64_t) (x % n);
 }
 
+#define BUFFER_(buf_) ((laplace_buffer_void_t *) &(buf_))
+
+/*  Returns 0 if out of memory, then the block should be cleared at
+ *  once.
+ */
+static int defer_clear(deferred_t *const deferred,
+                       ptrdiff_t const   id) {
+  ptrdiff_t const n    = deferred->ids.size;
+  ptrdiff_t const size = deferred->flags.size;
+
+  if (id >= size) {
+    DA_RESIZE(deferred->flags, id + 1);
+    if (deferred->flags.size != id + 1)
+      return 0;
+    memset(deferred->flags.values + size, 0, id + 1 - size);
+  }
+
+  DA_RESIZE(deferred->ids, n + 1);
+  if (deferred->ids.size != n + 1)
+    return 0;
+
+  deferred->ids.values[n]    = id;
+  deferred->flags.values[id] = 1;
+  return 1;
+}
+
+#define CLEAR_BLOCK_(buf_, id_)                                 \
+  do {                                                          \
+    laplace_handle_t const h_ = { .id = (id_) };                \
+    LAPLACE_BUF_ZERO_(                                          \
+        (buf_), h_, 0,                                          \
+        atomic_load_explicit(&(buf_).blocks.values[h_.id].size, \
+                             memory_order_relaxed));            \
+  } while (0)
+
+/*  Clear the block now if its clearing is deferred.
+ */
+#define CLEAR_NOW_(buf_, deferred_, id_)                    \
+  do {                                                      \
+    ptrdiff_t const id_now_ = (id_);                        \
+    if (id_now_ >= 0 && id_now_ < (deferred_).flags.size && \
+        (deferred_).flags.values[id_now_]) {                \
+      (deferred_).flags.values[id_now_] = 0;                \
+      CLEAR_BLOCK_((buf_), id_now_);                        \
+    }                                                       \
+  } while (0)
+
+/*  Clear the new block, or leave it to the clear loop.
+ */
+#define CLEAR_NEW_(buf_, deferred_, h_, size_)     \
+  do {                                             \
+    if ((h_).id != LAPLACE_ID_UNDEFINED &&         \
+        !(internal->deferring &&                   \
+          defer_clear(&(deferred_), (h_).id)))     \
+      LAPLACE_BUF_ZERO_((buf_), (h_), 0, (size_)); \
+  } while (0)
+
 static kit_status_t apply(void *const                   p,
                           laplace_impact_t const *const impact) {
   state_internal_t *internal = (state_internal_t *) p;
@@ -213,17 +428,21 @@ static kit_status_t apply(void *const                   p,
                                impact->type_##_reserve.count);      \
     break;                                                          \
   case LAPLACE_IMPACT_##TYPE_CAPS_##_ALLOCATE_INTO: {               \
-    laplace_handle_t h;                                             \
-    LAPLACE_BUFFER_ALLOCATE_INTO(                                   \
-        h, internal->type_##s, impact->type_##_allocate_into.size,  \
+    laplace_handle_t const h = laplace_buffer_allocate_into(        \
+        BUFFER_(internal->type_##s),                                \
+        impact->type_##_allocate_into.size,                         \
         impact->type_##_allocate_into.handle);                      \
+    CLEAR_NEW_(internal->type_##s, internal->deferred_##type_##s,   \
+               h, impact->type_##_allocate_into.size);              \
     if (h.id == LAPLACE_ID_UNDEFINED)                               \
       s = h.error;                                                  \
   } break;                                                          \
   case LAPLACE_IMPACT_##TYPE_CAPS_##_ALLOCATE: {                    \
-    laplace_handle_t h;                                             \
-    LAPLACE_BUFFER_ALLOCATE(h, internal->type_##s,                  \
-                            impact->type_##_allocate.size);         \
+    laplace_handle_t const h = laplace_buffer_allocate(             \
+        BUFFER_(internal->type_##s),                                \
+        impact->type_##_allocate.size);                             \
+    CLEAR_NEW_(internal->type_##s, internal->deferred_##type_##s,   \
+               h, impact->type_##_allocate.size);                   \
     if (h.id != LAPLACE_ID_UNDEFINED) {                             \
       LAPLACE_BUFFER_SET(s, internal->integers,                     \
                          impact->type_##_allocate.return_handle,    \
@@ -287,25 +506,308 @@ static kit_status_t apply(void *const                   p,
   return s;
 }
 
-static void adjust_loop(void *p) {
+/*  Chunks of both buffers are taken from one counter, so a thread
+ *  done with one buffer takes the remaining chunks of the other.
+ */
+static void adjust_loop(void *p, ptrdiff_t const thread_count) {
   state_internal_t *internal = (state_internal_t *) p;
 
-  for (int ints = 1, bytes = 1; ints || bytes;) {
-    if (ints)
-      LAPLACE_BUFFER_ADJUST(ints, internal->integers,
-                            laplace_integer_t);
-    if (bytes)
-      LAPLACE_BUFFER_ADJUST(bytes, internal->bytes, laplace_byte_t);
+  ptrdiff_t const ints_chunk = laplace_buffer_adjust_chunk_size(
+      (laplace_buffer_void_t *) &internal->integers, thread_count);
+  ptrdiff_t const bytes_chunk = laplace_buffer_adjust_chunk_size(
+      (laplace_buffer_void_t *) &internal->bytes, thread_count);
+  ptrdiff_t const ints_count = (internal->integers.data.size +
+                                ints_chunk - 1) /
+                               ints_chunk;
+  ptrdiff_t const count = ints_count + (internal->bytes.data.size +
+                                        bytes_chunk - 1) /
+                                           bytes_chunk;
+
+  for (;;) {
+    ptrdiff_t const i = atomic_fetch_add_explicit(
+        &internal->next_chunk, 1, memory_order_relaxed);
+    if (i >= count)
+      break;
+    if (i < ints_count)
+      LAPLACE_BUFFER_ADJUST_RANGE(internal->integers,
+                                  laplace_integer_t, i * ints_chunk,
+                                  ints_chunk);
+    else
+      LAPLACE_BUFFER_ADJUST_RANGE(internal->bytes, laplace_byte_t,
+                                  (i - ints_count) * bytes_chunk,
+                                  bytes_chunk);
   }
 }
 
 static void adjust_done(void *p) {
   state_internal_t *internal = (state_internal_t *) p;
 
+  atomic_store_explicit(&internal->next_chunk, 0,
+                        memory_order_relaxed);
   LAPLACE_BUFFER_ADJUST_DONE(internal->integers);
   LAPLACE_BUFFER_ADJUST_DONE(internal->bytes);
 }
 
+/*  Blocks that the impact touches are cleared first, so that the
+ *  clear loop does not overwrite the impact.
+ */
+static kit_status_t apply_deferred(
+    void *const p, laplace_impact_t const *const impact) {
+  state_internal_t *internal = (state_internal_t *) p;
+
+#define TOUCH_T(TYPE_CAPS_, type_, FIELD_CAPS_, field_)           \
+  case LAPLACE_IMPACT_##TYPE_CAPS_##_##FIELD_CAPS_:               \
+    CLEAR_NOW_(internal->type_##s, internal->deferred_##type_##s, \
+               impact->type_##_##field_.handle.id);               \
+    break
+
+#define TOUCHES_T(TYPE_CAPS_, type_)                            \
+  TOUCH_T(TYPE_CAPS_, type_, SET, set);                         \
+  TOUCH_T(TYPE_CAPS_, type_, ADD, add);                         \
+  TOUCH_T(TYPE_CAPS_, type_, WRITE_VALUES, write_values);       \
+  TOUCH_T(TYPE_CAPS_, type_, WRITE_DELTAS, write_deltas);       \
+  TOUCH_T(TYPE_CAPS_, type_, REALLOCATE, reallocate);           \
+  TOUCH_T(TYPE_CAPS_, type_, DEALLOCATE, deallocate);           \
+  case LAPLACE_IMPACT_##TYPE_CAPS_##_ALLOCATE:                  \
+    CLEAR_NOW_(internal->integers, internal->deferred_integers, \
+               impact->type_##_allocate.return_handle.id);      \
+    break
+
+  switch (impact->type) {
+    TOUCHES_T(INTEGER, integer);
+    TOUCHES_T(BYTE, byte);
+    case LAPLACE_IMPACT_INTEGER_RANDOM:
+      CLEAR_NOW_(internal->integers, internal->deferred_integers,
+                 impact->integer_random.return_handle.id);
+      break;
+    case LAPLACE_IMPACT_BYTE_RANDOM:
+      CLEAR_NOW_(internal->bytes, internal->deferred_bytes,
+                 impact->byte_random.return_handle.id);
+      break;
+    default:;
+  }
+
+#undef TOUCHES_T
+#undef TOUCH_T
+
+  internal->deferring  = 1;
+  kit_status_t const s = apply(p, impact);
+  internal->deferring  = 0;
+  return s;
+}
+
+/*  Blocks of both buffers are taken from one counter. A block that
+ *  was cleared at once, deallocated and allocated again is listed
+ *  twice, and clearing it twice is harmless.
+ */
+static void clear_loop(void *p, ptrdiff_t const thread_count) {
+  state_internal_t *internal = (state_internal_t *) p;
+
+  ptrdiff_t const ints  = internal->deferred_integers.ids.size;
+  ptrdiff_t const count = ints + internal->deferred_bytes.ids.size;
+  ptrdiff_t       batch = count /
+                    ((thread_count > 1 ? thread_count : 1) *
+                     LAPLACE_BUFFER_CHUNKS_PER_THREAD);
+  if (batch < 1)
+    batch = 1;
+
+  for (;;) {
+    ptrdiff_t const begin = atomic_fetch_add_explicit(
+        &internal->next_clear, batch, memory_order_relaxed);
+    if (begin >= count)
+      break;
+    ptrdiff_t const end = begin + batch < count ? begin + batch
+                                                : count;
+
+    for (ptrdiff_t i = begin; i < end; i++)
+      if (i < ints) {
+        ptrdiff_t const id =
+            internal->deferred_integers.ids.values[i];
+        if (internal->deferred_integers.flags.values[id])
+          CLEAR_BLOCK_(internal->integers, id);
+      } else {
+        ptrdiff_t const id =
+            internal->deferred_bytes.ids.values[i - ints];
+        if (internal->deferred_bytes.flags.values[id])
+          CLEAR_BLOCK_(internal->bytes, id);
+      }
+  }
+}
+
+static void clear_done(void *p) {
+  state_internal_t *internal = (state_internal_t *) p;
+  deferred_t *const deferred[] = { &internal->deferred_integers,
+                                   &internal->deferred_bytes };
+
+  atomic_store_explicit(&internal->next_clear, 0,
+                        memory_order_relaxed);
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    for (ptrdiff_t i = 0; i < deferred[k]->ids.size; i++)
+      deferred[k]->flags.values[deferred[k]->ids.values[i]] = 0;
+    DA_RESIZE(deferred[k]->ids, 0);
+  }
+}
+
+static uint64_t combine(uint64_t h, uint64_t const x) {
+  h ^= x + (uint64_t) 0x9e3779b97f4a7c15ull;
+  LAPLACE_BUF_MIX_(h);
+  return h;
+}
+
+#define HASH_SIZES_(h_, buf_)                            \
+  do {                                                   \
+    (h_) = combine((h_), (uint64_t) (buf_).reserved);    \
+    (h_) = combine((h_), (uint64_t) (buf_).next_block);  \
+    (h_) = combine((h_), (uint64_t) (buf_).data.size);   \
+    (h_) = combine((h_), (uint64_t) (buf_).blocks.size); \
+  } while (0)
+
+/*  The random generator state is hashed on query, it is small.
+ */
+static uint64_t hash_globals(state_internal_t *const internal) {
+  uint64_t h = 0;
+
+  HASH_SIZES_(h, internal->integers);
+  HASH_SIZES_(h, internal->bytes);
+
+  for (ptrdiff_t i = 0; i < KIT_MT64_N; i++)
+    h = combine(h, internal->mt64.mt[i]);
+  h = combine(h, (uint64_t) internal->mt64.index);
+
+  return h;
+}
+
+#undef HASH_SIZES_
+
+static uint64_t hash_random(uint64_t const                seed,
+                            kit_mt64_state_t const *const mt64) {
+  uint64_t h = combine(0, seed);
+
+  for (ptrdiff_t i = 0; i < KIT_MT64_N; i++)
+    h = combine(h, mt64->mt[i]);
+
+  return combine(h, (uint64_t) mt64->index);
+}
+
+static ptrdiff_t tree_height(state_internal_t *const internal,
+                             ptrdiff_t const         tree) {
+  switch (tree) {
+    case LAPLACE_HASH_INTEGERS:
+      return internal->integers.cell_tree.height;
+    case LAPLACE_HASH_INTEGER_BLOCKS:
+      return internal->integers.block_tree.height;
+    case LAPLACE_HASH_BYTES: return internal->bytes.cell_tree.height;
+    case LAPLACE_HASH_BYTE_BLOCKS:
+      return internal->bytes.block_tree.height;
+    default:;
+  }
+  return 0;
+}
+
+static ptrdiff_t tree_level_size(state_internal_t *const internal,
+                                 ptrdiff_t const         tree,
+                                 ptrdiff_t const         level) {
+  switch (tree) {
+    case LAPLACE_HASH_INTEGERS:
+      return laplace_buffer_tree_level_size(
+          &internal->integers.cell_tree, level);
+    case LAPLACE_HASH_INTEGER_BLOCKS:
+      return laplace_buffer_tree_level_size(
+          &internal->integers.block_tree, level);
+    case LAPLACE_HASH_BYTES:
+      return laplace_buffer_tree_level_size(
+          &internal->bytes.cell_tree, level);
+    case LAPLACE_HASH_BYTE_BLOCKS:
+      return laplace_buffer_tree_level_size(
+          &internal->bytes.block_tree, level);
+    default:;
+  }
+  return level >= 0 ? 1 : 0;
+}
+
+static uint64_t tree_node(state_internal_t *const internal,
+                          laplace_hash_node_t const node) {
+  switch (node.tree) {
+    case LAPLACE_HASH_INTEGERS:
+      return laplace_buffer_cell_hash(BUFFER_(internal->integers),
+                                      node.level, node.index);
+    case LAPLACE_HASH_INTEGER_BLOCKS:
+      return laplace_buffer_block_hash(BUFFER_(internal->integers),
+                                       node.level, node.index);
+    case LAPLACE_HASH_BYTES:
+      return laplace_buffer_cell_hash(BUFFER_(internal->bytes),
+                                      node.level, node.index);
+    case LAPLACE_HASH_BYTE_BLOCKS:
+      return laplace_buffer_block_hash(BUFFER_(internal->bytes),
+                                       node.level, node.index);
+    default:;
+  }
+  return node.level >= 0 && node.index == 0 ? hash_globals(internal)
+                                            : 0;
+}
+
+#undef BUFFER_
+
+static ptrdiff_t hash_children(void                     *p,
+                               laplace_hash_node_t const node,
+                               laplace_hash_node_t *const children,
+                               uint64_t *const            hashes) {
+  state_internal_t *internal = (state_internal_t *) p;
+
+  ptrdiff_t count = 0;
+
+  if (node.tree == LAPLACE_HASH_TOP) {
+    for (; count < LAPLACE_HASH_TREE_COUNT; count++) {
+      laplace_hash_node_t const root = {
+        .tree  = count,
+        .level = tree_height(internal, count),
+        .index = 0
+      };
+      if (children != NULL)
+        children[count] = root;
+      if (hashes != NULL)
+        hashes[count] = tree_node(internal, root);
+    }
+    return count;
+  }
+
+  if (node.tree < 0 || node.tree >= LAPLACE_HASH_TREE_COUNT ||
+      node.level <= 0 || node.index < 0 ||
+      node.index > PTRDIFF_MAX / LAPLACE_HASH_FANOUT)
+    return 0;
+
+  ptrdiff_t const begin = node.index * LAPLACE_HASH_FANOUT;
+  ptrdiff_t const size  = tree_level_size(internal, node.tree,
+                                          node.level - 1);
+
+  for (; count < LAPLACE_HASH_FANOUT && begin + count < size;
+       count++) {
+    laplace_hash_node_t const child = { .tree  = node.tree,
+                                        .level = node.level - 1,
+                                        .index = begin + count };
+    if (children != NULL)
+      children[count] = child;
+    if (hashes != NULL)
+      hashes[count] = tree_node(internal, child);
+  }
+
+  return count;
+}
+
+/*  Combined roots of all hash trees.
+ */
+static uint64_t hash(void *p) {
+  uint64_t  roots[LAPLACE_HASH_TREE_COUNT];
+  ptrdiff_t count = hash_children(
+      p, (laplace_hash_node_t) { .tree = LAPLACE_HASH_TOP }, NULL,
+      roots);
+
+  uint64_t h = 0;
+  for (ptrdiff_t i = 0; i < count; i++) h = combine(h, roots[i]);
+  return h;
+}
+
 kit_status_t laplace_state_init(laplace_read_write_t *const p,
                                 uint64_t const              seed,
                                 kit_allocator_t const       alloc) {
@@ -318,10 +820,20 @@ kit_status_t laplace_state_init(laplace_read_write_t *const p,
 
   atomic_store_explicit(&internal->ref_count, 0,
                         memory_order_relaxed);
-  internal->alloc = alloc;
-  internal->seed  = seed;
+  atomic_store_explicit(&internal->next_chunk, 0,
+                        memory_order_relaxed);
+  atomic_store_explicit(&internal->next_clear, 0,
+                        memory_order_relaxed);
+  internal->alloc     = alloc;
+  internal->seed      = seed;
+  internal->deferring = 0;
   mt64_init(&internal->mt64, seed);
 
+  DA_INIT(internal->deferred_integers.ids, 0, alloc);
+  DA_INIT(internal->deferred_integers.flags, 0, alloc);
+  DA_INIT(internal->deferred_bytes.ids, 0, alloc);
+  DA_INIT(internal->deferred_bytes.flags, 0, alloc);
+
   kit_status_t s;
 
   LAPLACE_BUFFER_INIT(s, internal->integers, alloc);
@@ -336,20 +848,255 @@ kit_status_t laplace_state_init(laplace_read_write_t *const p,
     return s;
   }
 
-  p->state         = internal;
-  p->acquire       = acquire;
-  p->release       = release;
-  p->clone         = clone_;
-  p->reset         = reset;
-  p->integers_size = integers_size;
-  p->bytes_size    = bytes_size;
-  p->read_integers = read_integers;
-  p->read_bytes    = read_bytes;
-  p->get_integer   = get_integer;
-  p->get_byte      = get_byte;
-  p->apply         = apply;
-  p->adjust_loop   = adjust_loop;
-  p->adjust_done   = adjust_done;
+  p->state            = internal;
+  p->acquire          = acquire;
+  p->release          = release;
+  p->clone            = clone_;
+  p->assign           = assign;
+  p->reset            = reset;
+  p->snapshot         = snapshot;
+  p->restore          = restore;
+  p->snapshot_destroy = snapshot_destroy;
+  p->integers_size    = integers_size;
+  p->bytes_size       = bytes_size;
+  p->read_integers    = read_integers;
+  p->read_bytes       = read_bytes;
+  p->get_integer      = get_integer;
+  p->get_byte         = get_byte;
+  p->apply            = apply;
+  p->adjust_loop      = adjust_loop;
+  p->adjust_done      = adjust_done;
+  p->apply_deferred   = apply_deferred;
+  p->clear_loop       = clear_loop;
+  p->clear_done       = clear_done;
+  p->hash             = hash;
+  p->hash_children    = hash_children;
+
+  return KIT_OK;
+}
+
+kit_status_t laplace_state_save(laplace_read_write_t const *const p,
+                                laplace_write_fn const write,
+                                void *const            user_data) {
+  assert(p != NULL && write != NULL);
+  assert(p->apply == apply);
+
+  state_internal_t *const self = (state_internal_t *) p->state;
+
+  state_save_t header;
+  memset(&header, 0, sizeof header);
+
+  memcpy(header.magic, save_magic, sizeof header.magic);
+  header.version    = SAVE_VERSION;
+  header.layout     = SAVE_LAYOUT;
+  header.word_size  = sizeof(ptrdiff_t);
+  header.byte_order = SAVE_BYTE_ORDER;
+  header.seed       = self->seed;
+  header.mt64       = self->mt64;
+
+  int64_t offset = sizeof header;
+
+  LAPLACE_BUFFER_SAVE_LAYOUT(offset, header.integers, self->integers,
+                             offset);
+  LAPLACE_BUFFER_SAVE_LAYOUT(offset, header.bytes, self->bytes,
+                             offset);
+
+  header.size = offset;
+
+  kit_status_t s = write(user_data, &header, sizeof header);
+
+  if (s != KIT_OK)
+    return s;
+
+  int64_t position = sizeof header;
+
+  LAPLACE_BUFFER_SAVE(s, header.integers, self->integers, &position,
+                      write, user_data);
+
+  if (s != KIT_OK)
+    return s;
+
+  LAPLACE_BUFFER_SAVE(s, header.bytes, self->bytes, &position, write,
+                      user_data);
+
+  assert(s != KIT_OK || position == header.size);
+  return s;
+}
+
+kit_status_t laplace_state_load(laplace_read_write_t *const p,
+                                void *const                 data,
+                                ptrdiff_t const             size,
+                                kit_allocator_t const       alloc) {
+  assert(p != NULL);
+
+  state_save_t header;
+
+  if (data == NULL || size < (ptrdiff_t) sizeof header ||
+      (uintptr_t) data % sizeof(int64_t) != 0)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  memcpy(&header, data, sizeof header);
+
+  if (memcmp(header.magic, save_magic, sizeof header.magic) != 0 ||
+      header.version != SAVE_VERSION ||
+      header.layout != SAVE_LAYOUT ||
+      header.word_size != sizeof(ptrdiff_t) ||
+      header.byte_order != SAVE_BYTE_ORDER || header.size > size)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  kit_status_t s = laplace_state_init(p, header.seed, alloc);
+
+  if (s != KIT_OK)
+    return s;
+
+  state_internal_t *const self = (state_internal_t *) p->state;
+
+  self->mt64         = header.mt64;
+  self->region.base  = alloc;
+  self->region.begin = (char *) data;
+  self->region.end   = (char *) data + header.size;
+
+  LAPLACE_BUFFER_LOAD(s, self->integers, header.integers,
+                      &self->region);
+
+  if (s == KIT_OK)
+    LAPLACE_BUFFER_LOAD(s, self->bytes, header.bytes, &self->region);
+
+  if (s != KIT_OK) {
+    destroy(self);
+    return s;
+  }
+
+  return KIT_OK;
+}
+
+kit_status_t laplace_state_diff(void const *const     previous_p,
+                                void const *const     snapshot_p,
+                                laplace_write_fn const write,
+                                void *const            user_data) {
+  state_snapshot_t const *previous = (state_snapshot_t const *)
+      previous_p;
+  state_snapshot_t const *snapshot = (state_snapshot_t const *)
+      snapshot_p;
+
+  assert(snapshot != NULL && write != NULL);
+
+  state_diff_t header;
+  memset(&header, 0, sizeof header);
+
+  memcpy(header.magic, diff_magic, sizeof header.magic);
+  header.version    = DIFF_VERSION;
+  header.layout     = SAVE_LAYOUT;
+  header.seed         = snapshot->seed;
+  header.mt64_index   = snapshot->mt64.index;
+  header.has_previous = previous != NULL;
+  header.random_hash  = hash_random(snapshot->seed, &snapshot->mt64);
+
+  if (previous != NULL) {
+    header.random_previous_hash = hash_random(previous->seed,
+                                              &previous->mt64);
+    header.previous_hashes[0]   = previous->integers.hash;
+    header.previous_hashes[1]   = previous->integers.block_hash;
+    header.previous_hashes[2]   = previous->bytes.hash;
+    header.previous_hashes[3]   = previous->bytes.block_hash;
+  }
+
+  /*  The generator words change only once per many random values.
+   */
+  header.mt64_changed = previous == NULL ||
+                        memcmp(previous->mt64.mt, snapshot->mt64.mt,
+                               sizeof snapshot->mt64.mt) != 0;
+
+  kit_status_t s = write(user_data, &header, sizeof header);
+
+  if (s == KIT_OK && header.mt64_changed)
+    s = write(user_data, snapshot->mt64.mt, sizeof snapshot->mt64.mt);
+
+  if (s == KIT_OK)
+    s = laplace_buffer_diff(previous != NULL ? &previous->integers
+                                             : NULL,
+                            &snapshot->integers, write, user_data);
+
+  if (s == KIT_OK)
+    s = laplace_buffer_diff(previous != NULL ? &previous->bytes
+                                             : NULL,
+                            &snapshot->bytes, write, user_data);
+
+  return s;
+}
+
+kit_status_t laplace_state_diff_apply(laplace_read_write_t *const p,
+                                      void const *const data,
+                                      ptrdiff_t const   size) {
+  assert(p != NULL);
+  assert(p->apply == apply);
+
+  state_internal_t *const self = (state_internal_t *) p->state;
+
+  state_diff_t header;
+
+  if (data == NULL || size < (ptrdiff_t) sizeof header)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  memcpy(&header, data, sizeof header);
+
+  ptrdiff_t position = sizeof header;
+
+  if (memcmp(header.magic, diff_magic, sizeof header.magic) != 0 ||
+      header.version != DIFF_VERSION ||
+      header.layout != SAVE_LAYOUT ||
+      header.mt64_index > KIT_MT64_N ||
+      (header.mt64_changed &&
+       size - position < (ptrdiff_t) sizeof self->mt64.mt))
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  /*  Check that the diff is for this state before any change. The
+   *  random generator of an empty state is not checked, a late join
+   *  replaces it.
+   */
+  if ((header.has_previous &&
+       header.random_previous_hash !=
+           hash_random(self->seed, &self->mt64)) ||
+      header.previous_hashes[0] !=
+          atomic_load_explicit(&self->integers.hash,
+                               memory_order_relaxed) ||
+      header.previous_hashes[1] != self->integers.block_hash ||
+      header.previous_hashes[2] !=
+          atomic_load_explicit(&self->bytes.hash,
+                               memory_order_relaxed) ||
+      header.previous_hashes[3] != self->bytes.block_hash)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  kit_mt64_state_t mt64 = self->mt64;
+
+  if (header.mt64_changed) {
+    memcpy(mt64.mt, (char const *) data + position, sizeof mt64.mt);
+    position += sizeof mt64.mt;
+  }
+
+  mt64.index = header.mt64_index;
+
+  if (hash_random(header.seed, &mt64) != header.random_hash)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  kit_status_t s;
+
+  LAPLACE_BUFFER_DIFF_APPLY(s, self->integers, data, size,
+                            &position);
+
+  if (s != KIT_OK)
+    return s;
+
+  LAPLACE_BUFFER_DIFF_APPLY(s, self->bytes, data, size, &position);
+
+  if (s != KIT_OK)
+    return s;
+
+  if (position != size)
+    return LAPLACE_ERROR_INVALID_FORMAT;
+
+  self->seed = header.seed;
+  self->mt64 = mt64;
 
   return KIT_OK;
 }
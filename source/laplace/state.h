@@ -12,8 +12,56 @@ extern "C" {
 kit_status_t laplace_state_init(laplace_read_write_t *state,
                                 uint64_t seed, kit_allocator_t alloc);
 
+/*  Save the state in a versioned binary format. Data is written in
+ *  order straight from the state, without a copy. Can save only
+ *  after join and before schedule.
+ */
+kit_status_t laplace_state_save(laplace_read_write_t const *state,
+                                laplace_write_fn write,
+                                void            *user_data);
+
+/*  Create a state from saved data. Arrays of the state point into
+ *  the data and are moved out of it only when they grow, so the data
+ *  can be a private mapping of a saved file.
+ *
+ *  Data should be aligned to 8 bytes, be writable and stay valid
+ *  while the state is in use. It is not freed by the state.
+ */
+kit_status_t laplace_state_load(laplace_read_write_t *state,
+                                void *data, ptrdiff_t size,
+                                kit_allocator_t alloc);
+
+/*  Write the difference between two snapshots of a state, taken by
+ *  its snapshot function. Previous snapshot can be NULL, then the
+ *  difference is from an empty state, e.g. for a late join.
+ *
+ *  Parts not written since the previous snapshot are skipped, and
+ *  changed values are encoded as compact deltas.
+ */
+kit_status_t laplace_state_diff(void const      *previous,
+                                void const      *snapshot,
+                                laplace_write_fn write,
+                                void            *user_data);
+
+/*  Apply a difference to a state that matches the previous snapshot.
+ *  Hashes of both buffers and the random generator are checked
+ *  before any change, so a difference for another state is an error
+ *  and the state is left as is. Can apply only after join and before
+ *  schedule.
+ *
+ *  If the data is damaged, the state may be changed in part, and it
+ *  should be restored or reset.
+ */
+kit_status_t laplace_state_diff_apply(laplace_read_write_t *state,
+                                      void const           *data,
+                                      ptrdiff_t             size);
+
 #ifndef LAPLACE_DISABLE_SHORT_NAMES
 #  define state_init laplace_state_init
+#  define state_save laplace_state_save
+#  define state_load laplace_state_load
+#  define state_diff laplace_state_diff
+#  define state_diff_apply laplace_state_diff_apply
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,116 @@
+#include "wheel.h"
+
+#include <stdlib.h>
+
+#define SLOT_(time_) ((ptrdiff_t) ((time_) % LAPLACE_WHEEL_SIZE))
+
+#define PUSH_(array_, value_)           \
+  do {                                  \
+    ptrdiff_t const n_ = (array_).size; \
+    DA_RESIZE((array_), n_ + 1);        \
+    if ((array_).size != n_ + 1)        \
+      return LAPLACE_ERROR_BAD_ALLOC;   \
+    (array_).values[n_] = (value_);     \
+  } while (0)
+
+void laplace_wheel_init(laplace_wheel_t *const wheel,
+                        kit_allocator_t const  alloc) {
+  assert(wheel != NULL);
+
+  for (ptrdiff_t i = 0; i < LAPLACE_WHEEL_SIZE; i++)
+    DA_INIT(wheel->buckets[i], 0, alloc);
+  DA_INIT(wheel->far, 0, alloc);
+  DA_INIT(wheel->due, 0, alloc);
+}
+
+void laplace_wheel_destroy(laplace_wheel_t *const wheel) {
+  assert(wheel != NULL);
+
+  for (ptrdiff_t i = 0; i < LAPLACE_WHEEL_SIZE; i++)
+    DA_DESTROY(wheel->buckets[i]);
+  DA_DESTROY(wheel->far);
+  DA_DESTROY(wheel->due);
+}
+
+void laplace_wheel_clear(laplace_wheel_t *const wheel) {
+  assert(wheel != NULL);
+
+  for (ptrdiff_t i = 0; i < LAPLACE_WHEEL_SIZE; i++)
+    DA_RESIZE(wheel->buckets[i], 0);
+  DA_RESIZE(wheel->far, 0);
+  DA_RESIZE(wheel->due, 0);
+}
+
+kit_status_t laplace_wheel_insert(laplace_wheel_t *const wheel,
+                                  laplace_time_t const   now,
+                                  laplace_time_t const   wake,
+                                  ptrdiff_t const        index) {
+  assert(wheel != NULL);
+  assert(now >= 0);
+
+  if (wake < now)
+    return KIT_OK;
+
+  laplace_wheel_entry_t const entry = { .wake  = wake,
+                                        .index = index };
+
+  if (wake - now < LAPLACE_WHEEL_SIZE)
+    PUSH_(wheel->buckets[SLOT_(wake)], entry);
+  else
+    PUSH_(wheel->far, entry);
+
+  return KIT_OK;
+}
+
+static int compare_index_(void const *const left,
+                          void const *const right) {
+  ptrdiff_t const a = *(ptrdiff_t const *) left;
+  ptrdiff_t const b = *(ptrdiff_t const *) right;
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+kit_status_t laplace_wheel_advance(laplace_wheel_t *const wheel,
+                                   laplace_time_t const   now) {
+  assert(wheel != NULL);
+  assert(now >= 0);
+
+  DA_RESIZE(wheel->due, 0);
+
+  /*  Once per turn, move far entries that wake during the turn into
+   *  buckets.
+   */
+  if (SLOT_(now) == 0)
+    for (ptrdiff_t i = 0; i < wheel->far.size;) {
+      laplace_wheel_entry_t const entry = wheel->far.values[i];
+      if (entry.wake - now >= LAPLACE_WHEEL_SIZE) {
+        i++;
+        continue;
+      }
+      PUSH_(wheel->buckets[SLOT_(entry.wake)], entry);
+      wheel->far.values[i] = wheel->far.values[wheel->far.size - 1];
+      DA_RESIZE(wheel->far, wheel->far.size - 1);
+    }
+
+  /*  All entries in the bucket should wake now. Later entries are
+   *  kept for safety.
+   */
+  ptrdiff_t const slot = SLOT_(now);
+  ptrdiff_t       kept = 0;
+
+  for (ptrdiff_t i = 0; i < wheel->buckets[slot].size; i++) {
+    laplace_wheel_entry_t const entry = wheel->buckets[slot]
+                                            .values[i];
+    if (entry.wake == now)
+      PUSH_(wheel->due, entry.index);
+    else if (entry.wake > now)
+      wheel->buckets[slot].values[kept++] = entry;
+  }
+
+  DA_RESIZE(wheel->buckets[slot], kept);
+
+  if (wheel->due.size > 1)
+    qsort(wheel->due.values, wheel->due.size,
+          sizeof *wheel->due.values, compare_index_);
+
+  return KIT_OK;
+}
@@ -0,0 +1,72 @@
+#ifndef LAPLACE_WHEEL_H
+#define LAPLACE_WHEEL_H
+
+#include "options.h"
+
+#include <kit/allocator.h>
+#include <kit/dynamic_array.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { LAPLACE_WHEEL_SIZE = 256 };
+
+typedef struct {
+  laplace_time_t wake;
+  ptrdiff_t      index;
+} laplace_wheel_entry_t;
+
+/*  Two-level timing wheel of sleeping actions.
+ *
+ *  Entries that wake within the wheel size are kept in the bucket of
+ *  their wake time. Later entries are kept in a far list, which is
+ *  moved into buckets once per turn of the wheel. Advancing visits
+ *  one bucket, so the cost of a tick does not depend on the number
+ *  of sleeping actions.
+ */
+typedef struct {
+  KIT_DA(laplace_wheel_entry_t) buckets[LAPLACE_WHEEL_SIZE];
+  KIT_DA(laplace_wheel_entry_t) far;
+  KIT_DA(ptrdiff_t) due;
+} laplace_wheel_t;
+
+void laplace_wheel_init(laplace_wheel_t *wheel,
+                        kit_allocator_t  alloc);
+
+void laplace_wheel_destroy(laplace_wheel_t *wheel);
+
+void laplace_wheel_clear(laplace_wheel_t *wheel);
+
+/*  Add an entry. Entries that wake before now are never due, and
+ *  are ignored.
+ */
+kit_status_t laplace_wheel_insert(laplace_wheel_t *wheel,
+                                  laplace_time_t   now,
+                                  laplace_time_t   wake,
+                                  ptrdiff_t        index);
+
+/*  Move indices of entries that wake at now into due, in increasing
+ *  order. Should be called for every time in increasing order.
+ */
+kit_status_t laplace_wheel_advance(laplace_wheel_t *wheel,
+                                   laplace_time_t   now);
+
+#ifndef LAPLACE_DISABLE_SHORT_NAMES
+#  define WHEEL_SIZE LAPLACE_WHEEL_SIZE
+#  define wheel_entry_t laplace_wheel_entry_t
+#  define wheel_t laplace_wheel_t
+
+#  define wheel_init laplace_wheel_init
+#  define wheel_destroy laplace_wheel_destroy
+#  define wheel_clear laplace_wheel_clear
+#  define wheel_insert laplace_wheel_insert
+#  define wheel_advance laplace_wheel_advance
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
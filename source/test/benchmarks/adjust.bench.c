@@ -0,0 +1,111 @@
+#include "../../laplace/impact.h"
+#include "../../laplace/state.h"
+#include "bench.h"
+
+#include <kit/atomic.h>
+#include <kit/thread.h>
+
+#include <stdio.h>
+#include <time.h>
+
+/*  Adjust pass scaling.
+ *
+ *  Every cell of both state buffers is changed before each pass.
+ *  Prints the mean pass time for each buffer size and thread count.
+ */
+
+enum { REPEATS = 20 };
+
+typedef struct {
+  laplace_read_write_t access;
+  ptrdiff_t            thread_count;
+  ATOMIC(ptrdiff_t) generation;
+  ATOMIC(ptrdiff_t) done;
+  ATOMIC(int) stop;
+} bench_t;
+
+static int adjust_worker(void *p) {
+  bench_t  *bench = (bench_t *) p;
+  ptrdiff_t seen  = 0;
+
+  for (;;) {
+    ptrdiff_t generation;
+    while ((generation = atomic_load_explicit(
+                &bench->generation, memory_order_acquire)) == seen &&
+           !atomic_load_explicit(&bench->stop, memory_order_acquire))
+      thrd_yield();
+    if (generation == seen)
+      return 0;
+    seen = generation;
+    bench->access.adjust_loop(bench->access.state,
+                              bench->thread_count);
+    atomic_fetch_add_explicit(&bench->done, 1, memory_order_release);
+  }
+}
+
+static int64_t adjust_run(ptrdiff_t const size,
+                          ptrdiff_t const thread_count) {
+  bench_t bench;
+  laplace_state_init(&bench.access, 0, kit_alloc_default());
+  bench.access.acquire(bench.access.state);
+  bench.thread_count = thread_count;
+  atomic_store_explicit(&bench.generation, 0, memory_order_relaxed);
+  atomic_store_explicit(&bench.done, 0, memory_order_relaxed);
+  atomic_store_explicit(&bench.stop, 0, memory_order_relaxed);
+
+  laplace_handle_t ints  = { .id = 0, .generation = -1 };
+  laplace_handle_t bytes = { .id = 0, .generation = -1 };
+  laplace_impact_t alloc[] = {
+    LAPLACE_INTEGER_ALLOCATE_INTO(ints, size),
+    LAPLACE_BYTE_ALLOCATE_INTO(bytes, size)
+  };
+  bench.access.apply(bench.access.state, alloc);
+  bench.access.apply(bench.access.state, alloc + 1);
+  ints.generation++;
+  bytes.generation++;
+
+  thrd_t pool[BENCH_MAX_THREAD_COUNT];
+  for (ptrdiff_t i = 1; i < thread_count; i++)
+    thrd_create(pool + i, adjust_worker, &bench);
+
+  int64_t total = 0;
+
+  for (int n = 0; n < REPEATS; n++) {
+    for (ptrdiff_t i = 0; i < size; i++) {
+      laplace_impact_t add[] = { LAPLACE_INTEGER_ADD(ints, i, 1),
+                                 LAPLACE_BYTE_ADD(bytes, i, 1) };
+      bench.access.apply(bench.access.state, add);
+      bench.access.apply(bench.access.state, add + 1);
+    }
+
+    int64_t const time = bench_now_ns();
+    atomic_store_explicit(&bench.done, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bench.generation, 1,
+                              memory_order_release);
+    bench.access.adjust_loop(bench.access.state, thread_count);
+    while (atomic_load_explicit(&bench.done, memory_order_acquire) !=
+           thread_count - 1)
+      thrd_yield();
+    bench.access.adjust_done(bench.access.state);
+    total += bench_now_ns() - time;
+  }
+
+  atomic_store_explicit(&bench.stop, 1, memory_order_release);
+  for (ptrdiff_t i = 1; i < thread_count; i++)
+    thrd_join(pool[i], NULL);
+
+  bench.access.release(bench.access.state);
+  return total / REPEATS;
+}
+
+void bench_adjust(void) {
+  ptrdiff_t const sizes[] = { 1000, 100000, 4000000 };
+
+  printf("\nAdjust pass\n");
+  printf("%10s %8s %14s\n", "cells", "threads", "ns per pass");
+
+  for (int i = 0; i < (int) (sizeof sizes / sizeof *sizes); i++)
+    for (ptrdiff_t n = 1; n <= BENCH_MAX_THREAD_COUNT; n *= 2)
+      printf("%10lld %8lld %14lld\n", (long long) sizes[i],
+             (long long) n, (long long) adjust_run(sizes[i], n));
+}
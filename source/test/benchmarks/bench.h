@@ -0,0 +1,14 @@
+#ifndef LAPLACE_BENCH_H
+#define LAPLACE_BENCH_H
+
+#include <stdint.h>
+
+enum { BENCH_MAX_THREAD_COUNT = 16 };
+
+int64_t bench_now_ns(void);
+
+void bench_adjust(void);
+void bench_fence(void);
+void bench_dispatch(void);
+
+#endif
@@ -0,0 +1,75 @@
+#include "../../laplace/execution.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  Tick dispatch cost.
+ *
+ *  One action continues several times per tick while many others
+ *  sleep for a long time. Prints the mean tick time for each number
+ *  of sleeping actions. With a ready set the time should not depend
+ *  on the number of sleeping actions.
+ */
+
+enum { TICKS = 200, CONTINUE_COUNT = 16, SLEEP_DURATION = 1000000 };
+
+STATIC_CORO(laplace_impact_list_t, sleeper_, kit_allocator_t alloc;
+            laplace_read_only_t access; laplace_handle_t self;) {
+  for (;;)
+    AF_YIELD_VOID;
+}
+CORO_END
+
+STATIC_CORO(laplace_impact_list_t, busy_, kit_allocator_t alloc;
+            laplace_read_only_t access; laplace_handle_t self;
+            int step;) {
+  for (;;) {
+    if (++self->step % CONTINUE_COUNT != 0) {
+      DA_INIT(self->return_value, 1, self->alloc);
+      laplace_impact_t i[] = { LAPLACE_TICK_CONTINUE() };
+      self->return_value.values[0] = i[0];
+    }
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+static int64_t dispatch_run(ptrdiff_t const sleeping) {
+  laplace_read_write_t  access;
+  laplace_thread_pool_t pool;
+  memset(&access, 0, sizeof access);
+  memset(&pool, 0, sizeof pool);
+
+  laplace_execution_t exe;
+  laplace_execution_init(&exe, access, pool, kit_alloc_default());
+
+  laplace_action_t busy = LAPLACE_ACTION(busy_, 1, { 0 });
+  laplace_execution_queue(&exe, busy);
+
+  for (ptrdiff_t i = 0; i < sleeping; i++) {
+    laplace_action_t sleeper = LAPLACE_ACTION(sleeper_,
+                                              SLEEP_DURATION, { 0 });
+    laplace_execution_queue(&exe, sleeper);
+  }
+
+  laplace_execution_schedule_and_join(&exe, 1);
+
+  int64_t const time = bench_now_ns();
+  laplace_execution_schedule_and_join(&exe, TICKS);
+  int64_t const total = bench_now_ns() - time;
+
+  laplace_execution_destroy(&exe);
+  return total / TICKS;
+}
+
+void bench_dispatch(void) {
+  ptrdiff_t const sizes[] = { 0, 1000, 100000 };
+
+  printf("\nTick dispatch\n");
+  printf("%10s %14s\n", "sleeping", "ns per tick");
+
+  for (int i = 0; i < (int) (sizeof sizes / sizeof *sizes); i++)
+    printf("%10lld %14lld\n", (long long) sizes[i],
+           (long long) dispatch_run(sizes[i]));
+}
@@ -0,0 +1,94 @@
+#include "../../laplace/barrier.h"
+#include "bench.h"
+
+#include <kit/thread.h>
+
+#include <stdio.h>
+
+/*  Fence latency.
+ *
+ *  Compares the barrier with a mutex and condition variable fence
+ *  like the one used by the execution before. Prints the mean time
+ *  of one fence for each thread count.
+ */
+
+enum { PHASES = 20000 };
+
+typedef struct {
+  ptrdiff_t thread_count;
+
+  laplace_barrier_t barrier;
+
+  mtx_t     lock;
+  cnd_t     on_fence;
+  ptrdiff_t arrived;
+  ptrdiff_t generation;
+} fence_t;
+
+static int barrier_worker(void *p) {
+  fence_t *fence = (fence_t *) p;
+  int      sense = laplace_barrier_sense(&fence->barrier);
+  int      serial;
+
+  for (int i = 0; i < PHASES; i++)
+    laplace_barrier_wait(&fence->barrier, fence->thread_count,
+                         &sense, &serial);
+
+  return 0;
+}
+
+static int condvar_worker(void *p) {
+  fence_t *fence = (fence_t *) p;
+
+  for (int i = 0; i < PHASES; i++) {
+    mtx_lock(&fence->lock);
+    ptrdiff_t const generation = fence->generation;
+    if (++fence->arrived == fence->thread_count) {
+      fence->arrived = 0;
+      fence->generation++;
+      cnd_broadcast(&fence->on_fence);
+    } else
+      while (fence->generation == generation)
+        cnd_wait(&fence->on_fence, &fence->lock);
+    mtx_unlock(&fence->lock);
+  }
+
+  return 0;
+}
+
+static int64_t fence_run(thrd_start_t worker,
+                         ptrdiff_t const thread_count) {
+  fence_t fence;
+  fence.thread_count = thread_count;
+  fence.arrived      = 0;
+  fence.generation   = 0;
+  laplace_barrier_init(&fence.barrier);
+  mtx_init(&fence.lock, mtx_plain);
+  cnd_init(&fence.on_fence);
+
+  thrd_t        pool[BENCH_MAX_THREAD_COUNT];
+  int64_t const time = bench_now_ns();
+
+  for (ptrdiff_t i = 0; i < thread_count; i++)
+    thrd_create(pool + i, worker, &fence);
+  for (ptrdiff_t i = 0; i < thread_count; i++)
+    thrd_join(pool[i], NULL);
+
+  int64_t const total = bench_now_ns() - time;
+
+  laplace_barrier_destroy(&fence.barrier);
+  mtx_destroy(&fence.lock);
+  cnd_destroy(&fence.on_fence);
+
+  return total / PHASES;
+}
+
+void bench_fence(void) {
+  printf("\nFence latency\n");
+  printf("%8s %14s %14s\n", "threads", "barrier ns", "condvar ns");
+
+  for (ptrdiff_t n = 1; n <= BENCH_MAX_THREAD_COUNT; n *= 2)
+    printf("%8lld %14lld %14lld\n", (long long) n,
+           (long long) fence_run(barrier_worker, n),
+           (long long) fence_run(condvar_worker, n));
+}
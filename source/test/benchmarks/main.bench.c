@@ -0,0 +1,16 @@
+#include "bench.h"
+
+#include <time.h>
+
+int64_t bench_now_ns(void) {
+  struct timespec t;
+  timespec_get(&t, TIME_UTC);
+  return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+int main(void) {
+  bench_fence();
+  bench_adjust();
+  bench_dispatch();
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include "../../laplace/arena.h"
+#include <kit/dynamic_array.h>
+
+#define KIT_TEST_FILE arena
+#include <kit_test/test.h>
+
+static int test_arena_allocs = 0;
+static int test_arena_frees  = 0;
+
+static void *test_arena_allocate(int request, void *_, ptrdiff_t size,
+                                 ptrdiff_t previous_size,
+                                 void     *pointer) {
+  switch (request) {
+    case KIT_ALLOCATE: test_arena_allocs++; break;
+    case KIT_DEALLOCATE: test_arena_frees++; break;
+    default:;
+  }
+
+  return kit_alloc_dispatch(kit_alloc_default(), request, size,
+                            previous_size, pointer);
+}
+
+TEST("arena allocate aligned") {
+  arena_t arena;
+  arena_init(&arena, kit_alloc_default());
+
+  char *a = (char *) arena_allocate(&arena, 1);
+  char *b = (char *) arena_allocate(&arena, 3);
+  char *c = (char *) arena_allocate(&arena, 100);
+
+  REQUIRE(a != NULL && b != NULL && c != NULL);
+  REQUIRE(a != b && b != c);
+  REQUIRE((size_t) b % _Alignof(max_align_t) == 0);
+  REQUIRE((size_t) c % _Alignof(max_align_t) == 0);
+
+  arena_destroy(&arena);
+}
+
+TEST("arena reset reuses memory") {
+  kit_allocator_t alloc = { .state    = NULL,
+                            .allocate = test_arena_allocate };
+  test_arena_allocs = 0;
+  test_arena_frees  = 0;
+
+  arena_t arena;
+  arena_init(&arena, alloc);
+
+  void *p = arena_allocate(&arena, 64);
+  REQUIRE(test_arena_allocs == 1);
+
+  arena_reset(&arena);
+  REQUIRE(arena_allocate(&arena, 64) == p);
+
+  for (int tick = 0; tick < 10; tick++) {
+    arena_reset(&arena);
+    for (int i = 0; i < 100; i++)
+      (void) arena_allocate(&arena, 64);
+  }
+
+  REQUIRE(test_arena_allocs == 1);
+
+  arena_destroy(&arena);
+  REQUIRE(test_arena_allocs == test_arena_frees);
+}
+
+TEST("arena reset coalesces blocks") {
+  kit_allocator_t alloc = { .state    = NULL,
+                            .allocate = test_arena_allocate };
+  test_arena_allocs = 0;
+  test_arena_frees  = 0;
+
+  arena_t arena;
+  arena_init(&arena, alloc);
+
+  for (int i = 0; i < 3; i++)
+    (void) arena_allocate(&arena, ARENA_BLOCK_SIZE);
+  REQUIRE(test_arena_allocs == 3);
+
+  arena_reset(&arena);
+  int const allocs = test_arena_allocs;
+
+  for (int i = 0; i < 3; i++)
+    (void) arena_allocate(&arena, ARENA_BLOCK_SIZE);
+  REQUIRE(test_arena_allocs == allocs);
+
+  arena_destroy(&arena);
+  REQUIRE(test_arena_allocs == test_arena_frees);
+}
+
+TEST("arena dynamic array") {
+  arena_t arena;
+  arena_init(&arena, kit_alloc_default());
+
+  DA(int64_t) a;
+  DA_INIT(a, 0, arena_allocator(&arena));
+
+  for (int64_t i = 0; i < 1000; i++) {
+    ptrdiff_t const n = a.size;
+    DA_RESIZE(a, n + 1);
+    REQUIRE(a.size == n + 1);
+    a.values[n] = i;
+  }
+
+  int ok = 1;
+  for (int64_t i = 0; i < 1000; i++) ok = ok && a.values[i] == i;
+  REQUIRE(ok);
+
+  DA_DESTROY(a);
+  arena_destroy(&arena);
+}
+
+TEST("arena merge") {
+  arena_t foo, bar;
+  arena_init(&foo, kit_alloc_default());
+  arena_init(&bar, kit_alloc_default());
+
+  (void) arena_allocate(&foo, 10);
+  (void) arena_allocate(&bar, 10);
+
+  arena_merge(&foo, &bar);
+  REQUIRE(bar.blocks == NULL);
+  REQUIRE(foo.blocks != NULL);
+
+  arena_destroy(&foo);
+  arena_destroy(&bar);
+}
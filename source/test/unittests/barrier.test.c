@@ -0,0 +1,103 @@
+#include "../../laplace/barrier.h"
+#include <kit/thread.h>
+
+#define KIT_TEST_FILE barrier
+#include <kit_test/test.h>
+
+enum { TEST_BARRIER_THREADS = 4, TEST_BARRIER_PHASES = 1000 };
+
+typedef struct {
+  barrier_t barrier;
+  ATOMIC(ptrdiff_t) serial_count;
+  ATOMIC(ptrdiff_t) phase;
+  ATOMIC(int) failed;
+} test_barrier_t;
+
+static int test_barrier_run(void *p) {
+  test_barrier_t *data  = (test_barrier_t *) p;
+  int             sense = barrier_sense(&data->barrier);
+
+  for (ptrdiff_t i = 0; i < TEST_BARRIER_PHASES; i++) {
+    int serial;
+    if (barrier_wait(&data->barrier, TEST_BARRIER_THREADS, &sense,
+                     &serial) != KIT_OK)
+      atomic_store_explicit(&data->failed, 1, memory_order_relaxed);
+    if (serial) {
+      atomic_fetch_add_explicit(&data->serial_count, 1,
+                                memory_order_relaxed);
+      atomic_fetch_add_explicit(&data->phase, 1,
+                                memory_order_relaxed);
+    }
+    if (barrier_wait(&data->barrier, TEST_BARRIER_THREADS, &sense,
+                     &serial) != KIT_OK)
+      atomic_store_explicit(&data->failed, 1, memory_order_relaxed);
+    if (atomic_load_explicit(&data->phase, memory_order_relaxed) !=
+        i + 1)
+      atomic_store_explicit(&data->failed, 1, memory_order_relaxed);
+  }
+
+  return 0;
+}
+
+TEST("barrier init and destroy") {
+  barrier_t barrier;
+  REQUIRE(barrier_init(&barrier) == KIT_OK);
+  barrier_destroy(&barrier);
+}
+
+TEST("barrier single thread is serial") {
+  barrier_t barrier;
+  REQUIRE(barrier_init(&barrier) == KIT_OK);
+  int sense = barrier_sense(&barrier);
+  int serial;
+  REQUIRE(barrier_wait(&barrier, 1, &sense, &serial) == KIT_OK);
+  REQUIRE(serial);
+  REQUIRE(barrier_wait(&barrier, 1, &sense, &serial) == KIT_OK);
+  REQUIRE(serial);
+  barrier_destroy(&barrier);
+}
+
+TEST("barrier one serial thread per phase") {
+  test_barrier_t data;
+  REQUIRE(barrier_init(&data.barrier) == KIT_OK);
+  atomic_store_explicit(&data.serial_count, 0, memory_order_relaxed);
+  atomic_store_explicit(&data.phase, 0, memory_order_relaxed);
+  atomic_store_explicit(&data.failed, 0, memory_order_relaxed);
+
+  thrd_t pool[TEST_BARRIER_THREADS];
+  for (int i = 0; i < TEST_BARRIER_THREADS; i++)
+    thrd_create(pool + i, test_barrier_run, &data);
+  for (int i = 0; i < TEST_BARRIER_THREADS; i++)
+    thrd_join(pool[i], NULL);
+
+  REQUIRE(atomic_load_explicit(&data.failed, memory_order_relaxed) ==
+          0);
+  REQUIRE(atomic_load_explicit(&data.serial_count,
+                               memory_order_relaxed) ==
+          TEST_BARRIER_PHASES);
+  barrier_destroy(&data.barrier);
+}
+
+static int test_barrier_wait_once(void *p) {
+  barrier_t *barrier = (barrier_t *) p;
+  int        sense   = barrier_sense(barrier);
+  int        serial;
+  (void) barrier_wait(barrier, 2, &sense, &serial);
+  return serial;
+}
+
+TEST("barrier cancel wakes waiting thread") {
+  barrier_t barrier;
+  REQUIRE(barrier_init(&barrier) == KIT_OK);
+  thrd_t t;
+  thrd_create(&t, test_barrier_wait_once, &barrier);
+  REQUIRE(barrier_cancel(&barrier) == KIT_OK);
+  int serial = 1;
+  thrd_join(t, &serial);
+  REQUIRE(serial == 0);
+  barrier_reset(&barrier);
+  int sense = barrier_sense(&barrier);
+  REQUIRE(barrier_wait(&barrier, 1, &sense, &serial) == KIT_OK);
+  REQUIRE(serial);
+  barrier_destroy(&barrier);
+}
@@ -1,4 +1,5 @@
 #include "../../laplace/buffer.h"
+#include <kit/mersenne_twister_64.h>
 #include <kit/thread.h>
 
 #define KIT_TEST_FILE buffer
@@ -658,6 +659,260 @@ TEST("buffer reallocate") {
 
 typedef BUFFER_TYPE(int64_t) test_buffer_int_t;
 
+TEST("buffer allocate reuses free run") {
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  handle_t a, b, c, d;
+  BUFFER_ALLOCATE(a, buf, 10);
+  BUFFER_ALLOCATE(b, buf, 10);
+  BUFFER_ALLOCATE(c, buf, 10);
+  ptrdiff_t const offset = buf.blocks.values[b.id].index;
+  REQUIRE(BUFFER_DEALLOCATE(buf, b) == KIT_OK);
+  BUFFER_ALLOCATE(d, buf, 5);
+  REQUIRE(d.id != ID_UNDEFINED);
+  REQUIRE(buf.blocks.values[d.id].index == offset);
+  BUFFER_ALLOCATE(d, buf, 5);
+  REQUIRE(d.id != ID_UNDEFINED);
+  REQUIRE(buf.blocks.values[d.id].index == offset + 5);
+  REQUIRE(buf.data.size == 30);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer deallocate merges free runs") {
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  handle_t a, b, c, d;
+  BUFFER_ALLOCATE(a, buf, 10);
+  BUFFER_ALLOCATE(b, buf, 10);
+  BUFFER_ALLOCATE(c, buf, 10);
+  BUFFER_ALLOCATE(d, buf, 10);
+  REQUIRE(BUFFER_DEALLOCATE(buf, a) == KIT_OK);
+  REQUIRE(BUFFER_DEALLOCATE(buf, c) == KIT_OK);
+  REQUIRE(BUFFER_DEALLOCATE(buf, b) == KIT_OK);
+  BUFFER_ALLOCATE(a, buf, 30);
+  REQUIRE(a.id != ID_UNDEFINED);
+  REQUIRE(buf.blocks.values[a.id].index == 0);
+  REQUIRE(buf.data.size == 40);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer allocate extends free run at the end") {
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  handle_t a, b;
+  BUFFER_ALLOCATE(a, buf, 10);
+  BUFFER_ALLOCATE(b, buf, 10);
+  REQUIRE(BUFFER_DEALLOCATE(buf, b) == KIT_OK);
+  BUFFER_ALLOCATE(b, buf, 15);
+  REQUIRE(b.id != ID_UNDEFINED);
+  REQUIRE(buf.blocks.values[b.id].index == 10);
+  REQUIRE(buf.data.size == 25);
+  BUFFER_DESTROY(buf);
+}
+
+static int test_alloc_sequence(test_buffer_int_t *buf,
+                               mt64_state_t *mt64, handle_t *handles,
+                               ptrdiff_t count, ptrdiff_t steps) {
+  for (ptrdiff_t i = 0; i < steps; i++) {
+    ptrdiff_t const k = (ptrdiff_t) (mt64_generate(mt64) % count);
+    ptrdiff_t const size = 1 + (ptrdiff_t) (mt64_generate(mt64) % 40);
+    if (handles[k].id == ID_UNDEFINED) {
+      BUFFER_ALLOCATE(handles[k], *buf, size);
+      if (handles[k].id == ID_UNDEFINED)
+        return 0;
+    } else if (BUFFER_DEALLOCATE(*buf, handles[k]) != KIT_OK)
+      return 0;
+    else
+      handles[k].id = ID_UNDEFINED;
+  }
+  return 1;
+}
+
+TEST("buffer allocation determinism with clone") {
+  enum { COUNT = 200, STEPS = 5000 };
+
+  kit_status_t      s;
+  test_buffer_int_t foo, bar;
+  BUFFER_INIT(s, foo, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  BUFFER_INIT(s, bar, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+
+  handle_t     foo_h[COUNT], bar_h[COUNT];
+  mt64_state_t foo_mt, bar_mt;
+  for (ptrdiff_t i = 0; i < COUNT; i++) {
+    foo_h[i].id = ID_UNDEFINED;
+    bar_h[i].id = ID_UNDEFINED;
+  }
+  mt64_init(&foo_mt, 42);
+
+  REQUIRE(test_alloc_sequence(&foo, &foo_mt, foo_h, COUNT, STEPS));
+
+  BUFFER_CLONE(s, bar, foo);
+  REQUIRE(s == KIT_OK);
+  memcpy(bar_h, foo_h, sizeof foo_h);
+  bar_mt = foo_mt;
+
+  REQUIRE(test_alloc_sequence(&foo, &foo_mt, foo_h, COUNT, STEPS));
+  REQUIRE(test_alloc_sequence(&bar, &bar_mt, bar_h, COUNT, STEPS));
+
+  int ok = foo.data.size == bar.data.size;
+  for (ptrdiff_t i = 0; i < COUNT; i++) {
+    ok = ok && foo_h[i].id == bar_h[i].id;
+    if (ok && foo_h[i].id != ID_UNDEFINED)
+      ok = foo.blocks.values[foo_h[i].id].index ==
+           bar.blocks.values[bar_h[i].id].index;
+  }
+  REQUIRE(ok);
+
+  BUFFER_DESTROY(foo);
+  BUFFER_DESTROY(bar);
+}
+
+TEST("buffer allocation has no overlaps") {
+  enum { COUNT = 100, STEPS = 5000 };
+
+  kit_status_t      s;
+  test_buffer_int_t buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+
+  handle_t     h[COUNT];
+  mt64_state_t mt;
+  for (ptrdiff_t i = 0; i < COUNT; i++) h[i].id = ID_UNDEFINED;
+  mt64_init(&mt, 1);
+
+  int ok = 1;
+  for (ptrdiff_t k = 0; ok && k < 10; k++) {
+    ok = test_alloc_sequence(&buf, &mt, h, COUNT, STEPS / 10);
+    for (ptrdiff_t i = 0; i < COUNT; i++)
+      if (h[i].id != ID_UNDEFINED)
+        for (ptrdiff_t j = 0; j < buf.blocks.values[h[i].id].size;
+             j++)
+          BUFFER_SET(s, buf, h[i], j, i);
+    for (int _ = 1; _;) BUFFER_ADJUST(_, buf, int64_t);
+    BUFFER_ADJUST_DONE(buf);
+    for (ptrdiff_t i = 0; i < COUNT; i++)
+      if (h[i].id != ID_UNDEFINED)
+        for (ptrdiff_t j = 0; j < buf.blocks.values[h[i].id].size;
+             j++) {
+          int64_t x;
+          BUFFER_READ_THREAD_SAFE(s, buf, h[i], j, 1, &x);
+          ok = ok && s == KIT_OK && x == i;
+        }
+  }
+  REQUIRE(ok);
+
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer adjust chunk size") {
+  kit_status_t      s;
+  test_buffer_int_t buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  laplace_buffer_void_t *p = (laplace_buffer_void_t *) &buf;
+  REQUIRE(laplace_buffer_adjust_chunk_size(p, 4) ==
+          BUFFER_DEFAULT_CHUNK_SIZE);
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, 100000);
+  REQUIRE(h.id != ID_UNDEFINED);
+  ptrdiff_t const chunk = laplace_buffer_adjust_chunk_size(p, 4);
+  REQUIRE(chunk % 64 == 0);
+  REQUIRE(chunk * 4 * BUFFER_CHUNKS_PER_THREAD >= 100000);
+  REQUIRE(chunk < laplace_buffer_adjust_chunk_size(p, 1));
+  REQUIRE(BUFFER_SET_CHUNK_SIZE(buf, 1000000) == KIT_OK);
+  REQUIRE(laplace_buffer_adjust_chunk_size(p, 4) == 1000000);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer adjust applies deltas to many cells") {
+  enum { SIZE = 300 };
+
+  kit_status_t      s;
+  test_buffer_int_t buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  BUFFER_SET_CHUNK_SIZE(buf, 100);
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, SIZE);
+  for (ptrdiff_t i = 0; i < SIZE; i++)
+    if (i < 128 || i % 3 == 0)
+      BUFFER_ADD(s, buf, h, i, i + 1);
+  for (int _ = 1; _;) BUFFER_ADJUST(_, buf, int64_t);
+  BUFFER_ADJUST_DONE(buf);
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < SIZE; i++) {
+    int64_t x;
+    BUFFER_READ_THREAD_SAFE(s, buf, h, i, 1, &x);
+    ok = ok && s == KIT_OK &&
+         x == (i < 128 || i % 3 == 0 ? i + 1 : 0);
+  }
+  REQUIRE(ok);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer adjust clears sparse changes") {
+  enum { SIZE = 100000 };
+
+  kit_status_t      s;
+  test_buffer_int_t buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, SIZE);
+  BUFFER_ADD(s, buf, h, 0, 1);
+  BUFFER_ADD(s, buf, h, 4095, 2);
+  BUFFER_ADD(s, buf, h, 4096, 3);
+  BUFFER_ADD(s, buf, h, SIZE - 1, 4);
+  for (int _ = 1; _;) BUFFER_ADJUST(_, buf, int64_t);
+  BUFFER_ADJUST_DONE(buf);
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < buf.changed.size; i++)
+    ok = ok && buf.changed.values[i].flags == 0;
+  for (ptrdiff_t i = 0; i < buf.summary.size; i++)
+    ok = ok && buf.summary.values[i].flags == 0;
+  REQUIRE(ok);
+  int64_t x[4];
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 0, 1, x);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 4095, 1, x + 1);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 4096, 1, x + 2);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, SIZE - 1, 1, x + 3);
+  REQUIRE(x[0] == 1);
+  REQUIRE(x[1] == 2);
+  REQUIRE(x[2] == 3);
+  REQUIRE(x[3] == 4);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer allocate does not wait for readers") {
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  handle_t a, b;
+  BUFFER_ALLOCATE(a, buf, 1);
+  ptrdiff_t const slot = laplace_buffer_read_begin(
+      (laplace_buffer_void_t *) &buf);
+  BUFFER_ALLOCATE(b, buf, 1000);
+  BUFFER_REALLOCATE(s, buf, 2000, a);
+  REQUIRE(b.id != ID_UNDEFINED);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(buf.retired.size > 0);
+  laplace_buffer_read_end((laplace_buffer_void_t *) &buf, slot);
+  BUFFER_ALLOCATE(b, buf, 10000);
+  REQUIRE(b.id != ID_UNDEFINED);
+  REQUIRE(buf.retired.size == 0);
+  BUFFER_DESTROY(buf);
+}
+
+
 typedef struct {
   test_buffer_int_t buf;
   handle_t          h;
@@ -770,6 +1025,40 @@ TEST("int buffer adjust concurrency harder") {
   BUFFER_DESTROY(data.buf);
 }
 
+static int test_int_adjust_all(void *p) {
+  test_int_buffer_data_t *data = (test_int_buffer_data_t *) p;
+  int                     more = 1;
+  while (more) BUFFER_ADJUST(more, data->buf, int64_t);
+  return 0;
+}
+
+TEST("int buffer hash with concurrent adjust") {
+  enum { THREAD_COUNT = 8, DATA_SIZE = 1000 };
+  kit_status_t           s;
+  test_int_buffer_data_t data, single;
+  BUFFER_INIT(s, data.buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  BUFFER_INIT(s, single.buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  BUFFER_SET_CHUNK_SIZE(data.buf, 10);
+  BUFFER_ALLOCATE(data.h, data.buf, DATA_SIZE);
+  BUFFER_ALLOCATE(single.h, single.buf, DATA_SIZE);
+  for (int i = 0; i < DATA_SIZE; i += 3) {
+    BUFFER_SET(s, data.buf, data.h, i, i * 7 - 500);
+    BUFFER_SET(s, single.buf, single.h, i, i * 7 - 500);
+  }
+  REQUIRE(data.buf.hash == 0);
+  thrd_t pool[THREAD_COUNT];
+  for (int i = 0; i < THREAD_COUNT; i++)
+    thrd_create(pool + i, test_int_adjust_all, &data);
+  for (int i = 0; i < THREAD_COUNT; i++) thrd_join(pool[i], NULL);
+  test_int_adjust_all(&single);
+  REQUIRE(data.buf.hash != 0);
+  REQUIRE(data.buf.hash == single.buf.hash);
+  BUFFER_DESTROY(data.buf);
+  BUFFER_DESTROY(single.buf);
+}
+
 typedef BUFFER_TYPE(int8_t) test_buffer_byte_t;
 
 typedef struct {
@@ -926,3 +1215,328 @@ TEST("buffer read concurrency") {
 
   REQUIRE(ok);
 }
+
+enum { TEST_KERNEL_SIZE = 1000 };
+
+/*  Writes the buffer hash and the sum of cell hashes.
+ */
+static int test_kernel_int(int kernel, int64_t *out,
+                          uint64_t *hash) {
+  kit_status_t      s;
+  test_buffer_int_t buf;
+  mt64_state_t      mt;
+  mt64_init(&mt, 42);
+  if (laplace_buffer_set_kernel(kernel) != KIT_OK)
+    return 0;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, TEST_KERNEL_SIZE);
+  for (ptrdiff_t i = 0; i < TEST_KERNEL_SIZE; i++) {
+    BUFFER_SET(s, buf, h, i, (int64_t) mt64_generate(&mt));
+    BUFFER_ADD(s, buf, h, i, (int64_t) mt64_generate(&mt));
+  }
+  for (int _ = 1; _;) BUFFER_ADJUST(_, buf, int64_t);
+  BUFFER_ADJUST_DONE(buf);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 0, TEST_KERNEL_SIZE, out);
+  hash[0] = buf.hash;
+  hash[1] = 0;
+  for (ptrdiff_t i = 0; i < buf.data.size; i++)
+    hash[1] += laplace_buffer_cell_hash(
+        (laplace_buffer_void_t const *) &buf, 0, i);
+  BUFFER_DESTROY(buf);
+  laplace_buffer_set_kernel(BUFFER_KERNEL_AUTO);
+  return 1;
+}
+
+static int test_kernel_byte(int kernel, int8_t *out,
+                           uint64_t *hash) {
+  kit_status_t s;
+  BUFFER_TYPE(int8_t) buf;
+  mt64_state_t mt;
+  mt64_init(&mt, 42);
+  if (laplace_buffer_set_kernel(kernel) != KIT_OK)
+    return 0;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, TEST_KERNEL_SIZE);
+  for (ptrdiff_t i = 0; i < TEST_KERNEL_SIZE; i++) {
+    BUFFER_SET(s, buf, h, i, (int8_t) mt64_generate(&mt));
+    BUFFER_ADD(s, buf, h, i, (int8_t) mt64_generate(&mt));
+  }
+  for (int _ = 1; _;) BUFFER_ADJUST(_, buf, int8_t);
+  BUFFER_ADJUST_DONE(buf);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 0, TEST_KERNEL_SIZE, out);
+  hash[0] = buf.hash;
+  hash[1] = 0;
+  for (ptrdiff_t i = 0; i < buf.data.size; i++)
+    hash[1] += laplace_buffer_cell_hash(
+        (laplace_buffer_void_t const *) &buf, 0, i);
+  BUFFER_DESTROY(buf);
+  laplace_buffer_set_kernel(BUFFER_KERNEL_AUTO);
+  return 1;
+}
+
+TEST("buffer adjust kernels are deterministic for integers") {
+  int64_t      expected[TEST_KERNEL_SIZE];
+  int64_t      x[TEST_KERNEL_SIZE];
+  uint64_t     scalar[2], hash[2];
+  mt64_state_t mt;
+  mt64_init(&mt, 42);
+  for (ptrdiff_t i = 0; i < TEST_KERNEL_SIZE; i++) {
+    uint64_t const value = mt64_generate(&mt);
+    uint64_t const delta = mt64_generate(&mt);
+    expected[i]          = (int64_t) (value + delta);
+  }
+  REQUIRE(test_kernel_int(BUFFER_KERNEL_SCALAR, x, scalar));
+  REQUIRE(memcmp(x, expected, sizeof x) == 0);
+  REQUIRE(scalar[0] != 0);
+  REQUIRE(scalar[0] == scalar[1]);
+  if (test_kernel_int(BUFFER_KERNEL_SSE2, x, hash)) {
+    REQUIRE(memcmp(x, expected, sizeof x) == 0);
+    REQUIRE(hash[0] == scalar[0] && hash[1] == scalar[0]);
+  }
+  if (test_kernel_int(BUFFER_KERNEL_AVX2, x, hash)) {
+    REQUIRE(memcmp(x, expected, sizeof x) == 0);
+    REQUIRE(hash[0] == scalar[0] && hash[1] == scalar[0]);
+  }
+}
+
+TEST("buffer adjust kernels are deterministic for bytes") {
+  int8_t       expected[TEST_KERNEL_SIZE];
+  int8_t       x[TEST_KERNEL_SIZE];
+  uint64_t     scalar[2], hash[2];
+  mt64_state_t mt;
+  mt64_init(&mt, 42);
+  for (ptrdiff_t i = 0; i < TEST_KERNEL_SIZE; i++) {
+    uint8_t const value = (uint8_t) mt64_generate(&mt);
+    uint8_t const delta = (uint8_t) mt64_generate(&mt);
+    expected[i]         = (int8_t) (uint8_t) (value + delta);
+  }
+  REQUIRE(test_kernel_byte(BUFFER_KERNEL_SCALAR, x, scalar));
+  REQUIRE(memcmp(x, expected, sizeof x) == 0);
+  REQUIRE(scalar[0] != 0);
+  REQUIRE(scalar[0] == scalar[1]);
+  if (test_kernel_byte(BUFFER_KERNEL_SSE2, x, hash)) {
+    REQUIRE(memcmp(x, expected, sizeof x) == 0);
+    REQUIRE(hash[0] == scalar[0] && hash[1] == scalar[0]);
+  }
+  if (test_kernel_byte(BUFFER_KERNEL_AVX2, x, hash)) {
+    REQUIRE(memcmp(x, expected, sizeof x) == 0);
+    REQUIRE(hash[0] == scalar[0] && hash[1] == scalar[0]);
+  }
+}
+
+TEST("buffer kernel auto detect") {
+  int const kernel = laplace_buffer_kernel();
+  REQUIRE(kernel != BUFFER_KERNEL_AUTO);
+  REQUIRE(laplace_buffer_set_kernel(kernel) == KIT_OK);
+  REQUIRE(laplace_buffer_set_kernel(BUFFER_KERNEL_AUTO) == KIT_OK);
+}
+
+static void test_snapshot_adjust(laplace_buffer_void_t *buf) {
+  BUFFER_TYPE(int64_t) *const b = (void *) buf;
+  int more                      = 1;
+  while (more) BUFFER_ADJUST(more, *b, int64_t);
+  BUFFER_ADJUST_DONE(*b);
+}
+
+TEST("buffer snapshot shares unchanged pages") {
+  enum { SIZE = BUFFER_PAGE_SIZE * 3 + 100 };
+
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, SIZE);
+  REQUIRE(h.id != ID_UNDEFINED);
+
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < SIZE; i++) {
+    BUFFER_SET(s, buf, h, i, i * 3);
+    ok = ok && s == KIT_OK;
+  }
+  REQUIRE(ok);
+  test_snapshot_adjust((laplace_buffer_void_t *) &buf);
+
+  laplace_buffer_snapshot_t a, b;
+  laplace_buffer_snapshot_init(&a, kit_alloc_default());
+  laplace_buffer_snapshot_init(&b, kit_alloc_default());
+
+  BUFFER_SNAPSHOT(s, a, buf, NULL);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(a.pages.size == 4);
+
+  BUFFER_ADD(s, buf, h, BUFFER_PAGE_SIZE + 5, 1000);
+  REQUIRE(s == KIT_OK);
+  test_snapshot_adjust((laplace_buffer_void_t *) &buf);
+
+  BUFFER_SNAPSHOT(s, b, buf, &a);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(b.pages.values[0] == a.pages.values[0]);
+  REQUIRE(b.pages.values[1] != a.pages.values[1]);
+  REQUIRE(b.pages.values[2] == a.pages.values[2]);
+  REQUIRE(b.pages.values[3] == a.pages.values[3]);
+  REQUIRE(b.hash != a.hash);
+
+  BUFFER_SET(s, buf, h, 7, -1);
+  REQUIRE(s == KIT_OK);
+  test_snapshot_adjust((laplace_buffer_void_t *) &buf);
+
+  static int64_t values[SIZE];
+
+  BUFFER_RESTORE(s, buf, a);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(buf.hash == a.hash);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 0, SIZE, values);
+  REQUIRE(s == KIT_OK);
+  for (ptrdiff_t i = 0; i < SIZE; i++)
+    ok = ok && values[i] == i * 3;
+  REQUIRE(ok);
+
+  BUFFER_RESTORE(s, buf, b);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(buf.hash == b.hash);
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 0, SIZE, values);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(values[7] == 21);
+  REQUIRE(values[BUFFER_PAGE_SIZE + 5] ==
+          (BUFFER_PAGE_SIZE + 5) * 3 + 1000);
+
+  laplace_buffer_snapshot_destroy(&a);
+  laplace_buffer_snapshot_destroy(&b);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer restore drops later allocations") {
+  kit_status_t s;
+  BUFFER_TYPE(int8_t) buf;
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+
+  handle_t h;
+  BUFFER_ALLOCATE(h, buf, 10);
+  REQUIRE(h.id != ID_UNDEFINED);
+  BUFFER_SET(s, buf, h, 3, 42);
+  REQUIRE(s == KIT_OK);
+  int more = 1;
+  while (more) BUFFER_ADJUST(more, buf, int8_t);
+  BUFFER_ADJUST_DONE(buf);
+
+  laplace_buffer_snapshot_t a;
+  laplace_buffer_snapshot_init(&a, kit_alloc_default());
+  BUFFER_SNAPSHOT(s, a, buf, NULL);
+  REQUIRE(s == KIT_OK);
+
+  uint64_t const hash       = buf.hash;
+  uint64_t const block_hash = buf.block_hash;
+
+  handle_t g;
+  BUFFER_ALLOCATE(g, buf, BUFFER_PAGE_SIZE * 2);
+  REQUIRE(g.id != ID_UNDEFINED);
+  REQUIRE(BUFFER_DEALLOCATE(buf, h) == KIT_OK);
+  REQUIRE(buf.data.size > BUFFER_PAGE_SIZE);
+
+  BUFFER_RESTORE(s, buf, a);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(buf.data.size == 10);
+  REQUIRE(buf.hash == hash);
+  REQUIRE(buf.block_hash == block_hash);
+  REQUIRE(BUFFER_SIZE_THREAD_SAFE(buf, h) == 10);
+  REQUIRE(BUFFER_SIZE_THREAD_SAFE(buf, g) == 0);
+
+  int8_t x = 0;
+  BUFFER_READ_THREAD_SAFE(s, buf, h, 3, 1, &x);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(x == 42);
+
+  /*  Allocation after restore gets the same handle.
+   */
+  handle_t k;
+  BUFFER_ALLOCATE(k, buf, 5);
+  REQUIRE(k.id == g.id);
+  REQUIRE(k.generation == g.generation);
+
+  laplace_buffer_snapshot_destroy(&a);
+  BUFFER_DESTROY(buf);
+}
+
+TEST("buffer clone") {
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) src;
+  BUFFER_TYPE(int64_t) dst;
+  BUFFER_INIT(s, src, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  BUFFER_INIT(s, dst, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+
+  handle_t a, b;
+  BUFFER_ALLOCATE(a, src, 10);
+  BUFFER_ALLOCATE(b, src, 20);
+  REQUIRE(a.id != ID_UNDEFINED && b.id != ID_UNDEFINED);
+  BUFFER_SET(s, src, b, 3, 42);
+  REQUIRE(s == KIT_OK);
+  test_snapshot_adjust((laplace_buffer_void_t *) &src);
+  REQUIRE(BUFFER_DEALLOCATE(src, a) == KIT_OK);
+
+  BUFFER_CLONE(s, dst, src);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(dst.hash == src.hash);
+  REQUIRE(dst.block_hash == src.block_hash);
+
+  int64_t x;
+  BUFFER_READ_THREAD_SAFE(s, dst, b, 3, 1, &x);
+  REQUIRE(s == KIT_OK);
+  REQUIRE(x == 42);
+  REQUIRE(BUFFER_SIZE_THREAD_SAFE(dst, a) == 0);
+
+  /*  Free runs are cloned too, so allocation goes the same way.
+   */
+  handle_t c, d;
+  BUFFER_ALLOCATE(c, src, 5);
+  BUFFER_ALLOCATE(d, dst, 5);
+  REQUIRE(c.id == d.id);
+  REQUIRE(c.generation == d.generation);
+  REQUIRE(src.blocks.values[c.id].index ==
+          dst.blocks.values[d.id].index);
+
+  BUFFER_DESTROY(src);
+  BUFFER_DESTROY(dst);
+}
+
+TEST("buffer diff apply rejects out of range entries") {
+  /*  Differences from an empty buffer to 8 cells and 1 block. Hashes
+   *  are zero, each varint takes one byte.
+   */
+  unsigned char const tag[] = { 0, 0, 0, 0, 8, 1, 0, 0, 0, 0,
+                                0, 1, 0, 40, 0, 0, 0, 0, 0 };
+  unsigned char const block[] = { 0, 0, 0, 0, 8, 1, 0, 0, 0,
+                                  0, 0, 0, 0, 1, 8, 0, 20, 0,
+                                  0, 0 };
+  unsigned char const free_list[] = { 0, 0, 0, 0, 8, 1, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 1, 0,
+                                      1, 8, 1, 0 };
+
+  kit_status_t s;
+  BUFFER_TYPE(int64_t) buf;
+
+  BUFFER_INIT(s, buf, kit_alloc_default());
+  REQUIRE(s == KIT_OK);
+  REQUIRE(buf.hash == 0 && buf.block_hash == 0);
+
+  ptrdiff_t position = 0;
+  BUFFER_DIFF_APPLY(s, buf, free_list, sizeof free_list, &position);
+  REQUIRE(s == ERROR_INVALID_FORMAT);
+  REQUIRE(position == 0);
+
+  BUFFER_DIFF_APPLY(s, buf, tag, sizeof tag, &position);
+  REQUIRE(s == ERROR_INVALID_FORMAT);
+  REQUIRE(buf.info.values[0].offset == 0);
+
+  BUFFER_DIFF_APPLY(s, buf, block, sizeof block, &position);
+  REQUIRE(s == ERROR_INVALID_FORMAT);
+  REQUIRE(buf.blocks.values[0].index == ID_UNDEFINED);
+
+  BUFFER_DESTROY(buf);
+}
@@ -1,4 +1,6 @@
 #include "../../laplace/controller.h"
+#include "../../laplace/impact.h"
+#include "../../laplace/state.h"
 
 #define KIT_TEST_FILE controller
 #include <kit_test/test.h>
@@ -61,3 +63,476 @@ TEST("controller schedule two events") {
   execution_destroy(&exe);
 }
 
+
+static ptrdiff_t test_controller_runs_ = 0;
+
+STATIC_CORO(impact_list_t, test_controller_add_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  test_controller_runs_++;
+  DA_INIT(self->return_value, 1, self->alloc);
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ADD(h, 0, self->self.id) };
+
+  self->return_value.values[0] = i[0];
+  AF_RETURN_VOID;
+}
+CORO_END
+
+STATIC_CORO(impact_list_t, test_controller_allocate_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  DA_INIT(self->return_value, 1, self->alloc);
+  handle_t h   = { .id = 0, .generation = -1 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h, 1) };
+
+  self->return_value.values[0] = i[0];
+  AF_RETURN_VOID;
+}
+CORO_END
+
+enum { TEST_CONTROLLER_TICKS = 100 };
+
+/*  Queue an allocation and an event for each following tick, and
+ *  advance one tick at a time, saving the value after each tick.
+ */
+static int test_controller_run_(controller_t *const ctrl,
+                                execution_t *const  exe,
+                                read_write_t const  state,
+                                int64_t *const      values) {
+  action_t allocate = ACTION_UNSAFE(test_controller_allocate_, 1,
+                                    HANDLE_NULL);
+  event_t  first    = { .time = 0, .action = allocate };
+  if (controller_queue(ctrl, first) != KIT_OK)
+    return 0;
+
+  for (ptrdiff_t t = 1; t < TEST_CONTROLLER_TICKS; t++) {
+    handle_t self   = { .id = 1 + t % 7, .generation = 0 };
+    action_t action = ACTION_UNSAFE(test_controller_add_, 1, self);
+    event_t  ev     = { .time = t, .action = action };
+    if (controller_queue(ctrl, ev) != KIT_OK)
+      return 0;
+  }
+
+  handle_t h = { .id = 0, .generation = 0 };
+  values[0]  = state.get_integer(state.state, h, 0, -1);
+
+  for (ptrdiff_t t = 1; t <= TEST_CONTROLLER_TICKS; t++) {
+    if (schedule_and_join(ctrl, exe, 1) != KIT_OK)
+      return 0;
+    values[t] = state.get_integer(state.state, h, 0, -1);
+  }
+
+  return 1;
+}
+
+static kit_status_t test_controller_init_(execution_t  *exe,
+                                          read_write_t *state) {
+  kit_allocator_t const alloc = kit_alloc_default();
+
+  kit_status_t s = state_init(state, 0, alloc);
+  if (s != KIT_OK)
+    return s;
+
+  thread_pool_t pool;
+  memset(&pool, 0, sizeof pool);
+
+  return execution_init(exe, *state, pool, alloc);
+}
+
+TEST("controller rewind from snapshot") {
+  read_write_t state;
+  execution_t  exe;
+  REQUIRE(test_controller_init_(&exe, &state) == KIT_OK);
+
+  controller_t ctrl;
+  REQUIRE(controller_init(&ctrl, 0, kit_alloc_default()) == KIT_OK);
+  REQUIRE(controller_set_snapshots(&ctrl, 10, 16) == KIT_OK);
+
+  int64_t values[TEST_CONTROLLER_TICKS + 1];
+  REQUIRE(test_controller_run_(&ctrl, &exe, state, values));
+  REQUIRE(values[TEST_CONTROLLER_TICKS] != values[0]);
+
+  handle_t h = { .id = 0, .generation = 0 };
+
+  /*  Only the ticks after the snapshot at 50 are replayed.
+   */
+  test_controller_runs_ = 0;
+  REQUIRE(controller_rewind(&ctrl, &exe, 55) == KIT_OK);
+  REQUIRE(ctrl.time == 55);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == values[55]);
+  REQUIRE(test_controller_runs_ <= 10);
+
+  REQUIRE(controller_rewind(&ctrl, &exe, 23) == KIT_OK);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == values[23]);
+
+  laplace_time_t const rest = TEST_CONTROLLER_TICKS - 23;
+  REQUIRE(schedule_and_join(&ctrl, &exe, rest) == KIT_OK);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) ==
+          values[TEST_CONTROLLER_TICKS]);
+
+  controller_destroy(&ctrl);
+  execution_destroy(&exe);
+}
+
+TEST("controller snapshot ring is bounded") {
+  read_write_t state;
+  execution_t  exe;
+  REQUIRE(test_controller_init_(&exe, &state) == KIT_OK);
+
+  controller_t ctrl;
+  REQUIRE(controller_init(&ctrl, 0, kit_alloc_default()) == KIT_OK);
+  REQUIRE(controller_set_snapshots(&ctrl, 10, 3) == KIT_OK);
+
+  int64_t values[TEST_CONTROLLER_TICKS + 1];
+  REQUIRE(test_controller_run_(&ctrl, &exe, state, values));
+  REQUIRE(ctrl.snapshot_count == 3);
+
+  handle_t h = { .id = 0, .generation = 0 };
+
+  /*  The target is older than the oldest snapshot, so the state is
+   *  reset and replayed from zero, and the ring is refilled from
+   *  there.
+   */
+  test_controller_runs_ = 0;
+  REQUIRE(controller_rewind(&ctrl, &exe, 20) == KIT_OK);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == values[20]);
+  REQUIRE(test_controller_runs_ > 10);
+  REQUIRE(ctrl.snapshot_count == 1);
+
+  controller_destroy(&ctrl);
+  execution_destroy(&exe);
+}
+
+static event_t test_controller_input_(laplace_time_t const time,
+                                      ptrdiff_t const      value) {
+  handle_t self = { .id = value, .generation = 0 };
+  event_t  ev   = { .time   = time,
+                    .action = ACTION_UNSAFE(test_controller_add_, 1,
+                                            self) };
+  return ev;
+}
+
+static kit_status_t test_controller_speculative_(controller_t *ctrl) {
+  kit_status_t s = controller_init(ctrl, 0, kit_alloc_default());
+  if (s == KIT_OK)
+    s = controller_set_snapshots(ctrl, 1, 32);
+  if (s == KIT_OK)
+    s = controller_set_speculative(ctrl, 1, 1);
+
+  action_t allocate = ACTION_UNSAFE(test_controller_allocate_, 1,
+                                    HANDLE_NULL);
+  event_t  first    = { .time = 0, .action = allocate };
+  if (s == KIT_OK)
+    s = controller_queue(ctrl, first);
+  return s;
+}
+
+TEST("controller speculative rollback on late input") {
+  read_write_t state;
+  execution_t  exe;
+  REQUIRE(test_controller_init_(&exe, &state) == KIT_OK);
+
+  controller_t ctrl;
+  REQUIRE(test_controller_speculative_(&ctrl) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = 0 };
+
+  /*  Ticks after the first input repeat it.
+   */
+  REQUIRE(controller_queue_input(&ctrl, 0,
+                                 test_controller_input_(1, 1)) ==
+          KIT_OK);
+  REQUIRE(schedule_and_join(&ctrl, &exe, 6) == KIT_OK);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == 5);
+
+  REQUIRE(controller_queue_input(&ctrl, 1,
+                                 test_controller_input_(2, 1)) ==
+          ERROR_INVALID_INDEX);
+
+  /*  Late inputs roll the state back to the snapshot at 2, and the
+   *  following ticks repeat the new input.
+   */
+  REQUIRE(controller_queue_input(&ctrl, 0,
+                                 test_controller_input_(2, 1)) ==
+          KIT_OK);
+  REQUIRE(controller_queue_input(&ctrl, 0,
+                                 test_controller_input_(3, 10)) ==
+          KIT_OK);
+  REQUIRE(ctrl.time == 6);
+
+  test_controller_runs_ = 0;
+  REQUIRE(schedule_and_join(&ctrl, &exe, 0) == KIT_OK);
+  REQUIRE(ctrl.time == 6);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == 32);
+  REQUIRE(test_controller_runs_ == 4);
+
+  controller_destroy(&ctrl);
+  execution_destroy(&exe);
+}
+
+TEST("controller speculative rollback without snapshot and reset") {
+  read_write_t state;
+  REQUIRE(state_init(&state, 0, kit_alloc_default()) == KIT_OK);
+  state.reset = NULL;
+
+  thread_pool_t pool;
+  memset(&pool, 0, sizeof pool);
+
+  execution_t exe;
+  REQUIRE(execution_init(&exe, state, pool, kit_alloc_default()) ==
+          KIT_OK);
+
+  controller_t ctrl;
+  REQUIRE(controller_init(&ctrl, 0, kit_alloc_default()) == KIT_OK);
+  REQUIRE(controller_set_speculative(&ctrl, 1, 1) == KIT_OK);
+
+  action_t allocate = ACTION_UNSAFE(test_controller_allocate_, 1,
+                                    HANDLE_NULL);
+  event_t  first    = { .time = 0, .action = allocate };
+  REQUIRE(controller_queue(&ctrl, first) == KIT_OK);
+  REQUIRE(schedule_and_join(&ctrl, &exe, 3) == KIT_OK);
+
+  /*  The state can not be restored, so the late input is not lost
+   *  silently and the rollback stays pending.
+   */
+  REQUIRE(controller_queue_input(&ctrl, 0,
+                                 test_controller_input_(1, 100)) ==
+          KIT_OK);
+  REQUIRE(schedule_and_join(&ctrl, &exe, 0) ==
+          ERROR_INVALID_REWIND_TIME);
+  REQUIRE(ctrl.rollback_time == 1);
+  REQUIRE(schedule_and_join(&ctrl, &exe, 1) ==
+          ERROR_INVALID_REWIND_TIME);
+  REQUIRE(ctrl.time == 3);
+
+  controller_destroy(&ctrl);
+  execution_destroy(&exe);
+}
+
+TEST("controller speculative result does not depend on delay") {
+  enum { TICKS = 40, DELAY = 3 };
+
+  read_write_t state[2];
+  execution_t  exe[2];
+  controller_t ctrl[2];
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    REQUIRE(test_controller_init_(exe + k, state + k) == KIT_OK);
+    REQUIRE(test_controller_speculative_(ctrl + k) == KIT_OK);
+  }
+
+  /*  The first controller gets each input in time, the second one
+   *  gets it a few ticks late.
+   */
+  int ok = 1;
+  for (laplace_time_t t = 1; t <= TICKS; t++) {
+    ptrdiff_t const value = 1 + (t * 7) % 5;
+    ok = ok && controller_queue_input(ctrl, 0,
+                                      test_controller_input_(
+                                          t, value)) == KIT_OK;
+    ok = ok && schedule_and_join(ctrl, exe, 1) == KIT_OK;
+
+    if (t > DELAY) {
+      laplace_time_t const late = t - DELAY;
+      ok = ok && controller_queue_input(
+                     ctrl + 1, 0,
+                     test_controller_input_(late,
+                                            1 + (late * 7) % 5)) ==
+                     KIT_OK;
+    }
+    ok = ok && schedule_and_join(ctrl + 1, exe + 1, 1) == KIT_OK;
+  }
+  REQUIRE(ok);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  REQUIRE(state[0].get_integer(state[0].state, h, 0, -1) !=
+          state[1].get_integer(state[1].state, h, 0, -1));
+
+  for (laplace_time_t t = TICKS - DELAY + 1; t <= TICKS; t++)
+    ok = ok && controller_queue_input(
+                   ctrl + 1, 0,
+                   test_controller_input_(t, 1 + (t * 7) % 5)) ==
+                   KIT_OK;
+  REQUIRE(ok);
+  REQUIRE(schedule_and_join(ctrl + 1, exe + 1, 0) == KIT_OK);
+
+  REQUIRE(state[0].get_integer(state[0].state, h, 0, -1) ==
+          state[1].get_integer(state[1].state, h, 0, -1));
+  REQUIRE(state[0].hash(state[0].state) ==
+          state[1].hash(state[1].state));
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    controller_destroy(ctrl + k);
+    execution_destroy(exe + k);
+  }
+}
+
+TEST("controller speculative inputs queued in advance") {
+  read_write_t state;
+  execution_t  exe;
+  REQUIRE(test_controller_init_(&exe, &state) == KIT_OK);
+
+  controller_t ctrl;
+  REQUIRE(test_controller_speculative_(&ctrl) == KIT_OK);
+
+  /*  The first input is repeated until the second one.
+   */
+  REQUIRE(controller_queue_input(&ctrl, 0,
+                                 test_controller_input_(1, 1)) ==
+          KIT_OK);
+  REQUIRE(controller_queue_input(&ctrl, 0,
+                                 test_controller_input_(10, 10)) ==
+          KIT_OK);
+  REQUIRE(schedule_and_join(&ctrl, &exe, 12) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == 9 + 20);
+
+  controller_destroy(&ctrl);
+  execution_destroy(&exe);
+}
+
+TEST("controller speculative inputs out of order") {
+  enum { TICKS = 12 };
+
+  read_write_t state[2];
+  execution_t  exe[2];
+  controller_t ctrl[2];
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    REQUIRE(test_controller_init_(exe + k, state + k) == KIT_OK);
+    REQUIRE(test_controller_speculative_(ctrl + k) == KIT_OK);
+  }
+
+  int ok = 1;
+  ok     = ok && controller_queue_input(
+                 ctrl, 0, test_controller_input_(1, 1)) == KIT_OK;
+  ok     = ok && controller_queue_input(
+                 ctrl, 0, test_controller_input_(4, 3)) == KIT_OK;
+  ok     = ok && controller_queue_input(
+                 ctrl, 0, test_controller_input_(7, 5)) == KIT_OK;
+  ok     = ok && schedule_and_join(ctrl, exe, TICKS) == KIT_OK;
+
+  /*  The latest input arrives first, and others arrive late in
+   *  reverse order.
+   */
+  ok = ok && controller_queue_input(
+                 ctrl + 1, 0, test_controller_input_(7, 5)) == KIT_OK;
+  ok = ok && schedule_and_join(ctrl + 1, exe + 1, 5) == KIT_OK;
+  ok = ok && controller_queue_input(
+                 ctrl + 1, 0, test_controller_input_(4, 3)) == KIT_OK;
+  ok = ok && schedule_and_join(ctrl + 1, exe + 1, 3) == KIT_OK;
+  ok = ok && controller_queue_input(
+                 ctrl + 1, 0, test_controller_input_(1, 1)) == KIT_OK;
+  ok = ok && schedule_and_join(ctrl + 1, exe + 1, TICKS - 8) ==
+                 KIT_OK;
+  REQUIRE(ok);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  REQUIRE(state[0].get_integer(state[0].state, h, 0, -1) ==
+          3 + 3 * 3 + 5 * 5);
+  REQUIRE(state[1].get_integer(state[1].state, h, 0, -1) ==
+          3 + 3 * 3 + 5 * 5);
+  REQUIRE(state[0].hash(state[0].state) ==
+          state[1].hash(state[1].state));
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    controller_destroy(ctrl + k);
+    execution_destroy(exe + k);
+  }
+}
+
+enum { TEST_CONTROLLER_STEPS = 3 };
+
+/*  Add the value for a few ticks, one time each tick.
+ */
+STATIC_CORO(impact_list_t, test_controller_add_steps_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self; int step;) {
+  for (self->step = 0; self->step < TEST_CONTROLLER_STEPS;
+       self->step++) {
+    test_controller_runs_++;
+    DA_INIT(self->return_value, 1, self->alloc);
+    handle_t h   = { .id = 0, .generation = 0 };
+    impact_t i[] = { INTEGER_ADD(h, 0, self->self.id) };
+
+    self->return_value.values[0] = i[0];
+    AF_YIELD_VOID;
+  }
+
+  DA_INIT(self->return_value, 0, self->alloc);
+  AF_RETURN_VOID;
+}
+CORO_END
+
+static event_t test_controller_steps_(laplace_time_t const time,
+                                      ptrdiff_t const      value) {
+  handle_t self   = { .id = value, .generation = 0 };
+  action_t action = ACTION_UNSAFE(test_controller_add_steps_, 1,
+                                  self);
+  event_t  ev     = { .time = time, .action = action };
+  return ev;
+}
+
+TEST("controller speculative rollback of multi-tick actions") {
+  enum { TICKS = 30, DELAY = 4 };
+
+  read_write_t state[2];
+  execution_t  exe[2];
+  controller_t ctrl[2];
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    REQUIRE(test_controller_init_(exe + k, state + k) == KIT_OK);
+    REQUIRE(test_controller_speculative_(ctrl + k) == KIT_OK);
+  }
+
+  /*  Each input and each prediction runs for a few ticks, so actions
+   *  are still running when the state is rolled back.
+   */
+  int ok = 1;
+  for (laplace_time_t t = 1; t <= TICKS; t++) {
+    if (t % 3 == 1)
+      ok = ok && controller_queue_input(
+                     ctrl, 0,
+                     test_controller_steps_(t, 1 + t % 4)) ==
+                     KIT_OK;
+    ok = ok && schedule_and_join(ctrl, exe, 1) == KIT_OK;
+
+    laplace_time_t const late = t - DELAY;
+    if (late > 0 && late % 3 == 1)
+      ok = ok && controller_queue_input(
+                     ctrl + 1, 0,
+                     test_controller_steps_(late, 1 + late % 4)) ==
+                     KIT_OK;
+    ok = ok && schedule_and_join(ctrl + 1, exe + 1, 1) == KIT_OK;
+  }
+  REQUIRE(ok);
+
+  for (laplace_time_t t = TICKS - DELAY + 1; t <= TICKS; t++)
+    if (t % 3 == 1)
+      ok = ok && controller_queue_input(
+                     ctrl + 1, 0,
+                     test_controller_steps_(t, 1 + t % 4)) == KIT_OK;
+  REQUIRE(ok);
+  REQUIRE(schedule_and_join(ctrl + 1, exe + 1, 0) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  REQUIRE(state[0].get_integer(state[0].state, h, 0, -1) ==
+          state[1].get_integer(state[1].state, h, 0, -1));
+  REQUIRE(state[0].hash(state[0].state) ==
+          state[1].hash(state[1].state));
+
+  /*  Both executions have the same actions running, so the next ticks
+   *  match too.
+   */
+  REQUIRE(schedule_and_join(ctrl, exe, 5) == KIT_OK);
+  REQUIRE(schedule_and_join(ctrl + 1, exe + 1, 5) == KIT_OK);
+  REQUIRE(state[0].hash(state[0].state) ==
+          state[1].hash(state[1].state));
+
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    controller_destroy(ctrl + k);
+    execution_destroy(exe + k);
+  }
+}
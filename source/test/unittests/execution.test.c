@@ -1176,3 +1176,377 @@ TEST("execution queue concurrency") {
 
   REQUIRE(ok);
 }
+
+STATIC_CORO(impact_list_t, test_exe_alloc_ordered_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  DA_INIT(self->return_value, 1, self->alloc);
+  handle_t ret = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE(1, ret, self->self.id * 2) };
+
+  self->return_value.values[0] = i[0];
+  AF_RETURN_VOID;
+}
+CORO_END
+
+TEST("execution sync impacts applied in action order") {
+  enum { ACTION_COUNT = 32 };
+
+  kit_allocator_t alloc = kit_alloc_default();
+  int             ok    = 1;
+
+  for (ptrdiff_t thread_count = 0; thread_count <= 4;
+       thread_count += 4) {
+    pool_state_t_ pool_;
+    DA_INIT(pool_.threads, 0, alloc);
+    laplace_thread_pool_t pool = { .state   = &pool_,
+                                   .release = pool_release_,
+                                   .run     = pool_run_,
+                                   .join    = pool_join_ };
+
+    read_write_t state;
+    ok = ok && (state_init(&state, 0, alloc) == KIT_OK);
+
+    handle_t ret = { .id = 0, .generation = -1 };
+    impact_t i   = INTEGER_ALLOCATE_INTO(ret, ACTION_COUNT * 2);
+    ok           = ok && (state.apply(state.state, &i) == KIT_OK);
+    ret.generation++;
+
+    execution_t exe;
+    ok = ok && (execution_init(&exe, state, pool, alloc) == KIT_OK);
+    if (thread_count != 0)
+      ok = ok && (execution_set_thread_count(&exe, thread_count) ==
+                  KIT_OK);
+
+    for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+      handle_t self   = { .id = k, .generation = 0 };
+      action_t action = ACTION_UNSAFE(test_exe_alloc_ordered_, 1,
+                                      self);
+      ok = ok && (execution_queue(&exe, action) == KIT_OK);
+    }
+
+    ok = ok && (execution_schedule_and_join(&exe, 1) == KIT_OK);
+
+    for (ptrdiff_t k = 0; k < ACTION_COUNT; k++)
+      ok = ok &&
+           state.get_integer(state.state, ret, k * 2, -1) == k + 1;
+
+    execution_destroy(&exe);
+  }
+
+  REQUIRE(ok);
+}
+
+STATIC_CORO(impact_list_t, test_exe_add_one_, kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  DA_INIT(self->return_value, 1, self->alloc);
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ADD(h, self->self.id, 1) };
+
+  self->return_value.values[0] = i[0];
+  AF_RETURN_VOID;
+}
+CORO_END
+
+TEST("execution many actions") {
+  enum { ACTION_COUNT = 2000, CELL_COUNT = 3 };
+
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_state_t_ pool_;
+  DA_INIT(pool_.threads, 0, alloc);
+  laplace_thread_pool_t pool = { .state   = &pool_,
+                                 .release = pool_release_,
+                                 .run     = pool_run_,
+                                 .join    = pool_join_ };
+
+  read_write_t state;
+  REQUIRE(state_init(&state, 0, alloc) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = -1 };
+  impact_t i = INTEGER_ALLOCATE_INTO(h, CELL_COUNT);
+  REQUIRE(state.apply(state.state, &i) == KIT_OK);
+  h.generation++;
+
+  execution_t exe;
+  REQUIRE(execution_init(&exe, state, pool, alloc) == KIT_OK);
+  REQUIRE(execution_set_thread_count(&exe, 4) == KIT_OK);
+
+  int ok = 1;
+  for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+    handle_t self   = { .id = k % CELL_COUNT, .generation = 0 };
+    action_t action = ACTION_UNSAFE(test_exe_add_one_, 1, self);
+    ok = ok && (execution_queue(&exe, action) == KIT_OK);
+  }
+  REQUIRE(ok);
+
+  REQUIRE(execution_schedule_and_join(&exe, 1) == KIT_OK);
+
+  for (ptrdiff_t k = 0; k < CELL_COUNT; k++)
+    REQUIRE(state.get_integer(state.state, h, k, -1) ==
+            (ACTION_COUNT + CELL_COUNT - 1 - k) / CELL_COUNT);
+
+  execution_destroy(&exe);
+}
+
+static int test_exe_alloc_count_ = 0;
+
+static void *test_exe_count_allocate_(int request, void *_,
+                                      ptrdiff_t size,
+                                      ptrdiff_t previous_size,
+                                      void     *pointer) {
+  if (request == KIT_ALLOCATE || request == KIT_ALLOCATE_ZERO ||
+      request == KIT_REALLOCATE)
+    test_exe_alloc_count_++;
+  return kit_alloc_dispatch(kit_alloc_default(), request, size,
+                            previous_size, pointer);
+}
+
+STATIC_CORO(impact_list_t, test_exe_set_each_tick_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  static handle_t const h0 = { .id = 0, .generation = -1 };
+  static handle_t const h  = { .id = 0, .generation = 0 };
+
+  DA_INIT(self->return_value, 1, self->alloc);
+  impact_t i0[] = { INTEGER_ALLOCATE_INTO(h0, 1) };
+
+  self->return_value.values[0] = i0[0];
+  AF_YIELD_VOID;
+
+  for (;;) {
+    DA_INIT(self->return_value, 2, self->alloc);
+    impact_t i1[] = { INTEGER_SET(h, 0, 42), INTEGER_ADD(h, 0, 1) };
+
+    self->return_value.values[0] = i1[0];
+    self->return_value.values[1] = i1[1];
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+TEST("seq execution impacts do not allocate from heap") {
+  laplace_thread_pool_t pool;
+  memset(&pool, 0, sizeof pool);
+
+  kit_allocator_t alloc = { .state    = NULL,
+                            .allocate = test_exe_count_allocate_ };
+
+  read_write_t state;
+  REQUIRE(state_init(&state, 0, kit_alloc_default()) == KIT_OK);
+
+  execution_t exe;
+  REQUIRE(execution_init(&exe, state, pool, alloc) == KIT_OK);
+
+  action_t action = ACTION(test_exe_set_each_tick_, 1, HANDLE_NULL);
+  REQUIRE(execution_queue(&exe, action) == KIT_OK);
+  /*  Warm up until every wheel bucket has been used once.
+   */
+  REQUIRE(execution_schedule_and_join(&exe, WHEEL_SIZE + 1) ==
+          KIT_OK);
+
+  int const count = test_exe_alloc_count_;
+  REQUIRE(execution_schedule_and_join(&exe, 100) == KIT_OK);
+  REQUIRE(test_exe_alloc_count_ == count);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  REQUIRE(state.get_integer(state.state, h, 0, -1) == 43);
+
+  execution_destroy(&exe);
+}
+
+STATIC_CORO(impact_list_t, test_exe_large_frame_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self; int64_t data[1000];) {
+  static handle_t const h0 = { .id = 0, .generation = -1 };
+
+  for (ptrdiff_t i = 0; i < 1000; i++) self->data[i] = i;
+
+  DA_INIT(self->return_value, 1, self->alloc);
+  impact_t i0[] = { INTEGER_ALLOCATE_INTO(h0, 1) };
+
+  self->return_value.values[0] = i0[0];
+  AF_YIELD_VOID;
+
+  static handle_t const h = { .id = 0, .generation = 0 };
+
+  int64_t sum = 0;
+  for (ptrdiff_t i = 0; i < 1000; i++) sum += self->data[i];
+
+  DA_INIT(self->return_value, 1, self->alloc);
+  impact_t i1[] = { INTEGER_SET(h, 0, sum) };
+
+  self->return_value.values[0] = i1[0];
+  AF_RETURN_VOID;
+}
+CORO_END
+
+TEST("execution action with large frame") {
+  for (ptrdiff_t thread_count = 0; thread_count <= 2;
+       thread_count += 2) {
+    kit_allocator_t alloc = kit_alloc_default();
+
+    pool_state_t_ pool_;
+    DA_INIT(pool_.threads, 0, alloc);
+    laplace_thread_pool_t pool = { .state   = &pool_,
+                                   .release = pool_release_,
+                                   .run     = pool_run_,
+                                   .join    = pool_join_ };
+
+    read_write_t state;
+    REQUIRE(state_init(&state, 0, alloc) == KIT_OK);
+
+    execution_t exe;
+    REQUIRE(execution_init(&exe, state, pool, alloc) == KIT_OK);
+    if (thread_count != 0)
+      REQUIRE(execution_set_thread_count(&exe, thread_count) ==
+              KIT_OK);
+
+    action_t action = ACTION(test_exe_large_frame_, 1, HANDLE_NULL);
+    REQUIRE(action.size > COROUTINE_SIZE);
+
+    REQUIRE(execution_queue(&exe, action) == KIT_OK);
+    REQUIRE(execution_schedule_and_join(&exe, 2) == KIT_OK);
+
+    handle_t h = { .id = 0, .generation = 0 };
+    REQUIRE(state.get_integer(state.state, h, 0, -1) ==
+            999 * 1000 / 2);
+
+    execution_destroy(&exe);
+  }
+}
+
+STATIC_CORO(impact_list_t, test_exe_add_forever_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  for (;;) {
+    DA_INIT(self->return_value, 1, self->alloc);
+    handle_t h   = { .id = 0, .generation = 0 };
+    impact_t i[] = { INTEGER_ADD(h, self->self.id, 1) };
+
+    self->return_value.values[0] = i[0];
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+TEST("execution sleeping actions wake on time") {
+  enum {
+    ACTION_COUNT = 40,
+    TICK_COUNT   = 1000,
+    MAX_DURATION = WHEEL_SIZE * 2 + 50
+  };
+
+  for (ptrdiff_t thread_count = 0; thread_count <= 2;
+       thread_count += 2) {
+    kit_allocator_t alloc = kit_alloc_default();
+
+    pool_state_t_ pool_;
+    DA_INIT(pool_.threads, 0, alloc);
+    laplace_thread_pool_t pool = { .state   = &pool_,
+                                   .release = pool_release_,
+                                   .run     = pool_run_,
+                                   .join    = pool_join_ };
+
+    read_write_t state;
+    REQUIRE(state_init(&state, 0, alloc) == KIT_OK);
+
+    handle_t h = { .id = 0, .generation = -1 };
+    impact_t i = INTEGER_ALLOCATE_INTO(h, ACTION_COUNT);
+    REQUIRE(state.apply(state.state, &i) == KIT_OK);
+    h.generation++;
+
+    execution_t exe;
+    REQUIRE(execution_init(&exe, state, pool, alloc) == KIT_OK);
+    if (thread_count != 0)
+      REQUIRE(execution_set_thread_count(&exe, thread_count) ==
+              KIT_OK);
+
+    int ok = 1;
+    for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+      handle_t       self     = { .id = k, .generation = 0 };
+      laplace_time_t duration = 1 + (k * 37) % MAX_DURATION;
+      action_t action = ACTION_UNSAFE(test_exe_add_forever_, duration,
+                                      self);
+      ok = ok && (execution_queue(&exe, action) == KIT_OK);
+    }
+    REQUIRE(ok);
+
+    REQUIRE(execution_schedule_and_join(&exe, TICK_COUNT) == KIT_OK);
+
+    for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+      laplace_time_t duration = 1 + (k * 37) % MAX_DURATION;
+      ok = ok && state.get_integer(state.state, h, k, -1) ==
+                     (TICK_COUNT - 1) / duration + 1;
+    }
+    REQUIRE(ok);
+
+    execution_destroy(&exe);
+  }
+}
+
+STATIC_CORO(impact_list_t, test_exe_add_continue_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self; int step;) {
+  for (;;) {
+    handle_t h = { .id = 0, .generation = 0 };
+    if (++self->step % 5 != 0) {
+      DA_INIT(self->return_value, 2, self->alloc);
+      impact_t i[] = { INTEGER_ADD(h, self->self.id, 1),
+                       TICK_CONTINUE() };
+      self->return_value.values[0] = i[0];
+      self->return_value.values[1] = i[1];
+    } else {
+      DA_INIT(self->return_value, 1, self->alloc);
+      impact_t i[] = { INTEGER_ADD(h, self->self.id, 1) };
+      self->return_value.values[0] = i[0];
+    }
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+TEST("execution continuation reruns only continued actions") {
+  enum { TICK_COUNT = 10 };
+
+  for (ptrdiff_t thread_count = 0; thread_count <= 2;
+       thread_count += 2) {
+    kit_allocator_t alloc = kit_alloc_default();
+
+    pool_state_t_ pool_;
+    DA_INIT(pool_.threads, 0, alloc);
+    laplace_thread_pool_t pool = { .state   = &pool_,
+                                   .release = pool_release_,
+                                   .run     = pool_run_,
+                                   .join    = pool_join_ };
+
+    read_write_t state;
+    REQUIRE(state_init(&state, 0, alloc) == KIT_OK);
+
+    handle_t h = { .id = 0, .generation = -1 };
+    impact_t i = INTEGER_ALLOCATE_INTO(h, 2);
+    REQUIRE(state.apply(state.state, &i) == KIT_OK);
+    h.generation++;
+
+    execution_t exe;
+    REQUIRE(execution_init(&exe, state, pool, alloc) == KIT_OK);
+    if (thread_count != 0)
+      REQUIRE(execution_set_thread_count(&exe, thread_count) ==
+              KIT_OK);
+
+    handle_t a_self = { .id = 0, .generation = 0 };
+    handle_t b_self = { .id = 1, .generation = 0 };
+    action_t a = ACTION_UNSAFE(test_exe_add_continue_, 1, a_self);
+    action_t b = ACTION_UNSAFE(test_exe_add_forever_, 1, b_self);
+
+    REQUIRE(execution_queue(&exe, a) == KIT_OK);
+    REQUIRE(execution_queue(&exe, b) == KIT_OK);
+    REQUIRE(execution_schedule_and_join(&exe, TICK_COUNT) == KIT_OK);
+
+    REQUIRE(state.get_integer(state.state, h, 0, -1) ==
+            TICK_COUNT * 5);
+    REQUIRE(state.get_integer(state.state, h, 1, -1) == TICK_COUNT);
+
+    execution_destroy(&exe);
+  }
+}
@@ -0,0 +1,223 @@
+#include "../../laplace/impact.h"
+#include "../../laplace/merkle.h"
+#include "../../laplace/state.h"
+
+#define KIT_TEST_FILE merkle
+#include <kit_test/test.h>
+
+static void test_merkle_tick_(read_write_t *a) {
+  a->adjust_loop(a->state, 1);
+  a->adjust_done(a->state);
+}
+
+/*  Every stored node is the sum of its children.
+ */
+static int test_merkle_consistent_(read_write_t *a,
+                                   hash_node_t   node) {
+  hash_node_t children[HASH_FANOUT];
+  uint64_t    hashes[HASH_FANOUT];
+  uint64_t    parent[HASH_FANOUT];
+
+  ptrdiff_t const n = a->hash_children(a->state, node, children,
+                                       hashes);
+
+  for (ptrdiff_t i = 0; i < n; i++) {
+    ptrdiff_t const m = a->hash_children(a->state, children[i], NULL,
+                                         parent);
+    if (m == 0)
+      continue;
+    uint64_t sum = 0;
+    for (ptrdiff_t j = 0; j < m; j++) sum += parent[j];
+    if (sum != hashes[i] ||
+        !test_merkle_consistent_(a, children[i]))
+      return 0;
+  }
+
+  return 1;
+}
+
+static hash_node_t const test_merkle_top_ = { .tree  = HASH_TOP,
+                                              .level = 0,
+                                              .index = 0 };
+
+TEST("merkle same states") {
+  read_write_t a, b;
+  REQUIRE(state_init(&a, 1, kit_alloc_default()) == KIT_OK);
+  a.acquire(a.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, 5000);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+  test_merkle_tick_(&a);
+
+  REQUIRE(a.clone(a.state, &b) == KIT_OK);
+  b.acquire(b.state);
+
+  hash_node_t leaves[4];
+  REQUIRE(merkle_localize(&a, &b, 4, leaves) == 0);
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("merkle localize one cell") {
+  enum { SIZE = 300000, INDEX = 123457 };
+
+  read_write_t a, b;
+  REQUIRE(state_init(&a, 0, kit_alloc_default()) == KIT_OK);
+  a.acquire(a.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  handle_t h  = { .id = 0, .generation = 0 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, SIZE);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+
+  REQUIRE(a.clone(a.state, &b) == KIT_OK);
+  b.acquire(b.state);
+
+  impact_t j = INTEGER_SET(h, INDEX, 42);
+  REQUIRE(b.apply(b.state, &j) == KIT_OK);
+  test_merkle_tick_(&a);
+  test_merkle_tick_(&b);
+  REQUIRE(a.hash(a.state) != b.hash(b.state));
+
+  /*  Walk down as two peers would, one level per round.
+   */
+  hash_node_t node   = test_merkle_top_;
+  ptrdiff_t   rounds = 0;
+
+  for (;;) {
+    uint64_t    remote[HASH_FANOUT];
+    hash_node_t differ[HASH_FANOUT];
+
+    ptrdiff_t const n = b.hash_children(b.state, node, NULL, remote);
+    REQUIRE(merkle_compare(&a, node, n, remote, differ) == 1);
+    node = differ[0];
+    rounds++;
+
+    if (node.level == 0)
+      break;
+  }
+
+  REQUIRE(node.tree == HASH_INTEGERS);
+  REQUIRE(node.index == INDEX);
+  REQUIRE(rounds == 5);
+
+  hash_node_t leaves[4];
+  REQUIRE(merkle_localize(&a, &b, 4, leaves) == 1);
+  REQUIRE(leaves[0].tree == HASH_INTEGERS);
+  REQUIRE(leaves[0].index == INDEX);
+
+  REQUIRE(test_merkle_consistent_(&a, test_merkle_top_));
+  REQUIRE(test_merkle_consistent_(&b, test_merkle_top_));
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("merkle localize blocks and globals") {
+  read_write_t a, b;
+  REQUIRE(state_init(&a, 0, kit_alloc_default()) == KIT_OK);
+  a.acquire(a.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 2),
+                   BYTE_ALLOCATE_INTO(h0, 100) };
+  REQUIRE(a.apply(a.state, i) == KIT_OK);
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+
+  REQUIRE(a.clone(a.state, &b) == KIT_OK);
+  b.acquire(b.state);
+
+  impact_t j[] = { BYTE_SET(h, 70, 5), INTEGER_SEED(7) };
+  REQUIRE(b.apply(b.state, j) == KIT_OK);
+  REQUIRE(b.apply(b.state, j + 1) == KIT_OK);
+  test_merkle_tick_(&b);
+
+  hash_node_t leaves[4];
+  REQUIRE(merkle_localize(&a, &b, 4, leaves) == 2);
+  REQUIRE(leaves[0].tree == HASH_BYTES);
+  REQUIRE(leaves[0].index == 70);
+  REQUIRE(leaves[1].tree == HASH_GLOBALS);
+
+  REQUIRE(a.apply(a.state, j) == KIT_OK);
+  REQUIRE(a.apply(a.state, j + 1) == KIT_OK);
+  test_merkle_tick_(&a);
+  REQUIRE(merkle_localize(&a, &b, 4, leaves) == 0);
+
+  /*  Deallocation changes one block table entry.
+   */
+
+  impact_t l = INTEGER_DEALLOCATE(h);
+  REQUIRE(a.apply(a.state, &l) == KIT_OK);
+  REQUIRE(merkle_localize(&a, &b, 4, leaves) >= 1);
+  REQUIRE(leaves[0].tree == HASH_INTEGER_BLOCKS);
+  REQUIRE(leaves[0].index == 0);
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("merkle tree after growth") {
+  read_write_t a;
+  REQUIRE(state_init(&a, 0, kit_alloc_default()) == KIT_OK);
+  a.acquire(a.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  handle_t h  = { .id = 0, .generation = 0 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, 100);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+
+  impact_t j = INTEGER_SET(h, 99, -3);
+  REQUIRE(a.apply(a.state, &j) == KIT_OK);
+  test_merkle_tick_(&a);
+
+  /*  Growth moves the upper levels of the tree.
+   */
+  for (ptrdiff_t k = 0; k < 50; k++) {
+    impact_t l = INTEGER_ALLOCATE(5000, h, 0);
+    REQUIRE(a.apply(a.state, &l) == KIT_OK);
+    test_merkle_tick_(&a);
+    handle_t block = { .id         = a.get_integer(a.state, h, 0, -1),
+                       .generation = a.get_integer(a.state, h, 1,
+                                                   -1) };
+    impact_t m     = INTEGER_SET(block, k * 7, k);
+    REQUIRE(a.apply(a.state, &m) == KIT_OK);
+    test_merkle_tick_(&a);
+  }
+
+  REQUIRE(test_merkle_consistent_(&a, test_merkle_top_));
+
+  a.release(a.state);
+}
+
+TEST("merkle tree after small growths across levels") {
+  read_write_t a;
+  REQUIRE(state_init(&a, 0, kit_alloc_default()) == KIT_OK);
+  a.acquire(a.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  handle_t h  = { .id = 0, .generation = 0 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, 2);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+
+  /*  Stored levels are added at the top as the buffer passes 64^2
+   *  and 64^3 cells.
+   */
+  for (ptrdiff_t k = 0; k < 300; k++) {
+    impact_t l = INTEGER_ALLOCATE(1000 + k % 7, h, 0);
+    REQUIRE(a.apply(a.state, &l) == KIT_OK);
+    handle_t block = { .id         = a.get_integer(a.state, h, 0, -1),
+                       .generation = a.get_integer(a.state, h, 1,
+                                                   -1) };
+    impact_t m     = INTEGER_SET(block, k % 1000, k + 1);
+    REQUIRE(a.apply(a.state, &m) == KIT_OK);
+    test_merkle_tick_(&a);
+  }
+
+  REQUIRE(test_merkle_consistent_(&a, test_merkle_top_));
+
+  a.release(a.state);
+}
@@ -0,0 +1,286 @@
+#include "../../laplace/pool.h"
+#include "../../laplace/state.h"
+
+#define KIT_TEST_FILE pool
+#include <kit_test/test.h>
+
+TEST("pool init and destroy") {
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 4, kit_alloc_default()) == KIT_OK);
+  REQUIRE(pool.worker_count == 4);
+  pool_destroy(&pool);
+}
+
+TEST("pool init with zero workers") {
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 0, kit_alloc_default()) ==
+          ERROR_INVALID_SIZE);
+}
+
+static void test_pool_add_(void *data) {
+  atomic_fetch_add_explicit((ATOMIC(ptrdiff_t) *) data, 1,
+                            memory_order_relaxed);
+}
+
+TEST("pool submit and wait") {
+  enum { TASK_COUNT = 10000 };
+
+  ATOMIC(ptrdiff_t) count;
+  atomic_store_explicit(&count, 0, memory_order_relaxed);
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 4, kit_alloc_default()) == KIT_OK);
+
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < TASK_COUNT; i++)
+    ok = ok && pool_submit(&pool, test_pool_add_, &count) == KIT_OK;
+  REQUIRE(ok);
+
+  REQUIRE(pool_wait(&pool) == KIT_OK);
+  REQUIRE(atomic_load_explicit(&count, memory_order_acquire) ==
+          TASK_COUNT);
+
+  pool_destroy(&pool);
+}
+
+typedef struct {
+  pool_t           *pool;
+  ATOMIC(ptrdiff_t) count;
+} test_pool_nested_t_;
+
+static void test_pool_spawn_(void *data) {
+  test_pool_nested_t_ *const n = (test_pool_nested_t_ *) data;
+
+  /*  Tasks submitted from a worker go to its own deque, and other
+   *  workers have to steal them.
+   */
+  for (ptrdiff_t i = 0; i < 100; i++)
+    (void) pool_submit(n->pool, test_pool_add_, &n->count);
+}
+
+TEST("pool nested submit") {
+  test_pool_nested_t_ n;
+  atomic_store_explicit(&n.count, 0, memory_order_relaxed);
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 4, kit_alloc_default()) == KIT_OK);
+  n.pool = &pool;
+
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < 10; i++)
+    ok = ok && pool_submit(&pool, test_pool_spawn_, &n) == KIT_OK;
+  REQUIRE(ok);
+
+  REQUIRE(pool_wait(&pool) == KIT_OK);
+  REQUIRE(atomic_load_explicit(&n.count, memory_order_acquire) ==
+          1000);
+
+  pool_destroy(&pool);
+}
+
+typedef struct {
+  pool_t   *pool;
+  ptrdiff_t worker;
+} test_pool_where_t_;
+
+static void test_pool_where_(void *data) {
+  test_pool_where_t_ *const w = (test_pool_where_t_ *) data;
+  w->worker = pool_current_worker(w->pool);
+}
+
+TEST("pool submit to worker") {
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 4, kit_alloc_default()) == KIT_OK);
+  REQUIRE(pool_current_worker(&pool) == -1);
+
+  test_pool_where_t_ w[8];
+
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < 8; i++) {
+    w[i].pool   = &pool;
+    w[i].worker = -1;
+    ok = ok && pool_submit_to(&pool, i % 4, test_pool_where_,
+                              w + i) == KIT_OK;
+  }
+  REQUIRE(ok);
+  REQUIRE(pool_wait(&pool) == KIT_OK);
+
+  for (ptrdiff_t i = 0; i < 8; i++)
+    REQUIRE(w[i].worker == i % 4);
+
+  REQUIRE(pool_submit_to(&pool, 4, test_pool_where_, w) ==
+          ERROR_INVALID_INDEX);
+
+  pool_destroy(&pool);
+}
+
+TEST("pool init pinned") {
+  int const unpinned[] = { -1, -1 };
+  int const invalid[]  = { -1, 1 << 20 };
+
+  pool_t pool;
+  REQUIRE(pool_init_pinned(&pool, 2, unpinned, kit_alloc_default()) ==
+          KIT_OK);
+  pool_destroy(&pool);
+
+  REQUIRE(pool_init_pinned(&pool, 2, invalid, kit_alloc_default()) ==
+          ERROR_BAD_AFFINITY);
+}
+
+STATIC_CORO(impact_list_t, test_pool_add_one_, kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  DA_INIT(self->return_value, 1, self->alloc);
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ADD(h, self->self.id, 1) };
+
+  self->return_value.values[0] = i[0];
+  AF_RETURN_VOID;
+}
+CORO_END
+
+TEST("pool execution many actions") {
+  enum { ACTION_COUNT = 2000, CELL_COUNT = 3 };
+
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 4, alloc) == KIT_OK);
+
+  read_write_t state;
+  REQUIRE(state_init(&state, 0, alloc) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = -1 };
+  impact_t i = INTEGER_ALLOCATE_INTO(h, CELL_COUNT);
+  REQUIRE(state.apply(state.state, &i) == KIT_OK);
+  h.generation++;
+
+  execution_t exe;
+  REQUIRE(execution_init(&exe, state, pool_thread_pool(&pool),
+                         alloc) == KIT_OK);
+  REQUIRE(execution_set_thread_count(&exe, 4) == KIT_OK);
+
+  int ok = 1;
+  for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+    handle_t self   = { .id = k % CELL_COUNT, .generation = 0 };
+    action_t action = ACTION_UNSAFE(test_pool_add_one_, 1, self);
+    ok = ok && (execution_queue(&exe, action) == KIT_OK);
+  }
+  REQUIRE(ok);
+
+  REQUIRE(execution_schedule_and_join(&exe, 1) == KIT_OK);
+
+  for (ptrdiff_t k = 0; k < CELL_COUNT; k++)
+    REQUIRE(state.get_integer(state.state, h, k, -1) ==
+            (ACTION_COUNT + CELL_COUNT - 1 - k) / CELL_COUNT);
+
+  REQUIRE(execution_set_thread_count(&exe, 2) == KIT_OK);
+  action_t action = ACTION_UNSAFE(test_pool_add_one_, 1, h);
+  REQUIRE(execution_queue(&exe, action) == KIT_OK);
+  REQUIRE(execution_schedule_and_join(&exe, 1) == KIT_OK);
+  REQUIRE(state.get_integer(state.state, h, 0, -1) ==
+          (ACTION_COUNT + CELL_COUNT - 1) / CELL_COUNT + 1);
+
+  execution_destroy(&exe);
+  pool_destroy(&pool);
+}
+
+STATIC_CORO(impact_list_t, test_pool_add_each_tick_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  for (;;) {
+    DA_INIT(self->return_value, 1, self->alloc);
+    handle_t h   = { .id = 0, .generation = 0 };
+    impact_t i[] = { INTEGER_ADD(h, self->self.id, 1) };
+
+    self->return_value.values[0] = i[0];
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+TEST("pool execution with more threads than workers") {
+  enum { ACTION_COUNT = 500, CELL_COUNT = 3, TICK_COUNT = 3 };
+
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 2, alloc) == KIT_OK);
+
+  read_write_t state;
+  REQUIRE(state_init(&state, 0, alloc) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = -1 };
+  impact_t i = INTEGER_ALLOCATE_INTO(h, CELL_COUNT);
+  REQUIRE(state.apply(state.state, &i) == KIT_OK);
+  h.generation++;
+
+  execution_t exe;
+  REQUIRE(execution_init(&exe, state, pool_thread_pool(&pool),
+                         alloc) == KIT_OK);
+  REQUIRE(execution_set_thread_count(&exe, 8) == KIT_OK);
+
+  int ok = 1;
+  for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+    handle_t self   = { .id = k % CELL_COUNT, .generation = 0 };
+    action_t action = ACTION_UNSAFE(test_pool_add_each_tick_, 1,
+                                    self);
+    ok = ok && (execution_queue(&exe, action) == KIT_OK);
+  }
+  REQUIRE(ok);
+
+  REQUIRE(execution_schedule_and_join(&exe, TICK_COUNT) == KIT_OK);
+
+  for (ptrdiff_t k = 0; k < CELL_COUNT; k++)
+    REQUIRE(state.get_integer(state.state, h, k, -1) ==
+            TICK_COUNT *
+                ((ACTION_COUNT + CELL_COUNT - 1 - k) / CELL_COUNT));
+
+  execution_destroy(&exe);
+  pool_destroy(&pool);
+}
+
+TEST("pool executions share workers") {
+  enum { ACTION_COUNT = 300, EXECUTION_COUNT = 3 };
+
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 2, alloc) == KIT_OK);
+
+  read_write_t state[EXECUTION_COUNT];
+  execution_t  exe[EXECUTION_COUNT];
+  handle_t     h = { .id = 0, .generation = 0 };
+
+  int ok = 1;
+  for (ptrdiff_t n = 0; n < EXECUTION_COUNT; n++) {
+    REQUIRE(state_init(state + n, 0, alloc) == KIT_OK);
+    handle_t h0 = { .id = 0, .generation = -1 };
+    impact_t i  = INTEGER_ALLOCATE_INTO(h0, 1);
+    REQUIRE(state[n].apply(state[n].state, &i) == KIT_OK);
+
+    REQUIRE(execution_init(exe + n, state[n],
+                           pool_thread_pool(&pool),
+                           alloc) == KIT_OK);
+    REQUIRE(execution_set_thread_count(exe + n, 2) == KIT_OK);
+
+    for (ptrdiff_t k = 0; k < ACTION_COUNT; k++) {
+      action_t action = ACTION_UNSAFE(test_pool_add_each_tick_, 1,
+                                      h);
+      ok = ok && (execution_queue(exe + n, action) == KIT_OK);
+    }
+  }
+  REQUIRE(ok);
+
+  for (ptrdiff_t n = 0; n < EXECUTION_COUNT; n++)
+    REQUIRE(execution_schedule(exe + n, n + 1) == KIT_OK);
+
+  for (ptrdiff_t n = 0; n < EXECUTION_COUNT; n++) {
+    execution_join(exe + n);
+    REQUIRE(exe[n].status == KIT_OK);
+    REQUIRE(state[n].get_integer(state[n].state, h, 0, -1) ==
+            (n + 1) * ACTION_COUNT);
+    execution_destroy(exe + n);
+  }
+
+  pool_destroy(&pool);
+}
@@ -0,0 +1,210 @@
+#include "../../laplace/scheduler.h"
+#include "../../laplace/state.h"
+
+#define KIT_TEST_FILE scheduler
+#include <kit_test/test.h>
+
+STATIC_CORO(impact_list_t, test_scheduler_add_, kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  for (;;) {
+    DA_INIT(self->return_value, 1, self->alloc);
+    handle_t h   = { .id = 0, .generation = 0 };
+    impact_t i[] = { INTEGER_ADD(h, 0, 1) };
+
+    self->return_value.values[0] = i[0];
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+static kit_status_t test_scheduler_match_(execution_t    *exe,
+                                          read_write_t   *state,
+                                          kit_allocator_t alloc) {
+  kit_status_t s = state_init(state, 0, alloc);
+  if (s != KIT_OK)
+    return s;
+
+  handle_t h = { .id = 0, .generation = -1 };
+  impact_t i = INTEGER_ALLOCATE_INTO(h, 1);
+  s          = state->apply(state->state, &i);
+  if (s != KIT_OK)
+    return s;
+
+  laplace_thread_pool_t pool;
+  memset(&pool, 0, sizeof pool);
+
+  s = execution_init(exe, *state, pool, alloc);
+  if (s != KIT_OK)
+    return s;
+
+  action_t action = ACTION_UNSAFE(test_scheduler_add_, 1,
+                                  HANDLE_NULL);
+  return execution_queue(exe, action);
+}
+
+TEST("scheduler many matches") {
+  enum { MATCH_COUNT = 50, TICK_COUNT = 20 };
+
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 4, alloc) == KIT_OK);
+
+  scheduler_t scheduler;
+  REQUIRE(scheduler_init(&scheduler, &pool, alloc) == KIT_OK);
+
+  execution_t  exe[MATCH_COUNT];
+  read_write_t state[MATCH_COUNT];
+
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < MATCH_COUNT; i++) {
+    ok = ok &&
+         test_scheduler_match_(exe + i, state + i, alloc) == KIT_OK;
+    ptrdiff_t const match = scheduler_add(&scheduler, exe + i,
+                                          1 + i % 3);
+    ok = ok && match == i;
+    ok = ok && scheduler_queue(&scheduler, match, TICK_COUNT) ==
+                   KIT_OK;
+  }
+  REQUIRE(ok);
+
+  REQUIRE(scheduler_run(&scheduler) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  for (ptrdiff_t i = 0; i < MATCH_COUNT; i++)
+    ok = ok && state[i].get_integer(state[i].state, h, 0, -1) ==
+                   TICK_COUNT;
+  REQUIRE(ok);
+
+  for (ptrdiff_t i = 0; i < MATCH_COUNT; i++)
+    execution_destroy(exe + i);
+  scheduler_destroy(&scheduler);
+  pool_destroy(&pool);
+}
+
+static ptrdiff_t test_scheduler_log_[16];
+static ptrdiff_t test_scheduler_log_size_ = 0;
+
+STATIC_CORO(impact_list_t, test_scheduler_log_match_,
+            kit_allocator_t alloc;
+            read_only_t access; handle_t self;) {
+  for (;;) {
+    if (test_scheduler_log_size_ < 16)
+      test_scheduler_log_[test_scheduler_log_size_++] = self->self.id;
+    AF_YIELD_VOID;
+  }
+}
+CORO_END
+
+TEST("scheduler earliest deadline first") {
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 1, alloc) == KIT_OK);
+
+  scheduler_t scheduler;
+  REQUIRE(scheduler_init(&scheduler, &pool, alloc) == KIT_OK);
+
+  execution_t  exe[2];
+  read_write_t state[2];
+
+  for (ptrdiff_t i = 0; i < 2; i++) {
+    REQUIRE(test_scheduler_match_(exe + i, state + i, alloc) ==
+            KIT_OK);
+    handle_t self   = { .id = i, .generation = 0 };
+    action_t action = ACTION_UNSAFE(test_scheduler_log_match_, 1,
+                                    self);
+    REQUIRE(execution_queue(exe + i, action) == KIT_OK);
+  }
+
+  /*  The first match ticks twice as often.
+   */
+  REQUIRE(scheduler_add(&scheduler, exe, 1) == 0);
+  REQUIRE(scheduler_add(&scheduler, exe + 1, 2) == 1);
+  REQUIRE(scheduler_queue(&scheduler, 0, 4) == KIT_OK);
+  REQUIRE(scheduler_queue(&scheduler, 1, 2) == KIT_OK);
+
+  test_scheduler_log_size_ = 0;
+  REQUIRE(scheduler_run(&scheduler) == KIT_OK);
+
+  ptrdiff_t const expected[] = { 0, 0, 1, 0, 0, 1 };
+  REQUIRE(test_scheduler_log_size_ == 6);
+  for (ptrdiff_t i = 0; i < 6; i++)
+    REQUIRE(test_scheduler_log_[i] == expected[i]);
+
+  for (ptrdiff_t i = 0; i < 2; i++)
+    execution_destroy(exe + i);
+  scheduler_destroy(&scheduler);
+  pool_destroy(&pool);
+}
+
+TEST("scheduler remove match") {
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool;
+  REQUIRE(pool_init(&pool, 2, alloc) == KIT_OK);
+
+  scheduler_t scheduler;
+  REQUIRE(scheduler_init(&scheduler, &pool, alloc) == KIT_OK);
+
+  execution_t  exe[2];
+  read_write_t state[2];
+
+  for (ptrdiff_t i = 0; i < 2; i++) {
+    REQUIRE(test_scheduler_match_(exe + i, state + i, alloc) ==
+            KIT_OK);
+    REQUIRE(scheduler_add(&scheduler, exe + i, 1) == i);
+    REQUIRE(scheduler_queue(&scheduler, i, 3) == KIT_OK);
+  }
+
+  scheduler_remove(&scheduler, 0);
+  REQUIRE(scheduler_queue(&scheduler, 0, 1) == ERROR_INVALID_INDEX);
+  REQUIRE(scheduler_run(&scheduler) == KIT_OK);
+
+  handle_t h = { .id = 0, .generation = 0 };
+  REQUIRE(state[0].get_integer(state[0].state, h, 0, -1) == 0);
+  REQUIRE(state[1].get_integer(state[1].state, h, 0, -1) == 3);
+
+  REQUIRE(scheduler_add(&scheduler, exe, 1) == 0);
+
+  for (ptrdiff_t i = 0; i < 2; i++)
+    execution_destroy(exe + i);
+  scheduler_destroy(&scheduler);
+  pool_destroy(&pool);
+}
+
+TEST("scheduler rejects executions that use threads") {
+  kit_allocator_t alloc = kit_alloc_default();
+
+  pool_t pool, other;
+  REQUIRE(pool_init(&pool, 1, alloc) == KIT_OK);
+  REQUIRE(pool_init(&other, 2, alloc) == KIT_OK);
+
+  scheduler_t scheduler;
+  REQUIRE(scheduler_init(&scheduler, &pool, alloc) == KIT_OK);
+
+  read_write_t state[2];
+  execution_t  exe[2];
+
+  REQUIRE(state_init(state, 0, alloc) == KIT_OK);
+  REQUIRE(state_init(state + 1, 0, alloc) == KIT_OK);
+  REQUIRE(execution_init(exe, state[0], pool_thread_pool(&pool),
+                         alloc) == KIT_OK);
+  REQUIRE(execution_init(exe + 1, state[1], pool_thread_pool(&other),
+                         alloc) == KIT_OK);
+
+  /*  Ticks of these executions need more than the worker that runs
+   *  them.
+   */
+  REQUIRE(scheduler_add(&scheduler, exe, 1) == -1);
+  REQUIRE(execution_set_thread_count(exe + 1, 2) == KIT_OK);
+  REQUIRE(scheduler_add(&scheduler, exe + 1, 1) == -1);
+  REQUIRE(execution_set_thread_count(exe + 1, 0) == KIT_OK);
+  REQUIRE(scheduler_add(&scheduler, exe + 1, 1) == 0);
+
+  for (ptrdiff_t i = 0; i < 2; i++)
+    execution_destroy(exe + i);
+  scheduler_destroy(&scheduler);
+  pool_destroy(&other);
+  pool_destroy(&pool);
+}
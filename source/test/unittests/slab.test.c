@@ -0,0 +1,98 @@
+#include "../../laplace/slab.h"
+#include <string.h>
+
+#define KIT_TEST_FILE slab
+#include <kit_test/test.h>
+
+TEST("slab allocate frames of each class") {
+  slab_t slab;
+  slab_init(&slab, kit_alloc_default());
+
+  ptrdiff_t const a = slab_allocate(&slab, 1);
+  ptrdiff_t const b = slab_allocate(&slab, SLAB_GRANULARITY + 1);
+  ptrdiff_t const c = slab_allocate(&slab, COROUTINE_SIZE);
+
+  REQUIRE(a >= 0 && b >= 0 && c >= 0);
+  REQUIRE(slab_frame_size(&slab, a) == SLAB_GRANULARITY);
+  REQUIRE(slab_frame_size(&slab, b) == SLAB_GRANULARITY * 2);
+  REQUIRE(slab_frame_size(&slab, c) >= COROUTINE_SIZE);
+  REQUIRE(slab_frame(&slab, a) != slab_frame(&slab, b));
+
+  slab_destroy(&slab);
+}
+
+TEST("slab allocate invalid size") {
+  slab_t slab;
+  slab_init(&slab, kit_alloc_default());
+
+  REQUIRE(slab_allocate(&slab, 0) == -1);
+  REQUIRE(slab_allocate(&slab, -1) == -1);
+
+  slab_destroy(&slab);
+}
+
+TEST("slab allocate large frames") {
+  enum { LARGE_SIZE = SLAB_CLASS_COUNT * SLAB_GRANULARITY + 1 };
+
+  slab_t slab;
+  slab_init(&slab, kit_alloc_default());
+
+  ptrdiff_t const a = slab_allocate(&slab, LARGE_SIZE);
+  ptrdiff_t const b = slab_allocate(&slab, 10000);
+
+  REQUIRE(a >= 0 && b >= 0 && a != b);
+  REQUIRE(slab_frame_size(&slab, a) == LARGE_SIZE);
+  REQUIRE(slab_frame_size(&slab, b) == 10000);
+
+  memset(slab_frame(&slab, b), 1, 10000);
+  slab_deallocate(&slab, a);
+
+  ptrdiff_t const c = slab_allocate(&slab, 5000);
+  REQUIRE(c == a);
+  REQUIRE(slab_frame_size(&slab, c) == 5000);
+  REQUIRE(((char *) slab_frame(&slab, b))[9999] == 1);
+
+  slab_destroy(&slab);
+}
+
+TEST("slab frames do not move") {
+  enum { COUNT = SLAB_CHUNK_SIZE * 3 + 1 };
+
+  slab_t slab;
+  slab_init(&slab, kit_alloc_default());
+
+  ptrdiff_t frames[COUNT];
+  char     *pointers[COUNT];
+
+  for (ptrdiff_t i = 0; i < COUNT; i++) {
+    frames[i]   = slab_allocate(&slab, 100);
+    pointers[i] = (char *) slab_frame(&slab, frames[i]);
+    memset(pointers[i], (int) (i & 0x7f), 100);
+  }
+
+  int ok = 1;
+  for (ptrdiff_t i = 0; i < COUNT; i++)
+    ok = ok && slab_frame(&slab, frames[i]) == pointers[i] &&
+         pointers[i][99] == (char) (i & 0x7f);
+  REQUIRE(ok);
+
+  slab_destroy(&slab);
+}
+
+TEST("slab reuse deallocated frame") {
+  slab_t slab;
+  slab_init(&slab, kit_alloc_default());
+
+  ptrdiff_t const a = slab_allocate(&slab, 200);
+  ptrdiff_t const b = slab_allocate(&slab, 200);
+  void *const     p = slab_frame(&slab, a);
+
+  slab_deallocate(&slab, a);
+  ptrdiff_t const c = slab_allocate(&slab, 200);
+
+  REQUIRE(c == a);
+  REQUIRE(slab_frame(&slab, c) == p);
+  REQUIRE(c != b);
+
+  slab_destroy(&slab);
+}
@@ -2,6 +2,7 @@
 #include "../../laplace/impact.h"
 #include <kit/mersenne_twister_64.h>
 #include <kit/secure_random.h>
+#include <kit/thread.h>
 
 #define KIT_TEST_FILE state
 #include <kit_test/test.h>
@@ -101,7 +102,7 @@ TEST("state apply allocate int and get") {
   ret.generation++;
   impact_t j = INTEGER_ALLOCATE(1, ret, 0);
   REQUIRE(a.apply(a.state, &j) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   handle_t h = { .id         = a.get_integer(a.state, ret, 0, -1),
                  .generation = a.get_integer(a.state, ret, 1, -1) };
   REQUIRE(h.id != -1);
@@ -143,7 +144,7 @@ TEST("state apply reserve int and allocate") {
   REQUIRE(a.apply(a.state, &k) == KIT_OK);
   impact_t l = INTEGER_ALLOCATE(1, ret, 2);
   REQUIRE(a.apply(a.state, &l) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   REQUIRE(a.get_integer(a.state, ret, 0, -1) == reserved);
   REQUIRE(a.get_integer(a.state, ret, 1, -1) == 0);
   REQUIRE(a.get_integer(a.state, ret, 2, -1) == reserved + 1);
@@ -163,7 +164,7 @@ TEST("state apply allocate int, set and get") {
   ret.generation++;
   impact_t j = INTEGER_ALLOCATE(1, ret, 0);
   REQUIRE(a.apply(a.state, &j) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   a.adjust_done(a.state);
   handle_t h = { .id         = a.get_integer(a.state, ret, 0, -1),
                  .generation = a.get_integer(a.state, ret, 1, -1) };
@@ -171,7 +172,7 @@ TEST("state apply allocate int, set and get") {
   REQUIRE(h.generation == 0);
   impact_t k = INTEGER_SET(h, 0, 42);
   REQUIRE(a.apply(a.state, &k) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   REQUIRE(a.get_integer(a.state, h, 0, -1) == 42);
   a.release(a.state);
 }
@@ -204,7 +205,7 @@ TEST("state apply add int") {
   REQUIRE(a.apply(a.state, i) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 2) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   REQUIRE(a.get_integer(a.state, h, 0, -1) == 42);
   a.release(a.state);
 }
@@ -246,7 +247,7 @@ TEST("state apply allocate byte and get") {
                    BYTE_ALLOCATE(1, ret, 0) };
   REQUIRE(a.apply(a.state, i) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   handle_t h = { .id         = a.get_integer(a.state, ret, 0, -1),
                  .generation = a.get_integer(a.state, ret, 1, -1) };
   REQUIRE(h.id != -1);
@@ -268,7 +269,7 @@ TEST("state apply allocate byte, set and get") {
                    BYTE_ALLOCATE(1, ret, 0), BYTE_SET(h, 0, 42) };
   REQUIRE(a.apply(a.state, i) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   a.adjust_done(a.state);
   h.id         = a.get_integer(a.state, ret, 0, -1);
   h.generation = a.get_integer(a.state, ret, 1, -1);
@@ -276,7 +277,7 @@ TEST("state apply allocate byte, set and get") {
   REQUIRE(h.generation == 0);
   i[2].byte_set.handle = h;
   REQUIRE(a.apply(a.state, i + 2) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   REQUIRE(a.get_byte(a.state, h, 0, -1) == 42);
   a.release(a.state);
 }
@@ -312,7 +313,7 @@ TEST("state apply reserve byte and allocate") {
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 2) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 3) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   REQUIRE(a.get_integer(a.state, ret, 0, -1) == reserved);
   REQUIRE(a.get_integer(a.state, ret, 1, -1) == 0);
   REQUIRE(a.get_integer(a.state, ret, 2, -1) == reserved + 1);
@@ -347,7 +348,7 @@ TEST("state apply add byte") {
   REQUIRE(a.apply(a.state, i) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 2) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   REQUIRE(a.get_byte(a.state, h, 0, -1) == 42);
   a.release(a.state);
 }
@@ -365,7 +366,7 @@ TEST("state apply random") {
                    INTEGER_RANDOM(1, 100, h, 0, size) };
   REQUIRE(a.apply(a.state, i) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   int ok = 1;
   for (ptrdiff_t k = 0; k < size; k++)
     ok = ok && ((a.get_integer(a.state, h, k, -1) >= 1 &&
@@ -404,8 +405,8 @@ TEST("state random with equal seed") {
   REQUIRE(bar.apply(bar.state, i + 1) == KIT_OK);
   REQUIRE(foo.apply(foo.state, i + 2) == KIT_OK);
   REQUIRE(bar.apply(bar.state, i + 2) == KIT_OK);
-  foo.adjust_loop(foo.state);
-  bar.adjust_loop(bar.state);
+  foo.adjust_loop(foo.state, 1);
+  bar.adjust_loop(bar.state, 1);
   int ok = 1;
   for (ptrdiff_t k = 0; k < size; k++)
     ok = ok && foo.get_integer(foo.state, h, k, -1) ==
@@ -435,8 +436,8 @@ TEST("state random with different seed") {
   REQUIRE(bar.apply(bar.state, i + 2) == KIT_OK);
   REQUIRE(foo.apply(foo.state, i + 3) == KIT_OK);
   REQUIRE(bar.apply(bar.state, i + 3) == KIT_OK);
-  foo.adjust_loop(foo.state);
-  bar.adjust_loop(bar.state);
+  foo.adjust_loop(foo.state, 1);
+  bar.adjust_loop(bar.state, 1);
 
   ptrdiff_t different_count = 0;
   for (ptrdiff_t k = 0; k < size; k++)
@@ -472,7 +473,7 @@ TEST("state allocation determinism") {
   REQUIRE(a.apply(a.state, i + 2) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 3) == KIT_OK);
 
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   a.adjust_done(a.state);
 
   REQUIRE(a.get_integer(a.state, h, 0, -1) == 1);
@@ -489,7 +490,7 @@ TEST("state allocation determinism") {
   REQUIRE(a.apply(a.state, i + 4) == KIT_OK);
   REQUIRE(a.apply(a.state, i + 5) == KIT_OK);
 
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   a.adjust_done(a.state);
 
   REQUIRE(a.get_integer(a.state, h, 6, -1) == 1);
@@ -507,10 +508,679 @@ TEST("state allocation determinism") {
 
   REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
 
-  a.adjust_loop(a.state);
+  a.adjust_loop(a.state, 1);
   a.adjust_done(a.state);
 
   REQUIRE(a.get_integer(a.state, h, 0, -1) == 1);
   REQUIRE(a.get_integer(a.state, h, 1, -1) == 2);
   a.release(a.state);
 }
+
+enum { TEST_ADJUST_THREAD_COUNT = 4 };
+
+static int test_adjust_loop(void *p) {
+  read_write_t *a = (read_write_t *) p;
+  a->adjust_loop(a->state, TEST_ADJUST_THREAD_COUNT);
+  return 0;
+}
+
+TEST("state adjust with many threads") {
+  enum { INTS = 5000, BYTES = 3000 };
+
+  read_write_t a;
+  state_init(&a, 0, kit_alloc_default());
+  a.acquire(a.state);
+  handle_t ints  = { .id = 0, .generation = -1 };
+  handle_t bytes = { .id = 0, .generation = -1 };
+  impact_t i[]   = { INTEGER_ALLOCATE_INTO(ints, INTS),
+                     BYTE_ALLOCATE_INTO(bytes, BYTES) };
+  REQUIRE(a.apply(a.state, i) == KIT_OK);
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  ints.generation++;
+  bytes.generation++;
+  for (ptrdiff_t k = 0; k < INTS; k++) {
+    impact_t j = INTEGER_ADD(ints, k, k);
+    REQUIRE(a.apply(a.state, &j) == KIT_OK);
+  }
+  for (ptrdiff_t k = 0; k < BYTES; k++) {
+    impact_t j = BYTE_ADD(bytes, k, k % 100);
+    REQUIRE(a.apply(a.state, &j) == KIT_OK);
+  }
+  thrd_t pool[TEST_ADJUST_THREAD_COUNT];
+  for (int k = 0; k < TEST_ADJUST_THREAD_COUNT; k++)
+    thrd_create(pool + k, test_adjust_loop, &a);
+  for (int k = 0; k < TEST_ADJUST_THREAD_COUNT; k++)
+    thrd_join(pool[k], NULL);
+  a.adjust_done(a.state);
+  int ok = 1;
+  for (ptrdiff_t k = 0; k < INTS; k++)
+    ok = ok && a.get_integer(a.state, ints, k, -1) == k;
+  for (ptrdiff_t k = 0; k < BYTES; k++)
+    ok = ok && a.get_byte(a.state, bytes, k, -1) == k % 100;
+  REQUIRE(ok);
+  a.release(a.state);
+}
+
+static void test_state_tick(read_write_t *a) {
+  a->adjust_loop(a->state, 1);
+  a->adjust_done(a->state);
+}
+
+static int test_clear_loop(void *p) {
+  read_write_t *a = (read_write_t *) p;
+  a->clear_loop(a->state, TEST_ADJUST_THREAD_COUNT);
+  return 0;
+}
+
+TEST("state deferred clear equals apply") {
+  read_write_t a, b;
+  state_init(&a, 0, kit_alloc_default());
+  state_init(&b, 0, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  handle_t h1 = { .id = 1, .generation = -1 };
+  handle_t h2 = { .id = 2, .generation = -1 };
+  handle_t h3 = { .id = 3, .generation = -1 };
+  handle_t g0 = { .id = 0, .generation = 0 };
+  handle_t g1 = { .id = 1, .generation = 0 };
+  handle_t g2 = { .id = 2, .generation = 0 };
+  handle_t g3 = { .id = 3, .generation = 0 };
+  handle_t h4 = { .id = 4, .generation = -1 };
+  handle_t g4 = { .id = 4, .generation = 0 };
+
+  /*  Leave nonzero values in freed runs.
+   */
+  impact_t i[] = {
+    INTEGER_ALLOCATE_INTO(h0, 100), INTEGER_ALLOCATE_INTO(h1, 100),
+    INTEGER_ALLOCATE_INTO(h2, 100), BYTE_ALLOCATE_INTO(h0, 100),
+    BYTE_ALLOCATE_INTO(h1, 100)
+  };
+  for (int k = 0; k < 5; k++) {
+    REQUIRE(a.apply(a.state, i + k) == KIT_OK);
+    REQUIRE(b.apply(b.state, i + k) == KIT_OK);
+  }
+  for (ptrdiff_t k = 0; k < 100; k++) {
+    impact_t j[] = { INTEGER_ADD(g0, k, k + 1),
+                     INTEGER_ADD(g1, k, k + 2),
+                     BYTE_ADD(g0, k, k + 3) };
+    for (int n = 0; n < 3; n++) {
+      REQUIRE(a.apply(a.state, j + n) == KIT_OK);
+      REQUIRE(b.apply(b.state, j + n) == KIT_OK);
+    }
+  }
+  test_state_tick(&a);
+  test_state_tick(&b);
+
+  impact_t d[] = { INTEGER_DEALLOCATE(g0), INTEGER_DEALLOCATE(g1),
+                   BYTE_DEALLOCATE(g0) };
+  for (int n = 0; n < 3; n++) {
+    REQUIRE(a.apply(a.state, d + n) == KIT_OK);
+    REQUIRE(b.apply(b.state, d + n) == KIT_OK);
+  }
+  test_state_tick(&a);
+  test_state_tick(&b);
+
+  /*  New blocks reuse the freed runs, one of them is written and one
+   *  is deallocated before the clear pass.
+   */
+  handle_t u0  = { .id = 0, .generation = 1 };
+  handle_t u1  = { .id = 1, .generation = 1 };
+  impact_t s[] = {
+    INTEGER_ALLOCATE_INTO(h3, 150), INTEGER_SET(g3, 3, 7),
+    INTEGER_ALLOCATE_INTO(g0, 30),  INTEGER_DEALLOCATE(u0),
+    INTEGER_ALLOCATE_INTO(g1, 20),  INTEGER_ADD(u1, 1, 5),
+    BYTE_ALLOCATE_INTO(g0, 90),     BYTE_SET(u0, 2, 9),
+    BYTE_ALLOCATE_INTO(h2, 40),     INTEGER_ALLOCATE_INTO(h4, 25)
+  };
+  for (int n = 0; n < 10; n++) {
+    REQUIRE(a.apply(a.state, s + n) == KIT_OK);
+    REQUIRE(b.apply_deferred(b.state, s + n) == KIT_OK);
+  }
+
+  thrd_t pool[TEST_ADJUST_THREAD_COUNT];
+  for (int k = 0; k < TEST_ADJUST_THREAD_COUNT; k++)
+    thrd_create(pool + k, test_clear_loop, &b);
+  for (int k = 0; k < TEST_ADJUST_THREAD_COUNT; k++)
+    thrd_join(pool[k], NULL);
+  b.clear_done(b.state);
+
+  test_state_tick(&a);
+  test_state_tick(&b);
+
+  int ok = 1;
+  for (ptrdiff_t k = 0; k < 150; k++)
+    ok = ok && a.get_integer(a.state, g3, k, -1) == (k == 3 ? 7 : 0);
+  for (ptrdiff_t k = 0; k < 20; k++)
+    ok = ok && a.get_integer(a.state, u1, k, -1) == (k == 1 ? 5 : 0);
+  for (ptrdiff_t k = 0; k < 90; k++)
+    ok = ok && a.get_byte(a.state, u0, k, -1) == (k == 2 ? 9 : 0);
+  for (ptrdiff_t k = 0; k < 40; k++)
+    ok = ok && a.get_byte(a.state, g2, k, -1) == 0;
+  for (ptrdiff_t k = 0; k < 25; k++)
+    ok = ok && a.get_integer(a.state, g4, k, -1) == 0;
+  REQUIRE(ok);
+
+  for (ptrdiff_t k = 0; k < 150; k++)
+    ok = ok && a.get_integer(a.state, g3, k, -1) ==
+                   b.get_integer(b.state, g3, k, -1);
+  for (ptrdiff_t k = 0; k < 20; k++)
+    ok = ok && a.get_integer(a.state, u1, k, -1) ==
+                   b.get_integer(b.state, u1, k, -1);
+  for (ptrdiff_t k = 0; k < 25; k++)
+    ok = ok && a.get_integer(a.state, g4, k, -1) ==
+                   b.get_integer(b.state, g4, k, -1);
+  for (ptrdiff_t k = 0; k < 90; k++)
+    ok = ok && a.get_byte(a.state, u0, k, -1) ==
+                   b.get_byte(b.state, u0, k, -1);
+  REQUIRE(ok);
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("state hash depends on values only") {
+  read_write_t a, b;
+  state_init(&a, 0, kit_alloc_default());
+  state_init(&b, 0, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 100),
+                   BYTE_ALLOCATE_INTO(h0, 100) };
+  REQUIRE(a.apply(a.state, i) == KIT_OK);
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  REQUIRE(b.apply(b.state, i) == KIT_OK);
+  REQUIRE(b.apply(b.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+  test_state_tick(&b);
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  /*  Same values reached in a different number of ticks, with byte
+   *  wraparound.
+   */
+  for (int n = 0; n < 3; n++) {
+    impact_t j[] = { INTEGER_ADD(h, 7, 1), BYTE_ADD(h, 9, 43) };
+    REQUIRE(a.apply(a.state, j) == KIT_OK);
+    REQUIRE(a.apply(a.state, j + 1) == KIT_OK);
+    test_state_tick(&a);
+  }
+
+  impact_t k[] = { INTEGER_SET(h, 7, 3), BYTE_SET(h, 9, -127) };
+  REQUIRE(b.apply(b.state, k) == KIT_OK);
+  REQUIRE(b.apply(b.state, k + 1) == KIT_OK);
+  REQUIRE(a.hash(a.state) != b.hash(b.state));
+  test_state_tick(&b);
+
+  REQUIRE(a.get_byte(a.state, h, 9, 0) == -127);
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  impact_t l = INTEGER_ADD(h, 8, 1);
+  REQUIRE(a.apply(a.state, &l) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.hash(a.state) != b.hash(b.state));
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("state hash of full flag words") {
+  read_write_t a, b;
+  state_init(&a, 0, kit_alloc_default());
+  state_init(&b, 0, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 256),
+                   BYTE_ALLOCATE_INTO(h0, 256) };
+  for (ptrdiff_t k = 0; k < 2; k++) {
+    REQUIRE(a.apply(a.state, i + k) == KIT_OK);
+    REQUIRE(b.apply(b.state, i + k) == KIT_OK);
+  }
+
+  /*  All cells change in one tick in the first state, and in two
+   *  ticks with partial flag words in the second one. Bytes wrap
+   *  around on the second pass.
+   */
+  int ok = 1;
+  for (int pass = 0; pass < 2; pass++) {
+    for (ptrdiff_t k = 0; k < 256; k++) {
+      impact_t j[] = { INTEGER_ADD(h, k, k * 3 - 100),
+                       BYTE_ADD(h, k, k % 200 - 100) };
+      ok = ok && a.apply(a.state, j) == KIT_OK &&
+           a.apply(a.state, j + 1) == KIT_OK;
+    }
+    for (ptrdiff_t k = 0; k < 256; k += 2) {
+      impact_t j[] = { INTEGER_ADD(h, k, k * 3 - 100),
+                       BYTE_ADD(h, k, k % 200 - 100) };
+      ok = ok && b.apply(b.state, j) == KIT_OK &&
+           b.apply(b.state, j + 1) == KIT_OK;
+    }
+    test_state_tick(&a);
+    test_state_tick(&b);
+    for (ptrdiff_t k = 1; k < 256; k += 2) {
+      impact_t j[] = { INTEGER_ADD(h, k, k * 3 - 100),
+                       BYTE_ADD(h, k, k % 200 - 100) };
+      ok = ok && b.apply(b.state, j) == KIT_OK &&
+           b.apply(b.state, j + 1) == KIT_OK;
+    }
+    test_state_tick(&b);
+  }
+  REQUIRE(ok);
+
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("state hash of allocations") {
+  read_write_t a, b;
+  state_init(&a, 0, kit_alloc_default());
+  state_init(&b, 0, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 4),
+                   INTEGER_ALLOCATE(10, h, 0) };
+  REQUIRE(a.apply(a.state, i) == KIT_OK);
+  REQUIRE(b.apply(b.state, i) == KIT_OK);
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.hash(a.state) != b.hash(b.state));
+
+  handle_t block = { .id         = a.get_integer(a.state, h, 0, -1),
+                     .generation = a.get_integer(a.state, h, 1, -1) };
+  impact_t j      = INTEGER_SET(block, 3, 42);
+  REQUIRE(a.apply(a.state, &j) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.get_integer(a.state, block, 3, -1) == 42);
+
+  read_write_t c;
+  REQUIRE(a.clone(a.state, &c) == KIT_OK);
+  c.acquire(c.state);
+  REQUIRE(a.hash(a.state) == c.hash(c.state));
+
+  /*  Deallocated blocks keep their generation, so the state does not
+   *  return to the initial hash.
+   */
+  impact_t k = INTEGER_DEALLOCATE(block);
+  REQUIRE(a.apply(a.state, &k) == KIT_OK);
+  REQUIRE(a.hash(a.state) != c.hash(c.state));
+
+  a.release(a.state);
+  b.release(b.state);
+  c.release(c.state);
+}
+
+TEST("state hash of random generator") {
+  read_write_t a, b;
+  state_init(&a, 1, kit_alloc_default());
+  state_init(&b, 1, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  impact_t i = INTEGER_SEED(2);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+  REQUIRE(a.hash(a.state) != b.hash(b.state));
+
+  a.release(a.state);
+  b.release(b.state);
+}
+
+TEST("state clone and assign keep random generator") {
+  read_write_t a, b, c;
+  state_init(&a, 1, kit_alloc_default());
+  state_init(&b, 7, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 10),
+                   INTEGER_RANDOM(0, 1000000, h, 0, 10) };
+  REQUIRE(a.apply(a.state, i) == KIT_OK);
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+
+  REQUIRE(a.clone(a.state, &c) == KIT_OK);
+  c.acquire(c.state);
+  REQUIRE(b.assign(b.state, a.state) == KIT_OK);
+  REQUIRE(a.hash(a.state) == c.hash(c.state));
+  REQUIRE(a.hash(a.state) == b.hash(b.state));
+
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  REQUIRE(b.apply(b.state, i + 1) == KIT_OK);
+  REQUIRE(c.apply(c.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+  test_state_tick(&b);
+  test_state_tick(&c);
+
+  int ok = 1;
+  for (ptrdiff_t k = 0; k < 10; k++) {
+    int64_t const x = a.get_integer(a.state, h, k, -1);
+    ok = ok && b.get_integer(b.state, h, k, -1) == x;
+    ok = ok && c.get_integer(c.state, h, k, -1) == x;
+  }
+  REQUIRE(ok);
+
+  a.release(a.state);
+  b.release(b.state);
+  c.release(c.state);
+}
+
+TEST("state snapshot and restore") {
+  read_write_t a;
+  state_init(&a, 1, kit_alloc_default());
+  a.acquire(a.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 10),
+                   INTEGER_RANDOM(0, 1000000, h, 0, 10) };
+  REQUIRE(a.apply(a.state, i) == KIT_OK);
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+
+  void *first = NULL, *second = NULL;
+  REQUIRE(a.snapshot(a.state, &first, NULL) == KIT_OK);
+  uint64_t const hash = a.hash(a.state);
+
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.snapshot(a.state, &second, first) == KIT_OK);
+  int64_t const x = a.get_integer(a.state, h, 0, -1);
+  REQUIRE(a.hash(a.state) != hash);
+
+  REQUIRE(a.restore(a.state, first) == KIT_OK);
+  REQUIRE(a.hash(a.state) == hash);
+
+  /*  The random generator is restored too.
+   */
+  REQUIRE(a.apply(a.state, i + 1) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.get_integer(a.state, h, 0, -1) == x);
+
+  a.snapshot_destroy(first);
+  a.snapshot_destroy(second);
+  a.release(a.state);
+}
+
+typedef DA(char) test_state_data_t_;
+
+static kit_status_t test_state_write_(void *user_data,
+                                      void const *data,
+                                      ptrdiff_t   size) {
+  test_state_data_t_ *const out = (test_state_data_t_ *) user_data;
+  ptrdiff_t const           n   = out->size;
+  DA_RESIZE(*out, n + size);
+  if (out->size != n + size)
+    return ERROR_BAD_ALLOC;
+  memcpy(out->values + n, data, size);
+  return KIT_OK;
+}
+
+TEST("state save and load") {
+  read_write_t a, b;
+  state_init(&a, 1, kit_alloc_default());
+  a.acquire(a.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, 10),
+                   BYTE_ALLOCATE_INTO(h0, 10),
+                   INTEGER_RANDOM(0, 1000000, h, 2, 8),
+                   INTEGER_ALLOCATE(3, h, 0),
+                   BYTE_SET(h, 4, 42) };
+  for (ptrdiff_t k = 0; k < 5; k++)
+    REQUIRE(a.apply(a.state, i + k) == KIT_OK);
+  test_state_tick(&a);
+
+  test_state_data_t_ data;
+  DA_INIT(data, 0, kit_alloc_default());
+  REQUIRE(state_save(&a, test_state_write_, &data) == KIT_OK);
+
+  REQUIRE(state_load(&b, data.values, data.size,
+                     kit_alloc_default()) == KIT_OK);
+  b.acquire(b.state);
+
+  REQUIRE(b.hash(b.state) == a.hash(a.state));
+  for (ptrdiff_t k = 0; k < 10; k++)
+    REQUIRE(b.get_integer(b.state, h, k, -1) ==
+            a.get_integer(a.state, h, k, -1));
+  REQUIRE(b.get_byte(b.state, h, 4, -1) == 42);
+
+  /*  Same impacts give the same state, including the random
+   *  generator and allocation of new blocks that grow the arrays.
+   */
+  handle_t p = { .id = a.get_integer(a.state, h, 0, -1),
+                 .generation = a.get_integer(a.state, h, 1, -1) };
+  impact_t j[] = { INTEGER_DEALLOCATE(p),
+                   INTEGER_RANDOM(0, 1000000, h, 2, 2),
+                   INTEGER_ALLOCATE(1000, h, 4) };
+  for (ptrdiff_t k = 0; k < 3; k++) {
+    REQUIRE(a.apply(a.state, j + k) == KIT_OK);
+    REQUIRE(b.apply(b.state, j + k) == KIT_OK);
+  }
+  test_state_tick(&a);
+  test_state_tick(&b);
+
+  REQUIRE(b.hash(b.state) == a.hash(a.state));
+  REQUIRE(b.get_integer(b.state, h, 2, -1) ==
+          a.get_integer(a.state, h, 2, -1));
+
+  a.release(a.state);
+  b.release(b.state);
+  DA_DESTROY(data);
+}
+
+TEST("state load invalid data") {
+  read_write_t a, b;
+  state_init(&a, 1, kit_alloc_default());
+  a.acquire(a.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, 100);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+  test_state_tick(&a);
+
+  test_state_data_t_ data;
+  DA_INIT(data, 0, kit_alloc_default());
+  REQUIRE(state_save(&a, test_state_write_, &data) == KIT_OK);
+
+  REQUIRE(state_load(&b, data.values, data.size - 1,
+                     kit_alloc_default()) == ERROR_INVALID_FORMAT);
+
+  data.values[0] = 'X';
+  REQUIRE(state_load(&b, data.values, data.size,
+                     kit_alloc_default()) == ERROR_INVALID_FORMAT);
+
+  a.release(a.state);
+  DA_DESTROY(data);
+}
+
+TEST("state diff and apply") {
+  enum { SIZE = 100000 };
+
+  read_write_t a, b;
+  state_init(&a, 1, kit_alloc_default());
+  state_init(&b, 2, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0  = { .id = 0, .generation = -1 };
+  handle_t h   = { .id = 0, .generation = 0 };
+  impact_t i[] = { INTEGER_ALLOCATE_INTO(h0, SIZE),
+                   BYTE_ALLOCATE_INTO(h0, 10),
+                   INTEGER_RANDOM(-1000, 1000, h, 100, 100),
+                   INTEGER_ALLOCATE(3, h, 0),
+                   BYTE_SET(h, 4, -7) };
+  for (ptrdiff_t k = 0; k < 5; k++)
+    REQUIRE(a.apply(a.state, i + k) == KIT_OK);
+  test_state_tick(&a);
+
+  /*  Late join, the difference from an empty state.
+   */
+  void *first = NULL, *second = NULL;
+  REQUIRE(a.snapshot(a.state, &first, NULL) == KIT_OK);
+
+  test_state_data_t_ data;
+  DA_INIT(data, 0, kit_alloc_default());
+  REQUIRE(state_diff(NULL, first, test_state_write_, &data) ==
+          KIT_OK);
+  REQUIRE(data.size < SIZE);
+  REQUIRE(state_diff_apply(&b, data.values, data.size) == KIT_OK);
+
+  REQUIRE(b.hash(b.state) == a.hash(a.state));
+  REQUIRE(b.get_integer(b.state, h, 150, -1) ==
+          a.get_integer(a.state, h, 150, -1));
+  REQUIRE(b.get_byte(b.state, h, 4, -1) == -7);
+
+  /*  A few changes give a small difference.
+   */
+  handle_t p = { .id = a.get_integer(a.state, h, 0, -1),
+                 .generation = a.get_integer(a.state, h, 1, -1) };
+  impact_t j[] = { INTEGER_DEALLOCATE(p),
+                   INTEGER_ADD(h, 50000, 1000000),
+                   INTEGER_RANDOM(-1000, 1000, h, 100, 2),
+                   BYTE_ADD(h, 4, 100) };
+  for (ptrdiff_t k = 0; k < 4; k++)
+    REQUIRE(a.apply(a.state, j + k) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.snapshot(a.state, &second, first) == KIT_OK);
+
+  DA_RESIZE(data, 0);
+  REQUIRE(state_diff(first, second, test_state_write_, &data) ==
+          KIT_OK);
+  REQUIRE(data.size < 1000);
+  REQUIRE(state_diff_apply(&b, data.values, data.size) == KIT_OK);
+
+  REQUIRE(b.hash(b.state) == a.hash(a.state));
+  REQUIRE(b.get_integer(b.state, h, 50000, -1) == 1000000);
+  REQUIRE(b.get_byte(b.state, h, 4, -1) == 93);
+
+  /*  Same impacts give the same state, including the random
+   *  generator and allocation into the free space.
+   */
+  impact_t k[] = { INTEGER_RANDOM(-1000, 1000, h, 200, 10),
+                   INTEGER_ALLOCATE(2, h, 2) };
+  for (ptrdiff_t n = 0; n < 2; n++) {
+    REQUIRE(a.apply(a.state, k + n) == KIT_OK);
+    REQUIRE(b.apply(b.state, k + n) == KIT_OK);
+  }
+  test_state_tick(&a);
+  test_state_tick(&b);
+  REQUIRE(b.hash(b.state) == a.hash(a.state));
+  REQUIRE(b.get_integer(b.state, h, 2, -1) ==
+          a.get_integer(a.state, h, 2, -1));
+
+  a.snapshot_destroy(first);
+  a.snapshot_destroy(second);
+  a.release(a.state);
+  b.release(b.state);
+  DA_DESTROY(data);
+}
+
+TEST("state diff apply to another state") {
+  read_write_t a, b;
+  state_init(&a, 1, kit_alloc_default());
+  state_init(&b, 1, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  handle_t h  = { .id = 0, .generation = 0 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, 10);
+  impact_t j  = INTEGER_SET(h, 3, 5);
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+  test_state_tick(&a);
+
+  void *first = NULL, *second = NULL;
+  REQUIRE(a.snapshot(a.state, &first, NULL) == KIT_OK);
+  REQUIRE(a.apply(a.state, &j) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.snapshot(a.state, &second, first) == KIT_OK);
+
+  test_state_data_t_ data;
+  DA_INIT(data, 0, kit_alloc_default());
+  REQUIRE(state_diff(first, second, test_state_write_, &data) ==
+          KIT_OK);
+  REQUIRE(state_diff_apply(&b, data.values, data.size) ==
+          ERROR_INVALID_FORMAT);
+
+  a.snapshot_destroy(first);
+  a.snapshot_destroy(second);
+  a.release(a.state);
+  b.release(b.state);
+  DA_DESTROY(data);
+}
+
+TEST("state diff apply checks all hashes before change") {
+  read_write_t a, b, c;
+  state_init(&a, 1, kit_alloc_default());
+  state_init(&b, 1, kit_alloc_default());
+  state_init(&c, 2, kit_alloc_default());
+  a.acquire(a.state);
+  b.acquire(b.state);
+  c.acquire(c.state);
+
+  handle_t h0 = { .id = 0, .generation = -1 };
+  handle_t h  = { .id = 0, .generation = 0 };
+  impact_t i  = INTEGER_ALLOCATE_INTO(h0, 10);
+  impact_t j  = BYTE_ALLOCATE_INTO(h0, 10);
+  impact_t k  = INTEGER_SET(h, 3, 5);
+  impact_t l  = BYTE_SET(h, 3, 7);
+
+  /*  Same integers in all states, bytes only in the first one, and
+   *  another random generator in the third one.
+   */
+  REQUIRE(a.apply(a.state, &i) == KIT_OK);
+  REQUIRE(a.apply(a.state, &j) == KIT_OK);
+  REQUIRE(b.apply(b.state, &i) == KIT_OK);
+  REQUIRE(c.apply(c.state, &i) == KIT_OK);
+  REQUIRE(c.apply(c.state, &j) == KIT_OK);
+  test_state_tick(&a);
+  test_state_tick(&b);
+  test_state_tick(&c);
+
+  void *first = NULL, *second = NULL;
+  REQUIRE(a.snapshot(a.state, &first, NULL) == KIT_OK);
+  REQUIRE(a.apply(a.state, &k) == KIT_OK);
+  REQUIRE(a.apply(a.state, &l) == KIT_OK);
+  test_state_tick(&a);
+  REQUIRE(a.snapshot(a.state, &second, first) == KIT_OK);
+
+  test_state_data_t_ data;
+  DA_INIT(data, 0, kit_alloc_default());
+  REQUIRE(state_diff(first, second, test_state_write_, &data) ==
+          KIT_OK);
+
+  uint64_t const b_hash = b.hash(b.state);
+  uint64_t const c_hash = c.hash(c.state);
+
+  REQUIRE(state_diff_apply(&b, data.values, data.size) ==
+          ERROR_INVALID_FORMAT);
+  REQUIRE(state_diff_apply(&c, data.values, data.size) ==
+          ERROR_INVALID_FORMAT);
+  REQUIRE(b.hash(b.state) == b_hash);
+  REQUIRE(c.hash(c.state) == c_hash);
+  REQUIRE(b.get_integer(b.state, h, 3, -1) == 0);
+  REQUIRE(c.get_integer(c.state, h, 3, -1) == 0);
+
+  a.snapshot_destroy(first);
+  a.snapshot_destroy(second);
+  a.release(a.state);
+  b.release(b.state);
+  c.release(c.state);
+  DA_DESTROY(data);
+}
@@ -0,0 +1,89 @@
+#include "../../laplace/wheel.h"
+
+#define KIT_TEST_FILE wheel
+#include <kit_test/test.h>
+
+TEST("wheel due at wake time") {
+  wheel_t wheel;
+  wheel_init(&wheel, kit_alloc_default());
+
+  REQUIRE(wheel_insert(&wheel, 0, 3, 7) == KIT_OK);
+  REQUIRE(wheel_insert(&wheel, 0, 1, 5) == KIT_OK);
+
+  REQUIRE(wheel_advance(&wheel, 0) == KIT_OK);
+  REQUIRE(wheel.due.size == 0);
+  REQUIRE(wheel_advance(&wheel, 1) == KIT_OK);
+  REQUIRE(wheel.due.size == 1);
+  REQUIRE(wheel.due.values[0] == 5);
+  REQUIRE(wheel_advance(&wheel, 2) == KIT_OK);
+  REQUIRE(wheel.due.size == 0);
+  REQUIRE(wheel_advance(&wheel, 3) == KIT_OK);
+  REQUIRE(wheel.due.size == 1);
+  REQUIRE(wheel.due.values[0] == 7);
+
+  wheel_destroy(&wheel);
+}
+
+TEST("wheel due in increasing index order") {
+  wheel_t wheel;
+  wheel_init(&wheel, kit_alloc_default());
+
+  REQUIRE(wheel_insert(&wheel, 0, 2, 9) == KIT_OK);
+  REQUIRE(wheel_insert(&wheel, 0, 2, 1) == KIT_OK);
+  REQUIRE(wheel_insert(&wheel, 1, 2, 4) == KIT_OK);
+
+  REQUIRE(wheel_advance(&wheel, 1) == KIT_OK);
+  REQUIRE(wheel_advance(&wheel, 2) == KIT_OK);
+  REQUIRE(wheel.due.size == 3);
+  REQUIRE(wheel.due.values[0] == 1);
+  REQUIRE(wheel.due.values[1] == 4);
+  REQUIRE(wheel.due.values[2] == 9);
+
+  wheel_destroy(&wheel);
+}
+
+TEST("wheel far entries") {
+  wheel_t wheel;
+  wheel_init(&wheel, kit_alloc_default());
+
+  laplace_time_t const far  = WHEEL_SIZE * 3 + 17;
+  laplace_time_t const next = WHEEL_SIZE + 17;
+
+  REQUIRE(wheel_insert(&wheel, 5, far, 1) == KIT_OK);
+  REQUIRE(wheel_insert(&wheel, 5, next, 2) == KIT_OK);
+  REQUIRE(wheel_insert(&wheel, 5, 4, 3) == KIT_OK);
+
+  ptrdiff_t count = 0;
+  int       ok    = 1;
+
+  for (laplace_time_t t = 5; t <= far; t++) {
+    REQUIRE(wheel_advance(&wheel, t) == KIT_OK);
+    count += wheel.due.size;
+    if (wheel.due.size != 0)
+      ok = ok && ((t == next && wheel.due.values[0] == 2) ||
+                  (t == far && wheel.due.values[0] == 1));
+  }
+
+  REQUIRE(ok);
+  REQUIRE(count == 2);
+
+  wheel_destroy(&wheel);
+}
+
+TEST("wheel clear") {
+  wheel_t wheel;
+  wheel_init(&wheel, kit_alloc_default());
+
+  REQUIRE(wheel_insert(&wheel, 0, 1, 1) == KIT_OK);
+  REQUIRE(wheel_insert(&wheel, 0, WHEEL_SIZE * 2, 2) == KIT_OK);
+  wheel_clear(&wheel);
+
+  ptrdiff_t count = 0;
+  for (laplace_time_t t = 0; t <= WHEEL_SIZE * 2; t++) {
+    REQUIRE(wheel_advance(&wheel, t) == KIT_OK);
+    count += wheel.due.size;
+  }
+  REQUIRE(count == 0);
+
+  wheel_destroy(&wheel);
+}